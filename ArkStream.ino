@@ -0,0 +1,721 @@
+/********************************************************************************
+  This file contains functions that read responses from the Ark relay node API as a stream.
+
+  Each relay of the pool (see RelayPool.ino) has one HTTP/1.1 keep-alive connection. A new TCP connection is only opened
+  when the relay has closed the previous one, so back-to-back requests (wallet, pages of received transactions, send) skip
+  the TCP handshake. If a kept connection turns out to be closed by the relay the request is sent once more on a new connection.
+  If the relay cannot be reached the request is sent to the next relay of the pool.
+  Requests are not pipelined: each page request depends on the result of the previous page.
+
+  Reads of received transactions are hedged: if the relay has not answered within the hedge budget (p95 of the previous
+  reads, see arkHedgeBudget_ms()) the same request is sent to the next relay and the first response is used.
+  The connection of the slower relay is closed because its response is not read.
+  Transactions are sent to ARK_BROADCAST_RELAYS relays (see arkPost()).
+
+  The response body is parsed directly from the TCP connection as it arrives (arkBody). It is never copied into a string.
+  Only the fields selected by an ArduinoJson filter are kept and they are stored in the statically sized
+  arkJsonArena so the memory used does not depend on the size of the response.
+  https://arduinojson.org/v6/how-to/deserialize-a-very-large-document/
+  arkBody stops at the end of the body (Content-Length) and removes the chunked transfer encoding.
+********************************************************************************/
+
+
+/********************************************************************************
+  Body stream of the current response
+********************************************************************************/
+void ArkBodyStream::begin(WiFiClient &client, int32_t length, bool chunked) {
+  _client = &client;
+  _chunked = chunked;
+  _remaining = chunked ? 0 : length;
+  _firstChunk = true;
+  _lastChunk = !chunked;
+  bytesRead = 0;
+  failed = false;
+}
+
+bool ArkBodyStream::complete() {
+  return (_remaining == 0) && _lastChunk;
+}
+
+//read the size line of the next chunk. Returns false after the last chunk
+bool ArkBodyStream::nextChunk() {
+  char line[32];
+  if (!_firstChunk && !arkReadLine(*_client, line, sizeof(line))) {     //CRLF after the data of the previous chunk
+    _lastChunk = true;
+    return false;
+  }
+  _firstChunk = false;
+  if (!arkReadLine(*_client, line, sizeof(line))) {
+    _lastChunk = true;
+    return false;
+  }
+  _remaining = strtol(line, NULL, 16);
+  if (_remaining <= 0) {
+    _remaining = 0;
+    _lastChunk = true;
+    while (arkReadLine(*_client, line, sizeof(line)) && (line[0] != '\0')) {   //skip the trailer
+    }
+    return false;
+  }
+  return true;
+}
+
+int ArkBodyStream::available() {
+  if (complete()) {
+    return 0;
+  }
+  int available = _client->available();
+  return (_remaining > 0) ? min(available, _remaining) : available;
+}
+
+int ArkBodyStream::read() {
+  if ((_remaining == 0) && (_lastChunk || !nextChunk())) {
+    return -1;
+  }
+  uint8_t c;
+  if (_client->readBytes(&c, 1) != 1) {       //waits up to ARK_HTTP_TIMEOUT_MS
+    _remaining = 0;
+    _lastChunk = true;
+    failed = true;
+    return -1;
+  }
+  if (_remaining > 0) {
+    _remaining--;
+  }
+  bytesRead++;
+  return c;
+}
+
+//read the bytes of the body that have already arrived, up to size. Returns 0 if none have arrived yet
+//and -1 at the end of the body or if the relay closed the connection before the end
+int ArkBodyStream::readAvailable(uint8_t *buffer, size_t size) {
+  if (complete()) {
+    return -1;
+  }
+  if (!_client->available()) {
+    if (_client->connected()) {
+      return 0;
+    }
+    _remaining = 0;
+    _lastChunk = true;
+    failed = true;
+    return -1;
+  }
+  if ((_remaining == 0) && !nextChunk()) {
+    return -1;
+  }
+  int length = _client->available();
+  if (_remaining > 0) {
+    length = min(length, _remaining);
+  }
+  length = _client->read(buffer, min((size_t) length, size));
+  if (length <= 0) {
+    return 0;
+  }
+  if (_remaining > 0) {
+    _remaining -= length;
+  }
+  bytesRead += length;
+  return length;
+}
+
+int ArkBodyStream::peek() {
+  if ((_remaining == 0) && (_lastChunk || !nextChunk())) {
+    return -1;
+  }
+  uint32_t start_ms = millis();
+  while (!_client->available() && _client->connected() && (millis() - start_ms < ARK_HTTP_TIMEOUT_MS)) {
+    delay(1);
+  }
+  return _client->peek();
+}
+
+
+/********************************************************************************
+  Read one line of the response head (without CRLF). Returns false if the connection timed out or closed.
+********************************************************************************/
+bool arkReadLine(WiFiClient &client, char *line, size_t size) {
+  size_t length = client.readBytesUntil('\n', line, size - 1);
+  line[length] = '\0';
+  if ((length > 0) && (line[length - 1] == '\r')) {
+    line[--length] = '\0';
+  }
+  else if (length == 0) {
+    return client.connected() || client.available();    //empty line or nothing received
+  }
+  return true;
+}
+
+
+/********************************************************************************
+  Send a request to one relay. The kept connection is used if the relay has not closed it, otherwise a new one is opened.
+  Returns false if the relay could not be reached.
+********************************************************************************/
+bool arkSend(int relay, const char *const method, const char *const path, const char *body, size_t length) {
+  struct arkRelayState &r = arkRelays[relay];
+
+  char head[320];
+  int headLength = snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: keep-alive\r\n", method, path, r.host, r.port);
+  if (body != NULL) {
+    headLength += snprintf(&head[headLength], sizeof(head) - headLength, "Content-Type: application/json\r\nContent-Length: %u\r\n", (unsigned int) length);
+  }
+  headLength += snprintf(&head[headLength], sizeof(head) - headLength, "\r\n");
+
+  r.requests++;
+  if (!r.keepAlive || !r.client.connected()) {
+    r.client.stop();
+    r.keepAlive = false;
+    uint32_t connectStart_ms = millis();
+    if (!r.client.connect(r.host, r.port, ARK_HTTP_CONNECT_TIMEOUT_MS)) {
+      return false;
+    }
+    float connect_ms = millis() - connectStart_ms;
+    r.connect_ms = (r.connect_ms == 0) ? connect_ms : r.connect_ms + ARK_RELAY_EWMA_ALPHA * (connect_ms - r.connect_ms);
+    r.client.setTimeout(ARK_HTTP_TIMEOUT_MS / 1000);    //seconds in ESP32 core 1.0.4
+    r.client.setNoDelay(true);
+    arkConnectionStats.connects++;
+  }
+
+  bool sent = (r.client.write((const uint8_t *) head, headLength) == (size_t) headLength);
+  if (sent && (body != NULL)) {
+    sent = (r.client.write((const uint8_t *) body, length) == length);
+  }
+  return sent;
+}
+
+
+/********************************************************************************
+  Wait for the first of several relays to start answering.
+  relays -> relays the request was sent to. -1 = unused entry. A relay that closes its connection is set to -1
+  Returns the relay that answered first, or -1 if none answered within timeout_ms.
+********************************************************************************/
+int arkAwaitResponse(int *relays, int count, uint32_t timeout_ms) {
+  uint32_t start_ms = millis();
+  while (true) {
+    bool waiting = false;
+    for (int i = 0; i < count; i++) {
+      if (relays[i] < 0) {
+        continue;
+      }
+      WiFiClient &client = arkRelays[relays[i]].client;
+      if (client.available()) {
+        return relays[i];
+      }
+      if (!client.connected()) {
+        relays[i] = -1;
+        continue;
+      }
+      waiting = true;
+    }
+    if (!waiting || (millis() - start_ms >= timeout_ms)) {
+      return -1;
+    }
+    delay(1);
+  }
+}
+
+
+/********************************************************************************
+  Read the response head of a relay. Returns the HTTP code, or 0 if the response was not valid.
+  The body can then be read from arkBody.
+********************************************************************************/
+int arkReadHead(int relay) {
+  struct arkRelayState &r = arkRelays[relay];
+  int httpCode = 0;
+  int32_t contentLength = -1;
+  bool chunked = false;
+
+  //status line. e.g. "HTTP/1.1 200 OK"
+  char line[128];
+  if (arkReadLine(r.client, line, sizeof(line)) && (strncmp(line, "HTTP/1.", 7) == 0)) {
+    httpCode = atoi(&line[9]);
+    r.keepAlive = (line[7] == '1');             //HTTP/1.1 keeps the connection unless the relay says otherwise
+  }
+  if (httpCode <= 0) {
+    arkDropConnection(relay);
+    return 0;
+  }
+
+  //headers
+  while (arkReadLine(r.client, line, sizeof(line)) && (line[0] != '\0')) {
+    for (char *c = line; *c; c++) {
+      *c = tolower(*c);
+    }
+    if (strncmp(line, "content-length:", 15) == 0) {
+      contentLength = atol(&line[15]);
+    }
+    else if ((strncmp(line, "transfer-encoding:", 18) == 0) && strstr(line, "chunked")) {
+      chunked = true;
+    }
+    else if (strncmp(line, "connection:", 11) == 0) {
+      r.keepAlive = (strstr(line, "keep-alive") != NULL);
+    }
+  }
+  if (!chunked && (contentLength < 0)) {
+    r.keepAlive = false;                        //the body ends when the relay closes the connection
+  }
+  arkCurrentRelay = relay;
+  arkBody.begin(r.client, contentLength, chunked);
+  return httpCode;
+}
+
+
+/********************************************************************************
+  Send a request to the Ark relay pool and read the response head.
+  Returns the HTTP code, or 0 if no relay could be reached. The body can then be read from arkBody.
+  Call arkEnd() when finished reading the response.
+  relay = -1 -> the fastest synced relay (arkSelectRelay()). If it fails the request is sent to the next relay, up to
+               ARK_REQUEST_RELAYS relays
+  relay >= 0 -> only this relay
+  body = NULL for a request without body
+  endpoint -> HttpEndpoint_enum. Used to count the requests (see profileHttp())
+  hedge = true -> send the request to a second relay as well if the first one has not answered within arkHedgeBudget_ms()
+********************************************************************************/
+int arkRequest(int relay, const char *const method, const char *const path, const char *body, size_t length, int endpoint, bool hedge) {
+  arkRequestEndpoint = endpoint;
+  arkRequestStart_ms = millis();
+  arkConnectionStats.requests++;
+
+  const bool pool = (relay < 0);
+  if (pool) {
+    relay = arkSelectRelay(-1);
+  }
+
+  for (int tried = 0; (tried < ARK_REQUEST_RELAYS) && (relay >= 0); tried++) {
+    int winner = -1;
+    //a kept connection that the relay has closed is not a failure of the relay: the request is sent once more on
+    //a new connection to the same relay before the next relay is tried
+    for (int attempt = 0; attempt < 2; attempt++) {
+      bool reused = arkRelays[relay].keepAlive && arkRelays[relay].client.connected();
+      int racing[2] = {-1, -1};                 //relays the request was sent to
+      uint32_t sent_ms[2] = {millis(), 0};
+      winner = -1;
+
+      if (arkSend(relay, method, path, body, length)) {
+        racing[0] = relay;
+      }
+      if ((racing[0] >= 0) && hedge) {
+        winner = arkAwaitResponse(racing, 1, arkHedgeBudget_ms());
+        if ((winner < 0) && (racing[0] >= 0)) { //still waiting after the budget
+          int second = arkSelectRelay(relay);
+          sent_ms[1] = millis();
+          if ((second >= 0) && arkSend(second, method, path, body, length)) {
+            racing[1] = second;
+            arkConnectionStats.hedges++;
+          }
+        }
+      }
+      if (winner < 0) {
+        winner = arkAwaitResponse(racing, 2, ARK_HTTP_TIMEOUT_MS);
+      }
+
+      //the response of the other relay is not read so its connection cannot be used again.
+      //It took at least as long as the winner so that time is added to its latency. It is not counted as a success
+      for (int i = 0; i < 2; i++) {
+        if ((racing[i] >= 0) && (racing[i] != winner)) {
+          arkDropConnection(racing[i]);
+          if (winner >= 0) {
+            arkRelayLatency(racing[i], millis() - sent_ms[i]);
+          }
+        }
+      }
+      int httpCode = (winner >= 0) ? arkReadHead(winner) : 0;
+
+      if (httpCode > 0) {
+        arkRelayResult(winner, true, millis() - sent_ms[(winner == relay) ? 0 : 1]);
+        if (winner != relay) {
+          arkConnectionStats.hedgeWins++;
+          arkRelays[winner].hedgeWins++;
+        }
+        if (endpoint == HTTP_RECEIVED) {
+          //a relay that lost the race took at least as long as the time until the winner answered
+          recordLatency(arkReceivedLatency, (millis() - sent_ms[0]) * 1000);
+        }
+        return httpCode;
+      }
+
+      arkDropConnection(relay);
+      if (!reused || (winner >= 0)) {
+        break;
+      }
+      //the relay closed the connection we kept. Try once more on a new connection
+      arkConnectionStats.retries++;
+    }
+
+    arkRelayResult((winner >= 0) ? winner : relay, false, 0);
+    if (!pool) {
+      break;
+    }
+    //try the next relay
+    relay = arkSelectRelay(relay);
+    if (relay >= 0) {
+      arkConnectionStats.failovers++;
+    }
+  }
+  return 0;
+}
+
+
+/********************************************************************************
+  Start a GET request to the Ark relay pool.
+  Returns true if the relay responded with HTTP 200. The body can then be read from arkBody.
+  Call arkEnd() when finished reading the response.
+  Reads of received transactions are hedged (see arkRequest()).
+  path example: "/api/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1"
+********************************************************************************/
+bool arkGet(const char *const path, int endpoint) {
+  int httpCode = arkRequest(-1, "GET", path, NULL, 0, endpoint, endpoint == HTTP_RECEIVED);
+  if (httpCode != 200) {
+    Serial.print("Ark API request failed: ");
+    Serial.print(path);
+    Serial.print(" HTTP code: ");
+    Serial.println(httpCode);
+    if (httpCode != 0) {
+      arkEnd();
+    }
+    profileHttp(endpoint, false, 0, millis() - arkRequestStart_ms);
+    return false;
+  }
+  return true;
+}
+
+
+/********************************************************************************
+  POST a JSON body to the Ark relay pool. The body is sent to up to ARK_BROADCAST_RELAYS relays, fastest first, so a
+  transaction still reaches the network if one relay drops it. Relays that are not usable are only tried if no relay accepted the request.
+  A relay that answers with a code other than 2xx or 422 (the relay answers 422 when every transaction is invalid) is
+  counted as a failed request and the next relay is tried.
+  The response of the first relay that answered 2xx or 422 is copied into 'response' (truncated to responseSize - 1).
+  The other relays may answer that the transaction is already known so their responses are skipped.
+  Returns the length of the response or -1 if no relay answered 2xx or 422.
+  httpCode -> HTTP code of the response that was copied, else the code of the last relay that answered. 0 if no relay could be reached
+********************************************************************************/
+int arkPost(const char *const path, const char *body, size_t length, int endpoint, char *response, size_t responseSize, int &httpCode) {
+  int order[ARK_RELAY_COUNT];
+  arkRankRelays(order);
+
+  int responseLength = -1;
+  int sent = 0;
+  httpCode = 0;
+  for (int i = 0; (i < ARK_RELAY_COUNT) && (sent < ARK_BROADCAST_RELAYS); i++) {
+    if ((sent > 0) && !arkRelayUsable(order[i])) {
+      break;
+    }
+    int code = arkRequest(order[i], "POST", path, body, length, endpoint, false);
+    if (code == 0) {
+      Serial.print("Ark API request failed: ");
+      Serial.print(path);
+      Serial.print(" relay: ");
+      Serial.println(arkRelays[order[i]].host);
+      profileHttp(endpoint, false, 0, millis() - arkRequestStart_ms);
+      continue;
+    }
+    if (!(((code >= 200) && (code < 300)) || (code == 422))) {
+      Serial.print("Ark API request failed: ");
+      Serial.print(path);
+      Serial.print(" HTTP code: ");
+      Serial.print(code);
+      Serial.print(" relay: ");
+      Serial.println(arkRelays[order[i]].host);
+      arkEnd();
+      profileHttp(endpoint, false, 0, millis() - arkRequestStart_ms);
+      arkRelayResult(order[i], false, 0);     //e.g. a relay that is overloaded or behind a failing proxy
+      if (responseLength < 0) {
+        httpCode = code;
+      }
+      continue;
+    }
+    sent++;
+
+    if (responseLength < 0) {
+      httpCode = code;
+      responseLength = 0;
+      int c;
+      while ((responseLength < (int) responseSize - 1) && ((c = arkBody.read()) >= 0)) {
+        response[responseLength++] = c;
+      }
+      response[responseLength] = '\0';
+    }
+    arkEnd();
+  }
+
+  if (sent > 1) {
+    arkConnectionStats.broadcasts++;
+  }
+  if (responseLength < 0) {
+    response[0] = '\0';
+  }
+  return responseLength;
+}
+
+
+/********************************************************************************
+  Parse the response of POST /api/transactions (copied by arkPost()) into arkSendArena. See arkTransactionResult()
+     {
+       "data":{"accept":["<id>"],"broadcast":["<id>"],"excess":[],"invalid":["<id>"]},
+       "errors":{"<id>":[{"type":"ERR_DUPLICATE","message":"Duplicate transaction <id>"}]}
+     }
+  Returns false if the response holds no "data" object (e.g. it was truncated or a proxy answered)
+********************************************************************************/
+bool arkParseSendResponse(const char *response) {
+  StaticJsonDocument<64> filter;
+  filter["data"]["accept"] = true;
+  filter["data"]["broadcast"] = true;
+  filter["errors"] = true;
+  DeserializationError error = deserializeJson(arkSendArena, response, DeserializationOption::Filter(filter));
+  if (error) {
+    Serial.print("Transactions response could not be parsed: ");
+    Serial.println(error.c_str());
+    return false;
+  }
+  return !arkSendArena["data"].isNull();
+}
+
+
+/********************************************************************************
+  Result of the transaction with this id in the response parsed by arkParseSendResponse()
+  ARK_SEND_ACCEPTED    the id is in data.accept or data.broadcast
+  ARK_SEND_DELIVERED   the relay already has the transaction: ERR_DUPLICATE (in the pool) or ERR_FORGED (in a block)
+  ARK_SEND_REJECTED    any other error. Sending the transaction again will not change the answer
+  ARK_SEND_UNKNOWN     the id is not in the response (e.g. in data.excess when the pool of the relay is full)
+********************************************************************************/
+int arkTransactionResult(const char *id) {
+  JsonVariant data = arkSendArena["data"];
+  const char *const lists[] = {"accept", "broadcast"};
+  for (const char *list : lists) {
+    for (int i = 0; !data[list][i].isNull(); i++) {
+      if (strcmp(data[list][i].as<const char *>(), id) == 0) {
+        return ARK_SEND_ACCEPTED;
+      }
+    }
+  }
+
+  const char *type = arkSendArena["errors"][id][0]["type"];
+  if (type == NULL) {
+    return ARK_SEND_UNKNOWN;
+  }
+  if ((strcmp(type, "ERR_DUPLICATE") == 0) || (strcmp(type, "ERR_FORGED") == 0)) {
+    return ARK_SEND_DELIVERED;
+  }
+  Serial.print("Transaction rejected: ");
+  Serial.print(id);
+  Serial.print(" ");
+  Serial.println(arkSendArena["errors"][id][0]["message"].as<const char *>());
+  return ARK_SEND_REJECTED;
+}
+
+
+/********************************************************************************
+  Nonces of a transaction the relay rejected because of its nonce, from the response parsed by arkParseSendResponse()
+  Ark Core 2.6 answers ERR_APPLY: "Cannot apply a transaction with nonce X: the sender <publicKey> has nonce Y."
+  nonce -> X, the nonce of the transaction
+  senderNonce -> Y, the nonce of the scooter wallet on the relay (the next transaction must have Y + 1)
+  Returns false if the transaction was not rejected because of its nonce (e.g. the balance is too low)
+********************************************************************************/
+bool arkRejectedNonce(const char *id, uint64_t &nonce, uint64_t &senderNonce) {
+  const char *type = arkSendArena["errors"][id][0]["type"];
+  const char *message = arkSendArena["errors"][id][0]["message"];
+  static const char prefix[] = "Cannot apply a transaction with nonce ";
+  static const char sender[] = ": the sender ";
+  static const char has[] = " has nonce ";
+  if ((type == NULL) || (message == NULL) || (strcmp(type, "ERR_APPLY") != 0) || (strncmp(message, prefix, sizeof(prefix) - 1) != 0)) {
+    return false;
+  }
+
+  char *end;
+  nonce = strtoull(message + sizeof(prefix) - 1, &end, 10);
+  if ((end == message + sizeof(prefix) - 1) || (strncmp(end, sender, sizeof(sender) - 1) != 0)) {
+    return false;
+  }
+  const char *publicKey = end + sizeof(sender) - 1;
+  if ((strncmp(publicKey, ArkPublicKey, strlen(ArkPublicKey)) != 0) || (strncmp(publicKey + strlen(ArkPublicKey), has, sizeof(has) - 1) != 0)) {
+    return false;                         //the error of another wallet
+  }
+  const char *number = publicKey + strlen(ArkPublicKey) + sizeof(has) - 1;
+  senderNonce = strtoull(number, &end, 10);
+  return (end != number) && (*end == '.');
+}
+
+
+/********************************************************************************
+  Finish reading the response of the last request.
+  The rest of the body is skipped so the connection can be used again, e.g. the transactions of a page after the
+  "meta" counts or after the RentalStart. It is skipped in blocks as it arrives for as long as a new connection to the
+  relay takes (connect_ms, at least ARK_HTTP_DRAIN_MIN_MS). If the rest has not arrived by then, or the relay asked
+  for the connection to be closed, the connection is closed instead.
+********************************************************************************/
+void arkEnd() {
+  struct arkRelayState &r = arkRelays[arkCurrentRelay];
+  arkRxRemaining = 0;
+  if (r.keepAlive && !arkBody.complete()) {
+    uint32_t budget_ms = max((uint32_t) r.connect_ms, ARK_HTTP_DRAIN_MIN_MS);
+    uint32_t start_ms = millis();
+    uint8_t skipped[256];
+    while (!arkBody.complete() && (millis() - start_ms < budget_ms)) {
+      int length = arkBody.readAvailable(skipped, sizeof(skipped));
+      if (length < 0) {
+        break;
+      }
+      if (length == 0) {
+        delay(1);
+      }
+      arkConnectionStats.drainedBytes += length;
+    }
+    if (!arkBody.complete()) {
+      arkConnectionStats.drainCloses++;
+    }
+  }
+  if (!arkBody.complete() || arkBody.failed) {
+    r.keepAlive = false;
+  }
+  if (!r.keepAlive) {
+    r.client.stop();
+  }
+  profileHttp(arkRequestEndpoint, true, arkBody.bytesRead, millis() - arkRequestStart_ms);
+}
+
+
+/********************************************************************************
+  Parse the next JSON value from the response stream into arkJsonArena.
+  Returns false if the value could not be parsed.
+  If the arena is too small for the filtered value it is reported rather than being silently truncated.
+********************************************************************************/
+bool arkParse(JsonDocument &filter) {
+  DeserializationError error = deserializeJson(arkJsonArena, arkBody, DeserializationOption::Filter(filter));
+  if (error) {
+    Serial.print("Ark API response could not be parsed: ");
+    Serial.println(error.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+/********************************************************************************
+  Start reading one page of received transactions of a wallet.
+  The "meta" object is parsed first and the stream is left at the start of the "data" array.
+  Then call arkNextReceivedTransaction() up to 'count' times and finally arkEnd().
+  Returns false if the request failed.
+
+  count -> number of transactions on this page (meta.count)
+  totalCount -> meta.totalCount. Note: the API flags this as an estimate so only use it as a hint.
+
+  This is equivalant to calling:
+    https://radians.nl/api/v2/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=1&limit=1&orderBy=timestamp:asc
+
+  json-formatted object. Note: the node always sends the "meta" object before the "data" array.
+  {
+     "meta":{
+        "totalCountIsEstimate":true,
+        "count":1,
+        "pageCount":133,
+        "totalCount":133,
+        "next":"/api/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=2&limit=1&orderBy=timestamp%3Aasc&transform=true",
+        "previous":null,
+        "self":"/api/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=1&limit=1&orderBy=timestamp%3Aasc&transform=true",
+        "first":"/api/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=1&limit=1&orderBy=timestamp%3Aasc&transform=true",
+        "last":"/api/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=133&limit=1&orderBy=timestamp%3Aasc&transform=true"
+     },
+     "data":[
+        {
+           "id":"c45656ae40a6de17dea7694826f2bbb00d115130fbcaba257feaa820886acac3",
+           "blockId":"4937253598533919154",
+           "version":2,
+           "type":0,
+           "typeGroup":1,
+           "amount":"100000000000",
+           "fee":"9613248",
+           "sender":"TEf7p5jf1LReywuits5orBsmpkMe8fLTkk",
+           "senderPublicKey":"02b7cca8003dbce7394f87d3a7127f6fab5a8ebace83e5633baaae38c58f3eee7a",
+           "recipient":"TRXA2NUACckkYwWnS9JRkATQA453ukAcD1",
+           "signature":"57d78bc151d6b41d013e528966aee161c7fbc6f4d598774f33ac30f796c4b1ab7e2b2ce5f96612aebfe120a2956ce482515f99c73b3f52d7486a29ed8391295b",
+           "confirmations":1366750,
+           "timestamp":{
+              "epoch":374000,
+              "unix":1572368340,
+              "human":"2019-10-29T16:59:00.856Z"
+           },
+           "nonce":"2"
+        }
+     ]
+  }
+********************************************************************************/
+bool arkBeginReceivedTransactions(const char *const address, int page, int limit, int &count, int &totalCount) {
+  char path[128];
+  snprintf(path, sizeof(path), "/api/wallets/%s/transactions/received?page=%d&limit=%d&orderBy=timestamp:asc", address, page, limit);
+  if (!arkGet(path, HTTP_RECEIVED)) {
+    return false;
+  }
+
+  Stream &stream = arkBody;
+  StaticJsonDocument<64> filter;
+  filter["count"] = true;
+  filter["totalCount"] = true;
+
+  if (!stream.find("\"meta\":") || !arkParse(filter)) {
+    arkEnd();
+    return false;
+  }
+  count = arkJsonArena["count"] | 0;
+  totalCount = arkJsonArena["totalCount"] | 0;
+
+  if ((count > 0) && !stream.find("\"data\":[")) {
+    arkEnd();
+    return false;
+  }
+  arkRxRemaining = count;
+  arkRxFirst = true;
+  return true;
+}
+
+
+/********************************************************************************
+  Parse the next transaction of the page started with arkBeginReceivedTransactions()
+  Only the fields selected by the filter are kept. The transaction is stored in arkJsonArena so it is only
+  valid until the next call.
+  Returns a null JsonObject when there are no more transactions or the transaction could not be parsed.
+********************************************************************************/
+JsonObject arkNextReceivedTransaction(JsonDocument &filter) {
+  if (arkRxRemaining <= 0) {
+    return JsonObject();
+  }
+
+  //transactions are separated by a comma
+  if (!arkRxFirst && !arkBody.find(",")) {
+    arkRxRemaining = 0;
+    return JsonObject();
+  }
+  arkRxFirst = false;
+
+  if (!arkParse(filter)) {
+    arkRxRemaining = 0;
+    return JsonObject();
+  }
+  arkRxRemaining--;
+  return arkJsonArena.as<JsonObject>();
+}
+
+
+/********************************************************************************
+  Print the connection statistics. (end of a rental cycle)
+********************************************************************************/
+void printArkConnectionStats() {
+  Serial.print("Ark requests: ");
+  Serial.print(arkConnectionStats.requests);
+  Serial.print("  new connections: ");
+  Serial.print(arkConnectionStats.connects);
+  Serial.print("  retries on a new connection: ");
+  Serial.print(arkConnectionStats.retries);
+  Serial.print("  failovers: ");
+  Serial.println(arkConnectionStats.failovers);
+  Serial.print("Hedged reads: ");
+  Serial.print(arkConnectionStats.hedges);
+  Serial.print("  won by the second relay: ");
+  Serial.print(arkConnectionStats.hedgeWins);
+  Serial.print("  transactions sent to several relays: ");
+  Serial.println(arkConnectionStats.broadcasts);
+  Serial.print("Response bytes skipped to keep the connection: ");
+  Serial.print(arkConnectionStats.drainedBytes);
+  Serial.print("  connections closed instead: ");
+  Serial.println(arkConnectionStats.drainCloses);
+}
@@ -4,9 +4,8 @@
 
 
 /********************************************************************************
-  This routine checks to see if Ark node is syncronized to the chain.
-  This is a maybe a good way to see if node communication is working correctly.
-  This might be a good routine to run periodically
+  This routine checks to see if a relay of the pool is syncronized to the chain.
+  This is run for every relay by the health check (checkArkRelays()) and sets arkRelays[relay].synced
   Returns True if node is synced
 
      The following method can be used to get the Status of a Node.
@@ -24,19 +23,32 @@
     https://arduinojson.org/v6/api/jsondocument/
     https://arduinojson.org/v6/assistant/
 ********************************************************************************/
-bool checkArkNodeStatus() {
+bool checkArkNodeStatus(int relay) {
   Serial.println("\n=================================");
-  Serial.println("Check status of Radians Relay Node");
+  Serial.print("Check status of Radians Relay Node ");
+  Serial.println(arkRelays[relay].host);
+
+  int httpCode = arkRequest(relay, "GET", "/api/node/status", NULL, 0, HTTP_NODE_STATUS, false);
+  if (httpCode != 200) {
+    Serial.print("Ark API request failed: /api/node/status HTTP code: ");
+    Serial.println(httpCode);
+    if (httpCode != 0) {
+      arkEnd();
+    }
+    profileHttp(HTTP_NODE_STATUS, false, 0, millis() - arkRequestStart_ms);
+    arkRelays[relay].synced = false;
+    return false;
+  }
 
-  const auto nodeStatus = connection.api.node.status();   //get status of Ark node
-  Serial.print("\nNode Status: ");
-  Serial.println(nodeStatus.c_str()); // The response is a 'std::string', to Print on Arduino, we need the c_string type.
+  StaticJsonDocument<32> filter;
+  filter["data"]["synced"] = true;
+  bool parsed = arkParse(filter);
+  arkEnd();
 
-  const size_t capacity = JSON_OBJECT_SIZE(1) + JSON_OBJECT_SIZE(4) + 50;
-  DynamicJsonDocument doc(capacity);
-  deserializeJson(doc, nodeStatus.c_str());
-  JsonObject data = doc["data"];
-  return data["synced"];
+  arkRelays[relay].synced = parsed && arkJsonArena["data"]["synced"];
+  Serial.print("\nNode synced: ");
+  Serial.println(arkRelays[relay].synced ? "true" : "false");
+  return arkRelays[relay].synced;
 }
 
 
@@ -60,227 +72,371 @@ bool checkArkNodeStatus() {
   this function writes directly to these global variables:
   struct wallet {
   char walletBalance[64 + 1];
-  uint64_t walletNonce_Uint64 = 1ULL;
+  uint64_t confirmedNonce_Uint64 = 0ULL;
   char walletNonce[64 + 1];
   uint64_t walletBalance_Uint64 = 0ULL;
   }
+  The local nonce (walletNonce_Uint64) is managed by nextNonce() and reconcileNonce()
+  Returns false if the wallet could not be retrieved.
 
 ********************************************************************************/
-void getWallet() {
-  const auto walletGetResponse = connection.api.wallets.get(ArkAddress);
+bool getWallet() {
+  Serial.println("\n=================================");
+  Serial.println("Retrieving wallet Nonce & Balance");
 
-  const size_t capacity = JSON_OBJECT_SIZE(1) + JSON_OBJECT_SIZE(6) + 200;
-  DynamicJsonDocument doc(capacity);
+  char path[64];
+  snprintf(path, sizeof(path), "/api/wallets/%s", ArkAddress);
+  if (!arkGet(path, HTTP_WALLET)) {
+    return false;
+  }
+
+  //--------------------------------------------
+  // keep only the balance and nonce
+  StaticJsonDocument<64> filter;
+  filter["data"]["balance"] = true;
+  filter["data"]["nonce"] = true;
+  bool parsed = arkParse(filter);
+  arkEnd();
+
+  JsonObject data = arkJsonArena["data"];
+  if (!parsed || data["balance"].isNull() || data["nonce"].isNull()) {
+    Serial.println("Wallet was not updated");
+    return false;
+  }
 
-  deserializeJson(doc, walletGetResponse.c_str());
-  JsonObject data = doc["data"];
   strcpy(bridgechainWallet.walletBalance, data["balance"]);                     //copy into global character array
   bridgechainWallet.walletBalance_Uint64 = strtoull(data["balance"], NULL, 10); //convert string to unsigned long long
 
   strcpy(bridgechainWallet.walletNonce, data["nonce"]);                         //copy into global character array
-  bridgechainWallet.walletNonce_Uint64 = strtoull(data["nonce"], NULL, 10);     //convert string to unsigned long long
+  bridgechainWallet.confirmedNonce_Uint64 = strtoull(data["nonce"], NULL, 10);  //convert string to unsigned long long
 
-  Serial.println("\n=================================");
-  Serial.println("Retrieving wallet Nonce & Balance");
-  Serial.print("Get Wallet Response");
-  Serial.println(walletGetResponse.c_str());                                    // The response is a 'std::string', to Print on Arduino, we need the c_string type.
   Serial.print("Nonce: ");
-  //Serial.println(bridgechainWallet.walletNonce);                              // serial.print does not have support for Uint64 
-  Serial.printf("%" PRIu64 "\n", bridgechainWallet.walletNonce_Uint64);         // PRIx64 to print in hexadecimal
+  //Serial.println(bridgechainWallet.walletNonce);                              // serial.print does not have support for Uint64
+  Serial.printf("%" PRIu64 "\n", bridgechainWallet.confirmedNonce_Uint64);      // PRIx64 to print in hexadecimal
   Serial.print("Balance: ");
   Serial.println(bridgechainWallet.walletBalance);
+  return true;
 }
 
 
+/********************************************************************************
+  Nonce manager
+  The nonce of the last transaction signed by the scooter is kept in bridgechainWallet.walletNonce_Uint64 and saved
+  in the journal before the transaction is sent. Transactions are signed with nextNonce() without asking the relay first.
+  The local nonce only moves forward: at boot and after the relay rejects a transaction it is raised to the confirmed
+  nonce of the wallet if it is behind. It only goes back when the relay rejects a transaction because of its nonce
+  (see nonceRejected()).
+********************************************************************************/
+
 
 /********************************************************************************
-  This routine retrieves 1 received transaction in wallet if available
-  Returns '0' if no transaction exist
-  returns parameters in
-  id -> transaction ID
-  amount -> amount of Arktoshi
-  senderAddress -> transaction sender address
-  vendorfield -> 255(or 256??? check this) Byte vendor field
+  Raise the local nonce to the confirmed nonce of the wallet on the relay node.
+  Transactions waiting in the outbox or in the pool have nonces the confirmed nonce does not include yet so a local
+  nonce that is ahead is kept.
+********************************************************************************/
+void reconcileNonce() {
+  if (!getWallet()) {
+    nonceReconcilePending = true;         //try again before the next transaction is signed
+    return;
+  }
+  nonceReconcilePending = false;
 
-  This is equivalant to calling:
-    https://radians.nl/api/v2/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=1&limit=1&orderBy=timestamp:asc
-    query = "?page=1&limit=1&orderBy=timestamp:asc"
+  if (bridgechainWallet.confirmedNonce_Uint64 > bridgechainWallet.walletNonce_Uint64) {
+    bridgechainWallet.walletNonce_Uint64 = bridgechainWallet.confirmedNonce_Uint64;
+    commitJournal();
+  }
+  Serial.print("Local nonce: ");
+  Serial.printf("%" PRIu64 "\n", bridgechainWallet.walletNonce_Uint64);
+}
 
-  json-formatted object:
-  {
-     "meta":{
-        "totalCountIsEstimate":true,
-        "count":1,
-        "pageCount":133,
-        "totalCount":133,
-        "next":"/api/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=2&limit=1&orderBy=timestamp%3Aasc&transform=true",
-        "previous":null,
-        "self":"/api/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=1&limit=1&orderBy=timestamp%3Aasc&transform=true",
-        "first":"/api/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=1&limit=1&orderBy=timestamp%3Aasc&transform=true",
-        "last":"/api/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=133&limit=1&orderBy=timestamp%3Aasc&transform=true"
-     },
-     "data":[
-        {
-           "id":"c45656ae40a6de17dea7694826f2bbb00d115130fbcaba257feaa820886acac3",
-           "blockId":"4937253598533919154",
-           "version":2,
-           "type":0,
-           "typeGroup":1,
-           "amount":"100000000000",
-           "fee":"9613248",
-           "sender":"TEf7p5jf1LReywuits5orBsmpkMe8fLTkk",
-           "senderPublicKey":"02b7cca8003dbce7394f87d3a7127f6fab5a8ebace83e5633baaae38c58f3eee7a",
-           "recipient":"TRXA2NUACckkYwWnS9JRkATQA453ukAcD1",
-           "signature":"57d78bc151d6b41d013e528966aee161c7fbc6f4d598774f33ac30f796c4b1ab7e2b2ce5f96612aebfe120a2956ce482515f99c73b3f52d7486a29ed8391295b",
-           "confirmations":1366750,
-           "timestamp":{
-              "epoch":374000,
-              "unix":1572368340,
-              "human":"2019-10-29T16:59:00.856Z"
-           },
-           "nonce":"2"
-        }
-     ]
+
+/********************************************************************************
+  The relay rejected the transaction with this id. Call after arkParseSendResponse()
+  If it was rejected because of its nonce the relay reports the nonce of the wallet (see arkRejectedNonce()):
+    - the nonce is past the next one: an earlier transaction never reached the relay. The local nonce goes back to
+      the nonce of the wallet so the next transaction fills the gap
+    - the nonce was used already: the local nonce moves forward to the nonce of the wallet
+  Otherwise the local nonce is reconciled with the relay before the next transaction is signed.
+********************************************************************************/
+void nonceRejected(const char *id) {
+  uint64_t nonce;
+  uint64_t senderNonce;
+  if (!arkRejectedNonce(id, nonce, senderNonce)) {
+    nonceReconcilePending = true;
+    return;
+  }
+
+  uint64_t localNonce = bridgechainWallet.walletNonce_Uint64;
+  if ((nonce > senderNonce + 1) && (nonce <= localNonce)) {
+    localNonce = senderNonce;
+  }
+  else if (senderNonce > localNonce) {
+    localNonce = senderNonce;
+  }
+  if (localNonce != bridgechainWallet.walletNonce_Uint64) {
+    Serial.print("Nonce rejected by the relay. Local nonce: ");
+    Serial.printf("%" PRIu64 " -> %" PRIu64 "\n", bridgechainWallet.walletNonce_Uint64, localNonce);
+    bridgechainWallet.walletNonce_Uint64 = localNonce;
+    commitJournal();
   }
+}
+
+
+/********************************************************************************
+  Get the nonce for the next transaction. The nonce is saved before it is used so it is never used twice after a reboot.
 ********************************************************************************/
-int GetReceivedTransaction(const char *const address, int page, const char* &id, const char* &amount, const char* &senderAddress, const char* &senderPublicKey, const char* &vendorField ) {
+uint64_t nextNonce() {
+  if (nonceReconcilePending) {
+    reconcileNonce();
+  }
+  bridgechainWallet.walletNonce_Uint64++;
+  commitJournal();
+  return bridgechainWallet.walletNonce_Uint64;
+}
 
-  //--------------------------------------------
-  // assemble query string where the page number is a function parameter
-  // query = "?page=1&limit=1&orderBy=timestamp:asc"
-  char query[50];
-  strcpy(query, "?page=");
-  char page_char[8];
-  itoa(page, page_char, 10);    //convert int to string in base 10
-  strcat(query, page_char);
-  strcat(query, "&limit=1&orderBy=timestamp:asc");
+
+/********************************************************************************
+  Copy the "id" of a signed transaction (the JSON of Transaction::toJson(), 'length' bytes, not terminated) into 'id'
+  (64 hex characters + '\0'). Returns false if the JSON has no id.
+********************************************************************************/
+bool getTransactionId(const char *json, size_t length, char *id) {
+  static const char key[] = "\"id\":\"";
+  const size_t keyLength = sizeof(key) - 1;
+  for (size_t i = 0; i + keyLength + 64 < length; i++) {
+    if (memcmp(&json[i], key, keyLength) == 0) {
+      memcpy(id, &json[i + keyLength], 64);
+      id[64] = '\0';
+      return json[i + keyLength + 64] == '"';
+    }
+  }
+  id[0] = '\0';
+  return false;
+}
+
+
+/********************************************************************************
+  Queue a signed RentalFinish with the parameters it was built from. The queued transactions are sent together in
+  one request by drainOutbox().
+  If the outbox is not available the transaction is sent directly.
+********************************************************************************/
+void queueTransaction(const struct rentalFinishParameters &ride, const std::string &transactionJson) {
+  size_t payloadLength;
+  const uint8_t *payload = outboxRentalFinishPayload(ride, transactionJson, payloadLength);
+  if ((payload != NULL) && (outboxAppend(OUTBOX_RENTAL_FINISH, payload, payloadLength) != 0)) {
+    return;
+  }
 
   //--------------------------------------------
-  //peform the API call
-  //sort by oldest transactions first.  For simplicity set limit = 1 so we only get 1 transaction returned
-  const auto walletGetResponse = connection.api.wallets.transactionsReceived(address, query);
+  // The outbox is not available. Send the transaction directly
+  static char transactionsBuffer[OUTBOX_SLOT_SIZE + 32];
+  if (snprintf(&transactionsBuffer[0], sizeof(transactionsBuffer), "{\"transactions\":[%s]}", transactionJson.c_str()) >= (int) sizeof(transactionsBuffer)) {
+    Serial.println("Transaction is too large to be sent");
+    return;
+  }
+  static char response[ARK_RESPONSE_SIZE];
+  int httpCode;
+  int length = arkPost("/api/transactions", transactionsBuffer, strlen(transactionsBuffer), HTTP_SEND, response, sizeof(response), httpCode);
+  Serial.println(response);
+  char id[64 + 1];
+  if ((length > 0) && getTransactionId(transactionJson.c_str(), transactionJson.length(), id) && arkParseSendResponse(response) &&
+      (arkTransactionResult(id) == ARK_SEND_REJECTED)) {
+    nonceRejected(id);
+  }
+}
+
 
-  const size_t capacity = JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(9) + JSON_OBJECT_SIZE(14) + 1240 + 250; //add an extra 250 to be safe
-  DynamicJsonDocument doc(capacity);
-  deserializeJson(doc, walletGetResponse.c_str());
 
-  JsonObject data_0 = doc["data"][0];
-  id = data_0["id"];
-  amount = data_0["amount"];
-  senderAddress = data_0["sender"];
-  senderPublicKey = data_0["senderPublicKey"];
-  vendorField = data_0["vendorField"];
+/********************************************************************************
+  This routine retrieves the number of received transactions on one page of the wallet.
+  Only the "meta" object of the response is parsed so the page size can be large without using more memory.
+  Returns the number of transactions on the page (meta.count) or '-1' if the response could not be parsed.
+  totalCount -> meta.totalCount. Note: the API flags this as an estimate so only use it as a hint.
+
+  This is equivalant to calling:
+    https://radians.nl/api/v2/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=3&limit=50&orderBy=timestamp:asc
+********************************************************************************/
+int GetReceivedTransactionCount(const char *const address, int page, int limit, int &totalCount) {
+  int count = 0;
 
   //--------------------------------------------
-  //  Print the received transaction response
-  Serial.print("\nGet Received Transaction Response");
-  Serial.println(walletGetResponse.c_str());                    // The response is a 'std::string', to Print on Arduino, we need the c_string type.
+  // we only care about the meta counts. The "data" array is not read.
+  bool received = arkBeginReceivedTransactions(address, page, limit, count, totalCount);
+  arkEnd();
 
   Serial.print("Page: ");
-  Serial.println(page);
+  Serial.print(page);
+  Serial.print(" Limit: ");
+  Serial.print(limit);
 
-  //--------------------------------------------
-  //  the data_0_id parameter will be used to determine if a valid transaction was found.
-  if (id == nullptr) {
-    Serial.println("No Transaction found. data_0_id is null");
-    return 0;           //no transaction found
+  if (!received) {
+    Serial.println(" -> invalid response");
+    return -1;
   }
-  else {
-    Serial.println("Transaction was received");
-    Serial.print("Transactions ID: ");
-    Serial.println(id);
 
-    return 1;           //transaction found
-  }
+  Serial.print(" -> count: ");
+  Serial.println(count);
+  return count;
 }
 
 
 
 /********************************************************************************
-  This routine will search through all the received transactions of ArkAddress wallet starting from the oldest.
-  The routine returns the page number of the most recent transaction.
+  This routine will search the received transactions of ArkAddress wallet for the newest one, starting from the checkpoint stored in flash.
+  The routine returns the page number of the most recent transaction (using a page size of 1, as in search_RentalStartTx()).
   The final page number is also equal to the total number of received transactions in the wallet.
-  Empty wallet will return '0' (NOT YET TESTED)
+  Empty wallet will return '0'
 
+  Pass the first page that has not been seen yet (lastRXpage + 1).
+
+  Rather than requesting 1 transaction at a time we count whole pages of RX_CATCHUP_PAGE_LIMIT transactions:
+  1. Request the page holding the checkpoint. If it is not full we are done (the usual case after a reboot).
+  2. Gallop forward: first guess is the page given by meta.totalCount, then step 1, 2, 4, 8... pages until a page is not full.
+  3. Binary search between the last full page and the first empty page.
+  This reaches the newest transaction in O(log n) requests.
 ********************************************************************************/
-int getMostRecentReceivedTransaction(int page = 1) {
+int getMostRecentReceivedTransaction(int page) {
   Serial.println("\n=================================");
-  Serial.println("Scanning all the received transactions in the wallet looking for the the newest one...");
-  const char* id;               //transaction ID
-  const char* amount;           //transactions amount
-  const char* senderAddress;    //transaction address of sender
-  const char* senderPublicKey;  //transaction address of sender
-  const char* vendorField;      //vendor field
+  Serial.println("Scanning the received transactions in the wallet looking for the the newest one...");
+
+  const int limit = RX_CATCHUP_PAGE_LIMIT;
+  const int checkpoint = page - 1;      // number of received transactions that have already been seen
+  const uint32_t scanStart_ms = millis();
+  int requests = 0;
+  int totalCount = 0;
+
+  int lowPage = 0;                      // last page known to be full
+  int highPage = checkpoint / limit + 1;  // first page known not to be full. Start with the page holding the next unseen transaction
+  int highCount = GetReceivedTransactionCount(ArkAddress, highPage, limit, totalCount);
+  requests++;
+
+  if (highCount == limit) {
+    //--------------------------------------------
+    // gallop forward until we find a page that is not full
+    lowPage = highPage;
+    int step = 1;
+    int nextPage = (totalCount - 1) / limit + 1;    // totalCount is an estimate so it is only used as the first guess
+    if (nextPage <= lowPage) {
+      nextPage = lowPage + 1;
+    }
+    do {
+      highPage = nextPage;
+      highCount = GetReceivedTransactionCount(ArkAddress, highPage, limit, totalCount);
+      requests++;
+      if (highCount == limit) {
+        lowPage = highPage;
+        nextPage = lowPage + step;
+        step = step * 2;
+      }
+    } while (highCount == limit);
+
+    //--------------------------------------------
+    // a partially filled page is the last page. An empty page means the last page lies between lowPage and highPage.
+    while ((highCount == 0) && (highPage - lowPage > 1)) {
+      int midPage = lowPage + (highPage - lowPage) / 2;
+      int midCount = GetReceivedTransactionCount(ArkAddress, midPage, limit, totalCount);
+      requests++;
+      if (midCount < 0) {
+        highCount = -1;
+        break;
+      }
+      if (midCount == limit) {
+        lowPage = midPage;
+      }
+      else {
+        highPage = midPage;
+        highCount = midCount;
+      }
+    }
+  }
 
-  while ( GetReceivedTransaction(ArkAddress, page, id, amount, senderAddress, senderPublicKey, vendorField ) ) {
-    page++;
-  };
+  int newest;
+  if (highCount < 0) {
+    //we lost communication with the node. Keep what we know for sure.
+    Serial.println("Scan was interrupted by an invalid response");
+    newest = lowPage * limit;
+  }
+  else {
+    newest = (highPage - 1) * limit + highCount;
+  }
+
+  //never move backwards from the checkpoint. Sometimes the API returns no data even if there are transactions (flakey network)
+  if (newest < checkpoint) {
+    newest = checkpoint;
+  }
 
   Serial.print("No more Transactions ");
   Serial.print("\nThe most recent transaction was page #: ");
-  Serial.println(page - 1);
-  return page - 1;
+  Serial.println(newest);
+  Serial.print("Scan requests: ");
+  Serial.print(requests);
+  Serial.print("  Scan time(ms): ");
+  Serial.println(millis() - scanStart_ms);
+  return newest;
+}
+
+
+/********************************************************************************
+  This function is called when a transaction notification is received on MQTT_Notify_Topic.
+  The notification is only a hint. The transaction is always read back from the relay node by search_RentalStartTx()
+  example: {"id":"2238687a95688eb434953ac6548ade4648a3963a8158c036b65ee8e434e17230","type":500,"typeGroup":4000}
+********************************************************************************/
+void onTransactionNotification(const String &message) {
+  Serial.print("\nTransaction notification received: ");
+  Serial.println(message);
+  txNotificationPending = true;
+  txNotificationSeen = true;          //the bridge is publishing to us. Polling can slow down to the fallback interval
 }
 
 
 /********************************************************************************
   This routine will poll the Ark node API searching for the RentalStart custom transaction
-  It polls once every 8 seconds (defined by UpdateInterval_RentalStartSearch)
-  When polling the API we set the limit = 1 so we only retrieve 1 transaction at a time.
+  It polls when the JOB_RENTAL_SEARCH job has run, once every 8 seconds (defined by UpdateInterval_RentalStartSearch)
+  With ENABLE_MQTT_TX_NOTIFY it polls as soon as a transaction notification is received. Once a notification has
+  arrived on the current MQTT connection it otherwise only polls every UpdateInterval_RentalStartSearch_Fallback.
+  Each poll drains every unseen received transaction, RX_POLL_PAGE_LIMIT transactions per request, so a RentalStart
+  that arrives behind other transactions is still found within one poll interval.
+  lastRXpage is advanced once per poll and stored in Flash with the next journal commit.
+  Returns '1' if a RentalStart with the sessionID of the displayed QRcode was received.
 ********************************************************************************/
 int search_RentalStartTx() {
-  if (millis() - previousUpdateTime_RentalStartSearch > UpdateInterval_RentalStartSearch)  {    //poll Ark node every 8 seconds for a new transaction
-    previousUpdateTime_RentalStartSearch += UpdateInterval_RentalStartSearch;
+#ifdef ENABLE_MQTT_TX_NOTIFY
+  if (txNotificationPending) {
+    txNotificationPending = false;
+    rentalSearchDue = true;                                   //poll now
+    schedulerStart(networkScheduler, JOB_RENTAL_SEARCH, networkJobs[JOB_RENTAL_SEARCH].period_ms);
+  }
+#endif
+
+  if (rentalSearchDue)  {    //poll Ark node every 8 seconds for a new transaction
+    rentalSearchDue = false;
 
     Serial.println("\n=================================");
     Serial.println("Polling Radians network to see if Rental Start transaction has been received. ");
 
-    //  check to see if new new transaction has been received in wallet
-    // lastRXpage is the page# of the last received transaction
-    int searchRXpage = bridgechainWallet.lastRXpage + 1;
-    const char* id;               //transaction ID
-    const char* amount;           //transactions amount
-    const char* senderAddress;    //transaction address of sender
-    const char* senderPublicKey;  //transaction address of sender
-    const char* vendorField;      //vendor field
-
-    const char* asset_gps_latitude;
-    const char* asset_gps_longitude;
-    const char* asset_sessionId;
-    const char* asset_rate;
-
-    if ( GetTransaction_RentalStart(ArkAddress, searchRXpage, id, amount, senderAddress, senderPublicKey, vendorField, asset_gps_latitude, asset_gps_longitude, asset_sessionId, asset_rate) ) {
-      Serial.println("\n=================================");
-      Serial.println("Rental Start transaction was received");
-
-      bridgechainWallet.lastRXpage++;             //increment received counter if rental start was received.
-      saveEEPROM(bridgechainWallet.lastRXpage);   //store the page in the Flash
-      
-      Serial.print("Received SessionID: ");
-      Serial.println(asset_sessionId);
-      Serial.print("QR code SessionID: ");
-      Serial.println(scooterRental.sessionID_QRcode);
-
-      //check to see if sessionID of new transaction matches the Hash embedded in QRcode that was displayed
-      if  (strcmp(asset_sessionId, scooterRental.sessionID_QRcode) == 0) {
-        strcpy(scooterRental.senderAddress, senderAddress);           //copy into global character array
-        strcpy(scooterRental.payment, amount);                        //copy into global character array
-        scooterRental.payment_Uint64 = strtoull(amount, NULL, 10);    //convert string to unsigned long long global
-        strcpy(scooterRental.sessionID_RentalStart, asset_sessionId);             //copy into global character array
-
-        Serial.println("Received SessionID matched QR code SessionID");
-        return 1;
-      }
+    //  check to see if new transactions have been received in wallet
+    // lastRXpage is the page# (with limit = 1) of the last received transaction
+    int seenRXpage = bridgechainWallet.lastRXpage;
+    int rentalStartReceived = 0;
+    int pageStatus;
 
-      else {        //we received a transaction that did not match. We should issue refund.
-        Serial.print("SessionID did not match hash embedded in QRcode");
-        // issueRefund();  TODO!!!!!!!!!!!!!!!!!!!!!!!
-        return 0;
+    do {
+      pageStatus = GetTransactions_RentalStart(ArkAddress, RX_POLL_PAGE_LIMIT, seenRXpage);
+      if (pageStatus == RX_PAGE_RENTAL_START) {
+        rentalStartReceived = 1;
       }
+    } while (pageStatus == RX_PAGE_FULL);        //keep going until we have caught up with the newest transaction
+
+    if (seenRXpage != bridgechainWallet.lastRXpage) {
+      bridgechainWallet.lastRXpage = seenRXpage;
+      markJournalDirty();                         //stored in the Flash with the next journal commit
     }
-    else {    //we did not receive a transaction
-      return 0;
+
+    //refresh the balance published in the telemetry once our own transactions have been sent
+    if (walletRefreshPending && !rentalStartReceived) {
+      walletRefreshPending = !getWallet();
     }
+
+    return rentalStartReceived;
   }
   else {      //it was not time to poll Ark network for a new transaction
     return 0;
@@ -289,14 +445,35 @@ int search_RentalStartTx() {
 
 
 /********************************************************************************
-  This routine retrieves 1 RentalStart transaction if available in wallet
-  Returns '0' if no transaction exists or if other transaction type exists.
-  Pass wallet address and page to function
+  Job of networkScheduler: the next pass of search_RentalStartTx() polls the relay node.
+  With ENABLE_MQTT_TX_NOTIFY the period is UpdateInterval_RentalStartSearch_Fallback while MQTT is connected and a
+  notification has arrived since the connection was established. Being subscribed does not mean that the bridge is
+  running, so until the first notification we keep polling every UpdateInterval_RentalStartSearch.
+********************************************************************************/
+void dueRentalSearch() {
+  rentalSearchDue = true;
+
+  uint32_t searchInterval = UpdateInterval_RentalStartSearch;
+#ifdef ENABLE_MQTT_TX_NOTIFY
+  if (txNotificationSeen && WiFiMQTTclient.isMqttConnected()) {
+    searchInterval = UpdateInterval_RentalStartSearch_Fallback;     //notifications are working. Polling is only a safety net
+  }
+#endif
+  schedulerSetPeriod(networkScheduler, JOB_RENTAL_SEARCH, searchInterval);
+}
 
-  //this is equivalent to called:  https://radians.nl/api/v2/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=41&limit=1&orderBy=timestamp:asc
-  //query = "?page=1&limit=1&orderBy=timestamp:asc"
 
-  json-formatted object:
+/********************************************************************************
+  This routine retrieves the received transactions following seenRXpage and looks for a RentalStart transaction
+  (type 500, typeGroup 4000) with the sessionID that is embedded in the displayed QRcode.
+  The transactions are checked in a single pass. Transactions we don't care about are skipped.
+  A RentalStart transaction with a different sessionID is skipped as well (refund is TODO).
+  Pass wallet address, page size(limit) and the number of transactions that have already been seen.
+
+  Transaction 'seenRXpage + 1' is found on page (seenRXpage / limit + 1) at index (seenRXpage % limit).
+  //this is equivalent to called:  https://radians.nl/api/v2/wallets/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions/received?page=3&limit=20&orderBy=timestamp:asc
+
+  example json-formatted object (limit = 1):
   {
    "meta":{
       "totalCountIsEstimate":true,
@@ -344,78 +521,97 @@ int search_RentalStartTx() {
    ]
   }
 
-  returns parameters:
-  id -> transaction ID
-  amount -> amount of Arktoshi
-  senderAddress -> transaction sender address
-  senderPublicKey -> transaction sender public key
-  vendorField -> 255 Byte vendor field
-  asset_gps_latitude
-  asset_gps_longitude
-  asset_sessionId
-  asset_rate
+  Only these fields of each transaction are kept when parsing: id, type, typeGroup, amount, sender, asset.sessionId
+
+  seenRXpage is advanced past every transaction that was checked. When a matching RentalStart is found we stop there
+  so the transactions received after it are checked on the next poll.
+  On a match the sender, payment and sessionID are copied into the scooterRental structure.
 
+  Returns:
+  RX_PAGE_RENTAL_START -> matching RentalStart transaction was received
+  RX_PAGE_FULL -> page was full. There may be more transactions on the next page
+  RX_PAGE_DONE -> no more transactions to check
+  RX_PAGE_ERROR -> response could not be parsed
 ********************************************************************************/
-int GetTransaction_RentalStart(const char *const address, int page, const char* &id, const char* &amount, const char* &senderAddress, const char* &senderPublicKey, const char* &vendorField, const char* &asset_gps_latitude, const char* &asset_gps_longitude, const char* &asset_sessionId, const char* &asset_rate ) {
+int GetTransactions_RentalStart(const char *const address, int limit, int &seenRXpage) {
 
-  //--------------------------------------------
-  // assemble query string where the page number is a function parameter
-  // query = "?page=1&limit=1&orderBy=timestamp:asc"
-  char query[50];
-  strcpy(query, "?page=");
-  char page_char[8];
-  itoa(page, page_char, 10);    //convert int to string in base 10
-  strcat(query, page_char);
-  strcat(query, "&limit=1&orderBy=timestamp:asc");
+  int page = seenRXpage / limit + 1;
+  int skip = seenRXpage % limit;      //transactions at the start of the page that have already been seen
+  int count = 0;
+  int totalCount = 0;
+
+  Serial.print("Get Wallet Received Transactions. Page: ");
+  Serial.print(page);
+  Serial.print(" Limit: ");
+  Serial.println(limit);
 
   //--------------------------------------------
   //peform the API call
-  //sort by oldest transactions first.  For simplicity set limit = 1 so we only get 1 transaction returned
-  const auto walletGetResponse = connection.api.wallets.transactionsReceived(address, query);
-
-  const size_t capacity = JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(3) + 2 * JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(9) + JSON_OBJECT_SIZE(15) + 1580;
-  DynamicJsonDocument doc(capacity);
-  deserializeJson(doc, walletGetResponse.c_str());
+  //sort by oldest transactions first.
+  if (!arkBeginReceivedTransactions(address, page, limit, count, totalCount)) {
+    return RX_PAGE_ERROR;
+  }
 
   //--------------------------------------------
-  //  Print the entire returned response string
-  Serial.print("Get Wallet Received Transaction: ");
-  Serial.println(walletGetResponse.c_str()); // The response is a 'std::string', to Print on Arduino, we need the c_string type.
+  //  keep only the fields we use. The filter is applied to each transaction as it is read from the stream
+  StaticJsonDocument<192> filter;
+  filter["id"] = true;
+  filter["type"] = true;
+  filter["typeGroup"] = true;
+  filter["amount"] = true;
+  filter["sender"] = true;
+  filter["asset"]["sessionId"] = true;
+
+  for (int i = 0; i < count; i++) {
+    JsonObject data_i = arkNextReceivedTransaction(filter);
+    if (data_i.isNull()) {
+      arkEnd();
+      return RX_PAGE_ERROR;
+    }
+    if (i < skip) {
+      continue;     //already seen
+    }
+    seenRXpage++;
 
-  JsonObject data_0 = doc["data"][0];
-  //--------------------------------------------
-  //  the data_0_id parameter will be used to determine if a valid transaction was found.
-  if (data_0["id"] == nullptr) {
-    Serial.println("No Transaction received");
-    return 0;           //no transaction found
-  }
-  else {
     //--------------------------------------------
     //  check for valid Rental Start transaction type.
-    if (!((data_0["type"] == 500) && (data_0["typeGroup"] == 4000))) {
+    if (!((data_i["type"] == 500) && (data_i["typeGroup"] == 4000))) {
+      Serial.print("Transaction I don't care about was received: ");
+      Serial.println(data_i["id"].as<const char*>());
+      continue;
+    }
 
-      Serial.println("\nTransaction I don't care about was received");
-      bridgechainWallet.lastRXpage++;              //increment global receive transaction counter.
-      saveEEPROM(bridgechainWallet.lastRXpage);   //store the page in the Flash
-      return 0;
+    const char* asset_sessionId = data_i["asset"]["sessionId"];
+    Serial.println("\n=================================");
+    Serial.println("Rental Start transaction was received");
+    Serial.print("Received SessionID: ");
+    Serial.println(asset_sessionId);
+    Serial.print("QR code SessionID: ");
+    Serial.println(scooterRental.sessionID_QRcode);
+
+    //check to see if sessionID of new transaction matches the Hash embedded in QRcode that was displayed
+    if ((asset_sessionId != nullptr) && (strcmp(asset_sessionId, scooterRental.sessionID_QRcode) == 0)) {
+      const char* amount = data_i["amount"];
+      strcpy(scooterRental.senderAddress, data_i["sender"]);         //copy into global character array
+      strcpy(scooterRental.payment, amount);                          //copy into global character array
+      scooterRental.payment_Uint64 = strtoull(amount, NULL, 10);      //convert string to unsigned long long global
+      strcpy(scooterRental.sessionID_RentalStart, asset_sessionId);   //copy into global character array
+      arkEnd();
+
+      Serial.println("Received SessionID matched QR code SessionID");
+      return RX_PAGE_RENTAL_START;
+    }
+    else {        //we received a transaction that did not match. We should issue refund.
+      Serial.println("SessionID did not match hash embedded in QRcode");
+      // issueRefund();  TODO!!!!!!!!!!!!!!!!!!!!!!!
     }
-    //--------------------------------------------
-    //  Rental Start transaction was received
-    JsonObject data_0_asset = data_0["asset"];
-    JsonObject data_0_asset_gps = data_0_asset["gps"];
-
-    asset_gps_latitude = data_0_asset_gps["latitude"];
-    asset_gps_longitude = data_0_asset_gps["longitude"];
-    asset_sessionId = data_0_asset["sessionId"];
-    asset_rate = data_0_asset["rate"];
-
-    id = data_0["id"];
-    amount = data_0["amount"];
-    senderAddress = data_0["sender"];
-    senderPublicKey = data_0["senderPublicKey"];
-    vendorField = data_0["vendorField"];
-    return 1;           //transaction found
   }
+  arkEnd();
+
+  if (count < limit) {
+    return RX_PAGE_DONE;
+  }
+  return RX_PAGE_FULL;
 }
 
 
@@ -472,68 +668,56 @@ int GetTransaction_RentalStart(const char *const address, int page, const char*
   }
 ********************************************************************************/
 void SendTransaction_RentalFinish() {
+  static struct rentalFinishParameters ride;
+  memset(&ride, 0, sizeof(ride));
+  strlcpy(ride.recipient, scooterRental.senderAddress, sizeof(ride.recipient));
+  memcpy(ride.sessionId, scooterRental.sessionID_QRcode_byte, sizeof(ride.sessionId));
+  ride.trackCount = min(rideTrack.count, RIDE_TRACK_MAX_POINTS);
+  memcpy(ride.track, rideTrack.points, ride.trackCount * sizeof(struct trackPoint));
+  ride.nonce = nextNonce();
+  const std::string transactionJson = signRentalFinish(ride);
 
-  //--------------------------------------------
-  // Retrieve Wallet Nonce from blockchain before sending transaction
-  getWallet();
+  Serial.println("\n=================================");
+  Serial.println("Ride is Finished. Locking scooter.");
+  Serial.println("\nSending Rental Finish Transaction");
+  printf("Bridgechain Transaction: %s\n", transactionJson.c_str());
 
   //--------------------------------------------
-  // increment the current nonce.
-  // note: If the send fails then we need to unwind this increment.
-  bridgechainWallet.walletNonce_Uint64 = bridgechainWallet.walletNonce_Uint64 + 1;
+  // Queue the transaction. The caller sends it with drainOutbox() once the rental is marked as finished in the journal.
+  queueTransaction(ride, transactionJson);
+}
 
-  //--------------------------------------------
-  // convert the floating point representation to 64-bit integers
-  uint64_t endlat = (uint64_t) (scooterRental.endLatitude * 1000000);
-  uint64_t endlon = (uint64_t) (scooterRental.endLongitude * 1000000);
 
-  uint64_t startlat = (uint64_t) (scooterRental.startLatitude * 1000000);
-  uint64_t startlon = (uint64_t) (scooterRental.startLongitude * 1000000);
+/********************************************************************************
+  Build and sign a RentalFinish and return its JSON. It is signed again with another nonce if the relay rejects
+  its nonce (see outboxResignRentalFinish())
+********************************************************************************/
+std::string signRentalFinish(const struct rentalFinishParameters &ride) {
 
   //--------------------------------------------
   // Use the Transaction Builder to make a transaction.
-  auto bridgechainTransaction = builder::radians::ScooterRentalFinish(cfg)
-                                .recipientId(scooterRental.senderAddress)
-                                .timestamp(scooterRental.startTime, 0)  //uint32_t
-                                .latitude(startlat, 0)                  //uint64_t
-                                .longitude(startlon, 0)                 //uint64_t
-                                .timestamp(scooterRental.endTime, 1)    //uint32_t
-                                .latitude(endlat, 1)                    //uint64_t
-                                .longitude(endlon, 1)                   //uint64_t
-                                .sessionId(scooterRental.sessionID_QRcode_byte)   //array of uint8_t 
+  // The nonce comes from the local nonce manager so no request to the relay is needed before signing.
+  // The asset carries every point of the ride track. The first point is the rental start and the last point is the rental finish.
+  // The coordinates are 64-bit integers in microdegrees. South and west are sign extended (two's complement):
+  // -113277912 is sent as "18446744073596273704" and is read back as an int64
+  builder::radians::ScooterRentalFinish rentalFinishBuilder(cfg);
+  rentalFinishBuilder.recipientId(ride.recipient);
+  for (int i = 0; i < ride.trackCount; i++) {
+    rentalFinishBuilder.timestamp(ride.track[i].timestamp, i)                     //uint32_t
+                       .latitude((uint64_t) (int64_t) ride.track[i].latitude, i)  //uint64_t
+                       .longitude((uint64_t) (int64_t) ride.track[i].longitude, i);
+  }
+  auto bridgechainTransaction = rentalFinishBuilder.sessionId(ride.sessionId)   //array of uint8_t
                                 .containsRefund(false)
                                 .fee(10000000)
-                                .nonce(bridgechainWallet.walletNonce_Uint64)
+                                .nonce(ride.nonce)
                                 .amount(1)
                                 .sign(PASSPHRASE)
                                 .build();
 
-  Serial.println("\n=================================");
-  Serial.println("Ride is Finished. Locking scooter.");
-  Serial.println("\nSending Rental Finish Transaction");
-
-  //--------------------------------------------
-  // Create and Print the Json representation of the Transaction.
-  const auto transactionJson = bridgechainTransaction.toJson();
-  printf("Bridgechain Transaction: %s\n", transactionJson.c_str());
-
-  //--------------------------------------------
-  // Sign the transaction
-  bridgechainTransaction.sign(PASSPHRASE);
-
-  //--------------------------------------------
-  // Create the JSON bufffer
-  char transactionsBuffer[1500];
-  snprintf(&transactionsBuffer[0], 1500, "{\"transactions\":[%s]}", bridgechainTransaction.toJson().c_str());
-  std::string jsonStr = transactionsBuffer;
-
-  //--------------------------------------------
-  // Send the transaction and display the response
-  std::string sendResponse = connection.api.transactions.send(jsonStr);
-  Serial.println(sendResponse.c_str());
-
   //--------------------------------------------
-  // NOTE: there should be some error handling here in case the transaction failed to send
+  // Create the Json representation of the Transaction.
+  return bridgechainTransaction.toJson();
 }
 
 
@@ -576,8 +760,9 @@ void sendBridgechainTransaction() {
 
   char transactionsBuffer[600];
   snprintf(&transactionsBuffer[0], 600, "{\"transactions\":[%s]}", bridgechainTransaction.toJson().c_str());
-  std::string jsonStr = transactionsBuffer;
-  std::string sendResponse = connection.api.transactions.send(jsonStr);
-  Serial.println(sendResponse.c_str());
+  static char response[ARK_RESPONSE_SIZE];
+  int httpCode;
+  arkPost("/api/transactions", transactionsBuffer, strlen(transactionsBuffer), HTTP_SEND, response, sizeof(response), httpCode);
+  Serial.println(response);
 }
 */
@@ -10,8 +10,7 @@
 
     Program Features:
     This program is designed to run on ESP32 Adafruit Huzzah.
-    This sketch uses the ARK Cpp-Client API to interact with a custom Ark V2.6 bridgechain.
-    Ark Cpp Client available from Ark Ecosystem <info@ark.io>
+    This sketch uses the REST API of the Ark relay nodes to interact with a custom Ark V2.6 bridgechain.
     Ark API documentation:  https://docs.ark.io/sdk/clients/usage.html
 
     Electronic Hardware Peripherals:
@@ -24,10 +23,6 @@
 
     Ark Library Verions
     Tested with:
-    Ark-CPP-client v1.4.0-arduino
-    change from v1.3->v1.4: added 2.6 endpoint
-    https://github.com/ArkEcosystem/cpp-client/pull/159
-
     *****************  this is Simons version with Radians transaction support. *******************8
     https://github.com/sleepdefic1t/cpp-crypto/tree/chains/radians
 
@@ -74,23 +69,50 @@ const int BAT_PIN = 35;     //ADC connected to Battery input pin (A13 = 35;)
 ********************************************************************************/
 bool initialConnectionEstablished_Flag = false;   //used to detect first run after power up
 
-bool WiFi_status = false;   // = true when connected to WiFi access point
-bool GPS_status = false;    // = true when GPS has signal lock
-bool ARK_status = false;    // = true when communication to Radians Bridgechain Node is working
-bool MQTT_status = false;   // = true when connected to MQTT broker
+//These flags are shared between the network task (core 0) and the display task (core 1)
+volatile bool WiFi_status = false;   // = true when connected to WiFi access point
+volatile bool GPS_status = false;    // = true when GPS has signal lock
+volatile bool ARK_status = false;    // = true when communication to Radians Bridgechain Node is working
+volatile bool MQTT_status = false;   // = true when connected to MQTT broker
+bool ARK_status_displayed = false;   // = ARK_status currently shown on the status bar
+
+volatile int batteryPercent = 0;     // use to store battery level in percentage
+
 
-int batteryPercent = 0;     // use to store battery level in percentage
-float previousSpeed = 0;
+/********************************************************************************
+  FreeRTOS Tasks
+  The work is split between the 2 cores of the ESP32 so the display never freezes during network I/O.
+  core 0: networkTask -> WiFi/MQTT client, State Machine, Ark API calls, MQTT publishing
+  core 1: loop()      -> GPS NMEA parsing, display updates
+  core 1: gpsIngestTask -> moves the bytes received from the GPS into gpsRing
+  The GPS data is passed to the network task as a snapshot (gpsFix) through a single entry queue (mailbox).
+  The state of the rental is passed the other way, to loop() and its jobs, in the same way (rideSnapshot).
+  Anything that draws on the display must hold displayMutex (see displayLock())
+********************************************************************************/
+TaskHandle_t networkTaskHandle;
+const uint32_t NETWORK_TASK_STACK_SIZE = 16384;   // bytes. Signing transactions needs a large stack
+SemaphoreHandle_t displayMutex;                   // recursive mutex protecting the TFT display
+QueueHandle_t gpsMailbox;                         // holds the latest gpsFix. Overwritten each time a sentence is parsed
+
+struct gpsFix {
+  uint32_t timestamp_ms;    // millis() when the snapshot was taken
+  bool fix;
+  uint8_t satellites;
+  float speedKnots;
+  int32_t latitude;         // microdegrees. South is negative
+  int32_t longitude;        // microdegrees. West is negative
+};
 
 /********************************************************************************
-   Arduino Json Libary - Tested with version 6.13
+   Arduino Json Libary - Tested with version 6.15
     Data returned from Ark API is in JSON format.
     This libary is used to parse and deserialize the reponse
+    Version 6.15 or newer is required for filtering (DeserializationOption::Filter)
 
-    This library is added by Ark crypto library so you do not need to include it here.
+    The responses are parsed directly from the relay connection (see ArkStream.ino).
 
 ********************************************************************************/
-//#include <ArduinoJson.h>
+#include <ArduinoJson.h>
 
 
 /********************************************************************************
@@ -103,6 +125,55 @@ float previousSpeed = 0;
 #include <EEPROM.h>
 
 
+/********************************************************************************
+  Store-and-forward outbox (see Outbox.ino)
+  Signed transactions and telemetry that could not be sent are kept in a ring of fixed size slots in a SPIFFS file.
+  Set Tools->Partition Scheme to one that includes SPIFFS. (e.g. Minimal SPIFFS(Large APPS with OTA))
+********************************************************************************/
+#include "SPIFFS.h"
+#include "rom/crc.h"
+
+#define OUTBOX_FILE "/outbox.bin"
+#define OUTBOX_TAIL_FILE "/outbox.tail"
+const uint32_t OUTBOX_MAGIC = 0x3158424F;         // "OBX1"
+const int OUTBOX_SLOTS = 16;
+const size_t OUTBOX_SLOT_SIZE = 2560;             // a signed RentalFinish transaction is ~600 bytes of json plus up to 96 bytes per ride track point (a negative coordinate has 20 digits)
+const int OUTBOX_TRANSACTION_BATCH = 4;           // maximum number of transactions sent in one request
+
+// OUTBOX_TRANSACTION: a signed transaction (JSON). OUTBOX_RENTAL_FINISH: struct rentalFinishParameters followed by
+// the signed RentalFinish (JSON), so it can be signed again with another nonce (see outboxSendTransactions())
+enum OutboxEntry_enum {OUTBOX_TRANSACTION = 1, OUTBOX_TELEMETRY = 2, OUTBOX_RENTAL_FINISH = 3};
+
+struct outboxEntryHeader {
+  uint32_t magic;
+  uint32_t id;
+  uint16_t type;            // OutboxEntry_enum
+  uint16_t length;          // payload length
+  uint32_t crc;             // CRC32 of the payload
+};
+
+struct outboxState {
+  bool ready = false;                 // = true when SPIFFS is mounted and the outbox file has been scanned
+  uint32_t head = 1;                  // ID of the next entry
+  uint32_t tail = 1;                  // ID of the oldest entry that has not been sent
+  int pendingTransactions = 0;        // transactions waiting in the outbox
+};
+struct outboxState outbox;
+
+struct outboxStatistics {
+  uint32_t appended = 0;
+  uint32_t sent = 0;
+  uint32_t sendCalls = 0;             // requests/publishes used to send the entries
+  uint32_t dropped = 0;               // telemetry entries dropped because the outbox was full
+  uint32_t refused = 0;               // entries not stored because the outbox was full of transactions
+  uint32_t resigned = 0;              // RentalFinish transactions signed again after a nonce rejection
+  uint32_t payloadBytes = 0;          // bytes of payload appended
+  uint32_t flashBytesWritten = 0;     // bytes written to flash including headers and the tail file
+  uint32_t bytesSent = 0;
+};
+struct outboxStatistics outboxStats;
+
+
 /********************************************************************************
     EspMQTTClient Library by @plapointe6 Version 1.8.0
     WiFi and MQTT connection handler for ESP32
@@ -116,6 +187,12 @@ float previousSpeed = 0;
 // #define MQTT_MAX_PACKET_SIZE 512  // the maximum message size, including header, is 128 bytes by default. Configurable in \Arduino\libraries\PubSubClient\src\PubSubClient.h.
 
 #include "EspMQTTClient.h"
+#if defined(ENABLE_MQTT_BATCH_TELEMETRY) && (MQTT_MAX_PACKET_SIZE < 1536)
+#error "ENABLE_MQTT_BATCH_TELEMETRY needs #define MQTT_MAX_PACKET_SIZE 1536 in PubSubClient.h (see README)"
+#endif
+#if defined(ENABLE_DIAGNOSTICS) && (MQTT_MAX_PACKET_SIZE < 1536)
+#error "ENABLE_DIAGNOSTICS needs #define MQTT_MAX_PACKET_SIZE 1536 in PubSubClient.h (see README)"
+#endif
 
 
 EspMQTTClient WiFiMQTTclient(
@@ -138,14 +215,93 @@ struct MQTTpacket {
   int battery;
   int fix;
   int satellites;
-  float latitude;
-  float longitude;
+  int32_t latitude;       // microdegrees
+  int32_t longitude;      // microdegrees
   float speedKPH;
   char walletBalance[65];
-  char signature[140];
+  char signature[144 + 1];    // DER encoded signature is up to 72 bytes
+  uint8_t geofence;           // GEOFENCE_FLAG_* (ENABLE_GEOFENCE)
 };
 struct MQTTpacket NodeRedMQTTpacket;
 
+const size_t MQTT_PACKET_BUFFER_SIZE = 500 + 1;   // must not exceed MQTT_MAX_PACKET_SIZE in PubSubClient.h (less the MQTT header and topic)
+
+
+/********************************************************************************
+  Batched telemetry (see Telemetry.ino). Enabled with ENABLE_MQTT_BATCH_TELEMETRY in secrets.h
+  Samples are collected in loop() and a full batch is passed to the network task through telemetryBatchQueue.
+*********************************************************************************/
+#define TELEMETRY_BATCH_SIZE 15                   // samples per signature
+#define TELEMETRY_SAMPLE_TEXT_SIZE 64             // "4294967295,-90000000,-180000000,65535,1,255,100,A"
+#define TELEMETRY_BATCH_PACKET_SIZE 1280          // must not exceed MQTT_MAX_PACKET_SIZE in PubSubClient.h (less the MQTT header and topic)
+
+struct telemetrySample {
+  uint32_t time;          // unix time (seconds)
+  int32_t latitude;       // microdegrees
+  int32_t longitude;      // microdegrees
+  uint16_t speed;         // hundredths of a kph
+  uint8_t fix;
+  uint8_t satellites;
+  uint8_t battery;
+  char status;            // first letter of scooterRental.rentalStatus
+};
+
+struct telemetryBatchBuffer {
+  int count = 0;
+  struct telemetrySample samples[TELEMETRY_BATCH_SIZE];
+};
+struct telemetryBatchBuffer telemetryBatch;       // batch being filled by loop()
+QueueHandle_t telemetryBatchQueue;                // full batches waiting to be signed and published by the network task
+uint32_t telemetryBatchesDropped = 0;             // batches dropped because the network task fell behind
+
+
+/********************************************************************************
+  Adaptive telemetry (see Telemetry.ino). Enabled with ENABLE_ADAPTIVE_TELEMETRY in secrets.h
+*********************************************************************************/
+enum TelemetryDecision_enum {TELEMETRY_SKIP, TELEMETRY_DELTA, TELEMETRY_KEYFRAME};
+
+const int32_t TELEMETRY_MOVING_SPEED = 300;                   // hundredths of a kph. Faster than this is considered moving
+const uint32_t TELEMETRY_MOVING_INTERVAL = 2000;              // minimum time between messages while rented and moving
+const uint32_t TELEMETRY_STOPPED_INTERVAL = 5000;             // minimum time between messages while rented and stopped
+const uint32_t TELEMETRY_PARKED_INTERVAL = 15000;             // minimum time between messages while not rented
+const uint32_t TELEMETRY_RENTED_KEYFRAME_INTERVAL = 30000;    // maximum time between keyframes while rented
+const uint32_t TELEMETRY_PARKED_KEYFRAME_INTERVAL = 120000;   // maximum time between keyframes while not rented
+const float TELEMETRY_RENTED_DEADBAND_METERS = 10;
+const float TELEMETRY_PARKED_DEADBAND_METERS = 30;            // larger than the GPS drift of a parked scooter
+const int32_t TELEMETRY_SPEED_DEADBAND = 200;                 // hundredths of a kph
+const int TELEMETRY_BATTERY_DEADBAND = 2;                     // percent
+
+struct telemetryPoint {
+  uint32_t time_ms = 0;
+  int32_t latitude = 0;     // microdegrees
+  int32_t longitude = 0;    // microdegrees
+  int32_t speed = 0;        // hundredths of a kph
+  int battery = 0;
+  int fix = 0;
+  uint8_t geofence = 0;
+};
+
+struct telemetryScheduleState {
+  bool started = false;                   // = true after the first keyframe
+  const char* keyframeStatus = nullptr;   // rental status of the last keyframe
+  struct telemetryPoint keyframe;         // values of the last keyframe. Deltas are relative to this
+  struct telemetryPoint lastSent;         // values of the last message. Dead-bands are relative to this
+  uint8_t chain[32];                      // hash chain of the deltas since the last keyframe (see publishTelemetryDelta())
+  uint16_t chainLength = 0;               // deltas in the chain
+};
+struct telemetryScheduleState telemetrySchedule;
+
+struct telemetryStatistics {
+  uint32_t keyframes = 0;
+  uint32_t deltas = 0;
+  uint32_t skipped = 0;
+  uint32_t keyframeBytes = 0;
+  uint32_t deltaBytes = 0;
+};
+struct telemetryStatistics telemetryStats;
+
+struct telemetryBatchBuffer outboxTelemetry;      // telemetry collected while MQTT is disconnected. Written to the outbox when full
+
 
 /********************************************************************************
     Adafruit GPS Library
@@ -154,6 +310,113 @@ struct MQTTpacket NodeRedMQTTpacket;
 #define GPSSerial Serial1
 Adafruit_GPS GPS(&GPSSerial);     // Connect to the GPS module via the hardware serial port
 
+/********************************************************************************
+  GPS NMEA ingestion (see GPS.ino)
+  Bytes received from the GPS are buffered in gpsRing by gpsIngestTask() and parsed in loop() by readGPS()
+********************************************************************************/
+#define GPS_RING_SIZE 1024                  // must be a power of 2. ~1 second of NMEA data at 9600 baud
+const uint32_t GPS_INGEST_PERIOD_MS = 10;   // the UART receives ~10 bytes/ms at 9600 baud
+const size_t GPS_SERIAL_RX_BUFFER_SIZE = 512;
+TaskHandle_t gpsIngestTaskHandle;
+
+struct ringBuffer {
+  volatile uint16_t head = 0;   // next position to write. Only written by the producer
+  volatile uint16_t tail = 0;   // next position to read. Only written by the consumer
+  volatile bool overflow = false;
+  char buffer[GPS_RING_SIZE];
+};
+struct ringBuffer gpsRing;
+
+char gpsSentence[100];          // NMEA sentences are at most 82 characters
+size_t gpsSentenceLength = 0;
+
+//Coordinates are int32_t microdegrees everywhere (GPS, QRcode, telemetry, rental, ride track, RentalFinish).
+//They are parsed from the digits of the NMEA sentence (see parseNMEAcoordinate()) and printed with formatMicrodegrees()
+int32_t gpsLatitude = 0;        // last position parsed from an RMC or GGA sentence
+int32_t gpsLongitude = 0;
+const int32_t DEFAULT_LATITUDE = 53535839;      // reported when there is no GPS fix
+const int32_t DEFAULT_LONGITUDE = -113276741;
+#define COORDINATE_TEXT_SIZE 13                 // "-180.000000"
+
+struct gpsIngestStatistics {
+  volatile uint32_t ringOverflows = 0;      // sentences lost because the ring was full. Only written by gpsIngestTask()
+  uint32_t droppedSentences = 0;            // sentences that were incomplete or too long. Only written by readGPS()
+  uint32_t checksumFailures = 0;            // sentences with an invalid checksum
+  uint32_t parsedSentences = 0;             // RMC and GGA sentences parsed
+};
+struct gpsIngestStatistics gpsStats;
+
+
+/********************************************************************************
+  Loop latency histograms (see Latency.ino)
+  The time of each iteration of loop() and networkTask() is recorded. The percentiles are printed after every rental.
+********************************************************************************/
+#define LATENCY_BUCKETS 124         // 4 buckets per power of 2 up to 2^32 us
+
+struct latencyHistogram {
+  uint32_t counts[LATENCY_BUCKETS];
+  uint32_t samples = 0;
+  uint32_t max_us = 0;
+  volatile bool resetRequested = true;      // the histogram is cleared by its own task on the next sample
+};
+struct latencyHistogram loopLatency;        // written by loop() (core 1)
+struct latencyHistogram networkLatency;     // written by networkTask() (core 0)
+
+
+/********************************************************************************
+  Loop profiler and stall detector (see Profiler.ino)
+  The summary is published on MQTT_Diagnostics_Topic when ENABLE_DIAGNOSTICS is defined in secrets.h
+********************************************************************************/
+enum ProfileSection_enum {
+  PROFILE_GPS,              // readGPS()                    (loop)
+  PROFILE_STATUS_BAR,       // Update*Status()              (loop)
+  PROFILE_RIDE_DISPLAY,     // speedometer and ride timer   (loop)
+  PROFILE_DISPLAY_FLUSH,    // flushDisplay()               (loop)
+  PROFILE_MQTT_LOOP,        // WiFiMQTTclient.loop()        (networkTask)
+  PROFILE_STATE_MACHINE,    // StateMachine()               (networkTask)
+  PROFILE_PUBLISH,          // send_MQTTpacket() and send_MQTTbatch() (networkTask)
+  PROFILE_OUTBOX,           // drainOutbox()                (networkTask)
+  PROFILE_CALIBRATION,      // used to measure the cost of the profiler. Must be last
+  PROFILE_SECTIONS
+};
+const char* profileSectionNames[PROFILE_SECTIONS] = {"gps", "bar", "ride", "flush", "mqtt", "state", "pub", "outbox", "cal"};
+
+enum HttpEndpoint_enum {HTTP_WALLET, HTTP_RECEIVED, HTTP_NODE_STATUS, HTTP_SEND, HTTP_ENDPOINTS};
+const char* httpEndpointNames[HTTP_ENDPOINTS] = {"wallet", "received", "status", "send"};
+
+const uint32_t PROFILE_STALL_THRESHOLD_MS = 500;  // a section that takes longer than this is recorded as a stall
+#define DIAGNOSTICS_PACKET_SIZE 1024              // must not exceed MQTT_MAX_PACKET_SIZE in PubSubClient.h (less the MQTT header and topic)
+
+//Each section is written by the task that runs it. The summary (networkTask) requests a reset with
+//histogram.resetRequested and the writer clears the section on its next call (see profileEnd())
+struct profileSection {
+  uint32_t calls = 0;
+  uint32_t total_us = 0;                  // 32 bits so the summary reads it in one load. Wraps after 71 minutes in a window
+  uint32_t start_ms = 0;                  // millis() when the section started. Used when the cycle counter wraps
+  struct latencyHistogram histogram;
+};
+struct profileSection profileSections[PROFILE_SECTIONS];
+
+struct profileEndpoint {
+  uint32_t calls = 0;
+  uint32_t failures = 0;
+  uint32_t bytes = 0;                     // bytes of response body received
+  uint32_t total_ms = 0;
+};
+struct profileEndpoint profileEndpoints[HTTP_ENDPOINTS];
+
+struct profileStall {
+  uint32_t count = 0;
+  int section = 0;                        // section of the last stall
+  uint32_t duration_ms = 0;
+  uint32_t time_ms = 0;                   // millis() at the end of the last stall
+};
+struct profileStall profileStalls;
+portMUX_TYPE profileStallMux = portMUX_INITIALIZER_UNLOCKED;   // profileStalls is written by both tasks
+
+uint32_t profileCyclesPerMicrosecond = 240;
+uint32_t profileCostCycles = 0;           // cycles used by one profileStart()/profileEnd() pair
+
 
 /********************************************************************************
   Libraries for ILI9341 2.4" 240x320 TFT FeatherWing display + touchscreen
@@ -209,6 +472,79 @@ Adafruit_STMPE610 ts = Adafruit_STMPE610(STMPE_CS);         //create Touchscreen
 #define SpeedGreenDarker 0x0760       // rgb(0, 236, 0)
 #define QRCODE_DARK_PIXEL_COLOR 0xF1A7
 
+/********************************************************************************
+  Display widgets (see Display.ino)
+  The text on the status bar and the ride screen is kept in widgets. A widget is only redrawn when its text changes.
+  Dirty widgets are drawn off-screen and flushed at most once every DISPLAY_FRAME_INTERVAL_MS.
+  The speedometer and countdown digits are drawn from a run-length encoded glyph cache (see GlyphCache.ino)
+********************************************************************************/
+enum DisplayWidget_enum {
+  WIDGET_GPS_SPEED,         // status bar
+  WIDGET_CLOCK,
+  WIDGET_RSSI,
+  WIDGET_BATTERY,
+  WIDGET_SATELLITES,
+  WIDGET_SPEEDOMETER,       // ride screen
+  WIDGET_COUNTDOWN,
+  WIDGET_GEOFENCE,
+  DISPLAY_WIDGETS
+};
+
+#define DISPLAY_WIDGET_TEXT_SIZE 16
+const uint32_t DISPLAY_FRAME_INTERVAL_MS = 50;    // 20 frames per second maximum
+
+#define GLYPH_CACHE_CHARS "0123456789."
+const int GLYPH_CACHE_SIZE = 11;          // strlen(GLYPH_CACHE_CHARS)
+
+struct glyphCache {
+  uint8_t digitWidth;                     // width of a digit cell (widest digit)
+  uint8_t pointWidth;                     // width of a '.' cell
+  uint8_t height;                         // height of the cells
+  int8_t top;                             // offset from the baseline to the top of the cells (negative)
+  uint16_t offset[GLYPH_CACHE_SIZE + 1];  // runs of GLYPH_CACHE_CHARS[i] are runs[offset[i]] to runs[offset[i + 1] - 1]
+  uint8_t *runs;                          // run lengths of the cell pixels, row by row, alternating background and foreground
+};
+
+struct displayWidget {
+  int16_t cursorX;                        // text cursor (left end of the baseline)
+  int16_t cursorY;
+  const GFXfont *font;
+  uint16_t color;
+  const char *layout;                     // widest text the widget shows, # = any digit. Used to size the widget when w = 0
+  int16_t x;                              // area that is redrawn
+  int16_t y;
+  uint16_t w;
+  uint16_t h;
+  char text[DISPLAY_WIDGET_TEXT_SIZE];
+  bool visible;
+  bool dirty;
+  struct glyphCache *glyphs;              // digit cells of the layout. NULL -> the widget is drawn with the off-screen canvas
+  char drawn[DISPLAY_WIDGET_TEXT_SIZE];   // character shown in each digit cell. 0 = unknown
+  int32_t value;                          // last value given to setWidgetNumber()
+};
+
+struct displayWidget displayWidgets[DISPLAY_WIDGETS] = {
+  {0, 283, &FreeSans9pt7b, WHITE, NULL, 0, 283 - 17, 35, 18},
+  {70 + 13, 283, &FreeSans9pt7b, WHITE, NULL, 70 + 13, 283 - 17, 65, 18},
+  {195, 283, &FreeSans9pt7b, WHITE, NULL, 195, 283 - 18, 40, 19},
+  {190, 301, &FreeSans9pt7b, WHITE, NULL, 190, 301 - 17, 45, 19},
+  {190, 319, &FreeSans9pt7b, WHITE, NULL, 190, 319 - 17, 40, 18},
+  {30, 105, &Lato_Black_96, SpeedGreenDarker, "##.#"},
+  {70, 230, &Lato_Semibold_48, OffWhite, "#####"},
+  {10, 180, &FreeSans9pt7b, ArkRed, NULL, 10, 180 - 14, 220, 19},
+};
+
+GFXcanvas16 *displayCanvas = NULL;        // off-screen buffer, as large as the largest widget drawn without a glyph cache
+
+struct displayStatistics {
+  uint32_t frames = 0;                    // frames that drew at least one widget
+  uint32_t widgetsDrawn = 0;
+  uint32_t unchanged = 0;                 // updates that were skipped because the text did not change
+  uint32_t pixels = 0;                    // pixels sent to the display
+};
+struct displayStatistics displayStats;
+uint32_t previousDisplayFrame_ms = 0;
+
 /********************************************************************************
     QRCode by Richard Moore version 0.0.1
         https://github.com/ricmoo/QRCode
@@ -223,6 +559,23 @@ Adafruit_STMPE610 ts = Adafruit_STMPE610(STMPE_CS);         //create Touchscreen
 const int QRcode_Version = 10;    // set the version (range 1->40)
 const int QRcode_ECC = 1;         // set the Error Correction level (range 0-3) or symbolic (ECC_LOW, ECC_MEDIUM, ECC_QUARTILE and ECC_HIGH)
 QRCode qrcode;                    // Create the QR code object
+uint8_t qrcodeData[((4 * QRcode_Version + 17) * (4 * QRcode_Version + 17) + 7) / 8];    // module matrix of the QR code. Same size as qrcode_getBufferSize(QRcode_Version)
+
+
+/********************************************************************************
+  The session ID and the QRcode text of the next rental session are generated ahead of time by the JOB_NEXT_SESSION
+  job while the current ride is in progress.
+  The QRcode itself is only encoded when it is displayed: it holds the GPS coordinates of the end of the ride, which are
+  not known before.
+********************************************************************************/
+struct session {
+  bool ready = false;                   // = true when the session ID and QRcode text prefix have been generated
+  char sessionID[64 + 1];               // SHA256 hash as hex string
+  byte sessionID_byte[32];              // SHA256 hash
+  char QRcodeText[256 + 1];             // QRcode Version = 10 with ECC=2 gives 211 Alphanumeric characters or 151 bytes(any characters)
+  size_t QRcodeTextPrefixLength;        // length of the text before the GPS coordinates
+};
+struct session nextSession;
 
 
 
@@ -237,8 +590,6 @@ QRCode qrcode;                    // Create the QR code object
 uint32_t rideTime_start_ms;
 uint32_t rideTime_length_ms;              //milliseconds
 
-uint32_t remainingRentalTime_previous_s;  // seconds
-
 time_t rideTime_start_seconds = 0;
 
 //use these if you want to use time for measuring elapsed time for the ride timer.
@@ -254,37 +605,110 @@ int prevDisplayMinute = 0;            // this is used if you want to update cloc
 ********************************************************************************/
 //Frequency at which the MQTT packets are published
 uint32_t UpdateInterval_MQTT_Publish = 15000;           // 15 seconds
-uint32_t previousUpdateTime_MQTT_Publish = millis();
+
+//Frequency at which telemetry samples are collected for the batched MQTT telemetry (ENABLE_MQTT_BATCH_TELEMETRY)
+uint32_t UpdateInterval_Telemetry_Sample = 1000;        // 1 second
+
+//Frequency at which the adaptive telemetry scheduler decides what to publish (ENABLE_ADAPTIVE_TELEMETRY)
+uint32_t UpdateInterval_Telemetry_Schedule = 1000;      // 1 second
+
+//Frequency at which the outbox is retried while entries are waiting to be sent
+uint32_t UpdateInterval_Outbox_Drain = 5000;            // 5 seconds
+uint32_t previousUpdateTime_Outbox_Sample = millis();   // telemetry is added to the outbox every UpdateInterval_MQTT_Publish
+
+//Frequency at which GPS fixes are recorded into the ride track
+uint32_t UpdateInterval_RideTrack = 1000;               // 1 second
+
+//Delay after the start of a ride before the next rental session is generated (JOB_NEXT_SESSION)
+uint32_t Delay_NextSession = 2000;                      // 2 seconds
+
+//Frequency at which the profiler summary is published (ENABLE_DIAGNOSTICS)
+uint32_t UpdateInterval_Diagnostics = 60000;            // 60 seconds
+uint32_t previousUpdateTime_Diagnostics = millis();     // start of the current diagnostics window
 
 //Frequency at which the battery level is updated on the screen
 uint32_t UpdateInterval_Battery = 7000;                 // 7 seconds
-uint32_t previousUpdateTime_Battery = millis();
 
 //Frequency at which the WiFi Receive Signal Level is updated on the screen
 uint32_t UpdateInterval_RSSI = 5000;                    // 5 seconds
-uint32_t previousUpdateTime_RSSI = millis();
 
 //Frequency at which the Ark Network is polled looking for a rental start transaction
 uint32_t UpdateInterval_RentalStartSearch = 8000;       // 8 seconds
-uint32_t previousUpdateTime_RentalStartSearch = millis();
+bool rentalSearchDue = false;            // = true when the rental start search job has run (see dueRentalSearch())
+
+//Frequency at which the Ark Network is polled when transaction notifications are received via MQTT (ENABLE_MQTT_TX_NOTIFY)
+uint32_t UpdateInterval_RentalStartSearch_Fallback = 60000;   // 60 seconds
+bool txNotificationPending = false;     // = true when MQTT notification of a received transaction has not been processed yet
+bool txNotificationSeen = false;        // = true when a notification has arrived since the MQTT connection was established
 
 //Frequency at which the Speed and # GPS Satellites are updated on the screen
 uint32_t UpdateInterval_GPS = 5000;
-uint32_t previousUpdateTime_GPS = millis();
+
+//Frequency at which the persistent state journal is checked for pending changes (see Journal.ino)
+uint32_t UpdateInterval_Journal = 1000;                 // 1 second
 
 
 /********************************************************************************
-     mbed TLS Library for SHA256 function
+  Job scheduler (see Scheduler.ino)
+  Each task has its own scheduler. The jobs are registered in initSchedulers().
+  loop() and networkTask() sleep until the next job is due, at most LOOP_MAX_SLEEP_MS / NETWORK_MAX_SLEEP_MS
+  because they also poll the GPS, the display, the MQTT client and the state machine.
+********************************************************************************/
+#define SCHEDULER_TICK_MS 10
+#define SCHEDULER_WHEEL_BITS 6
+#define SCHEDULER_WHEEL_SLOTS (1 << SCHEDULER_WHEEL_BITS)
+#define SCHEDULER_LEVELS 3                  // 0.64 seconds, 41 seconds and 43 minutes at 10ms ticks
+#define SCHEDULER_MAX_JOBS 8
+const uint32_t LOOP_MAX_SLEEP_MS = 20;
+const uint32_t NETWORK_MAX_SLEEP_MS = 10;
+
+struct schedulerJob {
+  const char *name;
+  void (*run)();
+  uint32_t period_ms;       // 0 = one-shot
+  uint32_t jitter_ms;       // random delay of up to jitter_ms added to every run
+  uint32_t deadline_ms;     // a run that starts later than this after it was due is an overrun. 0 = no deadline
+  int profileSection;       // ProfileSection_enum or -1
+
+  bool armed;               // = true when the job is in the wheel
+  uint32_t nominal;         // tick at which the job is due, without jitter
+  uint32_t due;             // tick at which the job runs
+  uint8_t level;            // wheel slot of the job
+  uint8_t slot;
+  int8_t next;              // next job in the same slot. -1 = none
+
+  uint32_t runs;
+  uint32_t coalesced;       // missed periods that were merged into a single run
+  uint32_t overruns;
+  uint32_t maxLate_ms;
+  uint32_t maxRun_us;
+};
+
+struct scheduler {
+  struct schedulerJob *jobs;
+  int jobCount;
+  uint32_t tick;            // last tick that was processed
+  uint32_t tick_ms;         // millis() of that tick
+  int8_t wheel[SCHEDULER_LEVELS][SCHEDULER_WHEEL_SLOTS];     // first job in each slot. -1 = empty
+};
+
+enum LoopJob_enum {JOB_BATTERY, JOB_RSSI, JOB_GPS_DATA, JOB_CLOCK, JOB_TELEMETRY_SAMPLE, LOOP_JOBS};
+enum NetworkJob_enum {JOB_PUBLISH, JOB_OUTBOX_DRAIN, JOB_RIDE_TRACK, JOB_RENTAL_SEARCH, JOB_JOURNAL, JOB_DIAGNOSTICS, JOB_RELAY_HEALTH, JOB_NEXT_SESSION, NETWORK_JOBS};
+struct schedulerJob loopJobs[LOOP_JOBS];
+struct schedulerJob networkJobs[NETWORK_JOBS];
+struct scheduler loopScheduler;             // only used by loop()
+struct scheduler networkScheduler;          // only used by networkTask()
 
-  https://techtutorialsx.com/2018/05/10/esp32-arduino-mbed-tls-using-the-sha-256-algorithm/#more-25918
-  support for sha256
+
+/********************************************************************************
+     ESP32 hardware SHA accelerator for SHA256 function
+  esp_sha() runs the hash on the SHA engine of the ESP32.
+  https://docs.espressif.com/projects/esp-idf/en/v3.3/api-reference/peripherals/
 
   hash generator to check results of library.
   https://passwordsgenerator.net/sha256-hash-generator/
 ********************************************************************************/
-#include "mbedtls/md.h"
-mbedtls_md_context_t ctx;
-mbedtls_md_type_t md_type = MBEDTLS_MD_SHA256;      //select SHA256 algorithm
+#include "hwcrypto/sha.h"
 
 
 
@@ -323,13 +747,101 @@ const Configuration cfg(BridgechainNetwork);
 
 
 /********************************************************************************
-  Ark Client Library (version 1.4.0)
-  ================  NOTE: Version 1.4.1 is available however I have not yet tested with it ===========
-  https://github.com/ArkEcosystem/cpp-client
+  Streaming reads of the Ark API responses (see ArkStream.ino)
+  Each relay node of the pool has one HTTP/1.1 keep-alive connection (see RelayPool.ino).
+  Responses are parsed directly from the connection. Only the filtered fields are stored in arkJsonArena.
+********************************************************************************/
+#include <WiFiClient.h>
+const uint32_t ARK_HTTP_CONNECT_TIMEOUT_MS = 3000;
+const uint32_t ARK_HTTP_TIMEOUT_MS = 5000;          // read timeout of the HTTP connection
+const uint32_t ARK_HTTP_DRAIN_MIN_MS = 10;          // lower limit of the time spent skipping the rest of a response to keep the connection (see arkEnd())
+#define ARK_RESPONSE_SIZE 3072                      // response of a POST (see arkPost()). Holds the errors of OUTBOX_TRANSACTION_BATCH rejected transactions
+enum ArkSendResult_enum {ARK_SEND_ACCEPTED, ARK_SEND_DELIVERED, ARK_SEND_REJECTED, ARK_SEND_UNKNOWN};   // see arkTransactionResult()
+
+//Body of the current response. Reads stop at the end of the body (Content-Length or chunked encoding)
+class ArkBodyStream : public Stream {
+  public:
+    void begin(WiFiClient &client, int32_t length, bool chunked);   // length = -1 -> the body ends when the connection closes
+    bool complete();                                // = true when the whole body has been read
+    int available();
+    int read();
+    int peek();
+    int readAvailable(uint8_t *buffer, size_t size);  // bytes of the body that have arrived, without waiting. -1 = end of the body
+    void flush() {}
+    size_t write(uint8_t) {
+      return 0;
+    }
+    uint32_t bytesRead = 0;
+    bool failed = false;                            // = true when the relay stopped sending before the end of the body
+
+  private:
+    bool nextChunk();
+    WiFiClient *_client = NULL;
+    int32_t _remaining = 0;                         // bytes left in the body or the current chunk. -1 = unknown
+    bool _chunked = false;
+    bool _firstChunk = true;
+    bool _lastChunk = true;
+};
+ArkBodyStream arkBody;
+
+struct arkConnectionStatistics {
+  uint32_t requests = 0;
+  uint32_t connects = 0;                            // new TCP connections
+  uint32_t retries = 0;                             // requests sent again because the relay had closed the kept connection
+  uint32_t failovers = 0;                           // requests sent again to the next relay because a relay failed
+  uint32_t hedges = 0;                              // reads also sent to a second relay because the first one was slow
+  uint32_t hedgeWins = 0;                           // hedged reads answered first by the second relay
+  uint32_t broadcasts = 0;                          // transaction requests sent to more than one relay
+  uint32_t drainedBytes = 0;                        // unread response bytes skipped to keep the connection
+  uint32_t drainCloses = 0;                         // connections closed because the rest of a response took longer than a new connection
+};
+struct arkConnectionStatistics arkConnectionStats;
 
+/********************************************************************************
+  Relay pool (see RelayPool.ino)
+  The relays are configured in secrets.h. Their health and sync state is checked by the JOB_RELAY_HEALTH job.
 ********************************************************************************/
-#include <arkClient.h>
-Ark::Client::Connection<Ark::Client::Api> connection(ARK_PEER, ARK_PORT);   // create ARK blockchain connection
+const int ARK_RELAY_COUNT = sizeof(ARK_RELAY_HOSTS) / sizeof(ARK_RELAY_HOSTS[0]);
+static_assert(sizeof(ARK_RELAY_PORTS) / sizeof(ARK_RELAY_PORTS[0]) == ARK_RELAY_COUNT, "ARK_RELAY_HOSTS and ARK_RELAY_PORTS must have the same length");
+const int ARK_BROADCAST_RELAYS = 2;                 // number of relays a transaction request is sent to
+const int ARK_REQUEST_RELAYS = 2;                   // number of relays a request is tried on before it fails (see arkRequest())
+const int ARK_RELAY_MAX_FAILURES = 3;               // consecutive failures after which a relay is only used when no other relay is left
+const float ARK_RELAY_EWMA_ALPHA = 0.25;            // weight of the newest sample in the latency average
+const uint32_t ARK_HEDGE_DEFAULT_MS = 1500;         // hedge budget until ARK_HEDGE_MIN_SAMPLES reads have been timed
+const uint32_t ARK_HEDGE_MIN_MS = 200;              // lower limit of the hedge budget
+const uint32_t ARK_HEDGE_MIN_SAMPLES = 20;
+const float ARK_HEDGE_PERCENTILE = 95;
+
+struct arkRelayState {
+  const char *host;
+  int port;
+  WiFiClient client;                                // keep-alive connection to the relay
+  bool keepAlive;                                   // = true when the connection can be used for the next request
+  bool synced;                                      // result of the last health check
+  uint8_t failures;                                 // consecutive requests that failed
+  float latency_ms;                                 // EWMA of the time from sending a request to its response head. 0 = not measured
+  float connect_ms;                                 // EWMA of the TCP handshake time. 0 = not measured
+  uint32_t requests;
+  uint32_t errors;
+  uint32_t hedgeWins;
+};
+struct arkRelayState arkRelays[ARK_RELAY_COUNT];
+int arkCurrentRelay = 0;                            // relay of the response being read from arkBody
+struct latencyHistogram arkReceivedLatency;         // time to the response head of the received transactions reads. Sets the hedge budget
+
+//Frequency at which the health and sync state of each relay is checked. The job checks one relay per run
+uint32_t UpdateInterval_RelayHealth = 30000;        // 30 seconds
+int arkHealthNextRelay = 0;                         // relay checked by the next run of the health check (checkArkRelays())
+
+#define ARK_JSON_ARENA_SIZE 768             // large enough for one filtered transaction or wallet
+StaticJsonDocument<ARK_JSON_ARENA_SIZE> arkJsonArena;
+#define ARK_SEND_ARENA_SIZE 2048            // accepted ids and errors of OUTBOX_TRANSACTION_BATCH transactions (see arkParseSendResponse())
+StaticJsonDocument<ARK_SEND_ARENA_SIZE> arkSendArena;
+
+int arkRequestEndpoint = 0;                 // endpoint of the current request (see profileHttp())
+uint32_t arkRequestStart_ms = 0;
+int arkRxRemaining = 0;                     // number of transactions that have not been read from the current page
+bool arkRxFirst = true;                     // = true when the next transaction is the first one of the page
 
 
 /********************************************************************************
@@ -342,14 +854,14 @@ struct rental {
   uint64_t payment_Uint64;
   char rentalRate[64 + 1];
   uint64_t rentalRate_Uint64;
-  float QRLatitude;
-  float QRLongitude;
+  int32_t QRLatitude;           // microdegrees
+  int32_t QRLongitude;
   uint32_t startTime;
-  float startLatitude;
-  float startLongitude;
+  int32_t startLatitude;
+  int32_t startLongitude;
   uint32_t endTime;
-  float endLatitude;
-  float endLongitude;
+  int32_t endLatitude;
+  int32_t endLongitude;
   char vendorField[256 + 1];
   char sessionID_RentalStart[64 + 1];
   char sessionID_QRcode[64 + 1]; 
@@ -357,24 +869,172 @@ struct rental {
 };
 struct rental scooterRental;
 
+/********************************************************************************
+  Ride track recorder (see Track.ino)
+  The GPS track of the ride is simplified as it is recorded so it fits in RIDE_TRACK_MAX_POINTS points.
+  All the points are included in the RentalFinish transaction.
+********************************************************************************/
+const int RIDE_TRACK_MAX_POINTS = 16;             // point budget of the RentalFinish transaction including start and finish
+const float RIDE_TRACK_DEADBAND_METERS = 5;       // fixes closer than this to the last point are ignored
+
+struct trackPoint {
+  uint32_t timestamp;     // unix time (seconds)
+  int32_t latitude;       // microdegrees
+  int32_t longitude;      // microdegrees
+};
+
+struct rideTrackBuffer {
+  int count = 0;
+  uint32_t received = 0;                                // points offered to the track during this ride
+  float maxError = 0;                                   // largest distance(m) of a removed point from the simplified route
+  struct trackPoint points[RIDE_TRACK_MAX_POINTS + 1];  // one spare entry for the point being added
+};
+struct rideTrackBuffer rideTrack;
+
+// everything a RentalFinish is built from (see signRentalFinish())
+struct rentalFinishParameters {
+  char recipient[34 + 1];                           // address of the rider
+  uint8_t sessionId[32];
+  uint64_t nonce;
+  uint8_t trackCount;
+  struct trackPoint track[RIDE_TRACK_MAX_POINTS];
+};
+
+/********************************************************************************
+  Geofences (see Geofence.ino). Enabled with ENABLE_GEOFENCE in secrets.h
+  The zones are polygons stored in flash (geofences.h, generated by tools/geofence_tool.py) with a uniform grid index.
+  Each new GPS fix is looked up and the result sets the speed cap, the warning on the ride screen and the "zone" telemetry field.
+********************************************************************************/
+enum GeofenceType_enum {GEOFENCE_NO_RIDE, GEOFENCE_SLOW, GEOFENCE_PARKING};
+#define GEOFENCE_FLAG_NO_RIDE (1 << GEOFENCE_NO_RIDE)
+#define GEOFENCE_FLAG_SLOW (1 << GEOFENCE_SLOW)
+#define GEOFENCE_FLAG_PARKING (1 << GEOFENCE_PARKING)
+const uint8_t GEOFENCE_NO_SPEED_LIMIT = 255;
+
+struct geofenceZone {
+  int32_t minLatitude;      // bounding box, microdegrees
+  int32_t minLongitude;
+  int32_t maxLatitude;
+  int32_t maxLongitude;
+  uint32_t firstVertex;     // vertices are geofenceVertices[firstVertex] to geofenceVertices[firstVertex + vertexCount - 1]
+  uint16_t vertexCount;
+  uint8_t type;             // GeofenceType_enum
+  uint8_t speedLimitKPH;    // GEOFENCE_SLOW zones
+};
+
+struct geofenceVertex {
+  int32_t latitude;         // microdegrees
+  int32_t longitude;        // microdegrees
+};
+
+struct geofenceState {
+  uint8_t flags = 0;                                // GEOFENCE_FLAG_* of every zone containing the fix
+  uint8_t speedLimitKPH = GEOFENCE_NO_SPEED_LIMIT;  // lowest limit of those zones. 0 in a no-ride zone
+  int16_t zone = -1;                                // zone that sets the limit. -1 = none
+};
+#include "geofences.h"
+struct geofenceState geofence;              // result of the last fix (loop(), core 1)
+uint32_t geofenceFix_ms = 0;                // timestamp of the fix that was looked up
+
+struct geofenceStatistics {
+  uint32_t lookups = 0;
+  uint32_t candidates = 0;                  // zones of the grid cells that were looked up
+  uint32_t polygonTests = 0;                // candidates whose bounding box contained the fix
+  uint32_t changes = 0;                     // fixes that entered or left a zone
+  uint32_t maxLookup_us = 0;
+};
+struct geofenceStatistics geofenceStats;
+
 /********************************************************************************
   This structure is used to store details of the bridgechain wallet
 ********************************************************************************/
 struct wallet {
   char walletBalance[64 + 1];             //current balance
   uint64_t walletBalance_Uint64 = 0ULL;   //current balance
-  char walletNonce[64 + 1];               //current nonce
-  uint64_t walletNonce_Uint64 = 1ULL;     //current nonce
+  char walletNonce[64 + 1];               //nonce on the relay node
+  uint64_t confirmedNonce_Uint64 = 0ULL;  //nonce on the relay node
+  uint64_t walletNonce_Uint64 = 0ULL;     //nonce of the last transaction signed by the scooter (see nextNonce())
   int lastRXpage = 0;                    //page number of the last received transaction in wallet
 };
 struct wallet bridgechainWallet;
+bool walletRefreshPending = false;      // = true when the balance should be read again after sending transactions
+bool nonceReconcilePending = false;     // = true when the local nonce must be reconciled with the relay before the next transaction
+const int NONCE_EEPROM_ADDRESS = 8;     // the local nonce is stored in flash after lastRXpage
+
+//Number of transactions requested per page when scanning the wallet for the newest received transaction after powerup.
+//Only the meta counts of the response are parsed. 100 is the largest page size allowed by the API.
+const int RX_CATCHUP_PAGE_LIMIT = 100;
+
+//Number of transactions requested per page when polling for the RentalStart transaction.
+//Each poll requests pages until it has caught up with the newest received transaction.
+//Transactions are parsed one at a time from the stream so the page size does not change the memory used.
+const int RX_POLL_PAGE_LIMIT = 100;
+
+//Return values of GetTransactions_RentalStart()
+enum RXpage_enum {RX_PAGE_ERROR, RX_PAGE_DONE, RX_PAGE_FULL, RX_PAGE_RENTAL_START};
                  
 
 /********************************************************************************
   State Machine
 ********************************************************************************/
 enum State_enum {STATE_0, STATE_1, STATE_2, STATE_3, STATE_4, STATE_5, STATE_6};    //The possible states of the state machine
-State_enum state = STATE_0;     //initialize the starting state.
+volatile State_enum state = STATE_0;     //initialize the starting state. Written by the network task. loop() reads rideSnapshot.state
+
+//The state machine, the ride timer and scooterRental belong to the network task. loop() and its jobs (core 1) read this
+//snapshot instead, so they never see a ride timer or a rental status that is being changed.
+QueueHandle_t rideMailbox;               // holds the latest rideSnapshot. Overwritten by publishRideSnapshot()
+
+struct rideSnapshot {
+  uint8_t state;                         // State_enum
+  char rentalStatus;                     // first letter of scooterRental.rentalStatus
+  uint32_t rideTime_start_ms;
+  uint32_t rideTime_length_ms;
+};
+
+
+/********************************************************************************
+  Persistent state journal (see Journal.ino)
+  lastRXpage, the local nonce and the rental in progress are saved in a ring of CRC protected records in a SPIFFS file.
+  A rental that was in progress when the scooter rebooted is resumed with its remaining ride time.
+********************************************************************************/
+#define JOURNAL_FILE "/journal.bin"
+const uint32_t JOURNAL_MAGIC = 0x324C4E4A;            // "JNL2": coordinates in microdegrees
+const uint32_t JOURNAL_MAGIC_V1 = 0x314C4E4A;         // "JNL1": float coordinates. Only lastRXpage and the nonce are kept
+const int JOURNAL_SLOTS = 8;
+const size_t JOURNAL_SLOT_SIZE = 1024;
+const uint32_t JOURNAL_COMMIT_INTERVAL_MS = 30000;    // changes that are safe to lose (lastRXpage) are saved at most this often
+const uint32_t JOURNAL_RIDE_INTERVAL_MS = 10000;      // the elapsed ride time is saved this often during a rental
+
+struct journalRecord {
+  uint32_t magic;
+  uint32_t sequence;                // increases with every commit. The valid record with the highest sequence is the current state
+  uint32_t crc;                     // CRC32 of the rest of the record
+  int32_t lastRXpage;
+  uint64_t nonce;                   // bridgechainWallet.walletNonce_Uint64
+  bool rentalActive;
+  uint32_t rideLength_ms;
+  uint32_t rideElapsed_ms;
+  struct rental rental;             // rentalStatus is a pointer and is not restored
+  struct rideTrackBuffer track;
+};
+static_assert(sizeof(struct journalRecord) <= JOURNAL_SLOT_SIZE, "journal record does not fit in a slot");
+
+struct journalState {
+  bool ready = false;
+  uint32_t sequence = 0;            // sequence of the newest record
+  bool dirty = false;               // = true when there are changes that have not been saved
+  uint32_t lastCommit_ms = 0;
+  bool rentalActive = false;        // = true from the RentalStart until the RentalFinish is in the outbox
+  uint64_t eepromNonce = 0;         // nonce saved with the EEPROM library, the fallback when SPIFFS cannot be mounted
+};
+struct journalState journal;
+
+struct journalStatistics {
+  uint32_t changes = 0;             // changes that were marked to be saved later
+  uint32_t commits = 0;             // records written
+  uint32_t flashBytesWritten = 0;
+};
+struct journalStatistics journalStats;
 
 
 /********************************************************************************
@@ -383,8 +1043,35 @@ State_enum state = STATE_0;     //initialize the starting state.
   We have put functions in other files so we need to manually add some prototypes as the automagic doesn't work correctly
 ********************************************************************************/
 void setup();
-int GetReceivedTransaction(const char *const address, int page, const char* &id, const char* &amount, const char* &senderAddress, const char* &senderPublicKey, const char* &vendorField );
-int getMostRecentReceivedTransaction();
+bool arkReadLine(WiFiClient &client, char *line, size_t size);
+bool arkSend(int relay, const char *const method, const char *const path, const char *body, size_t length);
+int arkAwaitResponse(int *relays, int count, uint32_t timeout_ms);
+int arkReadHead(int relay);
+int arkRequest(int relay, const char *const method, const char *const path, const char *body, size_t length, int endpoint, bool hedge);
+bool arkGet(const char *const path, int endpoint);
+int arkPost(const char *const path, const char *body, size_t length, int endpoint, char *response, size_t responseSize, int &httpCode);
+bool arkParseSendResponse(const char *response);
+int arkTransactionResult(const char *id);
+bool arkRejectedNonce(const char *id, uint64_t &nonce, uint64_t &senderNonce);
+void arkEnd();
+void printArkConnectionStats();
+void initRelayPool();
+bool arkRelayUsable(int relay);
+int arkRankRelays(int *order);
+int arkSelectRelay(int exclude);
+void arkRelayResult(int relay, bool ok, uint32_t latency_ms);
+void arkRelayLatency(int relay, uint32_t latency_ms);
+void arkDropConnection(int relay);
+uint32_t arkHedgeBudget_ms();
+bool checkArkNodeStatus(int relay);
+bool checkArkRelays(int count);
+void printRelayPoolStats();
+bool arkParse(JsonDocument &filter);
+bool arkBeginReceivedTransactions(const char *const address, int page, int limit, int &count, int &totalCount);
+JsonObject arkNextReceivedTransaction(JsonDocument &filter);
+int GetReceivedTransactionCount(const char *const address, int page, int limit, int &totalCount);
+int getMostRecentReceivedTransaction(int page = 1);
+int GetTransactions_RentalStart(const char *const address, int limit, int &seenRXpage);
 void UpdateDisplayTime();
 void UpdateWiFiConnectionStatus();
 void UpdateGPSConnectionStatus();
@@ -395,45 +1082,213 @@ void GPStoMQTT();
 void UpdateBatteryStatus();
 void StateMachine();
 void UpdateRSSIStatus();
-void Generate_QRcode();
+void GenerateDisplay_QRcode();
+void displayQRcode();
+void bytesToHex(const uint8_t *const bytes, size_t length, char *hex);
+void onTransactionNotification(const String &message);
+void networkTask(void *parameter);
+void readGPS();
+void gpsIngestTask(void *parameter);
+bool checkNMEAchecksum(const char *sentence);
+bool parseNMEAcoordinate(const char *field, int32_t &microdegrees);
+void parseNMEAposition(const char *sentence, int field);
+int formatMicrodegrees(int32_t microdegrees, char *text, size_t size);
+void getGPSfix(struct gpsFix &fix);
+void displayLock();
+void displayUnlock();
+void UpdateArkNodeConnectionStatus();
+void UpdateArkConnectionStatus();
+void sampleTelemetry();
+int formatTelemetrySample(const struct telemetrySample &sample, char *text, size_t size);
+void telemetryMerkleRoot(const struct telemetryBatchBuffer &batch, uint8_t root[32]);
+void send_MQTTbatch();
+int formatMQTTpacket(char *packet, size_t size);
+int publish_MQTTpacket();
+float telemetryDistance(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2);
+int scheduleTelemetry();
+void publishTelemetryKeyframe();
+void publishTelemetryDelta();
+void printTelemetryStats();
+int publishTelemetryBatch(const struct telemetryBatchBuffer &batch, const char *const topic, uint32_t id);
+uint32_t outboxCRC(const void *data, size_t length);
+bool outboxReadEntry(File &file, uint32_t id, struct outboxEntryHeader &header, void *payload);
+void saveOutboxTail();
+void initOutbox();
+bool outboxIsTransaction(uint16_t type);
+bool outboxDropOldestTelemetry();
+uint32_t outboxAppend(uint16_t type, const void *payload, size_t length);
+bool outboxWriteEntry(uint32_t id, uint16_t type, const void *payload, size_t length);
+const uint8_t *outboxRentalFinishPayload(const struct rentalFinishParameters &ride, const std::string &transactionJson, size_t &length);
+void outboxResignRentalFinish(uint32_t id, struct rentalFinishParameters &ride);
+void outboxAddTelemetrySample();
+void drainOutbox();
+bool outboxSendTransactions(File &file, uint32_t &sentEntries);
+bool outboxHasRentalFinish(const char *sessionId);
+void startRideTrack(uint32_t timestamp, int32_t latitude, int32_t longitude);
+void recordRideTrack();
+void finishRideTrack(uint32_t timestamp, int32_t latitude, int32_t longitude);
+float rideTrackError(const struct trackPoint &a, const struct trackPoint &p, const struct trackPoint &b);
+void addRideTrackPoint(uint32_t timestamp, int32_t latitude, int32_t longitude, bool force);
+bool getWallet();
+uint32_t schedulerTicks(uint32_t ms);
+void initScheduler(struct scheduler &s, struct schedulerJob *jobs, int jobCount);
+void schedulerAdd(struct scheduler &s, int job, const char *const name, void (*run)(), uint32_t period_ms, uint32_t jitter_ms, uint32_t deadline_ms, int profileSection);
+void schedulerInsert(struct scheduler &s, int job, int32_t minDelta);
+void schedulerCascade(struct scheduler &s, int level, int slot);
+void schedulerStop(struct scheduler &s, int job);
+void schedulerStart(struct scheduler &s, int job, uint32_t delay_ms);
+void schedulerSetPeriod(struct scheduler &s, int job, uint32_t period_ms);
+uint32_t schedulerRun(struct scheduler &s);
+void printSchedulerStats(const struct scheduler &s);
+void initSchedulers();
+void dueRentalSearch();
+void send_MQTTpacket();
+void reconcileNonce();
+void nonceRejected(const char *id);
+uint64_t nextNonce();
+std::string signRentalFinish(const struct rentalFinishParameters &ride);
+void queueTransaction(const struct rentalFinishParameters &ride, const std::string &transactionJson);
+bool getTransactionId(const char *json, size_t length, char *id);
+uint64_t loadNonceEEPROM();
+void saveNonceEEPROM(uint64_t nonce);
+bool journalReadRecord(File &file, int slot, struct journalRecord &record);
+void initJournal();
+void clearJournal();
+void markJournalDirty();
+void commitJournal();
+void updateJournal();
+void printJournalStats();
+void showRideScreen();
+void resumeRental();
+void applySpeedLimit(uint8_t speedLimitKPH);
+bool geofenceContains(const struct geofenceZone &zone, int32_t latitude, int32_t longitude);
+void lookupGeofence(int32_t latitude, int32_t longitude, struct geofenceState &result);
+void updateGeofence();
+void printGeofenceStats();
+int latencyBucket(uint32_t latency_us);
+uint32_t latencyBucketLowerBound(int bucket);
+void recordLatency(struct latencyHistogram &histogram, uint32_t latency_us);
+uint32_t latencyPercentile(const struct latencyHistogram &histogram, float percent);
+void reportLatency(const char *const name, struct latencyHistogram &histogram);
+void reportRentalCycleLatency();
+uint32_t profileStart(int section);
+void profileEnd(int section, uint32_t start);
+void profileHttp(int endpoint, bool ok, int bytes, uint32_t time_ms);
+void initProfiler();
+void send_Diagnostics();
+void initDisplayWidgets();
+void setWidgetText(int widget, const char *const text);
+void showWidget(int widget);
+void hideWidget(int widget);
+void drawWidget(struct displayWidget &widget);
+void flushDisplay(bool now = false);
+void printDisplayStats();
+void showGPSDataStatus();
+void setWidgetNumber(int widget, int32_t value, int decimals);
+struct glyphCache *buildGlyphCache(const GFXfont *font);
+int encodeGlyph(const GFXfont *font, const struct glyphCache &cache, char c, uint8_t *runs);
+void drawGlyphCell(const struct glyphCache &cache, char c, int16_t x, int16_t y, uint8_t width, uint16_t color);
+void drawDigitWidget(struct displayWidget &widget);
 
 /********************************************************************************
   MAIN LOOP
+  Runs on core 1. Reads the GPS and keeps the display up to date.
+  The network and rental logic runs in networkTask() on core 0.
 ********************************************************************************/
 void loop() {
-
-  //--------------------------------------------
-  // Process state machine
-  StateMachine();
-
-  //--------------------------------------------
-  // Handle the WiFi and MQTT connections
-  WiFiMQTTclient.loop();
+  uint32_t loopStart_us = micros();
+  uint32_t start;
 
   //--------------------------------------------
   // Parse GPS data if available
-  // We need to call GPS.read() constantly in the main loop to watch for data arriving on the serial port
-  char c = GPS.read();
-
-  //ask if a new chunk of data has been received by calling GPS.newNMEAreceived(), if this returns true then we can ask the library to parse that data with GPS.parse(GPS.lastNMEA()).
-  if (GPS.newNMEAreceived()) {
-    if (!GPS.parse(GPS.lastNMEA())) // this also sets the newNMEAreceived() flag to false
-      return;                       // we can fail to parse a sentence in which case we should just wait for another
-  }
-
+  start = profileStart(PROFILE_GPS);
+  readGPS();
+#ifdef ENABLE_GEOFENCE
+  updateGeofence();                 //look up the zones of a new fix
+#endif
+  profileEnd(PROFILE_GPS, start);
 
   //--------------------------------------------
   // Update all the data displayed on the TFT Display Status Bar
+  // The connection icons are drawn directly so they hold the display. The periodic jobs (GPS SAT and GPS Speed, clock,
+  // battery, RSSI, telemetry samples) only run when they are due. They change widgets, which take the display only
+  // while the widget is updated, so the network task is not kept off the display while the jobs run.
+  start = profileStart(PROFILE_STATUS_BAR);
+  displayLock();
   UpdateWiFiConnectionStatus();     //update WiFi status bar
   UpdateMQTTConnectionStatus();     //update MQTT status bar
+  UpdateArkConnectionStatus();      //update ARK status bar
   UpdateGPSConnectionStatus();      //update GPS status bar
-  UpdateGPSDataStatus();            //update GPS SAT and GPS Speed
-  UpdateDisplayTime();              //update the clock every 1 second
-  UpdateBatteryStatus();            //update battery status every UpdateInterval_Battery (5 seconds)
-  UpdateRSSIStatus();               //update battery status every UpdateInterval_RSSI (5 seconds)
+  displayUnlock();
+  uint32_t idle_ms = schedulerRun(loopScheduler);
+  profileEnd(PROFILE_STATUS_BAR, start);
+
+  //--------------------------------------------
+  // Update the speedometer and ride timer while the scooter is rented
+  struct rideSnapshot ride;
+  getRideSnapshot(ride);
+  if (ride.state == STATE_5) {
+    start = profileStart(PROFILE_RIDE_DISPLAY);
+    displayLock();
+    updateSpeedometer();
+    updateCountdownTimer();
+    displayUnlock();
+    profileEnd(PROFILE_RIDE_DISPLAY, start);
+  }
 
   //--------------------------------------------
-  // Publish MQTT data every UpdateInterval_MQTT_Publish
-  send_MQTTpacket();
+  // Draw the widgets that changed (at most once every DISPLAY_FRAME_INTERVAL_MS). flushDisplay() holds the display
+  start = profileStart(PROFILE_DISPLAY_FLUSH);
+  flushDisplay();
+  profileEnd(PROFILE_DISPLAY_FLUSH, start);
+
+  recordLatency(loopLatency, micros() - loopStart_us);
+
+  //--------------------------------------------
+  // Sleep until the next job is due. The GPS ring and the display are still served every LOOP_MAX_SLEEP_MS
+  vTaskDelay(pdMS_TO_TICKS(min(idle_ms, LOOP_MAX_SLEEP_MS)));
+}
 
+
+/********************************************************************************
+  NETWORK TASK
+  Runs on core 0. Blocking Ark API calls made here do not stall the display or the GPS.
+********************************************************************************/
+void networkTask(void *parameter) {
+  for (;;) {
+    uint32_t iterationStart_us = micros();
+    uint32_t start;
+
+    //--------------------------------------------
+    // Handle the WiFi and MQTT connections
+    start = profileStart(PROFILE_MQTT_LOOP);
+    WiFiMQTTclient.loop();
+    profileEnd(PROFILE_MQTT_LOOP, start);
+
+    //--------------------------------------------
+    // Process state machine
+    start = profileStart(PROFILE_STATE_MACHINE);
+    StateMachine();
+    publishRideSnapshot();
+    profileEnd(PROFILE_STATE_MACHINE, start);
+
+#ifdef ENABLE_MQTT_BATCH_TELEMETRY
+    //--------------------------------------------
+    // Sign and publish the telemetry batch when one is full
+    start = profileStart(PROFILE_PUBLISH);
+    send_MQTTbatch();
+    profileEnd(PROFILE_PUBLISH, start);
+#endif
+
+    //--------------------------------------------
+    // Run the periodic jobs that are due (see initSchedulers()):
+    // publish MQTT data, send the outbox, record the ride track, rental start search, save the journal, diagnostics
+    uint32_t idle_ms = schedulerRun(networkScheduler);
+
+    recordLatency(networkLatency, micros() - iterationStart_us);
+
+    //--------------------------------------------
+    // Sleep until the next job is due. This also lets the lower priority tasks on core 0 run
+    vTaskDelay(max(pdMS_TO_TICKS(min(idle_ms, NETWORK_MAX_SLEEP_MS)), (TickType_t) 1));
+  }
 }
@@ -0,0 +1,257 @@
+/********************************************************************************
+  This file contains the display widgets
+
+  The values on the status bar (GPS speed, clock, RSSI, battery, satellites) and on the ride screen (speedometer,
+  countdown timer) are kept as text in displayWidgets. The Update*Status() functions only call setWidgetText():
+    - if the text did not change nothing is drawn
+    - if it changed the widget is marked dirty
+  flushDisplay() is called at the end of every loop() and draws the dirty widgets at most once every DISPLAY_FRAME_INTERVAL_MS.
+
+  A widget is drawn into an off-screen canvas (erase + text) and sent to the display in one address window.
+  There is no flicker between erasing the old value and printing the new one, and there is 1 SPI transaction per widget
+  instead of a fillRect() plus one address window per glyph pixel.
+  Note: Adafruit_SPITFT only supports DMA on SAMD51/nRF52. On the ESP32 the pixels are written with SPIClass::writePixels()
+
+  The speedometer and the countdown timer are drawn from a glyph cache of their font (see GlyphCache.ino). Only the digit cells
+  that changed are sent. Numbers are given with setWidgetNumber() so an unchanged value is detected without formatting it.
+  If a glyph cache cannot be built the widget is sized from its layout (widest text) and drawn with the canvas.
+  clearMainScreen() hides the ride screen widgets. They are shown again when a rental starts.
+********************************************************************************/
+
+
+/********************************************************************************
+  Build the glyph caches, size the ride screen widgets and allocate the off-screen canvas. (setup())
+********************************************************************************/
+void initDisplayWidgets() {
+  uint16_t canvasWidth = 0;
+  uint16_t canvasHeight = 0;
+
+  for (int i = 0; i < DISPLAY_WIDGETS; i++) {
+    struct displayWidget &widget = displayWidgets[i];
+    widget.glyphs = NULL;
+    if (widget.layout != NULL) {
+      widget.glyphs = buildGlyphCache(widget.font);
+    }
+
+    if (widget.glyphs != NULL) {
+      widget.x = widget.cursorX;
+      widget.y = widget.cursorY + widget.glyphs->top;
+      widget.w = 0;
+      for (const char *c = widget.layout; *c; c++) {
+        widget.w += (*c == '.') ? widget.glyphs->pointWidth : widget.glyphs->digitWidth;
+      }
+      widget.h = widget.glyphs->height;
+      if (widget.x + widget.w > Lcd_X) {
+        Serial.println("Digit cells do not fit on the display. The widget is drawn with the canvas");
+        free(widget.glyphs->runs);
+        delete widget.glyphs;
+        widget.glyphs = NULL;
+        widget.w = 0;
+      }
+    }
+
+    if ((widget.glyphs == NULL) && (widget.w == 0)) {
+      //union of the bounds of the layout filled with each digit. The digits of a proportional font do not have the same width
+      tft.setFont(widget.font);
+      int16_t left = Lcd_X, top = Lcd_Y, right = 0, bottom = 0;
+      for (char digit = '0'; digit <= '9'; digit++) {
+        char text[DISPLAY_WIDGET_TEXT_SIZE];
+        strlcpy(text, widget.layout, sizeof(text));
+        for (char *c = text; *c; c++) {
+          if (*c == '#') {
+            *c = digit;
+          }
+        }
+        int16_t x1, y1;
+        uint16_t w, h;
+        tft.getTextBounds(text, widget.cursorX, widget.cursorY, &x1, &y1, &w, &h);
+        left = min(left, x1);
+        top = min(top, y1);
+        right = max(right, (int16_t) (x1 + w));
+        bottom = max(bottom, (int16_t) (y1 + h));
+      }
+      widget.x = max(left, (int16_t) 0);
+      widget.y = max(top, (int16_t) 0);
+      widget.w = min(right, (int16_t) Lcd_X) - widget.x;
+      widget.h = min(bottom, (int16_t) Lcd_Y) - widget.y;
+    }
+    if (widget.glyphs == NULL) {
+      canvasWidth = max(canvasWidth, widget.w);
+      canvasHeight = max(canvasHeight, widget.h);
+    }
+    widget.text[0] = '\0';
+    memset(widget.drawn, 0, sizeof(widget.drawn));
+    widget.value = INT32_MIN;
+    widget.visible = false;
+    widget.dirty = false;
+  }
+
+  displayCanvas = new GFXcanvas16(canvasWidth, canvasHeight);
+  if (displayCanvas->getBuffer() == NULL) {
+    Serial.println("Not enough memory for the display canvas. Widgets are drawn directly");
+  }
+  displayCanvas->setTextWrap(false);
+  tft.setFont(&FreeSans9pt7b);
+}
+
+
+/********************************************************************************
+  Change the text of a widget. The widget is only redrawn if the text is different.
+********************************************************************************/
+void setWidgetText(int widget, const char *const text) {
+  displayLock();
+  struct displayWidget &w = displayWidgets[widget];
+  if (strncmp(w.text, text, sizeof(w.text)) == 0) {
+    displayStats.unchanged++;
+  }
+  else {
+    strlcpy(w.text, text, sizeof(w.text));
+    w.dirty = w.visible;
+  }
+  w.value = INT32_MIN;
+  displayUnlock();
+}
+
+
+/********************************************************************************
+  Change the number shown by a widget. decimals = number of digits after the '.'
+  e.g. value = 253, decimals = 1 -> "25.3"
+  An unchanged value is detected before the text is formatted.
+********************************************************************************/
+void setWidgetNumber(int widget, int32_t value, int decimals) {
+  displayLock();
+  struct displayWidget &w = displayWidgets[widget];
+  if (w.value == value) {
+    displayStats.unchanged++;
+    displayUnlock();
+    return;
+  }
+
+  //format from the last digit backwards
+  char text[DISPLAY_WIDGET_TEXT_SIZE];
+  int i = sizeof(text) - 1;
+  text[i] = '\0';
+  uint32_t magnitude = (value < 0) ? -(int64_t) value : value;
+  for (int d = 0; d < decimals; d++) {
+    text[--i] = '0' + magnitude % 10;
+    magnitude /= 10;
+  }
+  if (decimals > 0) {
+    text[--i] = '.';
+  }
+  do {
+    text[--i] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while ((magnitude > 0) && (i > 1));
+  if (value < 0) {
+    text[--i] = '-';
+  }
+
+  setWidgetText(widget, &text[i]);
+  w.value = value;
+  displayUnlock();
+}
+
+
+/********************************************************************************
+  Show a widget. It is drawn on the next frame.
+********************************************************************************/
+void showWidget(int widget) {
+  displayLock();
+  displayWidgets[widget].visible = true;
+  displayWidgets[widget].dirty = true;
+  memset(displayWidgets[widget].drawn, 0, sizeof(displayWidgets[widget].drawn));    //draw every digit cell
+  displayUnlock();
+}
+
+
+/********************************************************************************
+  Stop drawing a widget. Its area is left as it is. (the caller clears it)
+********************************************************************************/
+void hideWidget(int widget) {
+  displayLock();
+  displayWidgets[widget].visible = false;
+  displayWidgets[widget].dirty = false;
+  displayUnlock();
+}
+
+
+/********************************************************************************
+  Draw one widget: erase its area and print its text in a single address window. (digit cells: only the cells that changed)
+  The caller must hold the display lock.
+********************************************************************************/
+void drawWidget(struct displayWidget &widget) {
+  uint16_t *pixels = displayCanvas ? displayCanvas->getBuffer() : NULL;
+
+  if (widget.glyphs != NULL) {
+    drawDigitWidget(widget);
+  }
+  else if (pixels == NULL) {
+    //no canvas. Draw directly on the display
+    tft.fillRect(widget.x, widget.y, widget.w, widget.h, BLACK);
+    tft.setFont(widget.font);
+    tft.setTextColor(widget.color);
+    tft.setCursor(widget.cursorX, widget.cursorY);
+    tft.print(widget.text);
+  }
+  else {
+    displayCanvas->fillRect(0, 0, widget.w, widget.h, BLACK);
+    displayCanvas->setFont(widget.font);
+    displayCanvas->setTextColor(widget.color);
+    displayCanvas->setCursor(widget.cursorX - widget.x, widget.cursorY - widget.y);
+    displayCanvas->print(widget.text);
+
+    //the canvas can be wider than the widget so the rows are sent one at a time in the same window
+    tft.startWrite();
+    tft.setAddrWindow(widget.x, widget.y, widget.w, widget.h);
+    for (int row = 0; row < widget.h; row++) {
+      tft.writePixels(&pixels[row * displayCanvas->width()], widget.w);
+    }
+    tft.endWrite();
+    displayStats.pixels += widget.w * widget.h;
+  }
+
+  widget.dirty = false;
+  displayStats.widgetsDrawn++;
+}
+
+
+/********************************************************************************
+  Draw the dirty widgets. Called every loop() but only draws once every DISPLAY_FRAME_INTERVAL_MS.
+  now = true draws right away.
+********************************************************************************/
+void flushDisplay(bool now) {
+  if (!now && (millis() - previousDisplayFrame_ms < DISPLAY_FRAME_INTERVAL_MS)) {
+    return;
+  }
+
+  displayLock();
+  bool drawn = false;
+  for (int i = 0; i < DISPLAY_WIDGETS; i++) {
+    if (displayWidgets[i].dirty) {
+      drawWidget(displayWidgets[i]);
+      drawn = true;
+    }
+  }
+  displayUnlock();
+
+  if (drawn) {
+    displayStats.frames++;
+    previousDisplayFrame_ms = millis();
+  }
+}
+
+
+/********************************************************************************
+  Print the display statistics. (end of a rental cycle)
+********************************************************************************/
+void printDisplayStats() {
+  Serial.print("Display frames: ");
+  Serial.print(displayStats.frames);
+  Serial.print("  widgets drawn: ");
+  Serial.print(displayStats.widgetsDrawn);
+  Serial.print("  unchanged updates skipped: ");
+  Serial.print(displayStats.unchanged);
+  Serial.print("  pixels: ");
+  Serial.println(displayStats.pixels);
+}
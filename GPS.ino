@@ -0,0 +1,231 @@
+/********************************************************************************
+  This file contains the GPS NMEA ingestion
+
+  gpsIngestTask() moves the bytes received by the UART into the gpsRing buffer as they arrive, independent of how long
+  an iteration of loop() takes. readGPS() drains every complete sentence from the ring on each pass of loop(),
+  checks the checksum, parses the RMC and GGA sentences and publishes a gpsFix snapshot.
+
+  The coordinates are parsed from the digits of the sentence into int32_t microdegrees (see parseNMEAcoordinate()).
+  No float or double is used between the NMEA text and the RentalFinish transaction, so a coordinate is exact to the
+  microdegree (~0.1 m) in every hemisphere. Adafruit_GPS still parses the fix, satellites and speed.
+
+  gpsRing is a single producer (gpsIngestTask) / single consumer (readGPS) ring buffer.
+  Only the producer writes head and only the consumer writes tail so no lock is needed.
+********************************************************************************/
+
+
+/********************************************************************************
+  Moves bytes from the GPS serial port into gpsRing. (core 1, higher priority than loop())
+  If the ring is full the rest of the sentence is dropped and the drop is counted.
+********************************************************************************/
+void gpsIngestTask(void *parameter) {
+  for (;;) {
+    while (GPSSerial.available()) {
+      char c = GPSSerial.read();
+
+      if (gpsRing.overflow) {
+        if (c != '$') {
+          continue;                   //skip until the start of the next sentence
+        }
+        gpsRing.overflow = false;
+      }
+
+      uint16_t head = gpsRing.head;
+      uint16_t next = (head + 1) & (GPS_RING_SIZE - 1);
+      if (next == gpsRing.tail) {     //ring is full
+        gpsRing.overflow = true;
+        gpsStats.ringOverflows++;
+        continue;
+      }
+      gpsRing.buffer[head] = c;
+      gpsRing.head = next;
+    }
+    vTaskDelay(pdMS_TO_TICKS(GPS_INGEST_PERIOD_MS));
+  }
+}
+
+
+/********************************************************************************
+  Verify the checksum of an NMEA sentence.  $GPRMC,...*47
+  The checksum is the XOR of all characters between '$' and '*'
+********************************************************************************/
+bool checkNMEAchecksum(const char *sentence) {
+  if (*sentence++ != '$') {
+    return false;
+  }
+  uint8_t sum = 0;
+  while (*sentence && (*sentence != '*')) {
+    sum ^= *sentence++;
+  }
+  if (*sentence != '*') {
+    return false;
+  }
+  char checksum[3];
+  snprintf(checksum, sizeof(checksum), "%02X", sum);
+  return (sentence[1] == checksum[0]) && (sentence[2] == checksum[1]);
+}
+
+
+/********************************************************************************
+  Convert a coordinate field of an NMEA sentence into microdegrees.
+  field points to "ddmm.mmmm,N" (latitude) or "dddmm.mmmm,E" (longitude). S and W are negative.
+  The minutes are read as an integer in millionths of a minute and divided by 60 with rounding.
+  Returns false if the field is empty or not a valid coordinate.
+  e.g. "11316.6045,W" -> -113276742
+********************************************************************************/
+bool parseNMEAcoordinate(const char *field, int32_t &microdegrees) {
+  uint32_t whole = 0;           //dddmm
+  int digits = 0;
+  while (isdigit(*field) && (digits < 5)) {
+    whole = whole * 10 + (*field++ - '0');
+    digits++;
+  }
+  if (digits < 3) {
+    return false;
+  }
+
+  uint32_t fraction = 0;        //millionths of a minute. Digits after the 6th are ignored
+  if (*field == '.') {
+    field++;
+    for (uint32_t scale = 100000; isdigit(*field); field++) {
+      fraction += (*field - '0') * scale;
+      scale /= 10;
+    }
+  }
+  if (*field++ != ',') {
+    return false;
+  }
+
+  uint32_t minutes = (whole % 100) * 1000000 + fraction;
+  if (minutes >= 60000000) {
+    return false;
+  }
+  int32_t value = (whole / 100) * 1000000 + (minutes + 30) / 60;
+
+  switch (*field) {
+    case 'N':
+    case 'E':
+      break;
+    case 'S':
+    case 'W':
+      value = -value;
+      break;
+    default:
+      return false;
+  }
+  if ((value > 180000000) || (value < -180000000)) {
+    return false;
+  }
+  microdegrees = value;
+  return true;
+}
+
+
+/********************************************************************************
+  Parse the latitude and longitude of an RMC or GGA sentence into gpsLatitude and gpsLongitude.
+  field = index of the latitude field. The position is only updated if both coordinates are valid.
+********************************************************************************/
+void parseNMEAposition(const char *sentence, int field) {
+  for (int i = 0; (i < field) && sentence; i++) {
+    sentence = strchr(sentence, ',');
+    if (sentence) {
+      sentence++;
+    }
+  }
+  if (sentence == NULL) {
+    return;
+  }
+
+  int32_t latitude, longitude;
+  const char *longitudeField = strchr(sentence, ',');     //hemisphere of the latitude
+  longitudeField = longitudeField ? strchr(longitudeField + 1, ',') : NULL;
+  if (longitudeField && parseNMEAcoordinate(sentence, latitude) && parseNMEAcoordinate(longitudeField + 1, longitude)) {
+    gpsLatitude = latitude;
+    gpsLongitude = longitude;
+  }
+}
+
+
+/********************************************************************************
+  Print microdegrees as decimal degrees with 6 decimals, without floating point.
+  e.g. -113276741 -> "-113.276741", -500 -> "-0.000500"
+  Returns the length of the text.
+********************************************************************************/
+int formatMicrodegrees(int32_t microdegrees, char *text, size_t size) {
+  uint32_t magnitude = (microdegrees < 0) ? -(int64_t) microdegrees : microdegrees;
+  return snprintf(text, size, "%s%lu.%06lu",
+                  (microdegrees < 0) ? "-" : "",
+                  (unsigned long) (magnitude / 1000000),
+                  (unsigned long) (magnitude % 1000000));
+}
+
+
+/********************************************************************************
+  Drain the complete NMEA sentences from gpsRing and parse the RMC and GGA sentences. (loop(), core 1)
+  A snapshot of the GPS data is placed in gpsMailbox for the network task after the sentences have been parsed.
+********************************************************************************/
+void readGPS() {
+  bool updated = false;
+
+  while (gpsRing.tail != gpsRing.head) {
+    char c = gpsRing.buffer[gpsRing.tail];
+    gpsRing.tail = (gpsRing.tail + 1) & (GPS_RING_SIZE - 1);
+
+    if (c == '$') {
+      if (gpsSentenceLength > 0) {
+        gpsStats.droppedSentences++;      //previous sentence was not terminated
+      }
+      gpsSentenceLength = 0;
+    }
+    else if (gpsSentenceLength == 0) {
+      continue;                           //wait for the start of a sentence
+    }
+
+    if (c == '\n') {
+      gpsSentence[gpsSentenceLength] = '\0';    //sentence keeps the '\r' like GPS.lastNMEA()
+      gpsSentenceLength = 0;
+
+      if (!checkNMEAchecksum(gpsSentence)) {
+        gpsStats.checksumFailures++;
+        continue;
+      }
+      if ((strncmp(&gpsSentence[3], "RMC", 3) != 0) && (strncmp(&gpsSentence[3], "GGA", 3) != 0)) {
+        continue;                         //we only need the recommended minimum and fix data
+      }
+      if (GPS.parse(gpsSentence)) {
+        parseNMEAposition(gpsSentence, (gpsSentence[3] == 'R') ? 3 : 2);     //RMC: field 3, GGA: field 2
+        gpsStats.parsedSentences++;
+        updated = true;
+      }
+      continue;
+    }
+
+    if (gpsSentenceLength >= sizeof(gpsSentence) - 1) {
+      gpsStats.droppedSentences++;        //too long to be a valid sentence
+      gpsSentenceLength = 0;
+      continue;
+    }
+    gpsSentence[gpsSentenceLength++] = c;
+  }
+
+  if (updated) {
+    struct gpsFix fix;
+    fix.timestamp_ms = millis();
+    fix.fix = GPS.fix;
+    fix.satellites = GPS.satellites;
+    fix.speedKnots = GPS.speed;
+    fix.latitude = gpsLatitude;
+    fix.longitude = gpsLongitude;
+    xQueueOverwrite(gpsMailbox, &fix);
+  }
+}
+
+
+/********************************************************************************
+  Get the latest GPS snapshot. Safe to call from any task.
+********************************************************************************/
+void getGPSfix(struct gpsFix &fix) {
+  if (xQueuePeek(gpsMailbox, &fix, 0) != pdTRUE) {
+    memset(&fix, 0, sizeof(fix));      //no sentence has been parsed yet
+  }
+}
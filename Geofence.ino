@@ -0,0 +1,162 @@
+/********************************************************************************
+  This file contains the geofence engine (ENABLE_GEOFENCE)
+
+  The zones are polygons in microdegrees compiled into geofences.h by tools/geofence_tool.py. Everything is const so
+  it stays in flash. The zones are indexed by a uniform grid over their bounding boxes:
+    - geofenceZones: bounding box, first vertex, vertex count, type and speed limit of each zone
+    - geofenceVertices: the vertices of all the zones
+    - geofenceCellStart / geofenceCellZones: the zones whose bounding box touches grid cell n are
+      geofenceCellZones[geofenceCellStart[n]] to geofenceCellZones[geofenceCellStart[n + 1] - 1]
+  A lookup finds the cell of the fix, skips the candidates whose bounding box does not contain it and runs a
+  point in polygon test (crossing number, 64 bit integer math) on the others. Only the zones near the fix are tested,
+  so the time of a lookup depends on the density of the zones and not on their number. (tools/geofence_tool.py bench)
+
+  Zone types:
+    GEOFENCE_NO_RIDE -> speed limit 0
+    GEOFENCE_SLOW    -> speed limit speedLimitKPH. The lowest limit wins when slow zones overlap
+    GEOFENCE_PARKING -> no limit. Only flagged
+  updateGeofence() looks up each new fix in loop() (core 1). When the result changes it sets the warning on the
+  ride screen (WIDGET_GEOFENCE) and calls applySpeedLimit(). build_MQTTpacket() adds the flags to the telemetry.
+********************************************************************************/
+
+
+/********************************************************************************
+  = true if a point is inside a zone. Points on an edge may be inside or outside.
+********************************************************************************/
+bool geofenceContains(const struct geofenceZone &zone, int32_t latitude, int32_t longitude) {
+  if ((latitude < zone.minLatitude) || (latitude > zone.maxLatitude)
+      || (longitude < zone.minLongitude) || (longitude > zone.maxLongitude)) {
+    return false;
+  }
+  geofenceStats.polygonTests++;
+
+  //count the edges crossed by a line going east from the point. Odd = inside
+  const struct geofenceVertex *vertices = &geofenceVertices[zone.firstVertex];
+  bool inside = false;
+  for (uint16_t i = 0, j = zone.vertexCount - 1; i < zone.vertexCount; j = i++) {
+    const struct geofenceVertex &a = vertices[j];
+    const struct geofenceVertex &b = vertices[i];
+    if ((a.latitude > latitude) == (b.latitude > latitude)) {
+      continue;     //the edge does not cross the latitude of the point
+    }
+    //sign of the cross product (b - a) x (point - a): the crossing is east of the point when it has the sign of b.latitude - a.latitude
+    int64_t cross = (int64_t) (b.longitude - a.longitude) * (latitude - a.latitude)
+                    - (int64_t) (longitude - a.longitude) * (b.latitude - a.latitude);
+    if ((b.latitude > a.latitude) ? (cross > 0) : (cross < 0)) {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+
+/********************************************************************************
+  Find the zones that contain a point
+  result -> flags of every zone containing the point, the lowest speed limit and the zone that sets it
+********************************************************************************/
+void lookupGeofence(int32_t latitude, int32_t longitude, struct geofenceState &result) {
+  result.flags = 0;
+  result.speedLimitKPH = GEOFENCE_NO_SPEED_LIMIT;
+  result.zone = -1;
+
+  if ((latitude < GEOFENCE_GRID_LATITUDE) || (longitude < GEOFENCE_GRID_LONGITUDE)) {
+    return;
+  }
+  uint32_t row = (uint32_t) (latitude - GEOFENCE_GRID_LATITUDE) / GEOFENCE_CELL_LATITUDE;
+  uint32_t column = (uint32_t) (longitude - GEOFENCE_GRID_LONGITUDE) / GEOFENCE_CELL_LONGITUDE;
+  if ((row >= GEOFENCE_GRID_ROWS) || (column >= GEOFENCE_GRID_COLUMNS)) {
+    return;         //outside of every zone
+  }
+
+  uint32_t cell = row * GEOFENCE_GRID_COLUMNS + column;
+  for (uint32_t i = geofenceCellStart[cell]; i < geofenceCellStart[cell + 1]; i++) {
+    uint16_t index = geofenceCellZones[i];
+    const struct geofenceZone &zone = geofenceZones[index];
+    geofenceStats.candidates++;
+    if (!geofenceContains(zone, latitude, longitude)) {
+      continue;
+    }
+
+    result.flags |= 1 << zone.type;
+    uint8_t speedLimitKPH = GEOFENCE_NO_SPEED_LIMIT;
+    if (zone.type == GEOFENCE_NO_RIDE) {
+      speedLimitKPH = 0;
+    }
+    else if (zone.type == GEOFENCE_SLOW) {
+      speedLimitKPH = zone.speedLimitKPH;
+    }
+    if ((speedLimitKPH < result.speedLimitKPH) || (result.zone < 0)) {
+      result.speedLimitKPH = speedLimitKPH;     //a zone without a limit only sets the zone if it is the first
+      result.zone = index;
+    }
+  }
+}
+
+
+/********************************************************************************
+  Look up the latest GPS fix if it is new. (loop(), core 1)
+  Without a fix the last result is kept so a scooter in a no-ride zone stays limited.
+********************************************************************************/
+void updateGeofence() {
+  struct gpsFix fix;
+  getGPSfix(fix);
+  if (!fix.fix || (fix.timestamp_ms == geofenceFix_ms)) {
+    return;
+  }
+  geofenceFix_ms = fix.timestamp_ms;
+
+  struct geofenceState result;
+  uint32_t start = micros();
+  lookupGeofence(fix.latitude, fix.longitude, result);
+  uint32_t elapsed_us = micros() - start;
+  geofenceStats.lookups++;
+  geofenceStats.maxLookup_us = max(geofenceStats.maxLookup_us, elapsed_us);
+
+  if ((result.flags == geofence.flags) && (result.speedLimitKPH == geofence.speedLimitKPH) && (result.zone == geofence.zone)) {
+    return;
+  }
+  geofence = result;
+  geofenceStats.changes++;
+
+  char text[DISPLAY_WIDGET_TEXT_SIZE];
+  if (result.flags & GEOFENCE_FLAG_NO_RIDE) {
+    strlcpy(text, "NO RIDE ZONE", sizeof(text));
+  }
+  else if (result.flags & GEOFENCE_FLAG_SLOW) {
+    snprintf(text, sizeof(text), "SLOW %u km/h", result.speedLimitKPH);
+  }
+  else if (result.flags & GEOFENCE_FLAG_PARKING) {
+    strlcpy(text, "PARKING ZONE", sizeof(text));
+  }
+  else {
+    text[0] = '\0';
+  }
+  setWidgetText(WIDGET_GEOFENCE, text);     //only drawn on the ride screen
+  applySpeedLimit(result.speedLimitKPH);
+
+  Serial.print("Geofence zone: ");
+  Serial.print(result.zone);
+  Serial.print("  flags: ");
+  Serial.print(result.flags);
+  Serial.print("  speed limit(km/h): ");
+  Serial.println(result.speedLimitKPH);
+}
+
+
+/********************************************************************************
+  Print the geofence lookups. (end of a rental cycle)
+********************************************************************************/
+void printGeofenceStats() {
+  Serial.print("Geofence zones: ");
+  Serial.print(GEOFENCE_ZONES);
+  Serial.print("  lookups: ");
+  Serial.print(geofenceStats.lookups);
+  Serial.print("  candidates: ");
+  Serial.print(geofenceStats.candidates);
+  Serial.print("  polygon tests: ");
+  Serial.print(geofenceStats.polygonTests);
+  Serial.print("  changes: ");
+  Serial.print(geofenceStats.changes);
+  Serial.print("  max lookup(us): ");
+  Serial.println(geofenceStats.maxLookup_us);
+}
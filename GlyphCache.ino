@@ -0,0 +1,168 @@
+/********************************************************************************
+  This file contains the digit glyph cache of the speedometer and the countdown timer
+
+  Printing with a large GFX font sets the address window for every glyph pixel and the old text must be erased first.
+  Instead the characters "0123456789." of the font are rasterized once at boot into fixed size cells and
+  run-length encoded (alternating background/foreground run lengths, row by row):
+    - all digit cells have the width of the widest digit so a digit can be replaced without moving its neighbours
+    - the '.' cell has the width of the '.' glyph
+    - all cells have the height of the tallest character so drawing a cell also erases the previous character
+  A cell is drawn in a single address window with a few writeColor() fills. Only the cells whose character changed are drawn.
+  The cache of a font is a few kB. Its size is printed at boot.
+********************************************************************************/
+
+
+/********************************************************************************
+  Rasterize and encode GLYPH_CACHE_CHARS of a font. Returns NULL if the font does not contain them or memory is full.
+********************************************************************************/
+struct glyphCache *buildGlyphCache(const GFXfont *font) {
+  struct glyphCache *cache = new glyphCache;
+  cache->digitWidth = 0;
+  cache->pointWidth = 0;
+  cache->runs = NULL;
+
+  int top = 0;
+  int bottom = 0;
+  for (int i = 0; i < GLYPH_CACHE_SIZE; i++) {
+    char c = GLYPH_CACHE_CHARS[i];
+    if ((c < font->first) || (c > font->last)) {
+      delete cache;
+      return NULL;
+    }
+    const GFXglyph &glyph = font->glyph[c - font->first];
+    uint8_t width = max((int) glyph.xAdvance, glyph.xOffset + glyph.width);
+    if (c == '.') {
+      cache->pointWidth = width;
+    }
+    else {
+      cache->digitWidth = max(cache->digitWidth, width);
+    }
+    top = min(top, (int) glyph.yOffset);
+    bottom = max(bottom, glyph.yOffset + glyph.height);
+  }
+  cache->top = top;
+  cache->height = bottom - top;
+
+  //first pass counts the runs, second pass stores them
+  cache->offset[0] = 0;
+  for (int i = 0; i < GLYPH_CACHE_SIZE; i++) {
+    cache->offset[i + 1] = cache->offset[i] + encodeGlyph(font, *cache, GLYPH_CACHE_CHARS[i], NULL);
+  }
+  cache->runs = (uint8_t *) malloc(cache->offset[GLYPH_CACHE_SIZE]);
+  if (cache->runs == NULL) {
+    delete cache;
+    return NULL;
+  }
+  for (int i = 0; i < GLYPH_CACHE_SIZE; i++) {
+    encodeGlyph(font, *cache, GLYPH_CACHE_CHARS[i], &cache->runs[cache->offset[i]]);
+  }
+
+  Serial.print("Glyph cache cell(WxH): ");
+  Serial.print(cache->digitWidth);
+  Serial.print("x");
+  Serial.print(cache->height);
+  Serial.print("  bytes: ");
+  Serial.println(cache->offset[GLYPH_CACHE_SIZE]);
+  return cache;
+}
+
+
+/********************************************************************************
+  Run-length encode the cell of one character. Returns the number of runs. runs = NULL only counts them.
+  A run is at most 255 pixels. A longer run is split with a 0 length run of the other color.
+********************************************************************************/
+int encodeGlyph(const GFXfont *font, const struct glyphCache &cache, char c, uint8_t *runs) {
+  const GFXglyph &glyph = font->glyph[c - font->first];
+  int width = (c == '.') ? cache.pointWidth : cache.digitWidth;
+  int left = glyph.xOffset + (width - glyph.xAdvance) / 2;     //digits narrower than the cell are centered
+  int rowStart = glyph.yOffset - cache.top;
+
+  int count = 0;
+  bool foreground = false;
+  int run = 0;
+  for (int row = 0; row < cache.height; row++) {
+    for (int column = 0; column < width; column++) {
+      int x = column - left;
+      int y = row - rowStart;
+      bool pixel = false;
+      if ((x >= 0) && (x < glyph.width) && (y >= 0) && (y < glyph.height)) {
+        int bit = y * glyph.width + x;          //the glyph bitmap is a continuous stream of bits
+        pixel = font->bitmap[glyph.bitmapOffset + bit / 8] & (0x80 >> (bit & 7));
+      }
+
+      if (pixel != foreground) {
+        if (runs) runs[count] = run;
+        count++;
+        run = 0;
+        foreground = pixel;
+      }
+      if (run == 255) {
+        if (runs) {
+          runs[count] = 255;
+          runs[count + 1] = 0;
+        }
+        count += 2;
+        run = 0;
+      }
+      run++;
+    }
+  }
+  if (runs) runs[count] = run;
+  count++;
+  return count;
+}
+
+
+/********************************************************************************
+  Draw one cell. A character that is not in the cache (e.g. ' ') draws an empty cell.
+********************************************************************************/
+void drawGlyphCell(const struct glyphCache &cache, char c, int16_t x, int16_t y, uint8_t width, uint16_t color) {
+  const char *cached = c ? strchr(GLYPH_CACHE_CHARS, c) : NULL;
+
+  tft.startWrite();
+  tft.setAddrWindow(x, y, width, cache.height);
+  if (cached == NULL) {
+    tft.writeColor(BLACK, (uint32_t) width * cache.height);
+  }
+  else {
+    int i = cached - GLYPH_CACHE_CHARS;
+    bool foreground = false;
+    for (int run = cache.offset[i]; run < cache.offset[i + 1]; run++) {
+      if (cache.runs[run]) {
+        tft.writeColor(foreground ? color : BLACK, cache.runs[run]);
+      }
+      foreground = !foreground;
+    }
+  }
+  tft.endWrite();
+}
+
+
+/********************************************************************************
+  Draw the cells of a widget whose character changed. The text is right aligned to the layout so the '.' does not move.
+  The caller must hold the display lock.
+********************************************************************************/
+void drawDigitWidget(struct displayWidget &widget) {
+  const struct glyphCache &cache = *widget.glyphs;
+  int cells = strlen(widget.layout);
+  int length = strlen(widget.text);
+
+  int16_t x = widget.cursorX;
+  int16_t y = widget.cursorY + cache.top;
+  for (int i = 0; i < cells; i++) {
+    bool pointCell = (widget.layout[i] == '.');
+    uint8_t width = pointCell ? cache.pointWidth : cache.digitWidth;
+
+    int textIndex = length - cells + i;
+    char c = (textIndex >= 0) ? widget.text[textIndex] : ' ';
+    if ((c == '.') != pointCell) {
+      c = ' ';
+    }
+    if (widget.drawn[i] != c) {
+      drawGlyphCell(cache, c, x, y, width, widget.color);
+      widget.drawn[i] = c;
+      displayStats.pixels += width * cache.height;
+    }
+    x += width;
+  }
+}
@@ -0,0 +1,224 @@
+/********************************************************************************
+  This file contains the persistent state journal
+
+  The state that must survive a reboot is saved as one record in a ring of JOURNAL_SLOTS slots in a SPIFFS file (JOURNAL_FILE):
+    - lastRXpage
+    - the local nonce
+    - the rental in progress (struct rental, the ride track, the ride length and the elapsed ride time)
+  Each commit writes the next slot with an increasing sequence number so the writes are spread over the slots.
+  At boot the valid record with the highest sequence is the current state. A record is only valid if the magic number
+  and the CRC32 match, so a partly written slot after a power loss is ignored and the previous record is used.
+
+  Commits are coalesced:
+    - the nonce, the rental start and the rental finish are saved right away with commitJournal()
+    - lastRXpage is marked with markJournalDirty() and saved at most every JOURNAL_COMMIT_INTERVAL_MS. Losing it only
+      means some received transactions are read again
+    - during a rental the elapsed ride time is saved every JOURNAL_RIDE_INTERVAL_MS
+  If the scooter reboots during a rental the ride is resumed with the remaining time (see resumeRental()).
+  The ride time between the last commit and the reboot is given back to the rider.
+
+  The RentalFinish transaction is signed and written to the outbox before the rental is marked as finished. A reboot
+  between the two finds the RentalFinish of the session in the outbox, so the rental is finished without signing a
+  second one and the RentalFinish is never lost.
+
+  lastRXpage and the nonce used to be stored with the EEPROM library. They are migrated the first time the journal is created.
+  Records of the firmware that stored the coordinates as floats (JOURNAL_MAGIC_V1) only give lastRXpage and the nonce.
+  If SPIFFS cannot be mounted they are still saved with the EEPROM library and a rental cannot be resumed.
+  Each new nonce is also saved with the EEPROM library so the nonce is not stale if SPIFFS cannot be mounted later.
+********************************************************************************/
+
+
+/********************************************************************************
+  Read the record in a slot. Returns false if the slot does not hold a valid record.
+********************************************************************************/
+bool journalReadRecord(File &file, int slot, struct journalRecord &record) {
+  file.seek(slot * JOURNAL_SLOT_SIZE);
+  if (file.read((uint8_t *) &record, sizeof(record)) != sizeof(record)) {
+    return false;
+  }
+  if ((record.magic != JOURNAL_MAGIC) && (record.magic != JOURNAL_MAGIC_V1)) {
+    return false;
+  }
+  const size_t crcStart = offsetof(struct journalRecord, crc) + sizeof(record.crc);
+  return outboxCRC((const uint8_t *) &record + crcStart, sizeof(record) - crcStart) == record.crc;
+}
+
+
+/********************************************************************************
+  Load the newest record. The rental in progress is restored into RAM. (setup(), after initOutbox())
+  Call resumeRental() if journal.rentalActive is true afterwards. A rental whose RentalFinish is already in the outbox
+  is finished instead.
+********************************************************************************/
+void initJournal() {
+  if (!SPIFFS.begin(true)) {
+    Serial.println("SPIFFS could not be mounted. Journal is disabled");
+    bridgechainWallet.lastRXpage = loadEEPROM();
+    bridgechainWallet.walletNonce_Uint64 = loadNonceEEPROM();
+    return;
+  }
+
+  //create the file with all the slots so records can be written in place
+  if (!SPIFFS.exists(JOURNAL_FILE)) {
+    File file = SPIFFS.open(JOURNAL_FILE, FILE_WRITE);
+    uint8_t empty[64] = {0};
+    for (size_t i = 0; i < JOURNAL_SLOTS * JOURNAL_SLOT_SIZE; i += sizeof(empty)) {
+      file.write(empty, sizeof(empty));
+    }
+    file.close();
+  }
+
+  static struct journalRecord record;     //too large for the stack of setup()
+  int newest = -1;
+  uint32_t newestSequence = 0;
+  File file = SPIFFS.open(JOURNAL_FILE, FILE_READ);
+  for (int slot = 0; slot < JOURNAL_SLOTS; slot++) {
+    if (journalReadRecord(file, slot, record) && ((newest < 0) || (record.sequence > newestSequence))) {
+      newest = slot;
+      newestSequence = record.sequence;
+    }
+  }
+  journal.ready = true;
+  journal.eepromNonce = loadNonceEEPROM();
+
+  if (newest < 0) {
+    file.close();
+    Serial.println("Journal is empty. Migrating lastRXpage and nonce from EEPROM");
+    bridgechainWallet.lastRXpage = loadEEPROM();
+    bridgechainWallet.walletNonce_Uint64 = journal.eepromNonce;
+    commitJournal();
+    return;
+  }
+
+  journalReadRecord(file, newest, record);
+  file.close();
+  journal.sequence = record.sequence;
+  bridgechainWallet.lastRXpage = record.lastRXpage;
+  bridgechainWallet.walletNonce_Uint64 = record.nonce;
+
+  if (record.magic == JOURNAL_MAGIC_V1) {
+    Serial.println("Journal was written by an older firmware. A rental in progress is not resumed");
+    commitJournal();                      //its coordinates are floats. The record is written again as JOURNAL_MAGIC
+  }
+  else if (record.rentalActive && outboxHasRentalFinish(record.rental.sessionID_QRcode)) {
+    Serial.println("The RentalFinish of the rental in progress is in the outbox. The rental is finished");
+    commitJournal();
+  }
+  else if (record.rentalActive) {
+    journal.rentalActive = true;
+    scooterRental = record.rental;
+    scooterRental.rentalStatus = "Rented";
+    rideTrack = record.track;
+    rideTime_length_ms = record.rideLength_ms;
+    rideTime_start_ms = millis() - record.rideElapsed_ms;
+  }
+
+  Serial.print("Journal sequence: ");
+  Serial.print(journal.sequence);
+  Serial.print("  RXpage: ");
+  Serial.print(bridgechainWallet.lastRXpage);
+  Serial.print("  rental in progress: ");
+  Serial.println(journal.rentalActive ? "yes" : "no");
+}
+
+
+/********************************************************************************
+  Delete the journal. (ERASE_FLASH)
+********************************************************************************/
+void clearJournal() {
+  if (SPIFFS.begin(true) && SPIFFS.remove(JOURNAL_FILE)) {
+    Serial.println("cleared journal");
+  }
+}
+
+
+/********************************************************************************
+  Mark a change that can wait for the next coalesced commit (updateJournal())
+********************************************************************************/
+void markJournalDirty() {
+  journal.dirty = true;
+  journalStats.changes++;
+}
+
+
+/********************************************************************************
+  Save the current state in the next slot now.
+********************************************************************************/
+void commitJournal() {
+  journal.dirty = false;
+  journal.lastCommit_ms = millis();
+
+  if (!journal.ready) {
+    saveEEPROM(bridgechainWallet.lastRXpage);
+    saveNonceEEPROM(bridgechainWallet.walletNonce_Uint64);
+    return;
+  }
+
+  static struct journalRecord record;
+  memset(&record, 0, sizeof(record));     //padding is covered by the CRC
+  record.magic = JOURNAL_MAGIC;
+  record.sequence = journal.sequence + 1;
+  record.lastRXpage = bridgechainWallet.lastRXpage;
+  record.nonce = bridgechainWallet.walletNonce_Uint64;
+  record.rentalActive = journal.rentalActive;
+  if (journal.rentalActive) {
+    record.rideLength_ms = rideTime_length_ms;
+    record.rideElapsed_ms = millis() - rideTime_start_ms;
+    record.rental = scooterRental;
+    record.rental.rentalStatus = NULL;
+    record.track = rideTrack;
+  }
+  const size_t crcStart = offsetof(struct journalRecord, crc) + sizeof(record.crc);
+  record.crc = outboxCRC((const uint8_t *) &record + crcStart, sizeof(record) - crcStart);
+
+  File file = SPIFFS.open(JOURNAL_FILE, "r+");
+  if (!file) {
+    Serial.println("Journal could not be opened");
+    journal.dirty = true;
+    return;
+  }
+  file.seek((record.sequence % JOURNAL_SLOTS) * JOURNAL_SLOT_SIZE);
+  size_t written = file.write((const uint8_t *) &record, sizeof(record));
+  file.close();
+  if (written != sizeof(record)) {
+    Serial.println("Journal record could not be written");
+    journal.dirty = true;                 //try again with the next commit
+    return;
+  }
+
+  journal.sequence = record.sequence;
+  journalStats.commits++;
+  journalStats.flashBytesWritten += sizeof(record);
+
+  if (record.nonce != journal.eepromNonce) {
+    saveNonceEEPROM(record.nonce);        //fallback if SPIFFS cannot be mounted at the next boot
+    journal.eepromNonce = record.nonce;
+  }
+}
+
+
+/********************************************************************************
+  Save the pending changes every JOURNAL_COMMIT_INTERVAL_MS, or every JOURNAL_RIDE_INTERVAL_MS during a rental. (networkTask, core 0)
+********************************************************************************/
+void updateJournal() {
+  uint32_t interval = JOURNAL_COMMIT_INTERVAL_MS;
+  if (journal.rentalActive && journal.ready) {
+    journal.dirty = true;                 //the elapsed ride time is always changing
+    interval = JOURNAL_RIDE_INTERVAL_MS;
+  }
+  if (journal.dirty && (millis() - journal.lastCommit_ms >= interval)) {
+    commitJournal();
+  }
+}
+
+
+/********************************************************************************
+  Print the journal statistics. (end of a rental cycle)
+********************************************************************************/
+void printJournalStats() {
+  Serial.print("Journal commits: ");
+  Serial.print(journalStats.commits);
+  Serial.print("  coalesced changes: ");
+  Serial.print(journalStats.changes);
+  Serial.print("  flash bytes written: ");
+  Serial.println(journalStats.flashBytesWritten);
+}
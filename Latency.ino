@@ -0,0 +1,102 @@
+/********************************************************************************
+  This file contains the loop latency histograms
+
+  The time of every iteration of loop() (display/GPS, core 1) and networkTask() (core 0) is recorded in a
+  fixed-bucket histogram. The percentiles are printed at the end of every rental cycle and the histograms are reset.
+
+  Buckets have 4 sub-buckets per power of 2 so a percentile is accurate to within 25%:
+    bucket 0..3 -> 0..3 us
+    bucket 4..7 -> 4,5,6,7 us
+    bucket 8..11 -> 8-9, 10-11, 12-13, 14-15 us    ...and so on up to 2^32 us
+  Each histogram only has one writer (its own task). A reset is requested by setting resetRequested and is done by the writer.
+********************************************************************************/
+
+
+/********************************************************************************
+  Bucket of a latency in microseconds
+********************************************************************************/
+int latencyBucket(uint32_t latency_us) {
+  if (latency_us < 4) {
+    return latency_us;
+  }
+  int msb = 31 - __builtin_clz(latency_us);
+  int sub = (latency_us >> (msb - 2)) & 3;
+  return (msb - 1) * 4 + sub;
+}
+
+
+/********************************************************************************
+  Smallest latency in microseconds that falls into a bucket
+********************************************************************************/
+uint32_t latencyBucketLowerBound(int bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+  int msb = bucket / 4 + 1;
+  return (uint32_t) (4 + bucket % 4) << (msb - 2);
+}
+
+
+/********************************************************************************
+  Record the time of one iteration. Only call this from the task that owns the histogram.
+********************************************************************************/
+void recordLatency(struct latencyHistogram &histogram, uint32_t latency_us) {
+  if (histogram.resetRequested) {
+    memset(histogram.counts, 0, sizeof(histogram.counts));
+    histogram.samples = 0;
+    histogram.max_us = 0;
+    histogram.resetRequested = false;
+  }
+  histogram.counts[latencyBucket(latency_us)]++;
+  histogram.samples++;
+  if (latency_us > histogram.max_us) {
+    histogram.max_us = latency_us;
+  }
+}
+
+
+/********************************************************************************
+  Latency in microseconds below which 'percent' of the iterations completed. (upper bound of the bucket)
+********************************************************************************/
+uint32_t latencyPercentile(const struct latencyHistogram &histogram, float percent) {
+  uint32_t target = (uint32_t) ceilf(histogram.samples * percent / 100);
+  uint32_t count = 0;
+  for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+    count += histogram.counts[bucket];
+    if ((count >= target) && (count > 0)) {
+      uint32_t upperBound = (bucket + 1 < LATENCY_BUCKETS) ? latencyBucketLowerBound(bucket + 1) - 1 : UINT32_MAX;
+      return min(upperBound, histogram.max_us);
+    }
+  }
+  return histogram.max_us;
+}
+
+
+/********************************************************************************
+  Print the percentiles of a histogram and request a reset
+********************************************************************************/
+void reportLatency(const char *const name, struct latencyHistogram &histogram) {
+  Serial.print(name);
+  Serial.print(" iterations: ");
+  Serial.print(histogram.samples);
+  Serial.print("  p50(us): ");
+  Serial.print(latencyPercentile(histogram, 50));
+  Serial.print("  p90(us): ");
+  Serial.print(latencyPercentile(histogram, 90));
+  Serial.print("  p99(us): ");
+  Serial.print(latencyPercentile(histogram, 99));
+  Serial.print("  max(us): ");
+  Serial.println(histogram.max_us);
+  histogram.resetRequested = true;
+}
+
+
+/********************************************************************************
+  Print the loop latencies of the rental cycle that just finished. (STATE_5)
+********************************************************************************/
+void reportRentalCycleLatency() {
+  Serial.println("\n=================================");
+  Serial.println("Loop latency of this rental cycle");
+  reportLatency("display loop", loopLatency);
+  reportLatency("network task", networkLatency);
+}
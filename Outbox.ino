@@ -0,0 +1,513 @@
+/********************************************************************************
+  This file contains the store-and-forward outbox
+
+  Signed RentalFinish transactions and telemetry collected while MQTT is disconnected are appended to a ring
+  of fixed size slots in a SPIFFS file (OUTBOX_FILE). Nothing is lost if the WiFi drops or the scooter reboots
+  before the data is sent. drainOutbox() sends the pending entries in order once the connection is back:
+    - consecutive transactions are sent together in one {"transactions":[...]} request
+    - each telemetry entry is a batch of samples published as one signed frame on MQTT_Backlog_Topic
+
+  Every entry has an increasing ID. The ID of the oldest entry that has not been sent (the tail) is saved in
+  OUTBOX_TAIL_FILE after each successful send so an entry is never sent again after it has been delivered.
+  If the scooter reboots between sending and saving the tail the entry is sent again. The relay answers a
+  transaction it already has with ERR_DUPLICATE or ERR_FORGED, which counts as delivered (see outboxSendTransactions()),
+  and the backend can drop telemetry frames with an "id" it already received.
+
+  A RentalFinish is stored with the parameters it was built from (OUTBOX_RENTAL_FINISH). If the relay rejects it
+  because of its nonce it is signed again with the corrected nonce and stays in the outbox.
+
+  slot layout: outboxEntryHeader followed by the payload
+  The slot of an entry is (id % OUTBOX_SLOTS). A slot is only valid if the magic number, the id and the CRC32 of
+  the payload match, so a partly written slot after a power loss is ignored.
+********************************************************************************/
+
+
+/********************************************************************************
+  CRC32 of the outbox entries and tail file. (ESP32 ROM function)
+********************************************************************************/
+uint32_t outboxCRC(const void *data, size_t length) {
+  return crc32_le(0, (const uint8_t *) data, length);
+}
+
+
+/********************************************************************************
+  Returns true if an entry of this type is sent to the relay (see outboxSendTransactions())
+********************************************************************************/
+bool outboxIsTransaction(uint16_t type) {
+  return (type == OUTBOX_TRANSACTION) || (type == OUTBOX_RENTAL_FINISH);
+}
+
+
+/********************************************************************************
+  Read the header of the entry with this id. Returns false if the slot does not hold a valid entry with this id.
+  The payload is read into 'payload' if it is not NULL.
+********************************************************************************/
+bool outboxReadEntry(File &file, uint32_t id, struct outboxEntryHeader &header, void *payload) {
+  file.seek((id % OUTBOX_SLOTS) * OUTBOX_SLOT_SIZE);
+  if (file.read((uint8_t *) &header, sizeof(header)) != sizeof(header)) {
+    return false;
+  }
+  if ((header.magic != OUTBOX_MAGIC) || (header.id != id) || (header.length > OUTBOX_SLOT_SIZE - sizeof(header))) {
+    return false;
+  }
+
+  static uint8_t buffer[OUTBOX_SLOT_SIZE];
+  uint8_t *data = payload ? (uint8_t *) payload : buffer;
+  if (file.read(data, header.length) != header.length) {
+    return false;
+  }
+  return outboxCRC(data, header.length) == header.crc;
+}
+
+
+/********************************************************************************
+  Save the ID of the oldest entry that has not been sent
+********************************************************************************/
+void saveOutboxTail() {
+  uint32_t record[2] = {outbox.tail, 0};
+  record[1] = outboxCRC(&record[0], sizeof(record[0]));
+
+  File file = SPIFFS.open(OUTBOX_TAIL_FILE, FILE_WRITE);
+  if (!file) {
+    Serial.println("Outbox tail could not be saved");
+    return;
+  }
+  file.write((const uint8_t *) record, sizeof(record));
+  file.close();
+  outboxStats.flashBytesWritten += sizeof(record);
+}
+
+
+/********************************************************************************
+  Mount SPIFFS, create the outbox file if needed and find the pending entries. (setup())
+********************************************************************************/
+void initOutbox() {
+  if (!SPIFFS.begin(true)) {              //format SPIFFS the first time it is used
+    Serial.println("SPIFFS could not be mounted. Outbox is disabled");
+    return;
+  }
+
+  //a file of another slot size (an older firmware) cannot be read. Its entries are dropped
+  if (SPIFFS.exists(OUTBOX_FILE)) {
+    File file = SPIFFS.open(OUTBOX_FILE, FILE_READ);
+    bool resized = (file.size() != OUTBOX_SLOTS * OUTBOX_SLOT_SIZE);
+    file.close();
+    if (resized) {
+      Serial.println("Outbox slot size changed. The outbox is cleared");
+      SPIFFS.remove(OUTBOX_FILE);
+      SPIFFS.remove(OUTBOX_TAIL_FILE);
+    }
+  }
+
+  //create the file with all the slots so entries can be written in place
+  if (!SPIFFS.exists(OUTBOX_FILE)) {
+    File file = SPIFFS.open(OUTBOX_FILE, FILE_WRITE);
+    uint8_t empty[64] = {0};
+    for (size_t i = 0; i < OUTBOX_SLOTS * OUTBOX_SLOT_SIZE; i += sizeof(empty)) {
+      file.write(empty, sizeof(empty));
+    }
+    file.close();
+  }
+
+  //read the saved tail
+  outbox.tail = 1;
+  File tailFile = SPIFFS.open(OUTBOX_TAIL_FILE, FILE_READ);
+  if (tailFile) {
+    uint32_t record[2];
+    if ((tailFile.read((uint8_t *) record, sizeof(record)) == sizeof(record)) && (outboxCRC(&record[0], sizeof(record[0])) == record[1])) {
+      outbox.tail = record[0];
+    }
+    tailFile.close();
+  }
+
+  //the next ID follows the newest valid entry
+  outbox.head = outbox.tail;
+  File file = SPIFFS.open(OUTBOX_FILE, FILE_READ);
+  for (int slot = 0; slot < OUTBOX_SLOTS; slot++) {
+    struct outboxEntryHeader header;
+    file.seek(slot * OUTBOX_SLOT_SIZE);
+    if ((file.read((uint8_t *) &header, sizeof(header)) == sizeof(header)) && (header.magic == OUTBOX_MAGIC) && (header.id >= outbox.head)) {
+      outbox.head = header.id + 1;
+    }
+  }
+
+  if (outbox.head - outbox.tail > OUTBOX_SLOTS) {
+    outbox.tail = outbox.head - OUTBOX_SLOTS;   //older entries have been overwritten
+  }
+
+  //count the pending transactions so the nonce is not refreshed from the relay while they are waiting
+  outbox.pendingTransactions = 0;
+  for (uint32_t id = outbox.tail; id != outbox.head; id++) {
+    struct outboxEntryHeader header;
+    if (outboxReadEntry(file, id, header, NULL) && outboxIsTransaction(header.type)) {
+      outbox.pendingTransactions++;
+    }
+  }
+  file.close();
+
+  outbox.ready = true;
+  Serial.print("Outbox pending entries: ");
+  Serial.print(outbox.head - outbox.tail);
+  Serial.print("  transactions: ");
+  Serial.println(outbox.pendingTransactions);
+}
+
+
+/********************************************************************************
+  Make room for a new entry in a full outbox by dropping its oldest telemetry entry. Transactions are never dropped.
+  The transactions older than the dropped entry are moved up by one ID (from the newest to the oldest) and the tail
+  moves up by one. A power loss while they are moved leaves one transaction in two slots. It is sent twice and
+  the relay answers the copy with ERR_DUPLICATE or ERR_FORGED.
+  Returns false if every entry is a transaction.
+********************************************************************************/
+bool outboxDropOldestTelemetry() {
+  File file = SPIFFS.open(OUTBOX_FILE, "r+");
+  if (!file) {
+    return false;
+  }
+  struct outboxEntryHeader header;
+  uint32_t dropped = outbox.tail;
+  while ((dropped != outbox.head) && outboxReadEntry(file, dropped, header, NULL) && outboxIsTransaction(header.type)) {
+    dropped++;
+  }
+  if (dropped == outbox.head) {
+    file.close();
+    return false;
+  }
+
+  for (uint32_t id = dropped; id != outbox.tail; id--) {
+    outboxReadEntry(file, id - 1, header, NULL);
+    uint32_t from = ((id - 1) % OUTBOX_SLOTS) * OUTBOX_SLOT_SIZE + sizeof(header);
+    uint32_t to = (id % OUTBOX_SLOTS) * OUTBOX_SLOT_SIZE + sizeof(header);
+    uint8_t chunk[128];
+    for (size_t copied = 0; copied < header.length; copied += sizeof(chunk)) {
+      size_t length = min(sizeof(chunk), (size_t) (header.length - copied));
+      file.seek(from + copied);
+      file.read(chunk, length);
+      file.seek(to + copied);
+      file.write(chunk, length);
+    }
+    header.id = id;
+    file.seek(to - sizeof(header));
+    file.write((const uint8_t *) &header, sizeof(header));
+    outboxStats.flashBytesWritten += sizeof(header) + header.length;
+  }
+  file.close();
+
+  outbox.tail++;
+  saveOutboxTail();
+  return true;
+}
+
+
+/********************************************************************************
+  Append an entry to the outbox. Returns the ID of the entry or 0 if it could not be stored.
+  If the outbox is full the oldest telemetry entry is dropped (see outboxDropOldestTelemetry()). If there is none,
+  the entry is not stored: a transaction is never dropped to make room.
+********************************************************************************/
+uint32_t outboxAppend(uint16_t type, const void *payload, size_t length) {
+  if (!outbox.ready || (length > OUTBOX_SLOT_SIZE - sizeof(struct outboxEntryHeader))) {
+    return 0;
+  }
+
+  if (outbox.head - outbox.tail >= OUTBOX_SLOTS) {
+    if (!outboxDropOldestTelemetry()) {
+      Serial.println("Outbox is full of transactions. The entry is not stored");
+      outboxStats.refused++;
+      return 0;
+    }
+    Serial.println("Outbox is full. Dropping the oldest telemetry");
+    outboxStats.dropped++;
+  }
+
+  if (!outboxWriteEntry(outbox.head, type, payload, length)) {
+    return 0;
+  }
+  outbox.head++;
+  if (outboxIsTransaction(type)) {
+    outbox.pendingTransactions++;
+  }
+  outboxStats.appended++;
+  outboxStats.payloadBytes += length;
+  return outbox.head - 1;
+}
+
+
+/********************************************************************************
+  Write the entry with this id into its slot. Returns false if the outbox file could not be opened.
+********************************************************************************/
+bool outboxWriteEntry(uint32_t id, uint16_t type, const void *payload, size_t length) {
+  struct outboxEntryHeader header;
+  header.magic = OUTBOX_MAGIC;
+  header.id = id;
+  header.type = type;
+  header.length = length;
+  header.crc = outboxCRC(payload, length);
+
+  File file = SPIFFS.open(OUTBOX_FILE, "r+");
+  if (!file) {
+    Serial.println("Outbox could not be opened");
+    return false;
+  }
+  file.seek((id % OUTBOX_SLOTS) * OUTBOX_SLOT_SIZE);
+  file.write((const uint8_t *) &header, sizeof(header));
+  file.write((const uint8_t *) payload, length);
+  file.close();
+  outboxStats.flashBytesWritten += sizeof(header) + length;
+  return true;
+}
+
+
+/********************************************************************************
+  Payload of an OUTBOX_RENTAL_FINISH entry: the parameters of the RentalFinish followed by its signed JSON.
+  Returns NULL if it does not fit in a slot.
+********************************************************************************/
+const uint8_t *outboxRentalFinishPayload(const struct rentalFinishParameters &ride, const std::string &transactionJson, size_t &length) {
+  static uint8_t payload[OUTBOX_SLOT_SIZE];
+  length = sizeof(ride) + transactionJson.length();
+  if (length > OUTBOX_SLOT_SIZE - sizeof(struct outboxEntryHeader)) {
+    return NULL;
+  }
+  memcpy(payload, &ride, sizeof(ride));
+  memcpy(payload + sizeof(ride), transactionJson.c_str(), transactionJson.length());
+  return payload;
+}
+
+
+/********************************************************************************
+  The relay rejected the RentalFinish of the entry with this id because of its nonce. It is signed again with the
+  next nonce (nonceRejected() has corrected the local nonce) and written back into its slot, so the ride is settled
+  by the next send. Its old signature was never applied: the relay answers ERR_FORGED for a transaction on the chain.
+********************************************************************************/
+void outboxResignRentalFinish(uint32_t id, struct rentalFinishParameters &ride) {
+  uint64_t rejectedNonce = ride.nonce;
+  ride.nonce = nextNonce();
+  std::string transactionJson = signRentalFinish(ride);
+  size_t length;
+  const uint8_t *payload = outboxRentalFinishPayload(ride, transactionJson, length);
+  if ((payload == NULL) || !outboxWriteEntry(id, OUTBOX_RENTAL_FINISH, payload, length)) {
+    return;
+  }
+  outboxStats.resigned++;
+  Serial.print("RentalFinish signed again. Nonce: ");
+  Serial.printf("%" PRIu64 " -> %" PRIu64 "\n", rejectedNonce, ride.nonce);
+}
+
+
+/********************************************************************************
+  Returns true if a pending transaction in the outbox is the RentalFinish of this session (64 hex characters).
+  A RentalFinish is written to the outbox before the rental is marked as finished in the journal (see initJournal())
+********************************************************************************/
+bool outboxHasRentalFinish(const char *sessionId) {
+  if (!outbox.ready) {
+    return false;
+  }
+  static char payload[OUTBOX_SLOT_SIZE + 1];
+  static const char key[] = "\"sessionId\":\"";
+  bool found = false;
+  File file = SPIFFS.open(OUTBOX_FILE, FILE_READ);
+  for (uint32_t id = outbox.tail; (id != outbox.head) && !found; id++) {
+    struct outboxEntryHeader header;
+    if (outboxReadEntry(file, id, header, payload) && outboxIsTransaction(header.type)) {
+      payload[header.length] = '\0';
+      size_t json = (header.type == OUTBOX_RENTAL_FINISH) ? sizeof(struct rentalFinishParameters) : 0;
+      const char *field = strstr(payload + json, key);
+      found = (field != NULL) && (strncasecmp(field + sizeof(key) - 1, sessionId, 64) == 0);
+    }
+  }
+  file.close();
+  return found;
+}
+
+
+/********************************************************************************
+  Add a telemetry sample while MQTT is disconnected. (networkTask, core 0)
+  A sample is taken every UpdateInterval_MQTT_Publish from NodeRedMQTTpacket (see build_MQTTpacket())
+  Samples are collected in RAM and written to the outbox as one entry when TELEMETRY_BATCH_SIZE samples have been collected.
+********************************************************************************/
+void outboxAddTelemetrySample() {
+  if (millis() - previousUpdateTime_Outbox_Sample < UpdateInterval_MQTT_Publish) {
+    return;
+  }
+  previousUpdateTime_Outbox_Sample = millis();
+
+  build_MQTTpacket();
+  struct telemetrySample &sample = outboxTelemetry.samples[outboxTelemetry.count];
+  sample.time = time(nullptr);
+  sample.latitude = NodeRedMQTTpacket.latitude;
+  sample.longitude = NodeRedMQTTpacket.longitude;
+  sample.speed = (uint16_t) lround(NodeRedMQTTpacket.speedKPH * 100);
+  sample.fix = NodeRedMQTTpacket.fix;
+  sample.satellites = NodeRedMQTTpacket.satellites;
+  sample.battery = NodeRedMQTTpacket.battery;
+  sample.status = NodeRedMQTTpacket.status[0];
+
+  outboxTelemetry.count++;
+  if (outboxTelemetry.count == TELEMETRY_BATCH_SIZE) {
+    outboxAppend(OUTBOX_TELEMETRY, &outboxTelemetry, sizeof(outboxTelemetry));
+    outboxTelemetry.count = 0;
+  }
+}
+
+
+/********************************************************************************
+  Send the pending outbox entries in order. (networkTask, core 0)
+  Job of networkScheduler: runs every UpdateInterval_Outbox_Drain. It is also called directly to send right away.
+  Stops at the first entry that could not be sent. It is retried after UpdateInterval_Outbox_Drain.
+  Transactions only need WiFi. Telemetry also needs the MQTT connection.
+********************************************************************************/
+void drainOutbox() {
+  if (!outbox.ready || !WiFiMQTTclient.isWifiConnected()) {
+    return;
+  }
+
+  //the telemetry collected while disconnected is stored first so it is sent in order
+  if ((outboxTelemetry.count > 0) && WiFiMQTTclient.isMqttConnected()) {
+    outboxAppend(OUTBOX_TELEMETRY, &outboxTelemetry, sizeof(outboxTelemetry));
+    outboxTelemetry.count = 0;
+  }
+  if (outbox.tail == outbox.head) {
+    return;
+  }
+
+  File file = SPIFFS.open(OUTBOX_FILE, FILE_READ);
+  while (outbox.tail != outbox.head) {
+    struct outboxEntryHeader header;
+    if (!outboxReadEntry(file, outbox.tail, header, NULL)) {
+      Serial.print("Outbox entry is not valid. Skipping ID: ");
+      Serial.println(outbox.tail);
+      outbox.tail++;
+      continue;
+    }
+
+    bool sent;
+    uint32_t sentEntries;
+    if (outboxIsTransaction(header.type)) {
+      sent = outboxSendTransactions(file, sentEntries);
+    }
+    else {
+      if (!WiFiMQTTclient.isMqttConnected()) {
+        break;                    //telemetry waits for the MQTT connection
+      }
+      struct telemetryBatchBuffer batch;
+      outboxReadEntry(file, outbox.tail, header, &batch);
+      int length = publishTelemetryBatch(batch, MQTT_Backlog_Topic, header.id);
+      sent = (length > 0);
+      sentEntries = 1;
+      outboxStats.bytesSent += length;
+    }
+    if (!sent) {
+      break;
+    }
+
+    outbox.tail += sentEntries;
+    outboxStats.sent += sentEntries;
+    outboxStats.sendCalls++;
+    saveOutboxTail();
+  }
+  file.close();
+
+  if (nonceReconcilePending) {
+    reconcileNonce();
+  }
+
+  Serial.print("Outbox appended: ");
+  Serial.print(outboxStats.appended);
+  Serial.print("  sent: ");
+  Serial.print(outboxStats.sent);
+  Serial.print(" in ");
+  Serial.print(outboxStats.sendCalls);
+  Serial.print(" sends  dropped: ");
+  Serial.print(outboxStats.dropped);
+  Serial.print("  refused: ");
+  Serial.print(outboxStats.refused);
+  Serial.print("  signed again: ");
+  Serial.print(outboxStats.resigned);
+  Serial.print("  flash bytes written: ");
+  Serial.print(outboxStats.flashBytesWritten);
+  Serial.print("  payload bytes: ");
+  Serial.print(outboxStats.payloadBytes);
+  Serial.print("  bytes sent: ");
+  Serial.println(outboxStats.bytesSent);
+}
+
+
+/********************************************************************************
+  Send up to OUTBOX_TRANSACTION_BATCH consecutive transactions starting at the tail in one request.
+  sentEntries -> number of outbox entries, from the tail, that can be removed
+  An entry is only removed when the relay answered 2xx or 422 and the response has a result for its id:
+    - accepted (data.accept or data.broadcast), or already known to the relay (ERR_DUPLICATE, ERR_FORGED)
+    - rejected with an error that is not about its nonce. It is not retried. The local nonce is reconciled instead
+  A RentalFinish rejected because of its nonce (see arkRejectedNonce()) stays in the outbox: the local nonce is
+  corrected (see nonceRejected()) and the RentalFinish is signed again with the next one (see outboxResignRentalFinish()).
+  The first entry that stays (e.g. also an entry in data.excess) and the entries after it stay in the outbox.
+  Returns false if no entry can be removed. The transactions are then retried later.
+********************************************************************************/
+bool outboxSendTransactions(File &file, uint32_t &sentEntries) {
+  static char body[OUTBOX_TRANSACTION_BATCH * OUTBOX_SLOT_SIZE + 32];
+  static char ids[OUTBOX_TRANSACTION_BATCH][64 + 1];
+  static struct rentalFinishParameters rides[OUTBOX_TRANSACTION_BATCH];
+  bool resignable[OUTBOX_TRANSACTION_BATCH];
+  size_t length = snprintf(body, sizeof(body), "{\"transactions\":[");
+
+  uint32_t entries = 0;
+  for (uint32_t id = outbox.tail; (id != outbox.head) && (entries < OUTBOX_TRANSACTION_BATCH); id++) {
+    struct outboxEntryHeader header;
+    char *json = &body[length + 1];
+    if (!outboxReadEntry(file, id, header, json) || !outboxIsTransaction(header.type)) {
+      break;
+    }
+    size_t jsonLength = header.length;
+    resignable[entries] = (header.type == OUTBOX_RENTAL_FINISH) && (header.length > sizeof(rides[entries]));
+    if (resignable[entries]) {
+      memcpy(&rides[entries], json, sizeof(rides[entries]));
+      jsonLength -= sizeof(rides[entries]);
+      memmove(json, json + sizeof(rides[entries]), jsonLength);
+    }
+    getTransactionId(json, jsonLength, ids[entries]);
+    body[length] = (entries == 0) ? ' ' : ',';
+    length += 1 + jsonLength;
+    entries++;
+  }
+  length += snprintf(&body[length], sizeof(body) - length, "]}");
+
+  Serial.print("Sending transactions from the outbox: ");
+  Serial.println(entries);
+  static char response[ARK_RESPONSE_SIZE];
+  int httpCode;
+  int responseLength = arkPost("/api/transactions", body, length, HTTP_SEND, response, sizeof(response), httpCode);
+  Serial.println(response);
+  sentEntries = 0;
+  if ((responseLength <= 0) || !(((httpCode >= 200) && (httpCode < 300)) || (httpCode == 422)) || !arkParseSendResponse(response)) {
+    Serial.print("The transactions were not delivered. HTTP code: ");
+    Serial.println(httpCode);
+    return false;
+  }
+  outboxStats.bytesSent += length;
+
+  bool kept = false;                      // an entry stays in the outbox: the entries after it stay too
+  for (uint32_t i = 0; i < entries; i++) {
+    int result = (ids[i][0] == '\0') ? ARK_SEND_REJECTED : arkTransactionResult(ids[i]);
+    if (result == ARK_SEND_UNKNOWN) {
+      break;
+    }
+    if (result == ARK_SEND_REJECTED) {
+      uint64_t nonce;
+      uint64_t senderNonce;
+      bool nonceError = arkRejectedNonce(ids[i], nonce, senderNonce);
+      nonceRejected(ids[i]);
+      if (nonceError && resignable[i]) {
+        outboxResignRentalFinish(outbox.tail + i, rides[i]);
+        kept = true;
+      }
+    }
+    sentEntries += kept ? 0 : 1;
+  }
+  if (sentEntries == 0) {
+    return false;
+  }
+
+  outbox.pendingTransactions -= sentEntries;
+  walletRefreshPending = true;
+  return true;
+}
@@ -0,0 +1,183 @@
+/********************************************************************************
+  This file contains the loop profiler and stall detector
+
+  The subsystems called from loop() and networkTask() are timed with the CPU cycle counter:
+    uint32_t start = profileStart(PROFILE_STATE_MACHINE);
+    StateMachine();
+    profileEnd(PROFILE_STATE_MACHINE, start);
+  Each section keeps a call count, the total time and a latency histogram (see Latency.ino). Only the task that runs
+  a section writes it, resets included.
+  A section that takes longer than PROFILE_STALL_THRESHOLD_MS is counted as a stall and the last stall is kept.
+  The stalls of both tasks go to one record, guarded by profileStallMux.
+
+  Ark relay requests are counted per endpoint (calls, failures, bytes received, time) with profileHttp().
+  Free heap, heap low-water mark and fragmentation (largest free block vs. free heap) are sampled when the summary is built.
+
+  A compact summary is published every UpdateInterval_Diagnostics on MQTT_Diagnostics_Topic and a reset of the
+  sections is requested. The cost of the profiler itself is measured at boot and reported as "ovh" (per mille of the elapsed time)
+  example: {"up":3605,"heap":[143320,120432,12],"ovh":0.3,"sec":{"mqtt":[60211,35,120,4410],...},"http":{"wallet":[2,0,412,188],...},"stalls":1,"stall":["state",5230,1820]}
+********************************************************************************/
+
+
+/********************************************************************************
+  Start timing a section. Returns the CPU cycle counter.
+********************************************************************************/
+uint32_t profileStart(int section) {
+  profileSections[section].start_ms = millis();
+  return ESP.getCycleCount();
+}
+
+
+/********************************************************************************
+  Stop timing a section. Only call this from the task that runs the section.
+  The cycle counter wraps after ~17 seconds at 240MHz so millis() is used for longer sections.
+  The reset requested by send_Diagnostics() is done here, by the task that owns the section.
+********************************************************************************/
+void profileEnd(int section, uint32_t start) {
+  struct profileSection &profile = profileSections[section];
+  uint32_t duration_us = (ESP.getCycleCount() - start) / profileCyclesPerMicrosecond;
+  uint32_t duration_ms = millis() - profile.start_ms;
+  if (duration_ms > 10000) {
+    duration_us = duration_ms * 1000;
+  }
+
+  if (profile.histogram.resetRequested) {
+    profile.calls = 0;
+    profile.total_us = 0;
+  }
+  profile.calls++;
+  profile.total_us += duration_us;
+  recordLatency(profile.histogram, duration_us);      //clears resetRequested
+
+  if (duration_us >= PROFILE_STALL_THRESHOLD_MS * 1000) {
+    portENTER_CRITICAL(&profileStallMux);
+    profileStalls.count++;
+    profileStalls.section = section;
+    profileStalls.duration_ms = duration_us / 1000;
+    profileStalls.time_ms = millis();
+    portEXIT_CRITICAL(&profileStallMux);
+  }
+}
+
+
+/********************************************************************************
+  Count a request to the Ark relay node.
+  bytes -> size of the response body. time_ms -> how long the request took
+********************************************************************************/
+void profileHttp(int endpoint, bool ok, int bytes, uint32_t time_ms) {
+  struct profileEndpoint &profile = profileEndpoints[endpoint];
+  profile.calls++;
+  if (!ok) {
+    profile.failures++;
+  }
+  if (bytes > 0) {
+    profile.bytes += bytes;
+  }
+  profile.total_ms += time_ms;
+
+  if (time_ms >= PROFILE_STALL_THRESHOLD_MS) {
+    Serial.print("Slow Ark API request(ms): ");
+    Serial.println(time_ms);
+  }
+}
+
+
+/********************************************************************************
+  Measure the cost of profileStart()/profileEnd() so the overhead of the profiler can be reported. (setup())
+********************************************************************************/
+void initProfiler() {
+  profileCyclesPerMicrosecond = ESP.getCpuFreqMHz();
+
+  const int calibrationCalls = 100;
+  uint32_t start = ESP.getCycleCount();
+  for (int i = 0; i < calibrationCalls; i++) {
+    profileEnd(PROFILE_CALIBRATION, profileStart(PROFILE_CALIBRATION));
+  }
+  profileCostCycles = (ESP.getCycleCount() - start) / calibrationCalls;
+  profileSections[PROFILE_CALIBRATION].histogram.resetRequested = true;
+  previousUpdateTime_Diagnostics = millis();
+}
+
+
+/********************************************************************************
+  Publish the profiler summary. Job of networkScheduler: runs every UpdateInterval_Diagnostics (networkTask, core 0)
+  section: [calls, average us, p99 us, max us]
+  http endpoint: [calls, failures, bytes, average ms]
+  heap: [free, low-water, fragmentation %]
+  stall: [section, duration ms, seconds ago]
+********************************************************************************/
+void send_Diagnostics() {
+  uint32_t window_ms = millis() - previousUpdateTime_Diagnostics;
+  previousUpdateTime_Diagnostics = millis();
+
+  if (!WiFiMQTTclient.isMqttConnected()) {
+    return;
+  }
+
+  uint32_t freeHeap = ESP.getFreeHeap();
+  uint32_t largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  uint32_t fragmentation = freeHeap ? 100 - (uint64_t) largestBlock * 100 / freeHeap : 0;
+
+  //a section that still has its reset pending was not called in this window
+  uint32_t calls[PROFILE_CALIBRATION];
+  uint32_t profiledCalls = 0;
+  for (int i = 0; i < PROFILE_CALIBRATION; i++) {
+    calls[i] = profileSections[i].histogram.resetRequested ? 0 : profileSections[i].calls;
+    profiledCalls += calls[i];
+  }
+
+  //overhead of the profiler in this window, in per mille of the elapsed time
+  float overhead = (float) profiledCalls * profileCostCycles / profileCyclesPerMicrosecond / window_ms;
+
+  static char packet[DIAGNOSTICS_PACKET_SIZE];      //large enough for every field at its maximum width
+  int length = snprintf(packet, sizeof(packet), "{\"up\":%lu,\"heap\":[%lu,%lu,%lu],\"ovh\":%.1f,\"sec\":{",
+                        millis() / 1000,
+                        (unsigned long) freeHeap,
+                        (unsigned long) ESP.getMinFreeHeap(),
+                        (unsigned long) fragmentation,
+                        overhead);
+
+  for (int i = 0; i < PROFILE_CALIBRATION; i++) {
+    struct profileSection &profile = profileSections[i];
+    length += snprintf(&packet[length], sizeof(packet) - length, "%s\"%s\":[%lu,%lu,%lu,%lu]",
+                       (i == 0) ? "" : ",",
+                       profileSectionNames[i],
+                       (unsigned long) calls[i],
+                       (unsigned long) (calls[i] ? profile.total_us / calls[i] : 0),
+                       (unsigned long) (calls[i] ? latencyPercentile(profile.histogram, 99) : 0),
+                       (unsigned long) (calls[i] ? profile.histogram.max_us : 0));
+    profile.histogram.resetRequested = true;          //done by the task that owns the section (see profileEnd())
+  }
+
+  length += snprintf(&packet[length], sizeof(packet) - length, "},\"http\":{");
+  for (int i = 0; i < HTTP_ENDPOINTS; i++) {
+    const struct profileEndpoint &profile = profileEndpoints[i];
+    length += snprintf(&packet[length], sizeof(packet) - length, "%s\"%s\":[%lu,%lu,%lu,%lu]",
+                       (i == 0) ? "" : ",",
+                       httpEndpointNames[i],
+                       (unsigned long) profile.calls,
+                       (unsigned long) profile.failures,
+                       (unsigned long) profile.bytes,
+                       (unsigned long) (profile.calls ? profile.total_ms / profile.calls : 0));
+  }
+
+  portENTER_CRITICAL(&profileStallMux);
+  struct profileStall stalls = profileStalls;
+  portEXIT_CRITICAL(&profileStallMux);
+  length += snprintf(&packet[length], sizeof(packet) - length, "},\"stalls\":%lu", (unsigned long) stalls.count);
+  if (stalls.count > 0) {
+    length += snprintf(&packet[length], sizeof(packet) - length, ",\"stall\":[\"%s\",%lu,%lu]",
+                       profileSectionNames[stalls.section],
+                       (unsigned long) stalls.duration_ms,
+                       (unsigned long) ((millis() - stalls.time_ms) / 1000));
+  }
+  length += snprintf(&packet[length], sizeof(packet) - length, "}");
+
+  if (length >= (int) sizeof(packet)) {
+    Serial.println("Diagnostics packet is too large");
+    return;
+  }
+  Serial.print("Sending diagnostics: ");
+  Serial.println(packet);
+  WiFiMQTTclient.publish(MQTT_Diagnostics_Topic, packet);
+}
@@ -4,9 +4,11 @@
 
 /********************************************************************************
   This routine will display a large QRcode on a 240x320 TFT display
+  The QRcode must already be encoded in the qrcode object (see encodeNextSessionQRcode())
 ********************************************************************************/
-void displayQRcode(char *const QRcodeText) {
+void displayQRcode() {
 
+  displayLock();
   clearMainScreen();
   tft.setFont(&FreeSansBold18pt7b);
   tft.setTextColor(ArkRed);
@@ -15,12 +17,6 @@ void displayQRcode(char *const QRcodeText) {
   tft.setFont(&FreeSans9pt7b);
   tft.setTextColor(WHITE);
 
-  // Allocate memory to store the QR code.
-  // memory size depends on version number
-  uint8_t qrcodeData[qrcode_getBufferSize(QRcode_Version)];
-
-  qrcode_initText(&qrcode, qrcodeData, QRcode_Version, QRcode_ECC, QRcodeText);
-
   // Draw white background with a few pixels of guard around the code
   tft.fillRoundRect(27, 77 - 30, 186, 186, 4, WHITE); 
 
@@ -29,36 +25,40 @@ void displayQRcode(char *const QRcodeText) {
   uint8_t y0 =  85 - 30; 
  
   // display QRcode
-  for (uint8_t y = 0; y < qrcode.size; y++) {
-    for (uint8_t x = 0; x < qrcode.size; x++) {
-
-      if (qrcode_getModule(&qrcode, x, y) == 0) {     //change to == 1 to make QR code with black background
-        //  we started by setting all background pixels to white so we don't need to clear them again.
-        //     tft.drawPixel(x0 + 3 * x,     y0 + 3 * y, TFT_WHITE);
-        //     tft.drawPixel(x0 + 3 * x + 1, y0 + 3 * y, TFT_WHITE);
-        //     tft.drawPixel(x0 + 3 * x + 2, y0 + 3 * y, TFT_WHITE);
-
-        //     tft.drawPixel(x0 + 3 * x,     y0 + 3 * y + 1, TFT_WHITE);
-        //     tft.drawPixel(x0 + 3 * x + 1, y0 + 3 * y + 1, TFT_WHITE);
-        //     tft.drawPixel(x0 + 3 * x + 2, y0 + 3 * y + 1, TFT_WHITE);
-
-        //     tft.drawPixel(x0 + 3 * x,     y0 + 3 * y + 2, TFT_WHITE);
-        //     tft.drawPixel(x0 + 3 * x + 1, y0 + 3 * y + 2, TFT_WHITE);
-        //     tft.drawPixel(x0 + 3 * x + 2, y0 + 3 * y + 2, TFT_WHITE);
+  drawQRcodeModules(x0, y0);
+  displayUnlock();
+}
 
-      } else {
-        tft.drawPixel(x0 + 3 * x,     y0 + 3 * y, QRCODE_DARK_PIXEL_COLOR);
-        tft.drawPixel(x0 + 3 * x + 1, y0 + 3 * y, QRCODE_DARK_PIXEL_COLOR);
-        tft.drawPixel(x0 + 3 * x + 2, y0 + 3 * y, QRCODE_DARK_PIXEL_COLOR);
 
-        tft.drawPixel(x0 + 3 * x,     y0 + 3 * y + 1, QRCODE_DARK_PIXEL_COLOR);
-        tft.drawPixel(x0 + 3 * x + 1, y0 + 3 * y + 1, QRCODE_DARK_PIXEL_COLOR);
-        tft.drawPixel(x0 + 3 * x + 2, y0 + 3 * y + 1, QRCODE_DARK_PIXEL_COLOR);
+/********************************************************************************
+  Draws the modules of the QRcode stored in the qrcode object. Each module is 3x3 pixels.
+  The whole code is pushed through one address window on the display:
+  each row of modules is expanded into a line buffer of pixels which is written 3 times (once for each pixel row).
+  The line buffer is static and sized for QRcode_Version so it is not on the stack of loop().
+  Light modules are written in white so the background does not need to be cleared first.
+********************************************************************************/
+void drawQRcodeModules(int16_t x0, int16_t y0) {
+  const uint8_t scale = 3;
+  static uint16_t line[(4 * QRcode_Version + 17) * scale];     //one row of pixels of the largest QRcode (QRcode_Version)
+  const uint16_t lineLength = qrcode.size * scale;
+  if (lineLength > (sizeof(line) / sizeof(line[0]))) {
+    return;
+  }
 
-        tft.drawPixel(x0 + 3 * x,     y0 + 3 * y + 2, QRCODE_DARK_PIXEL_COLOR);
-        tft.drawPixel(x0 + 3 * x + 1, y0 + 3 * y + 2, QRCODE_DARK_PIXEL_COLOR);
-        tft.drawPixel(x0 + 3 * x + 2, y0 + 3 * y + 2, QRCODE_DARK_PIXEL_COLOR);
-      }
+  tft.startWrite();
+  tft.setAddrWindow(x0, y0, lineLength, lineLength);
+  for (uint8_t y = 0; y < qrcode.size; y++) {
+    uint16_t *pixel = line;
+    for (uint8_t x = 0; x < qrcode.size; x++) {
+      //change to == 0 to make QR code with dark background
+      uint16_t color = qrcode_getModule(&qrcode, x, y) ? QRCODE_DARK_PIXEL_COLOR : WHITE;
+      *pixel++ = color;
+      *pixel++ = color;
+      *pixel++ = color;
+    }
+    for (uint8_t row = 0; row < scale; row++) {
+      tft.writePixels(line, lineLength);
     }
   }
+  tft.endWrite();
 }
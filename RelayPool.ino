@@ -0,0 +1,191 @@
+/********************************************************************************
+  This file contains the Ark relay pool
+
+  The relays are configured in secrets.h (ARK_RELAY_HOSTS, ARK_RELAY_PORTS). For each relay the pool keeps:
+    - a keep-alive connection (see ArkStream.ino)
+    - synced: the result of the last node/status health check (JOB_RELAY_HEALTH checks one relay per run, in turn, so
+      each relay is checked every UpdateInterval_RelayHealth)
+    - failures: consecutive requests that failed
+    - latency_ms: an EWMA of the time from sending a request to its response head (weight ARK_RELAY_EWMA_ALPHA)
+    - connect_ms: an EWMA of the TCP handshake time. It limits the time spent skipping the rest of a response (see arkEnd())
+  A relay is usable when it is synced and has failed less than ARK_RELAY_MAX_FAILURES times in a row.
+  Requests go to the usable relay with the lowest latency. If no relay is usable the others are still tried, fastest first.
+  A successful request or health check makes a relay usable again.
+
+  ARK_status is true when at least one relay is synced. It is checked again by every health check, so a scooter whose
+  relay was unsynced at boot becomes available once any relay of the pool is synced.
+  All the requests are made by networkTask (core 0) so the pool is not locked.
+********************************************************************************/
+
+
+/********************************************************************************
+  Load the relays from secrets.h (setup())
+********************************************************************************/
+void initRelayPool() {
+  for (int i = 0; i < ARK_RELAY_COUNT; i++) {
+    struct arkRelayState &r = arkRelays[i];
+    r.host = ARK_RELAY_HOSTS[i];
+    r.port = ARK_RELAY_PORTS[i];
+    r.keepAlive = false;
+    r.synced = false;
+    r.failures = 0;
+    r.latency_ms = 0;
+    r.connect_ms = 0;
+    r.requests = 0;
+    r.errors = 0;
+    r.hedgeWins = 0;
+  }
+}
+
+
+/********************************************************************************
+  = true when a relay is synced and has not failed ARK_RELAY_MAX_FAILURES times in a row
+********************************************************************************/
+bool arkRelayUsable(int relay) {
+  return arkRelays[relay].synced && (arkRelays[relay].failures < ARK_RELAY_MAX_FAILURES);
+}
+
+
+/********************************************************************************
+  Order the relays: usable relays first, then by latency (lowest first). A relay that has not been timed yet comes first
+  within its group so it gets measured.
+  order -> ARK_RELAY_COUNT relay numbers. Returns ARK_RELAY_COUNT
+********************************************************************************/
+int arkRankRelays(int *order) {
+  for (int i = 0; i < ARK_RELAY_COUNT; i++) {
+    int relay = i;
+    int j = i;
+    //insertion sort. There are only a few relays
+    while (j > 0) {
+      int previous = order[j - 1];
+      bool usable = arkRelayUsable(relay);
+      bool previousUsable = arkRelayUsable(previous);
+      if ((previousUsable && !usable) ||
+          ((previousUsable == usable) && (arkRelays[previous].latency_ms <= arkRelays[relay].latency_ms))) {
+        break;
+      }
+      order[j] = previous;
+      j--;
+    }
+    order[j] = relay;
+  }
+  return ARK_RELAY_COUNT;
+}
+
+
+/********************************************************************************
+  Best relay for the next request
+  exclude -> relay that must not be returned (-1 = none)
+  Returns -1 if there is no other relay
+********************************************************************************/
+int arkSelectRelay(int exclude) {
+  int order[ARK_RELAY_COUNT];
+  arkRankRelays(order);
+  for (int i = 0; i < ARK_RELAY_COUNT; i++) {
+    if (order[i] != exclude) {
+      return order[i];
+    }
+  }
+  return -1;
+}
+
+
+/********************************************************************************
+  Record the result of a request to a relay
+  latency_ms -> time from sending the request to its response head (only used if ok = true)
+********************************************************************************/
+void arkRelayResult(int relay, bool ok, uint32_t latency_ms) {
+  struct arkRelayState &r = arkRelays[relay];
+  if (!ok) {
+    r.errors++;
+    if (r.failures < 255) {
+      r.failures++;
+    }
+    return;
+  }
+  r.failures = 0;
+  arkRelayLatency(relay, latency_ms);
+}
+
+
+/********************************************************************************
+  Add a latency sample to the average of a relay without counting a result, e.g. the lower bound of the relay that
+  lost a hedged read (its response was not read so it is not known whether the request succeeded)
+********************************************************************************/
+void arkRelayLatency(int relay, uint32_t latency_ms) {
+  struct arkRelayState &r = arkRelays[relay];
+  if (r.latency_ms == 0) {
+    r.latency_ms = latency_ms;
+  }
+  else {
+    r.latency_ms += ARK_RELAY_EWMA_ALPHA * ((float) latency_ms - r.latency_ms);
+  }
+}
+
+
+/********************************************************************************
+  Close the connection to a relay. (a response that is not read, or a failed request)
+********************************************************************************/
+void arkDropConnection(int relay) {
+  arkRelays[relay].client.stop();
+  arkRelays[relay].keepAlive = false;
+}
+
+
+/********************************************************************************
+  Time after which a read of received transactions is also sent to a second relay.
+  This is the ARK_HEDGE_PERCENTILE of the previous reads so about 1 read in 20 is hedged.
+********************************************************************************/
+uint32_t arkHedgeBudget_ms() {
+  if (arkReceivedLatency.samples < ARK_HEDGE_MIN_SAMPLES) {
+    return ARK_HEDGE_DEFAULT_MS;
+  }
+  uint32_t budget_ms = latencyPercentile(arkReceivedLatency, ARK_HEDGE_PERCENTILE) / 1000;
+  return min(max(budget_ms, ARK_HEDGE_MIN_MS), ARK_HTTP_TIMEOUT_MS);
+}
+
+
+/********************************************************************************
+  Check the health and sync state of the next relays in turn, starting after the relay that was checked last.
+  The health check job checks one relay per run so an unreachable relay blocks the network task for one timeout only.
+  count -> number of relays to check (ARK_RELAY_COUNT = all of them)
+  Returns true if at least one relay of the pool is synced.
+********************************************************************************/
+bool checkArkRelays(int count) {
+  for (int i = 0; i < min(count, ARK_RELAY_COUNT); i++) {
+    checkArkNodeStatus(arkHealthNextRelay);
+    arkHealthNextRelay = (arkHealthNextRelay + 1) % ARK_RELAY_COUNT;
+  }
+  for (int relay = 0; relay < ARK_RELAY_COUNT; relay++) {
+    if (arkRelays[relay].synced) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/********************************************************************************
+  Print the state of the relays. (end of a rental cycle)
+********************************************************************************/
+void printRelayPoolStats() {
+  for (int relay = 0; relay < ARK_RELAY_COUNT; relay++) {
+    struct arkRelayState &r = arkRelays[relay];
+    Serial.print("Relay ");
+    Serial.print(r.host);
+    Serial.print(":");
+    Serial.print(r.port);
+    Serial.print("  synced: ");
+    Serial.print(r.synced ? "yes" : "no");
+    Serial.print("  latency(ms): ");
+    Serial.print(r.latency_ms, 0);
+    Serial.print("  requests: ");
+    Serial.print(r.requests);
+    Serial.print("  errors: ");
+    Serial.print(r.errors);
+    Serial.print("  hedges won: ");
+    Serial.println(r.hedgeWins);
+  }
+  Serial.print("Hedge budget(ms): ");
+  Serial.println(arkHedgeBudget_ms());
+}
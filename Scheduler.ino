@@ -0,0 +1,309 @@
+/********************************************************************************
+  This file contains the cooperative job scheduler
+
+  The periodic work of each task is registered as jobs instead of each function checking millis() on every pass:
+    loopScheduler    (loop(), core 1): battery, RSSI, GPS data and clock on the status bar, telemetry samples
+    networkScheduler (networkTask, core 0): MQTT publish, outbox, ride track, rental start search, journal, relay health, diagnostics,
+                                            next rental session
+  schedulerRun() is called once per pass of the task. It only runs the jobs that are due and returns how long
+  the task can sleep until the next one.
+
+  The jobs are kept in a hierarchical timer wheel of SCHEDULER_LEVELS levels with SCHEDULER_WHEEL_SLOTS slots each.
+  Level 0 has one slot per tick (SCHEDULER_TICK_MS), level 1 one slot per 64 ticks and level 2 one slot per 4096 ticks.
+  A job is placed in the lowest level that reaches its deadline. When level 0 wraps, the next slot of level 1 is
+  moved down (cascade), and so on. Adding, removing and expiring a job does not depend on the number of jobs.
+
+  Each job has:
+    period_ms    0 = one-shot. A one-shot job is started again with schedulerStart()
+    jitter_ms    a random delay of up to jitter_ms is added to every run so jobs with the same period do not run in the same pass
+    deadline_ms  a run that starts more than deadline_ms after it was due is counted as an overrun. 0 = no deadline
+  Overdue jobs are coalesced: after a stall a periodic job runs once and the periods it missed are counted and
+  skipped, instead of running once per missed period.
+  Run counts, coalesced periods, overruns, the largest delay and the longest run are printed with printSchedulerStats().
+  Each scheduler must only be used from its own task.
+********************************************************************************/
+
+
+/********************************************************************************
+  Register and start the jobs of loop() and networkTask(). (setup(), before the tasks are started)
+  JOB_RIDE_TRACK is started by startRideTrack() and stopped by finishRideTrack().
+  JOB_NEXT_SESSION is a one-shot job started when a ride starts.
+********************************************************************************/
+void initSchedulers() {
+  initScheduler(loopScheduler, loopJobs, LOOP_JOBS);
+  //                           job                   name         run                   period_ms                        jitter_ms  deadline_ms  profile
+  schedulerAdd(loopScheduler,  JOB_BATTERY,          "battery",   UpdateBatteryStatus,  UpdateInterval_Battery,          250,       1000,        -1);
+  schedulerAdd(loopScheduler,  JOB_RSSI,             "rssi",      UpdateRSSIStatus,     UpdateInterval_RSSI,             250,       1000,        -1);
+  schedulerAdd(loopScheduler,  JOB_GPS_DATA,         "gps",       UpdateGPSDataStatus,  UpdateInterval_GPS,              250,       1000,        -1);
+  schedulerAdd(loopScheduler,  JOB_CLOCK,            "clock",     UpdateDisplayTime,    0,                               0,         1000,        -1);
+#ifdef ENABLE_MQTT_BATCH_TELEMETRY
+  schedulerAdd(loopScheduler,  JOB_TELEMETRY_SAMPLE, "sample",    sampleTelemetry,      UpdateInterval_Telemetry_Sample, 0,         500,         -1);
+#endif
+
+  initScheduler(networkScheduler, networkJobs, NETWORK_JOBS);
+#if defined(ENABLE_MQTT_BATCH_TELEMETRY)
+  //the batches replace the packets on MQTT_Base_Topic. They are published by the network task (see send_MQTTbatch())
+#elif defined(ENABLE_ADAPTIVE_TELEMETRY)
+  schedulerAdd(networkScheduler, JOB_PUBLISH,        "publish",   send_MQTTpacket,      UpdateInterval_Telemetry_Schedule, 0,       1000,        PROFILE_PUBLISH);
+#else
+  schedulerAdd(networkScheduler, JOB_PUBLISH,        "publish",   send_MQTTpacket,      UpdateInterval_MQTT_Publish,     0,         2000,        PROFILE_PUBLISH);
+#endif
+  schedulerAdd(networkScheduler, JOB_OUTBOX_DRAIN,   "outbox",    drainOutbox,          UpdateInterval_Outbox_Drain,     500,       5000,        PROFILE_OUTBOX);
+  schedulerAdd(networkScheduler, JOB_RIDE_TRACK,     "track",     recordRideTrack,      UpdateInterval_RideTrack,        0,         500,         -1);
+  schedulerAdd(networkScheduler, JOB_RENTAL_SEARCH,  "search",    dueRentalSearch,      UpdateInterval_RentalStartSearch, 0,        2000,        -1);
+  schedulerAdd(networkScheduler, JOB_JOURNAL,        "journal",   updateJournal,        UpdateInterval_Journal,          0,         2000,        -1);
+  schedulerAdd(networkScheduler, JOB_RELAY_HEALTH,   "relays",    UpdateArkNodeConnectionStatus, UpdateInterval_RelayHealth / ARK_RELAY_COUNT, 1000, 5000, -1);
+  schedulerAdd(networkScheduler, JOB_NEXT_SESSION,   "session",   prepareNextSession,   0,                               0,         0,           -1);
+#ifdef ENABLE_DIAGNOSTICS
+  schedulerAdd(networkScheduler, JOB_DIAGNOSTICS,    "diag",      send_Diagnostics,     UpdateInterval_Diagnostics,      1000,      5000,        -1);
+#endif
+
+  //the jobs of features that are disabled are not registered and are not started
+  for (int job = 0; job < LOOP_JOBS; job++) {
+    schedulerStart(loopScheduler, job, loopJobs[job].period_ms);
+  }
+  schedulerStart(loopScheduler, JOB_CLOCK, 0);
+  for (int job = 0; job < NETWORK_JOBS; job++) {
+    if ((job != JOB_RIDE_TRACK) && (job != JOB_NEXT_SESSION)) {
+      schedulerStart(networkScheduler, job, networkJobs[job].period_ms);
+    }
+  }
+}
+
+
+/********************************************************************************
+  Convert milliseconds into ticks (rounded up)
+********************************************************************************/
+uint32_t schedulerTicks(uint32_t ms) {
+  return (ms + SCHEDULER_TICK_MS - 1) / SCHEDULER_TICK_MS;
+}
+
+
+/********************************************************************************
+  Prepare an empty scheduler for the jobs in 'jobs'. (setup())
+********************************************************************************/
+void initScheduler(struct scheduler &s, struct schedulerJob *jobs, int jobCount) {
+  s.jobs = jobs;
+  s.jobCount = jobCount;
+  s.tick = 0;
+  s.tick_ms = millis();
+  memset(s.wheel, -1, sizeof(s.wheel));
+  for (int i = 0; i < jobCount; i++) {
+    jobs[i].armed = false;
+    jobs[i].next = -1;
+  }
+}
+
+
+/********************************************************************************
+  Register a job. It does not run until it is started with schedulerStart().
+  profileSection -> the job is timed by the profiler in this section (see Profiler.ino). -1 = not profiled
+********************************************************************************/
+void schedulerAdd(struct scheduler &s, int job, const char *const name, void (*run)(), uint32_t period_ms, uint32_t jitter_ms, uint32_t deadline_ms, int profileSection) {
+  struct schedulerJob &j = s.jobs[job];
+  j.name = name;
+  j.run = run;
+  j.period_ms = period_ms;
+  j.jitter_ms = jitter_ms;
+  j.deadline_ms = deadline_ms;
+  j.profileSection = profileSection;
+}
+
+
+/********************************************************************************
+  Put an armed job in the wheel slot of its deadline.
+  minDelta = 0 while cascading (the slot of the current tick has not been run yet), otherwise 1.
+********************************************************************************/
+void schedulerInsert(struct scheduler &s, int job, int32_t minDelta) {
+  struct schedulerJob &j = s.jobs[job];
+  int32_t delta = j.due - s.tick;
+  if (delta < minDelta) {
+    delta = minDelta;                     //overdue. Run on the next tick
+  }
+  if (delta >= (1 << (SCHEDULER_WHEEL_BITS * SCHEDULER_LEVELS))) {
+    delta = (1 << (SCHEDULER_WHEEL_BITS * SCHEDULER_LEVELS)) - 1;    //beyond the last level. Placed again when it is cascaded
+  }
+  uint32_t expires = s.tick + delta;
+
+  int level = 0;
+  while ((level < SCHEDULER_LEVELS - 1) && (delta >= (1 << (SCHEDULER_WHEEL_BITS * (level + 1))))) {
+    level++;
+  }
+  int slot = (expires >> (SCHEDULER_WHEEL_BITS * level)) & (SCHEDULER_WHEEL_SLOTS - 1);
+
+  j.level = level;
+  j.slot = slot;
+  j.next = s.wheel[level][slot];
+  s.wheel[level][slot] = job;
+  j.armed = true;
+}
+
+
+/********************************************************************************
+  Move the jobs of a slot of a higher level down to the lower levels
+********************************************************************************/
+void schedulerCascade(struct scheduler &s, int level, int slot) {
+  int8_t job = s.wheel[level][slot];
+  s.wheel[level][slot] = -1;
+  while (job >= 0) {
+    int8_t next = s.jobs[job].next;
+    schedulerInsert(s, job, 0);
+    job = next;
+  }
+}
+
+
+/********************************************************************************
+  Remove a job from the wheel. Nothing is done if it is not armed.
+********************************************************************************/
+void schedulerStop(struct scheduler &s, int job) {
+  struct schedulerJob &j = s.jobs[job];
+  if (!j.armed) {
+    return;
+  }
+  int8_t *link = &s.wheel[j.level][j.slot];
+  while (*link >= 0) {
+    if (*link == job) {
+      *link = j.next;
+      break;
+    }
+    link = &s.jobs[*link].next;
+  }
+  j.next = -1;
+  j.armed = false;
+}
+
+
+/********************************************************************************
+  (Re)start a job. It runs after delay_ms (plus jitter), then every period_ms if it is periodic.
+********************************************************************************/
+void schedulerStart(struct scheduler &s, int job, uint32_t delay_ms) {
+  struct schedulerJob &j = s.jobs[job];
+  if (j.run == NULL) {
+    return;                               //not registered (feature disabled)
+  }
+  schedulerStop(s, job);
+  j.nominal = s.tick + schedulerTicks(millis() - s.tick_ms + delay_ms);
+  j.due = j.nominal + (j.jitter_ms ? schedulerTicks(esp_random() % (j.jitter_ms + 1)) : 0);
+  schedulerInsert(s, job, 1);
+}
+
+
+/********************************************************************************
+  Change the period of a job. It is used from the next run.
+********************************************************************************/
+void schedulerSetPeriod(struct scheduler &s, int job, uint32_t period_ms) {
+  s.jobs[job].period_ms = period_ms;
+}
+
+
+/********************************************************************************
+  Advance the wheel to the current time and run the jobs that are due. (once per pass of the task)
+  Returns the number of milliseconds until the next job is due. 0xFFFFFFFF if no job is armed.
+********************************************************************************/
+uint32_t schedulerRun(struct scheduler &s) {
+  uint32_t now_ms = millis();
+
+  //advance tick by tick and collect the expired jobs
+  int8_t expired[SCHEDULER_MAX_JOBS];
+  int expiredCount = 0;
+  while (now_ms - s.tick_ms >= SCHEDULER_TICK_MS) {
+    s.tick_ms += SCHEDULER_TICK_MS;
+    s.tick++;
+
+    int slot = s.tick & (SCHEDULER_WHEEL_SLOTS - 1);
+    if (slot == 0) {
+      int slot1 = (s.tick >> SCHEDULER_WHEEL_BITS) & (SCHEDULER_WHEEL_SLOTS - 1);
+      if (slot1 == 0) {
+        schedulerCascade(s, 2, (s.tick >> (2 * SCHEDULER_WHEEL_BITS)) & (SCHEDULER_WHEEL_SLOTS - 1));
+      }
+      schedulerCascade(s, 1, slot1);
+    }
+
+    int8_t job = s.wheel[0][slot];
+    s.wheel[0][slot] = -1;
+    while (job >= 0) {
+      struct schedulerJob &j = s.jobs[job];
+      int8_t next = j.next;
+      j.next = -1;
+      if ((int32_t) (s.tick - j.due) >= 0) {
+        j.armed = false;
+        expired[expiredCount++] = job;
+      }
+      else {
+        schedulerInsert(s, job, 1);        //deadline clamped to the last level
+      }
+      job = next;
+    }
+  }
+
+  //run each expired job once. A job that is overdue by more than one period is coalesced into this run
+  for (int i = 0; i < expiredCount; i++) {
+    struct schedulerJob &j = s.jobs[expired[i]];
+    if (j.armed) {
+      continue;                           //started again by a job that ran before it
+    }
+
+    uint32_t late_ms = (s.tick - j.due) * SCHEDULER_TICK_MS + (now_ms - s.tick_ms);
+    j.maxLate_ms = max(j.maxLate_ms, late_ms);
+    if ((j.deadline_ms > 0) && (late_ms > j.deadline_ms)) {
+      j.overruns++;
+    }
+
+    uint32_t start_us = micros();
+    uint32_t start = (j.profileSection >= 0) ? profileStart(j.profileSection) : 0;
+    j.run();
+    if (j.profileSection >= 0) {
+      profileEnd(j.profileSection, start);
+    }
+    j.maxRun_us = max(j.maxRun_us, (uint32_t) (micros() - start_us));
+    j.runs++;
+
+    if ((j.period_ms > 0) && !j.armed) {
+      uint32_t period = schedulerTicks(j.period_ms);
+      j.nominal += period;
+      if ((int32_t) (s.tick - j.nominal) >= 0) {
+        j.coalesced += (s.tick - j.nominal) / period + 1;     //missed periods
+        j.nominal = s.tick + period;
+      }
+      j.due = j.nominal + (j.jitter_ms ? schedulerTicks(esp_random() % (j.jitter_ms + 1)) : 0);
+      schedulerInsert(s, expired[i], 1);
+    }
+  }
+
+  //time until the next deadline
+  uint32_t sleep_ms = 0xFFFFFFFF;
+  uint32_t elapsed_ms = millis() - s.tick_ms;
+  for (int i = 0; i < s.jobCount; i++) {
+    if (s.jobs[i].armed) {
+      int32_t due_ms = (int32_t) (s.jobs[i].due - s.tick) * SCHEDULER_TICK_MS - elapsed_ms;
+      sleep_ms = min(sleep_ms, (uint32_t) max(due_ms, (int32_t) 0));
+    }
+  }
+  return sleep_ms;
+}
+
+
+/********************************************************************************
+  Print the statistics of each job. (end of a rental cycle)
+********************************************************************************/
+void printSchedulerStats(const struct scheduler &s) {
+  for (int i = 0; i < s.jobCount; i++) {
+    const struct schedulerJob &j = s.jobs[i];
+    if (j.run == NULL) {
+      continue;
+    }
+    Serial.print("Job ");
+    Serial.print(j.name);
+    Serial.print("  runs: ");
+    Serial.print(j.runs);
+    Serial.print("  coalesced: ");
+    Serial.print(j.coalesced);
+    Serial.print("  overruns: ");
+    Serial.print(j.overruns);
+    Serial.print("  max late(ms): ");
+    Serial.print(j.maxLate_ms);
+    Serial.print("  max run(us): ");
+    Serial.println(j.maxRun_us);
+  }
+}
@@ -0,0 +1,378 @@
+/********************************************************************************
+  This file contains the batched MQTT telemetry (ENABLE_MQTT_BATCH_TELEMETRY)
+
+  loop() takes a telemetry sample every UpdateInterval_Telemetry_Sample. When TELEMETRY_BATCH_SIZE samples
+  have been collected the batch is queued for the network task which signs and publishes it on MQTT_Batch_Topic.
+
+  Each sample is published as a line of text. The leaves of a Merkle tree are the SHA256 hash of each line and
+  the 32 byte root is signed once with the wallet's private key. This replaces one ECDSA signature per packet
+  with one per batch while the backend can still verify any single sample:
+    1. hash the sample text: leaf = SHA256(0x00 || text)
+    2. combine it with the sibling hashes up to the root: node = SHA256(0x01 || left || right). The last node of a
+       level with an odd number of nodes has no sibling and is carried up unchanged.
+    3. verify the signature of the root (hex) against the scooter's public key. (tools/verify_telemetry_batch.py)
+  The prefixes keep a leaf from being passed off as a node, and because an odd node is not paired with itself a batch
+  with its last sample repeated does not have the same root (CVE-2012-2459).
+
+  sample text: time,lat,lon,speed,fix,sat,bat,status
+    time -> unix time (seconds)
+    lat/lon -> microdegrees
+    speed -> hundredths of a kph
+    status -> first letter of the rental status (A)vailable, (R)ented, (B)roken
+
+  example: {"root":"6e3f...","sig":"3044...","s":["1589222400,53538493,-113275896,74,1,5,96,R","1589222401,53538494,-113275897,80,1,5,96,R"]}
+
+  The batches replace the periodic packets on MQTT_Base_Topic: JOB_PUBLISH is not registered (see initSchedulers()).
+  The Node-RED flow must read MQTT_Batch_Topic, or the feature is left off (the default).
+  A batch that is full while MQTT is disconnected is stored in the outbox and published on MQTT_Backlog_Topic later.
+********************************************************************************/
+
+
+/********************************************************************************
+  Add a sample to the current batch. Job of loopScheduler: runs every UpdateInterval_Telemetry_Sample (loop(), core 1)
+  The sample is taken from the same data as build_MQTTpacket(). NodeRedMQTTpacket belongs to the network task
+  so it is not used here.
+********************************************************************************/
+void sampleTelemetry() {
+  struct gpsFix fix;
+  getGPSfix(fix);
+
+  struct telemetrySample &sample = telemetryBatch.samples[telemetryBatch.count];
+  sample.time = time(nullptr);
+  sample.fix = fix.fix;
+  if (fix.fix) {
+    sample.satellites = fix.satellites;
+    sample.speed = (uint16_t) (fix.speedKnots * 185.2 + 0.5);      //convert knots to hundredths of a kph
+    sample.latitude = fix.latitude;
+    sample.longitude = fix.longitude;
+  }
+  else {
+    sample.satellites = 0;
+    sample.speed = 0;
+    sample.latitude = DEFAULT_LATITUDE;
+    sample.longitude = DEFAULT_LONGITUDE;
+  }
+  struct rideSnapshot ride;
+  getRideSnapshot(ride);              //scooterRental belongs to the network task
+  sample.battery = batteryPercent;
+  sample.status = ride.rentalStatus;
+
+  telemetryBatch.count++;
+  if (telemetryBatch.count < TELEMETRY_BATCH_SIZE) {
+    return;
+  }
+
+  //hand the batch to the network task. If it has fallen behind the batch is dropped
+  if (xQueueSend(telemetryBatchQueue, &telemetryBatch, 0) != pdTRUE) {
+    telemetryBatchesDropped++;
+  }
+  telemetryBatch.count = 0;
+}
+
+
+/********************************************************************************
+  Write the text of a sample. This exact text is hashed for the Merkle tree and published.
+  Returns the length of the text.
+********************************************************************************/
+int formatTelemetrySample(const struct telemetrySample &sample, char *text, size_t size) {
+  return snprintf(text, size, "%lu,%ld,%ld,%u,%u,%u,%u,%c",
+                  (unsigned long) sample.time,
+                  (long) sample.latitude,
+                  (long) sample.longitude,
+                  sample.speed,
+                  sample.fix,
+                  sample.satellites,
+                  sample.battery,
+                  sample.status);
+}
+
+
+/********************************************************************************
+  Calculate the Merkle root of the samples in a batch.
+  leaf = SHA256(0x00 || sample text), node = SHA256(0x01 || left || right).
+  If a level has an odd number of nodes the last node is carried up to the next level unchanged.
+********************************************************************************/
+void telemetryMerkleRoot(const struct telemetryBatchBuffer &batch, uint8_t root[32]) {
+  uint8_t nodes[TELEMETRY_BATCH_SIZE][32];
+  uint8_t leaf[1 + TELEMETRY_SAMPLE_TEXT_SIZE];
+
+  leaf[0] = 0x00;
+  for (int i = 0; i < batch.count; i++) {
+    int length = formatTelemetrySample(batch.samples[i], (char *) &leaf[1], sizeof(leaf) - 1);
+    esp_sha(SHA2_256, leaf, 1 + length, nodes[i]);
+  }
+
+  int count = batch.count;
+  while (count > 1) {
+    uint8_t pair[1 + 64];
+    pair[0] = 0x01;
+    for (int i = 0; i + 1 < count; i += 2) {
+      memcpy(&pair[1], nodes[i], 32);
+      memcpy(&pair[33], nodes[i + 1], 32);
+      esp_sha(SHA2_256, pair, sizeof(pair), nodes[i / 2]);
+    }
+    if (count % 2) {
+      memcpy(nodes[count / 2], nodes[count - 1], 32);     //no sibling: carried up unchanged
+    }
+    count = (count + 1) / 2;
+  }
+  memcpy(root, nodes[0], 32);
+}
+
+
+/********************************************************************************
+  Sign and publish a batch of telemetry samples if one is waiting. (networkTask, core 0)
+  While MQTT is disconnected the batch is appended to the outbox. drainOutbox() publishes it on MQTT_Backlog_Topic.
+********************************************************************************/
+void send_MQTTbatch() {
+  struct telemetryBatchBuffer batch;
+
+  if (xQueueReceive(telemetryBatchQueue, &batch, 0) != pdTRUE) {
+    return;
+  }
+  if (batch.count == 0) {
+    return;
+  }
+  if (!WiFiMQTTclient.isMqttConnected()) {
+    outboxAppend(OUTBOX_TELEMETRY, &batch, sizeof(batch));    //keep the telemetry until MQTT is connected again
+    return;
+  }
+  publishTelemetryBatch(batch, MQTT_Batch_Topic, 0);
+}
+
+
+/********************************************************************************
+  Sign a batch of telemetry samples and publish it on a topic.
+  If id is not 0 it is added to the packet. This is used for the batches sent from the outbox (see Outbox.ino)
+  example: {"root":"6e3f...","sig":"3044...","s":["1589222400,53538493,-113275896,74,1,5,96,R",...]}
+  example: {"id":42,"root":"6e3f...","sig":"3044...","s":["1589222400,53538493,-113275896,74,1,5,96,R",...]}
+  Returns the number of bytes published. 0 if the batch could not be published.
+********************************************************************************/
+int publishTelemetryBatch(const struct telemetryBatchBuffer &batch, const char *const topic, uint32_t id) {
+  uint8_t root[32];
+  char rootHex[64 + 1];
+  telemetryMerkleRoot(batch, root);
+  bytesToHex(root, sizeof(root), rootHex);
+
+  //one signature covers all the samples in the batch
+  Message message;
+  message.sign(rootHex, PASSPHRASE);
+  char signature[144 + 1];
+  bytesToHex(message.signature.data(), message.signature.size(), signature);
+
+  static char packet[TELEMETRY_BATCH_PACKET_SIZE];    //kept off the stack of the network task
+  int length = 0;
+  if (id != 0) {
+    length = snprintf(packet, sizeof(packet), "{\"id\":%lu,", (unsigned long) id);
+  }
+  else {
+    packet[length++] = '{';
+  }
+  length += snprintf(&packet[length], sizeof(packet) - length, "\"root\":\"%s\",\"sig\":\"%s\",\"s\":[", rootHex, signature);
+  for (int i = 0; i < batch.count; i++) {
+    if (length + TELEMETRY_SAMPLE_TEXT_SIZE + 4 > sizeof(packet)) {
+      Serial.println("MQTT batch packet is too large");
+      return 0;
+    }
+    if (i > 0) {
+      packet[length++] = ',';
+    }
+    packet[length++] = '"';
+    length += formatTelemetrySample(batch.samples[i], &packet[length], sizeof(packet) - length);
+    packet[length++] = '"';
+  }
+  length += snprintf(&packet[length], sizeof(packet) - length, "]}");
+
+  Serial.print("Sending MQTT batch. Samples: ");
+  Serial.print(batch.count);
+  Serial.print("  Merkle root: ");
+  Serial.println(rootHex);
+  if (!WiFiMQTTclient.publish(topic, packet)) {
+    return 0;
+  }
+  return length;
+}
+
+
+/********************************************************************************
+  Adaptive telemetry (ENABLE_ADAPTIVE_TELEMETRY)
+
+  Every UpdateInterval_Telemetry_Schedule the network task asks scheduleTelemetry() what to publish.
+  The minimum interval and dead-bands depend on the rental status and the speed:
+    Rented and moving  -> every 2 seconds if the position, speed or battery changed more than the dead-band
+    Rented and stopped -> every 5 seconds if something changed
+    Available / Broken -> every 15 seconds if it moved more than the (larger) parked dead-band
+  A keyframe (the full signed packet on MQTT_Base_Topic) is sent when the rental status, GPS fix or geofence zone changes and at
+  least every keyframe interval so idle scooters still report in.
+  In between, deltas relative to the last keyframe are sent on MQTT_Delta_Topic. Each delta only depends on the keyframe
+  so a lost delta does not corrupt the following ones.
+
+  The deltas are not signed. They are hash chained to the keyframe and the next keyframe signs the head of the chain:
+    h0 = SHA256(signature of the keyframe, hex as published)
+    hn = SHA256(hn-1 || delta text between the braces, without "h")      published in the delta as "h"
+    the next keyframe adds "chain":hn,"deltas":n before it is signed
+  A delta is authentic once the chain from the "h" of the delta before it reaches a signed chain head. A lost delta
+  only loses itself because the following deltas carry the "h" of their predecessor.
+
+  delta example: {"dt":4,"dlat":-153,"dlon":220,"dspd":120,"dbat":0,"h":"9b1c..."}
+    dt -> seconds since the keyframe
+    dlat/dlon -> microdegrees from the keyframe position
+    dspd -> hundredths of a kph from the keyframe speed
+    dbat -> percent from the keyframe battery
+    h -> head of the hash chain including this delta
+********************************************************************************/
+
+
+/********************************************************************************
+  Approximate distance in meters between 2 positions in microdegrees. (equirectangular, fine for short distances)
+********************************************************************************/
+float telemetryDistance(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2) {
+  const float metersPerMicrodegree = 0.111195;
+  float dy = (lat2 - lat1) * metersPerMicrodegree;
+  float dx = (lon2 - lon1) * metersPerMicrodegree * cosf(lat1 * (float) (M_PI / 180e6));
+  return sqrtf(dx * dx + dy * dy);
+}
+
+
+/********************************************************************************
+  Decide what to publish from the values in NodeRedMQTTpacket
+  returns TELEMETRY_SKIP, TELEMETRY_DELTA or TELEMETRY_KEYFRAME
+********************************************************************************/
+int scheduleTelemetry() {
+  struct telemetryPoint &key = telemetrySchedule.keyframe;
+  struct telemetryPoint &last = telemetrySchedule.lastSent;
+  uint32_t now = millis();
+
+  int32_t latitude = NodeRedMQTTpacket.latitude;
+  int32_t longitude = NodeRedMQTTpacket.longitude;
+  int32_t speed = (int32_t) lround(NodeRedMQTTpacket.speedKPH * 100);
+  int battery = NodeRedMQTTpacket.battery;
+
+  //pick the rate and dead-band for the current state
+  bool rented = (strcmp(NodeRedMQTTpacket.status, "Rented") == 0);
+  uint32_t minInterval;
+  uint32_t keyframeInterval;
+  float deadbandMeters;
+  if (rented && (speed >= TELEMETRY_MOVING_SPEED)) {
+    minInterval = TELEMETRY_MOVING_INTERVAL;
+    keyframeInterval = TELEMETRY_RENTED_KEYFRAME_INTERVAL;
+    deadbandMeters = TELEMETRY_RENTED_DEADBAND_METERS;
+  }
+  else if (rented) {
+    minInterval = TELEMETRY_STOPPED_INTERVAL;
+    keyframeInterval = TELEMETRY_RENTED_KEYFRAME_INTERVAL;
+    deadbandMeters = TELEMETRY_RENTED_DEADBAND_METERS;
+  }
+  else {
+    minInterval = TELEMETRY_PARKED_INTERVAL;
+    keyframeInterval = TELEMETRY_PARKED_KEYFRAME_INTERVAL;
+    deadbandMeters = TELEMETRY_PARKED_DEADBAND_METERS;
+  }
+
+  int decision = TELEMETRY_SKIP;
+  if (!telemetrySchedule.started
+      || (strcmp(NodeRedMQTTpacket.status, telemetrySchedule.keyframeStatus) != 0)
+      || (NodeRedMQTTpacket.fix != key.fix)
+      || (NodeRedMQTTpacket.geofence != key.geofence)
+      || (now - key.time_ms >= keyframeInterval)) {
+    decision = TELEMETRY_KEYFRAME;
+  }
+  else if (now - last.time_ms >= minInterval) {
+    if ((telemetryDistance(last.latitude, last.longitude, latitude, longitude) >= deadbandMeters)
+        || (abs(speed - last.speed) >= TELEMETRY_SPEED_DEADBAND)
+        || (abs(battery - last.battery) >= TELEMETRY_BATTERY_DEADBAND)) {
+      decision = TELEMETRY_DELTA;
+    }
+  }
+  if (decision == TELEMETRY_SKIP) {
+    return decision;
+  }
+
+  last.time_ms = now;
+  last.latitude = latitude;
+  last.longitude = longitude;
+  last.speed = speed;
+  last.battery = battery;
+  last.fix = NodeRedMQTTpacket.fix;
+  last.geofence = NodeRedMQTTpacket.geofence;
+  if (decision == TELEMETRY_KEYFRAME) {
+    key = last;
+    telemetrySchedule.keyframeStatus = NodeRedMQTTpacket.status;
+    telemetrySchedule.started = true;
+  }
+  return decision;
+}
+
+
+/********************************************************************************
+  Publish the full signed packet as a keyframe. It signs the head of the chain of the deltas before it (see formatMQTTpacket())
+  and starts a new chain from its signature.
+********************************************************************************/
+void publishTelemetryKeyframe() {
+  int length = publish_MQTTpacket();
+  if (length > 0) {
+    telemetryStats.keyframes++;
+    telemetryStats.keyframeBytes += length;
+    esp_sha(SHA2_256, (const unsigned char *) NodeRedMQTTpacket.signature, strlen(NodeRedMQTTpacket.signature), telemetrySchedule.chain);
+    telemetrySchedule.chainLength = 0;
+  }
+  printTelemetryStats();
+}
+
+
+/********************************************************************************
+  Publish the change from the last keyframe on MQTT_Delta_Topic, chained to the deltas before it
+  example: {"dt":4,"dlat":-153,"dlon":220,"dspd":120,"dbat":0,"h":"9b1c..."}
+********************************************************************************/
+void publishTelemetryDelta() {
+  const struct telemetryPoint &key = telemetrySchedule.keyframe;
+  const struct telemetryPoint &last = telemetrySchedule.lastSent;
+
+  char text[96];
+  int length = snprintf(text, sizeof(text), "\"dt\":%lu,\"dlat\":%ld,\"dlon\":%ld,\"dspd\":%ld,\"dbat\":%d",
+                        (unsigned long) ((last.time_ms - key.time_ms) / 1000),
+                        (long) (last.latitude - key.latitude),
+                        (long) (last.longitude - key.longitude),
+                        (long) (last.speed - key.speed),
+                        last.battery - key.battery);
+
+  //h = SHA256(previous h || delta text)
+  uint8_t link[32 + sizeof(text)];
+  memcpy(link, telemetrySchedule.chain, 32);
+  memcpy(&link[32], text, length);
+  esp_sha(SHA2_256, link, 32 + length, telemetrySchedule.chain);
+  telemetrySchedule.chainLength++;
+
+  char chain[64 + 1];
+  bytesToHex(telemetrySchedule.chain, sizeof(telemetrySchedule.chain), chain);
+  char message[sizeof(text) + 80];
+  length = snprintf(message, sizeof(message), "{%s,\"h\":\"%s\"}", text, chain);
+
+  WiFiMQTTclient.publish(MQTT_Delta_Topic, message);
+  telemetryStats.deltas++;
+  telemetryStats.deltaBytes += length;
+}
+
+
+/********************************************************************************
+  Print the number of telemetry messages and bytes sent compared to publishing a keyframe every UpdateInterval_MQTT_Publish
+********************************************************************************/
+void printTelemetryStats() {
+  uint32_t fixedMessages = millis() / UpdateInterval_MQTT_Publish;
+  uint32_t averageKeyframeBytes = telemetryStats.keyframes ? telemetryStats.keyframeBytes / telemetryStats.keyframes : 0;
+
+  Serial.println("\n=================================");
+  Serial.println("Adaptive telemetry");
+  Serial.print("keyframes: ");
+  Serial.print(telemetryStats.keyframes);
+  Serial.print("  deltas: ");
+  Serial.print(telemetryStats.deltas);
+  Serial.print("  skipped: ");
+  Serial.print(telemetryStats.skipped);
+  Serial.print("  bytes: ");
+  Serial.println(telemetryStats.keyframeBytes + telemetryStats.deltaBytes);
+  Serial.print("fixed interval: ");
+  Serial.print(fixedMessages);
+  Serial.print(" messages  bytes: ");
+  Serial.println(fixedMessages * averageKeyframeBytes);
+}
@@ -0,0 +1,116 @@
+/********************************************************************************
+  This file contains the ride track recorder
+
+  While the scooter is rented (STATE_5) a GPS fix is recorded every UpdateInterval_RideTrack into rideTrack.
+  The track is simplified as the points arrive so it never holds more than RIDE_TRACK_MAX_POINTS points,
+  however long the ride is:
+    1. dead-band: a fix closer than RIDE_TRACK_DEADBAND_METERS to the last kept point is ignored
+    2. when the buffer is full the point whose removal changes the route the least is removed. That is the point
+       with the smallest distance to the line between its neighbours. The first point (rental start) and
+       the newest point are never removed.
+  The RentalFinish transaction carries every point that was kept (see SendTransaction_RentalFinish())
+
+  The removal error is measured against the neighbours at the time of removal. maxError is the largest of these
+  and is printed at the end of the ride together with the compression ratio.
+********************************************************************************/
+
+
+/********************************************************************************
+  Start a new track at the rental start position
+********************************************************************************/
+void startRideTrack(uint32_t timestamp, int32_t latitude, int32_t longitude) {
+  rideTrack.count = 0;
+  rideTrack.received = 0;
+  rideTrack.maxError = 0;
+  addRideTrackPoint(timestamp, latitude, longitude, true);
+  schedulerStart(networkScheduler, JOB_RIDE_TRACK, UpdateInterval_RideTrack);
+}
+
+
+/********************************************************************************
+  Record the current GPS fix. Job of networkScheduler: runs every UpdateInterval_RideTrack from startRideTrack() to finishRideTrack()
+********************************************************************************/
+void recordRideTrack() {
+  struct gpsFix fix;
+  getGPSfix(fix);
+  if (!fix.fix) {
+    return;
+  }
+  addRideTrackPoint(time(nullptr), fix.latitude, fix.longitude, false);
+}
+
+
+/********************************************************************************
+  Add the rental finish position. It is always kept.
+********************************************************************************/
+void finishRideTrack(uint32_t timestamp, int32_t latitude, int32_t longitude) {
+  schedulerStop(networkScheduler, JOB_RIDE_TRACK);
+  addRideTrackPoint(timestamp, latitude, longitude, true);
+
+  Serial.println("\n=================================");
+  Serial.print("Ride track points received: ");
+  Serial.print(rideTrack.received);
+  Serial.print("  kept: ");
+  Serial.print(rideTrack.count);
+  Serial.print("  max error(m): ");
+  Serial.println(rideTrack.maxError, 1);
+}
+
+
+/********************************************************************************
+  Distance in meters from point p to the line segment a-b. (local flat projection, fine for the length of a ride)
+********************************************************************************/
+float rideTrackError(const struct trackPoint &a, const struct trackPoint &p, const struct trackPoint &b) {
+  const float metersPerMicrodegree = 0.111195;
+  float scaleLon = metersPerMicrodegree * cosf(a.latitude * (float) (M_PI / 180e6));
+
+  float bx = (b.longitude - a.longitude) * scaleLon;
+  float by = (b.latitude - a.latitude) * metersPerMicrodegree;
+  float px = (p.longitude - a.longitude) * scaleLon;
+  float py = (p.latitude - a.latitude) * metersPerMicrodegree;
+
+  float lengthSquared = bx * bx + by * by;
+  float t = (lengthSquared > 0) ? (px * bx + py * by) / lengthSquared : 0;
+  t = constrain(t, 0, 1);
+  float dx = px - t * bx;
+  float dy = py - t * by;
+  return sqrtf(dx * dx + dy * dy);
+}
+
+
+/********************************************************************************
+  Add a point to the track and remove the least important point if the track is over budget.
+  force = true skips the dead-band (rental start and finish)
+********************************************************************************/
+void addRideTrackPoint(uint32_t timestamp, int32_t latitude, int32_t longitude, bool force) {
+  rideTrack.received++;
+
+  struct trackPoint point = {timestamp, latitude, longitude};
+  if (!force && (rideTrack.count > 0)) {
+    const struct trackPoint &last = rideTrack.points[rideTrack.count - 1];
+    if (telemetryDistance(last.latitude, last.longitude, latitude, longitude) < RIDE_TRACK_DEADBAND_METERS) {
+      return;
+    }
+  }
+  rideTrack.points[rideTrack.count++] = point;
+
+  if (rideTrack.count <= RIDE_TRACK_MAX_POINTS) {
+    return;
+  }
+
+  //remove the interior point that is closest to the line between its neighbours
+  int smallest = 1;
+  float smallestError = rideTrackError(rideTrack.points[0], rideTrack.points[1], rideTrack.points[2]);
+  for (int i = 2; i < rideTrack.count - 1; i++) {
+    float error = rideTrackError(rideTrack.points[i - 1], rideTrack.points[i], rideTrack.points[i + 1]);
+    if (error < smallestError) {
+      smallestError = error;
+      smallest = i;
+    }
+  }
+  memmove(&rideTrack.points[smallest], &rideTrack.points[smallest + 1], (rideTrack.count - smallest - 1) * sizeof(struct trackPoint));
+  rideTrack.count--;
+  if (smallestError > rideTrack.maxError) {
+    rideTrack.maxError = smallestError;
+  }
+}
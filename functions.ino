@@ -4,45 +4,16 @@
 
 
 /********************************************************************************
-  converts latitude from Adafruit degree-minute format to decimal-degrees
-  https://gis.stackexchange.com/questions/8650/measuring-accuracy-of-latitude-and-longitude/8674#8674
+  Converts an array of bytes into a null terminated string of lowercase hex characters.
+  hex must have room for 2 * length + 1 characters
 ********************************************************************************/
-double convertDegMinToDecDeg_lat (float degMin) {
-  double min = 0.0;
-  double decDeg = 0.0;
-
-  //get the minutes, fmod() requires double
-  min = fmod((double)degMin, 100.0);
-
-  //rebuild coordinates in decimal degrees
-  degMin = (int) ( degMin / 100 );
-  decDeg = degMin + ( min / 60 );
-
-  if ( GPS.lat == 'S') {
-    decDeg = (0 - decDeg);
-  }
-  return decDeg;
-}
-
-/********************************************************************************
-  converts longitude from Adafruit degree-minute format to decimal-degrees
-  https://gis.stackexchange.com/questions/8650/measuring-accuracy-of-latitude-and-longitude/8674#8674
-********************************************************************************/
-double convertDegMinToDecDeg_lon (float degMin) {
-  double min = 0.0;
-  double decDeg = 0.0;
-
-  //get the minutes, fmod() requires double
-  min = fmod((double)degMin, 100.0);
-
-  //rebuild coordinates in decimal degrees
-  degMin = (int) ( degMin / 100 );
-  decDeg = degMin + ( min / 60 );
-
-  if ( GPS.lon == 'W') {
-    decDeg = (0 - decDeg);
+void bytesToHex(const uint8_t *const bytes, size_t length, char *hex) {
+  static const char hexDigits[] = "0123456789abcdef";
+  for (size_t i = 0; i < length; i++) {
+    *hex++ = hexDigits[bytes[i] >> 4];
+    *hex++ = hexDigits[bytes[i] & 0x0F];
   }
-  return decDeg;
+  *hex = '\0';
 }
 
 
@@ -52,11 +23,11 @@ double convertDegMinToDecDeg_lon (float degMin) {
   int battery;
   int fix;
   int satellites;
-  float latitude;
-  float longitude;
+  int32_t latitude;       // microdegrees
+  int32_t longitude;      // microdegrees
   float speedKPH;
   char walletBalance[65];
-  char signature[140];
+  char signature[144 + 1];
 
  ********************************************************************************/
 void build_MQTTpacket() {
@@ -64,22 +35,22 @@ void build_MQTTpacket() {
   strcpy( NodeRedMQTTpacket.walletBalance, bridgechainWallet.walletBalance);
 
   NodeRedMQTTpacket.status = scooterRental.rentalStatus;
+  NodeRedMQTTpacket.geofence = geofence.flags;          //written by loop() (core 1). A single byte so it is read in one access
 
-  NodeRedMQTTpacket.fix = int(GPS.fix);
+  struct gpsFix fix;
+  getGPSfix(fix);
+
+  NodeRedMQTTpacket.fix = int(fix.fix);
   if (NodeRedMQTTpacket.fix) {                          //check to see if there is a GPS lock
-    NodeRedMQTTpacket.satellites = GPS.satellites;      //number of satellites
-    NodeRedMQTTpacket.speedKPH = GPS.speed * 1.852;     //convert knots to kph
-    //we need to do some fomatting of the GPS signal so it is suitable for mapping software on Thingsboard
-     NodeRedMQTTpacket.latitude = 53.53583908;         //default location
-    NodeRedMQTTpacket.longitude = -113.27674103;      //default location
-       
-    NodeRedMQTTpacket.latitude = convertDegMinToDecDeg_lat(GPS.latitude);
-    NodeRedMQTTpacket.longitude = convertDegMinToDecDeg_lon(GPS.longitude);
+    NodeRedMQTTpacket.satellites = fix.satellites;      //number of satellites
+    NodeRedMQTTpacket.speedKPH = fix.speedKnots * 1.852;     //convert knots to kph
+    NodeRedMQTTpacket.latitude = fix.latitude;
+    NodeRedMQTTpacket.longitude = fix.longitude;
   }
   else {        //we do not have a GPS fix. What should the GPS location be?
     //  NodeRedMQTTpacket.status = "Broken";
-    NodeRedMQTTpacket.latitude = 53.53583908;         //default location
-    NodeRedMQTTpacket.longitude = -113.27674103;      //default location
+    NodeRedMQTTpacket.latitude = DEFAULT_LATITUDE;
+    NodeRedMQTTpacket.longitude = DEFAULT_LONGITUDE;
     NodeRedMQTTpacket.satellites = 0;                 //number of satellites
     NodeRedMQTTpacket.speedKPH = 0;                   //speed
   }
@@ -87,73 +58,124 @@ void build_MQTTpacket() {
 
 /********************************************************************************
   send structure to NodeRed MQTT broker
+  The packet is written directly into a fixed buffer with snprintf.
+  The signed message is everything between the leading '{' and the ",\"sig\"" field. This is exactly what the backend verifies.
+  example: {"status":"Rented","fix":1,"lat":53.538493,"lon":-113.275896,"speed":0.74,"sat":5,"bal":99990386752,"bat":96,"sig":"3044..."}
+  With ENABLE_GEOFENCE the GEOFENCE_FLAG_* of the zones the scooter is in are added: ..."bat":96,"zone":2,"sig":...
+  With ENABLE_ADAPTIVE_TELEMETRY a keyframe that follows deltas adds the head of their hash chain: ...,"chain":"9b1c...","deltas":3,"sig":...
+  Define DEBUG_VERIFY_MQTT_SIGNATURE in secrets.h to verify each signature after signing.
+
+  With ENABLE_ADAPTIVE_TELEMETRY the packets are scheduled by scheduleTelemetry() (see Telemetry.ino)
+  Otherwise a packet is published on every run.
+  Job of networkScheduler: runs every UpdateInterval_Telemetry_Schedule (adaptive) or UpdateInterval_MQTT_Publish
 ********************************************************************************/
 void send_MQTTpacket() {
 
-  if (millis() - previousUpdateTime_MQTT_Publish > UpdateInterval_MQTT_Publish)  {
-    previousUpdateTime_MQTT_Publish += UpdateInterval_MQTT_Publish;
-
-    if (WiFiMQTTclient.isMqttConnected()) {
-      build_MQTTpacket();        
-      // example: {"status":"Rented","fix":1,"lat":53.53849358,"lon":-113.27589669,"speed":0.74,"sat":5,"bal":99990386752,"bat":96}
-      String  buf;    //NOTE!  I think sprintf() is better to use here. update when you have a chance
-      buf += F("{");
-      buf += F("\"status\":");
-      buf += F("\"");
-      buf += String(NodeRedMQTTpacket.status);
-      buf += F("\"");
-      buf += F(",\"fix\":");
-      buf += String(NodeRedMQTTpacket.fix);
-      buf += F(",\"lat\":");
-      buf += String(NodeRedMQTTpacket.latitude, 8);    //use 8 decimal point precision.
-      buf += F(",\"lon\":");
-      buf += String(NodeRedMQTTpacket.longitude, 8);
-      buf += F(",\"speed\":");
-      buf += String(NodeRedMQTTpacket.speedKPH);
-      buf += F(",\"sat\":");
-      buf += String(NodeRedMQTTpacket.satellites);
-      buf += F(",\"bal\":");
-      buf += String(NodeRedMQTTpacket.walletBalance);
-      buf += F(",\"bat\":");
-      buf += String(NodeRedMQTTpacket.battery);
-
-      //These are pointers! They are not copying
-      const char * msg = buf.substring(1).c_str();    //get string without leading {
-
-      //alternate method
-      //we need to sign the buffer without the leading and ending {}.
-      // buf substring( 1,buf.length() )      //start index is inclusive. Ending index is exclusive.
-      //const char * msg = buf.substring( 1, buf.length() ).c_str();
-      //     const char * msg = buf.c_str();
-
-      char msgbackup[500 + 1];
-      strcpy(msgbackup, msg);
-
-      //sign the packet using Private Key
-      Message message;
-      message.sign(msg, PASSPHRASE);
-      const auto signatureString = BytesToHex(message.signature);
-
-      buf += F(",\"sig\":");
-      buf += F("\"");
-      buf += signatureString.c_str();   //append the signature
-      buf += F("\"");
-      buf += F("}");
+#ifdef ENABLE_ADAPTIVE_TELEMETRY
+  if (WiFiMQTTclient.isMqttConnected()) {
+    build_MQTTpacket();
+
+    switch (scheduleTelemetry()) {
+      case TELEMETRY_KEYFRAME:
+        publishTelemetryKeyframe();
+        break;
+      case TELEMETRY_DELTA:
+        publishTelemetryDelta();
+        break;
+      default:
+        telemetryStats.skipped++;
+        break;
+    }
+  }
+  else {
+    outboxAddTelemetrySample();     //keep the telemetry until MQTT is connected again
+  }
+#else
+  if (WiFiMQTTclient.isMqttConnected()) {
+    build_MQTTpacket();
+    publish_MQTTpacket();
+  }
+  else {
+    outboxAddTelemetrySample();     //keep the telemetry until MQTT is connected again
+  }
+#endif
+}
 
 
-      Serial.println("\n=================================");
-      Serial.println("Signing MQTT packet");
-      printf("Signature from Signed Message: %s\n", signatureString.c_str());
-      const bool isValid = message.verify();        //verify the signature
-      printf("Message Signature is valid? %s\n", isValid ? "true" : "false");
-      Serial.print("message that was signed: ");
-      Serial.println(msgbackup);
-
-      Serial.print("Sending MQTT packet: ");
-      Serial.println(buf);
-      WiFiMQTTclient.publish(MQTT_Base_Topic, buf.c_str());
-    }
+/********************************************************************************
+  Write NodeRedMQTTpacket into packet without the signature and the closing '}', in one pass and without allocating.
+  Returns the length of the packet. Like snprintf() the length can be >= size if the packet did not fit.
+********************************************************************************/
+int formatMQTTpacket(char *packet, size_t size) {
+  char latitude[COORDINATE_TEXT_SIZE];
+  char longitude[COORDINATE_TEXT_SIZE];
+  formatMicrodegrees(NodeRedMQTTpacket.latitude, latitude, sizeof(latitude));
+  formatMicrodegrees(NodeRedMQTTpacket.longitude, longitude, sizeof(longitude));
+
+  int length = snprintf(packet, size, "{\"status\":\"%s\",\"fix\":%d,\"lat\":%s,\"lon\":%s,\"speed\":%.2f,\"sat\":%d,\"bal\":%s,\"bat\":%d",
+                        NodeRedMQTTpacket.status,
+                        NodeRedMQTTpacket.fix,
+                        latitude,                         //6 decimals (microdegrees)
+                        longitude,
+                        NodeRedMQTTpacket.speedKPH,
+                        NodeRedMQTTpacket.satellites,
+                        NodeRedMQTTpacket.walletBalance,
+                        NodeRedMQTTpacket.battery);
+#ifdef ENABLE_GEOFENCE
+  if ((length > 0) && (length < (int) size)) {
+    length += snprintf(&packet[length], size - length, ",\"zone\":%u", NodeRedMQTTpacket.geofence);
+  }
+#endif
+#ifdef ENABLE_ADAPTIVE_TELEMETRY
+  //a keyframe signs the head of the hash chain of the deltas sent since the previous keyframe (see Telemetry.ino)
+  if ((telemetrySchedule.chainLength > 0) && (length > 0) && (length < (int) size)) {
+    char chain[64 + 1];
+    bytesToHex(telemetrySchedule.chain, sizeof(telemetrySchedule.chain), chain);
+    length += snprintf(&packet[length], size - length, ",\"chain\":\"%s\",\"deltas\":%u", chain, telemetrySchedule.chainLength);
+  }
+#endif
+  return length;
+}
+
+
+/********************************************************************************
+  Sign NodeRedMQTTpacket and publish it on MQTT_Base_Topic
+  Returns the number of bytes published. 0 if the packet could not be published.
+********************************************************************************/
+int publish_MQTTpacket() {
+  char packet[MQTT_PACKET_BUFFER_SIZE];
+  int length = formatMQTTpacket(packet, sizeof(packet));
+
+  //make sure there is room left for the signature
+  if ((length < 0) || (length + sizeof(",\"sig\":\"\"}") + sizeof(NodeRedMQTTpacket.signature) > sizeof(packet))) {
+    Serial.println("MQTT packet is too large");
+    return 0;
   }
+
+  //sign the packet without the leading '{' using Private Key
+  const char *const msg = &packet[1];
+  Message message;
+  message.sign(msg, PASSPHRASE);
+  bytesToHex(message.signature.data(), message.signature.size(), NodeRedMQTTpacket.signature);
+
+  Serial.println("\n=================================");
+  Serial.println("Signing MQTT packet");
+  Serial.print("message that was signed: ");
+  Serial.println(msg);
+  Serial.print("Signature from Signed Message: ");
+  Serial.println(NodeRedMQTTpacket.signature);
+#ifdef DEBUG_VERIFY_MQTT_SIGNATURE
+  const bool isValid = message.verify();        //verify the signature
+  printf("Message Signature is valid? %s\n", isValid ? "true" : "false");
+#endif
+
+  //append the signature
+  snprintf(&packet[length], sizeof(packet) - length, ",\"sig\":\"%s\"}", NodeRedMQTTpacket.signature);
+
+  Serial.print("Sending MQTT packet: ");
+  Serial.println(packet);
+  WiFiMQTTclient.publish(MQTT_Base_Topic, packet);
+  return strlen(packet);
 }
 
 
@@ -161,14 +183,18 @@ void send_MQTTpacket() {
   update the clock on the status bar
   https://github.com/esp8266/Arduino/issues/4749
   http://www.cplusplus.com/reference/ctime/strftime/
+  One-shot job of loopScheduler: it starts itself again at the start of the next minute, or in 1 second if NTP time is not synced yet.
 ********************************************************************************/
 void UpdateDisplayTime() {
   time_t now = time(nullptr);   //get current time
 
-  if (now > 1500000000) {       //this is a check to see if NTP time has been synced. (this is a time equal to approximatly the current time)
+  if (now <= 1500000000) {      //this is a check to see if NTP time has been synced. (this is a time equal to approximatly the current time)
+    schedulerStart(loopScheduler, JOB_CLOCK, 1000);
+  }
+  else {
     struct tm * timeinfo;
-    time(&now);
     timeinfo = localtime(&now);
+    schedulerStart(loopScheduler, JOB_CLOCK, (60 - timeinfo->tm_sec) * 1000);
 
     if ((timeinfo->tm_min) != prevDisplayMinute) { //update the display only if time has changed (updates every minute)
       prevDisplayMinute = timeinfo->tm_min;
@@ -180,29 +206,37 @@ void UpdateDisplayTime() {
       Serial.print("24hr time: ");
       Serial.println(formattedTime);
 
-      tft.setFont(&FreeSans9pt7b);
-      tft.setTextColor(WHITE);
-      tft.fillRect(70 + 13, 283 - 17, 65, 18, BLACK); //clear the previous time
-      tft.setCursor(70 + 13, 283);
-      tft.print(formattedTime);      //dislay the current time
+      setWidgetText(WIDGET_CLOCK, formattedTime);      //dislay the current time
     }
   }
 }
 
 /********************************************************************************
-  Update status bar with ARK node connection status.
+  Query the health and sync state of the next relay of the pool. (network task, JOB_RELAY_HEALTH)
+  ARK_status is true when at least one relay is synced. The status bar is updated by UpdateArkConnectionStatus()
 ********************************************************************************/
 void UpdateArkNodeConnectionStatus() {
-  if (checkArkNodeStatus()) {
-    if (!ARK_status) {
+  if (!WiFi_status) {
+    return;
+  }
+  ARK_status = checkArkRelays(1);
+}
+
+/********************************************************************************
+  Update status bar with ARK node connection status.
+  Display only updates on connection status change
+********************************************************************************/
+void UpdateArkConnectionStatus() {
+  if (ARK_status) {
+    if (!ARK_status_displayed) {
       tft.fillCircle(130, 319 - 6, 6, GREEN); //x,y,radius,color    //ARK Status
-      ARK_status = true;
+      ARK_status_displayed = true;
     }
   }
   else {
-    if (ARK_status) {
+    if (ARK_status_displayed) {
       tft.fillCircle(130, 319 - 6, 6, RED); //x,y,radius,color    //ARK Status
-      ARK_status = false;
+      ARK_status_displayed = false;
     }
   }
 }
@@ -210,19 +244,11 @@ void UpdateArkNodeConnectionStatus() {
 /********************************************************************************
   read the WiFi RSSI and update status bar
   I don't know if the value can actually be measured as actual dBm or just some other relative measurement
+  Job of loopScheduler: runs every UpdateInterval_RSSI
 ********************************************************************************/
 void UpdateRSSIStatus() {
-
-  if (millis() - previousUpdateTime_RSSI > UpdateInterval_RSSI)  {
-    previousUpdateTime_RSSI += UpdateInterval_RSSI;
-    if (WiFiMQTTclient.isWifiConnected()) {
-      long rssi = WiFi.RSSI();
-      tft.fillRect(195, 283 - 18, 40, 20, BLACK);   //clear the last voltage reading
-      tft.setFont(&FreeSans9pt7b);
-      tft.setTextColor(WHITE);
-      tft.setCursor(195, 283);
-      tft.print(rssi);
-    }
+  if (WiFiMQTTclient.isWifiConnected()) {
+    setWidgetNumber(WIDGET_RSSI, WiFi.RSSI(), 0);
   }
 }
 
@@ -230,22 +256,17 @@ void UpdateRSSIStatus() {
 /********************************************************************************
   read the battery voltage and update status bar
   the ESP32 ADC should really be calibrated so these readings are only good for relative measurements.
+  Job of loopScheduler: runs every UpdateInterval_Battery
 ********************************************************************************/
 void UpdateBatteryStatus() {
-  if (millis() - previousUpdateTime_Battery > UpdateInterval_Battery)  {
-    previousUpdateTime_Battery += UpdateInterval_Battery;
-    int battery = analogRead(BAT_PIN);
-    batteryPercent = map(battery, 1945, 2348, 0, 100);
-    batteryPercent = constrain(batteryPercent, 0, 100);
-    // batteryFloat = battery / 620.6; // battery(12 bit reading) / 4096 * 3.3V * 2(there is a resistor divider)
-    float batteryFloat = battery / 559.5; //we needed to add fudge factor to calibrate readings. There must not be a 50% voltage divider on the input.
-    tft.setFont(&FreeSans9pt7b);
-    tft.setTextColor(WHITE);
-    tft.fillRect(190, 301 - 17, 40, 19, BLACK);   //clear the last voltage reading
-    tft.setCursor(190, 301);
-    tft.print(batteryFloat);
-    tft.print("V");
-  }
+  int battery = analogRead(BAT_PIN);
+  batteryPercent = map(battery, 1945, 2348, 0, 100);
+  batteryPercent = constrain(batteryPercent, 0, 100);
+  // batteryFloat = battery / 620.6; // battery(12 bit reading) / 4096 * 3.3V * 2(there is a resistor divider)
+  float batteryFloat = battery / 559.5; //we needed to add fudge factor to calibrate readings. There must not be a 50% voltage divider on the input.
+  char voltage[DISPLAY_WIDGET_TEXT_SIZE];
+  snprintf(voltage, sizeof(voltage), "%.2fV", batteryFloat);
+  setWidgetText(WIDGET_BATTERY, voltage);
 }
 
 
@@ -290,25 +311,21 @@ void UpdateMQTTConnectionStatus() {
 
 /********************************************************************************
   if GPS fix then update display with GPS Speed and GPS Sat
+  Job of loopScheduler: runs every UpdateInterval_GPS
 ********************************************************************************/
 void UpdateGPSDataStatus() {
   if (GPS.fix) {
-    if (millis() - previousUpdateTime_GPS > UpdateInterval_GPS)  {
-      previousUpdateTime_GPS += UpdateInterval_GPS;
-
-      tft.setFont(&FreeSans9pt7b);
-      tft.setTextColor(WHITE);
-      tft.fillRect(190, 319 - 17, 40, 18, ILI9341_BLACK); //clear the last GPS Sat reading
-      tft.setCursor(190, 319);
-      tft.print(GPS.satellites);
+    showGPSDataStatus();
+  }
+}
 
-      tft.fillRect(0, 283 - 17, 35, 18, ILI9341_BLACK);   //clear the last speed reading
-      tft.setCursor(0, 283);
-      float speedkmh = GPS.speed * 1.852;
-      tft.print(speedkmh, 1);
 
-    }
-  }
+/********************************************************************************
+  Show the GPS Sat and GPS Speed on the status bar
+********************************************************************************/
+void showGPSDataStatus() {
+  setWidgetNumber(WIDGET_SATELLITES, GPS.satellites, 0);
+  setWidgetNumber(WIDGET_GPS_SPEED, lroundf(GPS.speed * 18.52), 1);     //km/h with 1 decimal point
 }
 
 
@@ -324,30 +341,15 @@ void UpdateGPSConnectionStatus() {
   if (GPS.fix) {
     if (!GPS_status) {
       tft.fillCircle(50, 319 - 6, 6, GREEN); //x,y,radius,color     //GPS Status
-
-      tft.fillRect(190, 319 - 17, 40, 18, BLACK);   //clear the last # of satellite reading
-      tft.setFont(&FreeSans9pt7b);
-      tft.setTextColor(WHITE);
-      tft.setCursor(190, 319);
-      tft.print(GPS.satellites);
-      tft.fillRect(0, 283 - 17, 35, 18, BLACK);   //clear the last speed reading
-      tft.setCursor(0, 283);
-      float speedkmh = GPS.speed * 1.852;
-      tft.print(speedkmh, 1);
+      showGPSDataStatus();
       GPS_status = true;
     }
   }
   else {
     if (GPS_status) {
       tft.fillCircle(50, 319 - 6, 6, RED); //x,y,radius,color     //GPS Status
-      tft.fillRect(190, 319 - 17, 40, 18, BLACK);  //clear the last # of satellite reading
-      tft.setFont(&FreeSans9pt7b);
-      tft.setTextColor(WHITE);
-      tft.setCursor(190, 319);
-      tft.print('0');
-      tft.fillRect(0, 283 - 17, 35, 18, BLACK);   //clear the last speed reading
-      tft.setCursor(0, 283);
-      tft.print('0');
+      setWidgetText(WIDGET_SATELLITES, "0");
+      setWidgetText(WIDGET_GPS_SPEED, "0");
       GPS_status = false;
     }
   }
@@ -358,13 +360,32 @@ void UpdateGPSConnectionStatus() {
   Display Ark Splash Screen
 ********************************************************************************/
 void DisplayArkBitmap() {
+  displayLock();
   clearMainScreen();
   tft.drawBitmap(56, 100, ArkBitmap, 128, 128, ArkRed);   // Display Ark bitmap on middle portion of screen
+  displayUnlock();
+}
+
+
+/********************************************************************************
+  Take/release exclusive access to the TFT display.
+  The display is drawn from both the network task and the display task.
+  The mutex is recursive so a function holding the lock can call other drawing functions that lock it again.
+********************************************************************************/
+void displayLock() {
+  xSemaphoreTakeRecursive(displayMutex, portMAX_DELAY);
+}
+
+void displayUnlock() {
+  xSemaphoreGiveRecursive(displayMutex);
 }
 
 
 void clearMainScreen() {
   tft.fillRect(0, 0, 240, 265 - 20, BLACK);   //clear the screen except for the status bar
+  hideWidget(WIDGET_SPEEDOMETER);
+  hideWidget(WIDGET_COUNTDOWN);
+  hideWidget(WIDGET_GEOFENCE);
 }
 
 
@@ -404,6 +425,35 @@ void saveEEPROM(int RXpage) {
   Serial.println("Saved RXpage to FLASH");
 }
 
+/********************************************************************************
+  Load the local nonce from nonvolatile memory. Returns 0 if no nonce has been saved.
+********************************************************************************/
+uint64_t loadNonceEEPROM() {
+  EEPROM.begin(512);
+  uint64_t nonce = 0;
+  EEPROM.get(NONCE_EEPROM_ADDRESS, nonce);
+  char ok[2 + 1];
+  EEPROM.get(NONCE_EEPROM_ADDRESS + sizeof(nonce), ok);
+  EEPROM.end();
+  if (String(ok) != String("OK")) {
+    nonce = 0;
+  }
+  return nonce;
+}
+
+
+/********************************************************************************
+  Store the local nonce in nonvolatile memory.
+********************************************************************************/
+void saveNonceEEPROM(uint64_t nonce) {
+  EEPROM.begin(512);
+  EEPROM.put(NONCE_EEPROM_ADDRESS, nonce);
+  char ok[2 + 1] = "OK";
+  EEPROM.put(NONCE_EEPROM_ADDRESS + sizeof(nonce), ok);
+  EEPROM.commit();
+  EEPROM.end();
+}
+
 /********************************************************************************
   Clear data in nonvolatile memory.
   Note. ESP32 has FLASH memory(not EEPROM) however the standard high level Arduino EEPROM arduino functions work.
@@ -415,6 +465,7 @@ void clearEEPROM() {
   EEPROM.put(1, 0);
   EEPROM.put(2, 0);
   EEPROM.put(3, 0);
+  EEPROM.put(NONCE_EEPROM_ADDRESS + sizeof(uint64_t), 0);   //clear the local nonce
   EEPROM.commit();
   EEPROM.end();
   Serial.println("cleared FLASH");
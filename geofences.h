@@ -0,0 +1,25 @@
+// Geofences generated by tools/geofence_tool.py from empty.geojson. Do not edit
+// 0 zones, 0 grid cells, 4 bytes of flash
+#define GEOFENCE_ZONES 0
+const int32_t GEOFENCE_GRID_LATITUDE = 0;        // south west corner of the grid, microdegrees
+const int32_t GEOFENCE_GRID_LONGITUDE = 0;
+const uint32_t GEOFENCE_CELL_LATITUDE = 1;       // size of a cell, microdegrees
+const uint32_t GEOFENCE_CELL_LONGITUDE = 1;
+const uint32_t GEOFENCE_GRID_ROWS = 0;
+const uint32_t GEOFENCE_GRID_COLUMNS = 0;
+
+const struct geofenceZone geofenceZones[] PROGMEM = {
+  {0, 0, 0, 0, 0, 0, 0, 0},     // placeholder. There are no zones
+};
+
+const struct geofenceVertex geofenceVertices[] PROGMEM = {
+  {0, 0},
+};
+
+const uint32_t geofenceCellStart[] PROGMEM = {
+  0,
+};
+
+const uint16_t geofenceCellZones[] PROGMEM = {
+  0,
+};
@@ -0,0 +1,63 @@
+/********************************************************************************
+  Ark transactions and signatures on the host (OpenSSL)
+  Used by the Ark Crypto stand-in of the sketch, the fake relays and the signer of the fleet load simulator.
+  Keys and addresses are the ones of Ark: private key = SHA256(passphrase), secp256k1, compressed public key,
+  address = base58check(version + RIPEMD160(public key)). Signatures are DER, low-S, with RFC 6979 nonces so
+  the results do not change between runs. These functions do not charge the simulated clock.
+********************************************************************************/
+#ifndef HOST_ARK_H
+#define HOST_ARK_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace host {
+namespace ark {
+
+struct Keys {
+  uint8_t privateKey[32];
+  uint8_t publicKey[33];
+};
+Keys keysFromPassphrase(const std::string &passphrase);
+void sha256(const void *data, size_t length, uint8_t hash[32]);
+std::vector<uint8_t> sign(const uint8_t hash[32], const uint8_t privateKey[32]);
+bool verify(const uint8_t hash[32], const std::vector<uint8_t> &signature, const uint8_t publicKey[33]);
+std::string address(const uint8_t publicKey[33], uint8_t version);
+bool decodeAddress(const std::string &address, uint8_t decoded[21]);
+std::string toHex(const uint8_t *data, size_t length);
+std::vector<uint8_t> fromHex(const std::string &hex);
+
+//Radians ScooterRentalFinish transaction (typeGroup 4000, type 600)
+const uint32_t RADIANS_TYPE_GROUP = 4000;
+const uint16_t RENTAL_START_TYPE = 500;
+const uint16_t RENTAL_FINISH_TYPE = 600;
+struct GpsPoint {
+  uint32_t timestamp;
+  uint64_t latitude;            // int64 microdegrees carried as uint64
+  uint64_t longitude;
+};
+struct RentalFinish {
+  uint8_t network = 0x41;
+  uint64_t nonce = 0;
+  uint8_t senderPublicKey[33] = {0};
+  uint64_t fee = 0;
+  uint64_t amount = 0;
+  std::string recipient;
+  uint8_t sessionId[32] = {0};
+  bool containsRefund = false;
+  std::vector<GpsPoint> gps;
+  std::vector<uint8_t> signature;
+};
+//AIP-11 serialization. The signature is included when withSignature is true
+std::vector<uint8_t> serialize(const RentalFinish &transaction, bool withSignature);
+std::string transactionId(const RentalFinish &transaction);
+void signTransaction(RentalFinish &transaction, const std::string &passphrase);
+bool verifyTransaction(const RentalFinish &transaction);
+std::string toJson(const RentalFinish &transaction);
+bool fromJson(const std::string &json, RentalFinish &transaction);      // one transaction object
+
+}
+}
+
+#endif
@@ -0,0 +1,95 @@
+/********************************************************************************
+  Boot catch-up benchmark
+  Counts the received transactions of wallets of different sizes with getMostRecentReceivedTransaction() (pages of
+  RX_CATCHUP_PAGE_LIMIT, galloping from the checkpoint) and with the walk of one transaction per request that the
+  sketch used before (limit=1 until an empty page), against the /wallets/{id}/transactions/received endpoint of the
+  fake relay. Reports the number of requests and the simulated time of each scan:
+    boot          the scan of setup() with an empty flash (checkpoint 0)
+    up to date    checkpoint = newest transaction (the usual reboot)
+    50 behind     50 transactions were received while the scooter was off
+    limit=1 walk  the old scan from the first transaction
+  usage: bench_catchup [wallet_<size>]
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+struct scan {
+  int checkpoint;                       // transactions already seen. -1 = the limit=1 walk
+  int newest;
+  int requests;
+  uint32_t time_ms;
+};
+static struct scan scans[4];
+static volatile bool scansDone = false;
+
+static void scanTask(void *) {
+  initProfiler();
+  initRelayPool();
+  //WiFi only: the broker is down so onConnectionEstablished() does not run
+  while (!WiFiMQTTclient.isWifiConnected()) {
+    WiFiMQTTclient.loop();
+    delay(100);
+  }
+  for (struct scan &s : scans) {
+    uint32_t start_ms = millis();
+    if (s.checkpoint >= 0) {
+      s.newest = getMostRecentReceivedTransaction(s.checkpoint + 1);
+      s.requests = atoi(host::serialLines("Scan requests: ").back().c_str() + strlen("Scan requests: "));
+    }
+    else {
+      int totalCount = 0;
+      int page = 1;
+      while (GetReceivedTransactionCount(ArkAddress, page, 1, totalCount) > 0) {
+        page++;
+      }
+      s.newest = page - 1;
+      s.requests = page;
+    }
+    s.time_ms = millis() - start_ms;
+  }
+  scansDone = true;
+  vTaskDelete(NULL);
+}
+
+static void catchUp(int transactions) {
+  {
+    host::HeapAccountingOff internal;
+    for (int i = 0; i < transactions; i++) {
+      host::arkChain().receiveTransfer(100000000, 1 + i % 8);
+    }
+  }
+  //the transactions are confirmed by the first block
+  host::runFor(host::arkChain().blockTime_ms + 1000);
+  host::mqtt().brokerAvailable = false;
+
+  scans[0] = {0, 0, 0, 0};
+  scans[1] = {transactions, 0, 0, 0};
+  scans[2] = {max(0, transactions - 50), 0, 0, 0};
+  scans[3] = {-1, 0, 0, 0};
+  xTaskCreatePinnedToCore(scanTask, "scanTask", 8192, NULL, 1, NULL, 0);
+  REQUIRE(host::runUntil([] { return scansDone; }, 3600000));
+
+  host::HeapAccountingOff internal;
+  fprintf(stdout, "wallet with %d received transactions (pages of %d)\n", transactions, RX_CATCHUP_PAGE_LIMIT);
+  const char *names[] = {"empty flash", "up to date", "50 behind", "limit=1 walk"};
+  for (int i = 0; i < 4; i++) {
+    CHECK_EQ(scans[i].newest, transactions);
+    fprintf(stdout, "  %-14s %6d requests %9u ms\n", names[i], scans[i].requests, scans[i].time_ms);
+  }
+}
+
+TEST(wallet_0) {
+  catchUp(0);
+}
+
+TEST(wallet_10) {
+  catchUp(10);
+}
+
+TEST(wallet_1000) {
+  catchUp(1000);
+}
+
+TEST(wallet_10000) {
+  catchUp(10000);
+}
@@ -0,0 +1,143 @@
+/********************************************************************************
+  Coordinate conversion benchmark
+  Converts the same NMEA coordinate fields (4 decimals of minutes like the PA1616, in every hemisphere) two ways:
+    float         the sketch before the fixed point coordinates: the ddmm.mmmm float of Adafruit_GPS 1.5 (parseCoord()),
+                  convertDegMinToDecDeg_lat/lon() with double and fmod(), kept in a float field and multiplied by 1e6
+                  for the RentalFinish. The text is printed from the double with "%.6f"
+    fixed         the sketch: parseNMEAcoordinate() into int32_t microdegrees and formatMicrodegrees()
+  Reports the host CPU time per coordinate (fastest of RUNS) of the conversion and of the conversion with the text,
+  and how far the microdegrees are from the exact value of the NMEA digits. The host has a double FPU. The ESP32 FPU
+  is single precision, so double and fmod() are software routines there and the float path is slower than on the host.
+  usage: bench_gps_coordinates
+********************************************************************************/
+#include <time.h>
+#include "sketch.cpp"
+#include "test.h"
+
+static const int RUNS = 51;
+static const int COORDINATES = 4096;
+
+static uint64_t cpu_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+struct coordinate {
+  char field[24];                 // "dddmm.mmmm,W"
+  bool latitude;
+  int32_t exact;                  // microdegrees
+};
+static std::vector<struct coordinate> coordinates;
+
+//parseCoord() of Adafruit_GPS 1.5: degrees and minutes as ddmm.mmmm in a float
+static float adafruitDegMin(const char *p, bool latitude, char &hemisphere) {
+  char degreebuff[10];
+  int degreeDigits = latitude ? 2 : 3;
+  strncpy(degreebuff, p, degreeDigits);
+  p += degreeDigits;
+  degreebuff[degreeDigits] = '\0';
+  long degree = atol(degreebuff) * 10000000;
+  strncpy(degreebuff, p, 2);          //minutes
+  p += 3;                             //skip the decimal point
+  strncpy(degreebuff + 2, p, 4);
+  degreebuff[6] = '\0';
+  long minutes = 50 * atol(degreebuff) / 3;
+  hemisphere = strchr(p, ',')[1];
+  return degree / 100000 + minutes * 0.000006F;
+}
+
+//convertDegMinToDecDeg_lat/lon() of the sketch before the fixed point coordinates
+static double convertDegMinToDecDeg(float degMin, char hemisphere) {
+  double min = fmod((double) degMin, 100.0);
+  degMin = (int) (degMin / 100);
+  double decDeg = degMin + (min / 60);
+  return ((hemisphere == 'S') || (hemisphere == 'W')) ? -decDeg : decDeg;
+}
+
+static volatile int32_t sink;
+
+static int32_t floatConversion(const struct coordinate &c) {
+  char hemisphere;
+  float degMin = adafruitDegMin(c.field, c.latitude, hemisphere);
+  float stored = convertDegMinToDecDeg(degMin, hemisphere);         //the float rental field
+  return (int32_t) (stored * 1e6);                    //the RentalFinish cast
+}
+
+static int32_t fixedConversion(const struct coordinate &c) {
+  int32_t microdegrees = 0;
+  parseNMEAcoordinate(c.field, microdegrees);
+  return microdegrees;
+}
+
+static int floatText(const struct coordinate &c, char *text, size_t size) {
+  char hemisphere;
+  float degMin = adafruitDegMin(c.field, c.latitude, hemisphere);
+  return snprintf(text, size, "%.6f", convertDegMinToDecDeg(degMin, hemisphere));
+}
+
+static int fixedText(const struct coordinate &c, char *text, size_t size) {
+  return formatMicrodegrees(fixedConversion(c), text, size);
+}
+
+template <typename F>
+static double fastest_ns(F run) {
+  uint64_t fastest = UINT64_MAX;
+  for (int r = 0; r < RUNS; r++) {
+    uint64_t start = cpu_ns();
+    for (const struct coordinate &c : coordinates) {
+      run(c);
+    }
+    fastest = std::min(fastest, cpu_ns() - start);
+  }
+  return (double) fastest / coordinates.size();
+}
+
+struct errors {
+  int wrong;
+  int32_t worst;
+};
+
+static struct errors conversionErrors(int32_t (*convert)(const struct coordinate &)) {
+  struct errors e = {0, 0};
+  for (const struct coordinate &c : coordinates) {
+    int32_t error = abs(convert(c) - c.exact);
+    e.wrong += (error > 0) ? 1 : 0;
+    e.worst = max(e.worst, error);
+  }
+  return e;
+}
+
+TEST(conversion) {
+  host::HeapAccountingOff internal;
+  srand(21);
+  for (int i = 0; i < COORDINATES; i++) {
+    struct coordinate c;
+    c.latitude = (i % 2) == 0;
+    uint32_t degrees = rand() % (c.latitude ? 90 : 180);
+    uint32_t minutes_e4 = rand() % 600000;
+    char hemisphere = c.latitude ? ((i % 4) < 2 ? 'N' : 'S') : ((i % 4) < 2 ? 'E' : 'W');
+    snprintf(c.field, sizeof(c.field), c.latitude ? "%02u%02u.%04u,%c" : "%03u%02u.%04u,%c",
+             degrees, minutes_e4 / 10000, minutes_e4 % 10000, hemisphere);
+    int64_t magnitude = ((int64_t) degrees * 600000 + minutes_e4) * 100;    //millionths of a minute
+    magnitude = (magnitude + 30) / 60;
+    c.exact = (int32_t) (((hemisphere == 'S') || (hemisphere == 'W')) ? -magnitude : magnitude);
+    coordinates.push_back(c);
+  }
+
+  char text[32];
+  double floatParse = fastest_ns([](const struct coordinate &c) { sink = floatConversion(c); });
+  double fixedParse = fastest_ns([](const struct coordinate &c) { sink = fixedConversion(c); });
+  double floatFormat = fastest_ns([&text](const struct coordinate &c) { sink = floatText(c, text, sizeof(text)); });
+  double fixedFormat = fastest_ns([&text](const struct coordinate &c) { sink = fixedText(c, text, sizeof(text)); });
+  struct errors floatErrors = conversionErrors(floatConversion);
+  struct errors fixedErrors = conversionErrors(fixedConversion);
+  CHECK_EQ(fixedErrors.wrong, 0);
+
+  fprintf(stdout, "%d coordinates in every hemisphere (host CPU per coordinate, fastest of %d)\n", COORDINATES, RUNS);
+  fprintf(stdout, "            conversion    + text   wrong microdegrees    worst\n");
+  fprintf(stdout, "  float   %8.1f ns %8.1f ns   %5d (%4.1f%%)     %6d\n", floatParse, floatFormat,
+          floatErrors.wrong, 100.0 * floatErrors.wrong / COORDINATES, floatErrors.worst);
+  fprintf(stdout, "  fixed   %8.1f ns %8.1f ns   %5d (%4.1f%%)     %6d\n", fixedParse, fixedFormat,
+          fixedErrors.wrong, 100.0 * fixedErrors.wrong / COORDINATES, fixedErrors.worst);
+}
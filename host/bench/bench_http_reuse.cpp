@@ -0,0 +1,129 @@
+/********************************************************************************
+  Relay connection reuse benchmark
+  Runs the requests of the sketch against the fake relay with a TCP handshake of 2, 20 and 80 ms, first with the
+  keep-alive connection of arkRequest() and then with a relay that closes the connection after every response
+  (a new connection per request, like the Ark Cpp-Client the sketch used before):
+    boot scan     getMostRecentReceivedTransaction() from an empty flash on a wallet of 1000 transactions. Only the
+                  "meta" counts of each page of RX_CATCHUP_PAGE_LIMIT are read so arkEnd() skips the transactions
+    rental start  GetTransactions_RentalStart() finds the RentalStart first on the last page, then getWallet().
+                  The AFTER_RENTAL_START transactions behind it are skipped
+    poll          node status, a poll of the last page (read to the end) and the wallet
+  Reports the requests, the new connections, the response bytes skipped to keep the connection, the connections
+  closed because the rest took longer than the handshake (see arkEnd()) and the simulated time per request.
+  usage: bench_http_reuse [handshake_<ms>]
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+static const int WALLET_SIZE = 1000;            // transactions received before the RentalStart
+static const int AFTER_RENTAL_START = RX_POLL_PAGE_LIMIT / 2;   // transactions received after it, on the same page
+static const int RENTALS = 10;
+static const int POLLS = 10;
+
+struct phase {
+  const char *name;
+  uint32_t requests;
+  uint32_t connects;
+  uint32_t drainedBytes;
+  uint32_t drainCloses;
+  uint32_t time_ms;
+};
+static struct phase phases[2][3];
+static volatile bool benchDone = false;
+
+static void measure(struct phase &p, const char *name, void (*requests)()) {
+  struct arkConnectionStatistics before = arkConnectionStats;
+  uint32_t start_ms = millis();
+  requests();
+  p.name = name;
+  p.time_ms = millis() - start_ms;
+  p.requests = arkConnectionStats.requests - before.requests;
+  p.connects = arkConnectionStats.connects - before.connects;
+  p.drainedBytes = arkConnectionStats.drainedBytes - before.drainedBytes;
+  p.drainCloses = arkConnectionStats.drainCloses - before.drainCloses;
+}
+
+static void bootScan() {
+  CHECK_EQ(getMostRecentReceivedTransaction(1), WALLET_SIZE + 1 + AFTER_RENTAL_START);
+}
+
+static void rentalStarts() {
+  for (int i = 0; i < RENTALS; i++) {
+    int seen = WALLET_SIZE;
+    CHECK_EQ(GetTransactions_RentalStart(ArkAddress, RX_POLL_PAGE_LIMIT, seen), RX_PAGE_RENTAL_START);
+    CHECK(getWallet());
+  }
+}
+
+static void polls() {
+  for (int i = 0; i < POLLS; i++) {
+    CHECK(checkArkNodeStatus(0));
+    int seen = WALLET_SIZE + AFTER_RENTAL_START;
+    CHECK_EQ(GetTransactions_RentalStart(ArkAddress, RX_POLL_PAGE_LIMIT, seen), RX_PAGE_DONE);
+    CHECK(getWallet());
+  }
+}
+
+static void benchTask(void *) {
+  initProfiler();
+  initRelayPool();
+  //WiFi only: the broker is down so onConnectionEstablished() does not run
+  while (!WiFiMQTTclient.isWifiConnected()) {
+    WiFiMQTTclient.loop();
+    delay(100);
+  }
+  strcpy(scooterRental.sessionID_QRcode, "bench session");
+  const uint32_t idleClose_ms[2] = {host::relay().idleClose_ms, 0};
+  for (int mode = 0; mode < 2; mode++) {
+    host::relay().idleClose_ms = idleClose_ms[mode];
+    arkDropConnection(0);
+    measure(phases[mode][0], "boot scan", bootScan);
+    measure(phases[mode][1], "rental start", rentalStarts);
+    measure(phases[mode][2], "poll", polls);
+  }
+  benchDone = true;
+  vTaskDelete(NULL);
+}
+
+static void handshake(uint32_t connect_ms) {
+  {
+    host::HeapAccountingOff internal;
+    for (int i = 0; i < WALLET_SIZE; i++) {
+      host::arkChain().receiveTransfer(100000000, 1 + i % 8);
+    }
+    host::arkChain().receiveRentalStart("bench session", 100000000, 1);
+    for (int i = 0; i < AFTER_RENTAL_START; i++) {
+      host::arkChain().receiveTransfer(100000000, 1 + i % 8);
+    }
+  }
+  //the transactions are confirmed by the first block
+  host::runFor(host::arkChain().blockTime_ms + 1000);
+  host::mqtt().brokerAvailable = false;
+  host::relay().connect_ms = connect_ms;
+
+  xTaskCreatePinnedToCore(benchTask, "benchTask", 8192, NULL, 1, NULL, 0);
+  REQUIRE(host::runUntil([] { return benchDone; }, 3600000));
+
+  host::HeapAccountingOff internal;
+  fprintf(stdout, "handshake %u ms, response head after %u ms, %.1f bytes/us\n", connect_ms, host::relay().latency_ms, host::relay().bytesPerUs);
+  fprintf(stdout, "                             requests  connections  skipped kB  closed  ms/request\n");
+  const char *modes[2] = {"keep-alive", "new per request"};
+  for (int mode = 0; mode < 2; mode++) {
+    for (const struct phase &p : phases[mode]) {
+      fprintf(stdout, "  %-16s %-12s %6u %12u %11u %7u %11.1f\n", modes[mode], p.name, p.requests, p.connects,
+              p.drainedBytes / 1024, p.drainCloses, (double) p.time_ms / max(p.requests, 1u));
+    }
+  }
+}
+
+TEST(handshake_2) {
+  handshake(2);
+}
+
+TEST(handshake_20) {
+  handshake(20);
+}
+
+TEST(handshake_80) {
+  handshake(80);
+}
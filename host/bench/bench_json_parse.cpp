@@ -0,0 +1,174 @@
+/********************************************************************************
+  Ark response parsing benchmark
+  Reads the wallet and pages of 1, 10 and 100 received RentalStart transactions from the fake relay three ways:
+    drain         the body is read and dropped (cost of the request and of the relay building the response)
+    string+doc    the body is copied into a std::string and deserialized into a DynamicJsonDocument sized for the
+                  whole response, like the Ark Cpp-Client path the sketch used before (capacities of the old code,
+                  per transaction for the pages)
+    stream        the sketch: getWallet() / GetTransactions_RentalStart() parse the connection with a filter into
+                  arkJsonArena
+  Reports the host CPU time of the parse (fastest run, less the fastest drain) and the heap peak above the heap in use
+  before the request. The stream time includes the Serial output of the sketch and the byte at a time reads of the
+  connection, so it is an upper bound. The requests run in a task on core 0 without the rest of the sketch.
+  usage: bench_json_parse
+********************************************************************************/
+#include <time.h>
+#include "sketch.cpp"
+#include "test.h"
+
+static const int RUNS = 51;
+static volatile bool benchDone = false;
+
+static uint64_t cpu_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+enum parsePath {DRAIN, STRING_DOCUMENT, STREAM};
+
+static char walletPath[64];
+static char pagePath[160];
+
+static bool drain(const char *path, int endpoint) {
+  if (!arkGet(path, endpoint)) {
+    return false;
+  }
+  while (arkBody.read() >= 0) {
+  }
+  arkEnd();
+  return true;
+}
+
+//the response as a std::string, like connection.api.wallets.get() of the Ark Cpp-Client
+static bool readString(const char *path, int endpoint, std::string &response) {
+  if (!arkGet(path, endpoint)) {
+    return false;
+  }
+  int c;
+  while ((c = arkBody.read()) >= 0) {
+    response += (char) c;
+  }
+  arkEnd();
+  return true;
+}
+
+static bool oldWallet() {
+  std::string response;
+  if (!readString(walletPath, HTTP_WALLET, response)) {
+    return false;
+  }
+  const size_t capacity = JSON_OBJECT_SIZE(1) + JSON_OBJECT_SIZE(6) + 200;
+  DynamicJsonDocument doc(capacity);
+  deserializeJson(doc, response.c_str());
+  JsonObject data = doc["data"];
+  return strtoull(data["nonce"], NULL, 10) == bridgechainWallet.walletNonce_Uint64;
+}
+
+static bool oldPage(int limit) {
+  std::string response;
+  if (!readString(pagePath, HTTP_RECEIVED, response)) {
+    return false;
+  }
+  const size_t capacity = JSON_ARRAY_SIZE(limit) + JSON_OBJECT_SIZE(9) + limit * (JSON_OBJECT_SIZE(3) + 2 * JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(15) + 1580);
+  DynamicJsonDocument doc(capacity);
+  if (deserializeJson(doc, response.c_str())) {
+    return false;
+  }
+  int found = 0;
+  for (int i = 0; i < limit; i++) {
+    JsonObject data_i = doc["data"][i];
+    if ((data_i["type"] == 500) && (data_i["typeGroup"] == 4000) && (data_i["asset"]["sessionId"].as<const char*>() != nullptr)) {
+      found++;
+    }
+  }
+  return found == limit;
+}
+
+static bool streamPage(int limit) {
+  int seen = 0;
+  return (GetTransactions_RentalStart(ArkAddress, limit, seen) == RX_PAGE_FULL) && (seen == limit);
+}
+
+struct measurement {
+  uint64_t cpu_ns;
+  size_t heapPeak;
+  bool ok;
+};
+
+static struct measurement measure(int path, int limit) {
+  std::vector<uint64_t> times;
+  struct measurement m = {0, 0, true};
+  for (int run = 0; run < RUNS; run++) {
+    {
+      host::HeapAccountingOff internal;
+      host::clearSerialLog();
+    }
+    host::resetHeapPeak();
+    size_t before = host::heap().current;
+    uint64_t start = cpu_ns();
+    bool ok;
+    if (limit == 0) {
+      ok = (path == DRAIN) ? drain(walletPath, HTTP_WALLET) : (path == STRING_DOCUMENT) ? oldWallet() : getWallet();
+    }
+    else {
+      ok = (path == DRAIN) ? drain(pagePath, HTTP_RECEIVED) : (path == STRING_DOCUMENT) ? oldPage(limit) : streamPage(limit);
+    }
+    uint64_t elapsed = cpu_ns() - start;
+    m.ok = m.ok && ok;
+    m.heapPeak = max(m.heapPeak, host::heap().peak - before);
+    host::HeapAccountingOff internal;
+    times.push_back(elapsed);
+  }
+  host::HeapAccountingOff internal;
+  m.cpu_ns = *std::min_element(times.begin(), times.end());
+  return m;
+}
+
+static void report(const char *name, int limit) {
+  if (limit > 0) {
+    snprintf(pagePath, sizeof(pagePath), "/api/wallets/%s/transactions/received?page=1&limit=%d&orderBy=timestamp:asc", ArkAddress, limit);
+  }
+  struct measurement drained = measure(DRAIN, limit);
+  struct measurement old = measure(STRING_DOCUMENT, limit);
+  struct measurement stream = measure(STREAM, limit);
+  CHECK(drained.ok && old.ok && stream.ok);
+  host::HeapAccountingOff internal;
+  fprintf(stdout, "  %-18s string+doc %8" PRIu64 " ns %7zu bytes    stream %8" PRIu64 " ns %7zu bytes\n", name,
+          old.cpu_ns > drained.cpu_ns ? old.cpu_ns - drained.cpu_ns : 0, old.heapPeak,
+          stream.cpu_ns > drained.cpu_ns ? stream.cpu_ns - drained.cpu_ns : 0, stream.heapPeak);
+}
+
+static void benchTask(void *) {
+  initProfiler();
+  initRelayPool();
+  //WiFi only: the broker is down so onConnectionEstablished() does not run
+  while (!WiFiMQTTclient.isWifiConnected()) {
+    WiFiMQTTclient.loop();
+    delay(100);
+  }
+  snprintf(walletPath, sizeof(walletPath), "/api/wallets/%s", ArkAddress);
+  getWallet();
+
+  fprintf(stdout, "parse time (host CPU, fastest of %d) and heap peak per response\n", RUNS);
+  report("wallet", 0);
+  report("page of 1", 1);
+  report("page of 10", 10);
+  report("page of 100", 100);
+  fprintf(stdout, "  (free heap of the scooter at boot: %zu bytes)\n", host::HEAP_SIZE);
+  benchDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(parse) {
+  {
+    host::HeapAccountingOff internal;
+    for (int i = 0; i < 100; i++) {
+      host::arkChain().receiveRentalStart("session " + std::to_string(i), 100000000, 1 + i % 8);
+    }
+  }
+  host::runFor(host::arkChain().blockTime_ms + 1000);
+  host::mqtt().brokerAvailable = false;
+  xTaskCreatePinnedToCore(benchTask, "benchTask", 8192, NULL, 1, NULL, 0);
+  REQUIRE(host::runUntil([] { return benchDone; }, 3600000));
+}
@@ -0,0 +1,174 @@
+/********************************************************************************
+  MQTT telemetry serializer benchmark
+  Signs and publishes the same NodeRedMQTTpacket two ways:
+    String        the Arduino String concatenations of the sketch before publish_MQTTpacket(): the signed message is
+                  copied out of a substring, the signature is hex encoded into a std::string and verified again
+    snprintf      the sketch: publish_MQTTpacket() writes the packet into a stack buffer in one pass
+  Reports the host CPU time (fastest of RUNS), the heap allocations and the heap peak of the serializer alone (the
+  text that is signed: the String concatenations and the copy of the message, or formatMQTTpacket()), and of the
+  whole packet with the modeled time of the task, which is mostly ECDSA (host::ECDSA_SIGN_US, host::ECDSA_VERIFY_US).
+  Both packets also allocate in Message::sign() (Cpp-Crypto builds a std::string) and for the two String arguments
+  of EspMQTTClient::publish().
+  The host String is a std::string, which keeps strings of up to 15 characters without an allocation, so the String
+  allocations are a lower bound of those of the Arduino String. The packets run in a task on core 0 without the rest
+  of the sketch.
+  usage: bench_mqtt_packet
+********************************************************************************/
+#include <time.h>
+#include "sketch.cpp"
+#include "test.h"
+
+static const int RUNS = 51;
+static volatile bool benchDone = false;
+
+static uint64_t cpu_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+//send_MQTTpacket() before the fixed buffer (the coordinates were doubles in decimal degrees)
+static void buildString(String &buf, char *msgbackup) {
+  buf += F("{");
+  buf += F("\"status\":");
+  buf += F("\"");
+  buf += String(NodeRedMQTTpacket.status);
+  buf += F("\"");
+  buf += F(",\"fix\":");
+  buf += String(NodeRedMQTTpacket.fix);
+  buf += F(",\"lat\":");
+  buf += String(NodeRedMQTTpacket.latitude / 1e6, 8);
+  buf += F(",\"lon\":");
+  buf += String(NodeRedMQTTpacket.longitude / 1e6, 8);
+  buf += F(",\"speed\":");
+  buf += String(NodeRedMQTTpacket.speedKPH);
+  buf += F(",\"sat\":");
+  buf += String(NodeRedMQTTpacket.satellites);
+  buf += F(",\"bal\":");
+  buf += String(NodeRedMQTTpacket.walletBalance);
+  buf += F(",\"bat\":");
+  buf += String(NodeRedMQTTpacket.battery);
+
+  String body = buf.substring(1);     //the old code kept a pointer into this temporary
+  strcpy(msgbackup, body.c_str());
+}
+
+static int publishString() {
+  String buf;
+  char msgbackup[500 + 1];
+  buildString(buf, msgbackup);
+
+  Message message;
+  message.sign(msgbackup, PASSPHRASE);
+  std::string signatureString;
+  for (uint8_t byte : message.signature) {      //BytesToHex() of Cpp-Crypto
+    static const char hexDigits[] = "0123456789abcdef";
+    signatureString += hexDigits[byte >> 4];
+    signatureString += hexDigits[byte & 0x0F];
+  }
+
+  buf += F(",\"sig\":");
+  buf += F("\"");
+  buf += signatureString.c_str();
+  buf += F("\"");
+  buf += F("}");
+
+  Serial.println("\n=================================");
+  Serial.println("Signing MQTT packet");
+  Serial.print("Signature from Signed Message: ");
+  Serial.println(signatureString.c_str());
+  const bool isValid = message.verify();
+  Serial.print("Message Signature is valid? ");
+  Serial.println(isValid ? "true" : "false");
+  Serial.print("message that was signed: ");
+  Serial.println(msgbackup);
+
+  Serial.print("Sending MQTT packet: ");
+  Serial.println(buf);
+  WiFiMQTTclient.publish(MQTT_Base_Topic, buf.c_str());
+  return buf.length();
+}
+
+static int serializeString() {
+  String buf;
+  char msgbackup[500 + 1];
+  buildString(buf, msgbackup);
+  return strlen(msgbackup);
+}
+
+static int serializeFixed() {
+  char packet[MQTT_PACKET_BUFFER_SIZE];
+  return formatMQTTpacket(packet, sizeof(packet)) - 1;
+}
+
+struct measurement {
+  uint64_t cpu_ns;
+  uint64_t allocations;
+  size_t heapPeak;
+  uint64_t modeled_us;
+  int length;
+};
+
+static struct measurement measure(int (*publish)()) {
+  std::vector<uint64_t> times;
+  struct measurement m = {0, 0, 0, 0, 0};
+  for (int run = 0; run < RUNS; run++) {
+    {
+      host::HeapAccountingOff internal;
+      host::clearSerialLog();
+    }
+    host::resetHeapPeak();
+    host::HeapStats before = host::heap();
+    uint64_t start_us = host::now();
+    uint64_t start = cpu_ns();
+    m.length = publish();
+    uint64_t elapsed = cpu_ns() - start;
+    m.modeled_us = host::now() - start_us;
+    m.allocations = host::heap().allocations - before.allocations;
+    m.heapPeak = max(m.heapPeak, host::heap().peak - before.current);
+    host::HeapAccountingOff internal;
+    times.push_back(elapsed);
+  }
+  host::HeapAccountingOff internal;
+  m.cpu_ns = *std::min_element(times.begin(), times.end());
+  return m;
+}
+
+static void report(const char *name, const struct measurement &serializer, const struct measurement &packet) {
+  fprintf(stdout, "  %-9s %8" PRIu64 " ns %3" PRIu64 " allocations %5zu bytes | %3d bytes %3" PRIu64 " allocations %5zu bytes %6" PRIu64 " us\n",
+          name, serializer.cpu_ns, serializer.allocations, serializer.heapPeak,
+          packet.length, packet.allocations, packet.heapPeak, packet.modeled_us);
+}
+
+static void benchTask(void *) {
+  initProfiler();
+  NodeRedMQTTpacket.status = "Rented";
+  NodeRedMQTTpacket.fix = 1;
+  NodeRedMQTTpacket.latitude = 53535352;
+  NodeRedMQTTpacket.longitude = -113277912;
+  NodeRedMQTTpacket.speedKPH = 9.26;
+  NodeRedMQTTpacket.satellites = 8;
+  strcpy(NodeRedMQTTpacket.walletBalance, "99990386752");
+  NodeRedMQTTpacket.battery = 96;
+
+  struct measurement stringText = measure(serializeString);
+  struct measurement fixedText = measure(serializeFixed);
+  struct measurement string = measure(publishString);
+  struct measurement fixed = measure(publish_MQTTpacket);
+  CHECK_EQ(fixedText.allocations, (uint64_t) 0);
+  CHECK(fixed.length > 0);
+  CHECK(fixed.modeled_us < string.modeled_us);
+
+  host::HeapAccountingOff internal;
+  fprintf(stdout, "per packet (host CPU, fastest of %d)\n", RUNS);
+  fprintf(stdout, "            serializer (signed text, %d / %d bytes)   | signed packet, published\n", stringText.length, fixedText.length);
+  report("String", stringText, string);
+  report("snprintf", fixedText, fixed);
+  benchDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(packet) {
+  xTaskCreatePinnedToCore(benchTask, "benchTask", 8192, NULL, 1, NULL, 0);
+  REQUIRE(host::runUntil([] { return benchDone; }, 600000));
+}
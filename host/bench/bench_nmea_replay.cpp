@@ -0,0 +1,180 @@
+/********************************************************************************
+  NMEA replay benchmark
+  Boots the scooter and feeds it NMEA for 60 s at realistic and at burst rates, then reports what gpsIngestTask() and
+  readGPS() made of it:
+    1 Hz 9600        the PA1616 default: RMC, GGA, GSA, 3 GSV and VTG once per second
+    10 Hz 115200     the same sentences ten times per second
+    recorded bursts  a recorded log with 1 corrupt sentence in 20, and the 40 sentences a module sends at once after a
+                     cold start every 10 s, at 115200 baud
+    1 Hz + stalls    1 Hz at 9600 baud while the network task holds the display for 2 s every 10 s (loop() waits)
+    10 Hz + stalls   10 Hz at 115200 baud with the same stalls: more than GPS_RING_SIZE bytes arrive during a stall,
+                     the overflows must be counted and the sentences after the stall parsed
+  Reports the RMC/GGA sentences sent and parsed, the UART bytes lost, the counters of gpsStats and the age of the
+  gpsFix snapshot (sampled every 50 ms), for the 60 s after the first BOOT_MS. The UART bytes lost during the boot
+  are reported on their own.
+  usage: bench_nmea_replay [rate_1hz | rate_10hz | recorded_bursts | display_stalls | display_stalls_10hz]
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+static const uint32_t BOOT_MS = 5000;
+static const uint32_t REPLAY_MS = 60000;
+
+//Counts the sentences of another replay
+class CountingReplay : public host::GpsReplay {
+  public:
+    std::shared_ptr<host::GpsReplay> replay;
+    uint64_t sentences = 0;
+    uint64_t fixSentences = 0;                  // RMC and GGA with a valid checksum
+    bool next(uint64_t now_us, uint64_t &at_us, std::string &text) override {
+      if (!replay->next(now_us, at_us, text)) {
+        return false;
+      }
+      host::HeapAccountingOff internal;
+      for (size_t start = text.find('$'); start != std::string::npos; start = text.find('$', start + 1)) {
+        sentences++;
+        std::string sentence = text.substr(start, text.find('\n', start) - start + 1);
+        if (((sentence.compare(3, 3, "RMC") == 0) || (sentence.compare(3, 3, "GGA") == 0)) && (sentence.find("*XX") == std::string::npos)) {
+          fixSentences++;
+        }
+      }
+      return true;
+    }
+};
+
+static std::shared_ptr<host::GpsRoute> movingRoute(uint32_t period_ms) {
+  host::HeapAccountingOff internal;
+  std::shared_ptr<host::GpsRoute> route = std::make_shared<host::GpsRoute>();
+  route->position = [](uint64_t now_us) {
+    return host::GpsPosition{53535352 + (int32_t) (now_us / 100000), -113277912, 5.0f, true, 8};
+  };
+  route->period_ms = period_ms;
+  route->extraSentences = true;
+  return route;
+}
+
+//A log of the PA1616 riding north. Every 20th sentence has a corrupt checksum and every 10 s the module sends 40
+//sentences at once (GSV of a cold start)
+static std::shared_ptr<host::GpsRecording> recordedLog() {
+  host::HeapAccountingOff internal;
+  std::shared_ptr<host::GpsRecording> log = std::make_shared<host::GpsRecording>();
+  int count = 0;
+  auto sentence = [&count](const std::string &body) {
+    std::string text = host::nmeaSentence(body);
+    if (++count % 20 == 0) {
+      text.replace(text.find('*') + 1, 2, "XX");
+    }
+    return text;
+  };
+  for (uint64_t second = 0; second < (BOOT_MS + REPLAY_MS) / 1000 + 30; second++) {
+    char time[16];
+    snprintf(time, sizeof(time), "%02u%02u%02u.000", (unsigned) (second / 3600) % 24, (unsigned) (second / 60) % 60, (unsigned) second % 60);
+    std::string lat = host::nmeaCoordinate(53535352 + (int32_t) second * 10, true);
+    std::string lon = host::nmeaCoordinate(-113277912, false);
+    std::string text = sentence(std::string("GPRMC,") + time + ",A," + lat + "," + lon + ",4.86,87.50,160926,,,A");
+    text += sentence(std::string("GPGGA,") + time + "," + lat + "," + lon + ",1,08,0.92,650.3,M,-17.0,M,,");
+    text += sentence("GPGSA,A,3,10,12,14,24,25,32,,,,,,,1.25,0.92,0.84");
+    int gsv = (second % 10 == 0) ? 37 : 3;
+    for (int i = 0; i < gsv; i++) {
+      text += sentence("GPGSV,3," + std::to_string(i % 3 + 1) + ",11,10,63,137,17,12,44,230,42,14,20,053,36,24,31,302,39");
+    }
+    log->sentences.push_back({second * 1000000 + 500000, text});
+  }
+  return log;
+}
+
+static volatile uint32_t stallDisplay_ms = 0;
+
+//The network task drawing for a long time (e.g. an HTTP request while the display is held)
+static void stallTask(void *) {
+  for (;;) {
+    delay(10000);
+    displayLock();
+    host::charge(stallDisplay_ms * 1000.0);
+    displayUnlock();
+  }
+}
+
+static void replay(const char *name, std::shared_ptr<host::GpsReplay> source, uint32_t baud, bool lossless = true) {
+  std::shared_ptr<CountingReplay> counter;
+  {
+    host::HeapAccountingOff internal;
+    counter = std::make_shared<CountingReplay>();
+    counter->replay = source;
+  }
+  host::setGpsReplay(counter, baud);
+  host::boot();
+  if (stallDisplay_ms > 0) {
+    xTaskCreatePinnedToCore(stallTask, "stallTask", 4096, NULL, 1, NULL, 0);
+  }
+
+  host::runFor(BOOT_MS);
+  uint64_t bootLost = host::gpsUart().lost;
+  host::GpsUartStats uart = host::gpsUart();
+  struct gpsIngestStatistics stats;
+  stats.ringOverflows = gpsStats.ringOverflows;
+  stats.droppedSentences = gpsStats.droppedSentences;
+  stats.checksumFailures = gpsStats.checksumFailures;
+  stats.parsedSentences = gpsStats.parsedSentences;
+  uint64_t sentences = counter->sentences;
+  uint64_t fixSentences = counter->fixSentences;
+
+  std::vector<uint32_t> ages;
+  for (uint32_t t = 0; t < REPLAY_MS; t += 50) {
+    host::runFor(50);
+    struct gpsFix fix;
+    getGPSfix(fix);
+    host::HeapAccountingOff internal;
+    if (fix.timestamp_ms > 0) {
+      ages.push_back((uint32_t) (host::now() / 1000) - fix.timestamp_ms);
+    }
+  }
+
+  host::HeapAccountingOff internal;
+  uart.delivered = host::gpsUart().delivered - uart.delivered;
+  uart.lost = host::gpsUart().lost - uart.lost;
+  stats.ringOverflows = gpsStats.ringOverflows - stats.ringOverflows;
+  stats.droppedSentences = gpsStats.droppedSentences - stats.droppedSentences;
+  stats.checksumFailures = gpsStats.checksumFailures - stats.checksumFailures;
+  stats.parsedSentences = gpsStats.parsedSentences - stats.parsedSentences;
+  fprintf(stdout, "%s: %" PRIu64 " sentences sent in %u s (%" PRIu64 " RMC/GGA), %" PRIu64 " UART bytes lost during the boot\n", name,
+          counter->sentences - sentences, REPLAY_MS / 1000, counter->fixSentences - fixSentences, bootLost);
+  fprintf(stdout, "  UART      %8" PRIu64 " bytes received %6" PRIu64 " lost, %4" PRIu64 " bytes buffered at most\n",
+          uart.delivered, uart.lost, host::gpsUart().maxBuffered);
+  fprintf(stdout, "  gpsStats  %8u parsed %6u ring overflows %6u dropped %6u checksum failures\n",
+          stats.parsedSentences, (uint32_t) stats.ringOverflows, stats.droppedSentences, stats.checksumFailures);
+  fprintf(stdout, "  fix age   p50 %5u ms  p99 %5u ms  max %5u ms\n",
+          host::percentile(ages, 50), host::percentile(ages, 99), *std::max_element(ages.begin(), ages.end()));
+  CHECK(stats.parsedSentences > 0);
+  if (lossless) {
+    CHECK_EQ(uart.lost, (uint64_t) 0);
+    CHECK_EQ((uint32_t) stats.ringOverflows, (uint32_t) 0);
+    CHECK_EQ(stats.droppedSentences, (uint32_t) 0);
+  }
+}
+
+TEST(rate_1hz) {
+  replay("1 Hz 9600", movingRoute(1000), 9600);
+  CHECK_EQ(host::gpsUart().lost, (uint64_t) 0);
+  CHECK_EQ(gpsStats.checksumFailures, (uint32_t) 0);
+}
+
+TEST(rate_10hz) {
+  replay("10 Hz 115200", movingRoute(100), 115200);
+}
+
+TEST(recorded_bursts) {
+  replay("recorded bursts", recordedLog(), 115200);
+  CHECK(gpsStats.checksumFailures > 0);
+}
+
+TEST(display_stalls) {
+  stallDisplay_ms = 2000;
+  replay("1 Hz + 2 s stalls", movingRoute(1000), 9600);
+}
+
+TEST(display_stalls_10hz) {
+  stallDisplay_ms = 2000;
+  replay("10 Hz + 2 s stalls", movingRoute(100), 115200, false);
+  CHECK(gpsStats.ringOverflows > 0);
+}
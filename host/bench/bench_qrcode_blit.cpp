@@ -0,0 +1,73 @@
+/********************************************************************************
+  QRcode blit benchmark
+  Draws the version 10 QRcode of a rental session on the counting ILI9341 with drawQRcodeModules() (one address window,
+  a line buffer per module row) and with the nine drawPixel() calls per dark module that the sketch used before, and
+  reports the SPI transactions, address windows, pixels and the modeled SPI time of each. Both must leave the same frame.
+  usage: bench_qrcode_blit
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+static const int16_t QR_X0 = 35;
+static const int16_t QR_Y0 = 85 - 30;
+
+//displayQRcode() before the blit: the background was filled white and only the dark modules were drawn
+static void drawQRcodePixels(int16_t x0, int16_t y0) {
+  for (uint8_t y = 0; y < qrcode.size; y++) {
+    for (uint8_t x = 0; x < qrcode.size; x++) {
+      if (qrcode_getModule(&qrcode, x, y)) {
+        for (int dy = 0; dy < 3; dy++) {
+          for (int dx = 0; dx < 3; dx++) {
+            tft.drawPixel(x0 + 3 * x + dx, y0 + 3 * y + dy, QRCODE_DARK_PIXEL_COLOR);
+          }
+        }
+      }
+    }
+  }
+}
+
+struct drawCost {
+  host::DisplayStats stats;
+  uint64_t time_us;
+  std::vector<uint16_t> frame;
+};
+
+static struct drawCost draw(void (*drawModules)(int16_t, int16_t)) {
+  tft.fillScreen(ILI9341_BLACK);
+  tft.fillRect(QR_X0, QR_Y0, qrcode.size * 3, qrcode.size * 3, WHITE);
+  host::DisplayStats before = host::display();
+  uint64_t start_us = host::now();
+  drawModules(QR_X0, QR_Y0);
+
+  struct drawCost cost;
+  cost.time_us = host::now() - start_us;
+  cost.stats.transactions = host::display().transactions - before.transactions;
+  cost.stats.addressWindows = host::display().addressWindows - before.addressWindows;
+  cost.stats.pixels = host::display().pixels - before.pixels;
+  host::HeapAccountingOff internal;
+  cost.frame = host::displayFrame();
+  return cost;
+}
+
+static void print(const char *name, const struct drawCost &cost) {
+  fprintf(stdout, "  %-18s %6" PRIu64 " SPI transactions %6" PRIu64 " address windows %7" PRIu64 " pixels %8" PRIu64 " us\n", name,
+          cost.stats.transactions, cost.stats.addressWindows, cost.stats.pixels, cost.time_us);
+}
+
+TEST(blit) {
+  strcpy(nextSession.QRcodeText, "https://radians.nl/?scooter=TRXA2NUACckkYwWnS9JRkATQA453ukAcD1&session=2cf24dba5fb0a30e26e83b2ac5b9e29e1b161e5c1fa7425e73043362938b9824&lat=53.535352&lon=-113.277912&rate=5");
+  qrcode_initText(&qrcode, qrcodeData, QRcode_Version, QRcode_ECC, nextSession.QRcodeText);
+  struct drawCost pixels = draw(drawQRcodePixels);
+  struct drawCost blit = draw(drawQRcodeModules);
+  CHECK(pixels.frame == blit.frame);
+
+  int dark = 0;
+  for (uint8_t y = 0; y < qrcode.size; y++) {
+    for (uint8_t x = 0; x < qrcode.size; x++) {
+      dark += qrcode_getModule(&qrcode, x, y) ? 1 : 0;
+    }
+  }
+  fprintf(stdout, "QRcode version %d: %d x %d modules, %d dark, 3x3 pixels per module\n", QRcode_Version, qrcode.size, qrcode.size, dark);
+  print("drawPixel()", pixels);
+  print("drawQRcodeModules()", blit);
+}
@@ -0,0 +1,125 @@
+/********************************************************************************
+  Rental cycle benchmark
+  Runs full rental cycles (QRcode displayed -> RentalStart paid -> ride -> RentalFinish accepted -> next QRcode)
+  against the fake relay, MQTT broker and GPS and reports the latency percentiles in simulated time:
+    unlock      RentalStart confirmed in a block -> scooter unlocked (STATE_5)
+    settle      end of the ride -> RentalFinish accepted by the relay
+    next QRcode end of the ride -> next QRcode displayed (STATE_4)
+  and the percentiles of the simulated time of each iteration of loop() (core 1) and networkTask() (core 0) over all the cycles,
+  taken from the latency histograms of the sketch (Latency.ino). The blocks are forged every 8 s.
+  usage: bench_rental_cycle [polling|notified]
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+static const int CYCLES = 40;
+static const uint32_t RIDE_SECONDS = 20;
+
+static void printPercentiles(const char *name, const std::vector<uint32_t> &values_ms) {
+  fprintf(stdout, "  %-12s p50 %6u ms  p90 %6u ms  p99 %6u ms  max %6u ms\n", name, host::percentile(values_ms, 50),
+          host::percentile(values_ms, 90), host::percentile(values_ms, 99), host::percentile(values_ms, 100));
+}
+
+//the samples of the benchmark are not allocations of the sketch
+static void record(std::vector<uint32_t> &values, uint64_t value) {
+  host::HeapAccountingOff internal;
+  values.push_back((uint32_t) value);
+}
+
+//Sums the loop latency histograms of the sketch over the cycles. The sketch clears them after each rental cycle
+//(reportRentalCycleLatency()), so the last copy taken before a clear is added to the total.
+struct CycleLatency {
+  struct latencyHistogram total, last;
+  const struct latencyHistogram *source;
+  explicit CycleLatency(const struct latencyHistogram &histogram) : source(&histogram) {
+    memset(total.counts, 0, sizeof(total.counts));
+    last = total;
+  }
+  void sample() {
+    if (source->samples < last.samples) {
+      add(last);
+    }
+    last = *source;
+  }
+  void add(const struct latencyHistogram &h) {
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+      total.counts[bucket] += h.counts[bucket];
+    }
+    total.samples += h.samples;
+    total.max_us = max(total.max_us, h.max_us);
+  }
+  void print(const char *name) {
+    add(last);
+    last.samples = 0;
+    fprintf(stdout, "  %-12s p50 %6u us  p90 %6u us  p99 %6u us  max %6u us  (%u iterations)\n", name,
+            latencyPercentile(total, 50), latencyPercentile(total, 90), latencyPercentile(total, 99), total.max_us, total.samples);
+  }
+};
+
+static CycleLatency *displayLoop;
+static CycleLatency *networkLoop;
+
+static bool runUntil(const std::function<bool()> &done, uint32_t timeout_ms) {
+  return host::runUntil([&done] {
+    displayLoop->sample();
+    networkLoop->sample();
+    return done();
+  }, timeout_ms);
+}
+
+static void runCycles(bool notified) {
+  CycleLatency display(loopLatency), network(networkLatency);
+  displayLoop = &display;
+  networkLoop = &network;
+  host::parkedGps();
+  REQUIRE(host::bootToAvailable());
+
+  std::vector<uint32_t> unlock_ms, settle_ms, nextQR_ms;
+  for (int cycle = 0; cycle < CYCLES; cycle++) {
+    //pay at a different point of the block interval every cycle
+    uint64_t pay_us = host::now() + 1000000 + (cycle * 1700) % 8000 * 1000;
+    REQUIRE(runUntil([pay_us] { return host::now() >= pay_us; }, 10000));
+    uint64_t accepted = host::arkChain().accepted;
+    std::string id = host::rentScooter(RIDE_SECONDS);
+    uint64_t confirmed_us = host::arkChain().blockAfter(host::arkChain().received.back().at_us);
+    if (notified) {
+      REQUIRE(runUntil([confirmed_us] { return host::now() >= confirmed_us; }, 10000));
+      host::mqtt().deliver(MQTT_Notify_Topic, "{\"id\":\"" + id + "\",\"type\":500,\"typeGroup\":4000}");
+    }
+    REQUIRE(runUntil([] { return state == STATE_5; }, 30000));
+    record(unlock_ms, (host::now() - confirmed_us) / 1000);
+
+    uint64_t rideEnd_us = host::now() + (uint64_t) RIDE_SECONDS * 1000000;
+    REQUIRE(runUntil([] { return state != STATE_5; }, RIDE_SECONDS * 1000 + 5000));
+    REQUIRE(runUntil([] { return state == STATE_4; }, 30000));
+    record(nextQR_ms, (host::now() - rideEnd_us) / 1000);
+    REQUIRE(runUntil([accepted] { return host::arkChain().accepted > accepted; }, 30000));
+    uint64_t acceptedAt_us = host::arkChain().pool.empty() ? host::now() : host::arkChain().pool.back().at_us;
+    record(settle_ms, (acceptedAt_us - rideEnd_us) / 1000);
+  }
+
+  size_t heapPeak = host::heap().peak;
+  host::HeapAccountingOff internal;
+  fprintf(stdout, "%s: %d rental cycles of %u s\n", notified ? "MQTT notification" : "polling", CYCLES, RIDE_SECONDS);
+  printPercentiles("unlock", unlock_ms);
+  printPercentiles("settle", settle_ms);
+  printPercentiles("next QRcode", nextQR_ms);
+
+  display.print("loop()");
+  network.print("networkTask");
+  const host::LoopStats &loop = host::loopStats();
+  std::vector<uint32_t> loop_ns(loop.hostCpu_ns.begin(), loop.hostCpu_ns.end());
+  fprintf(stdout, "  loop() host CPU p50 %u ns  p99 %u ns  (the CPU time of the sketch is not simulated)\n",
+          host::percentile(loop_ns, 50), host::percentile(loop_ns, 99));
+  fprintf(stdout, "  display: %" PRIu64 " SPI transactions  %" PRIu64 " pixels per cycle\n", host::display().transactions / CYCLES,
+          host::display().pixels / CYCLES);
+  fprintf(stdout, "  relay: %zu requests per cycle  heap peak %zu bytes\n", host::relay().requests.size() / CYCLES, heapPeak);
+}
+
+TEST(polling) {
+  runCycles(false);
+}
+
+TEST(notified) {
+  runCycles(true);
+}
@@ -0,0 +1,296 @@
+/********************************************************************************
+  Host harness
+  The sketch is compiled for the host against the stand-ins in host/mocks. This header is the control surface used by
+  the tests and benchmarks: the simulated clock and tasks, the captured serial output, the heap counters, the counting
+  display, the GPS replay, the MQTT broker and the Ark relays, and the flash image.
+
+  Time model
+    Every task has its own clock (one per core). The clock of a task advances when it sleeps (vTaskDelay(), delay()),
+    when it waits for a mutex or for data from a connection, and by the modeled cost of the peripherals (host::charge()).
+    The CPU time of the sketch itself is not counted, so the results are deterministic. The task whose clock is the
+    furthest behind always runs next, and a task that is charged more than HOST_SLICE_US ahead of the others gives up
+    the CPU, so a long cost on core 0 (signing, HTTP) does not delay core 1.
+********************************************************************************/
+#ifndef HOST_HOST_H
+#define HOST_HOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace host {
+
+/********************************************************************************
+  Modeled costs of the ESP32 peripherals (microseconds). Estimates, used to make the latencies comparable
+********************************************************************************/
+const uint32_t SPI_TRANSACTION_US = 2;          // SPI beginTransaction + CS
+const uint32_t SPI_ADDRESS_WINDOW_US = 3;       // CASET/PASET/RAMWR commands, 40 MHz
+const double SPI_PIXEL_US = 0.4;                // 16 bits at 40 MHz
+const uint32_t ECDSA_SIGN_US = 30000;           // secp256k1 signature (bcl/uECC at 240 MHz)
+const uint32_t ECDSA_VERIFY_US = 45000;
+const double SHA256_BYTE_US = 0.02;             // hardware SHA engine
+const uint32_t QRCODE_ENCODE_US = 18000;        // version 10 QRcode (Reed-Solomon and 8 mask evaluations)
+const uint32_t FLASH_OPEN_US = 600;             // SPIFFS open
+const double FLASH_WRITE_BYTE_US = 2.5;         // SPIFFS page program
+const double FLASH_READ_BYTE_US = 0.05;
+const uint32_t EEPROM_COMMIT_US = 30000;        // erase and program a 4 kB sector
+const uint32_t MQTT_PUBLISH_US = 300;           // PubSubClient publish (blocking TCP write)
+const double MQTT_BYTE_US = 1.0;
+const uint32_t HOST_SLICE_US = 200;
+
+/********************************************************************************
+  Clock and tasks
+********************************************************************************/
+uint64_t now();                                 // microseconds of the running task (or of the harness)
+void charge(double us);                         // modeled CPU/peripheral time of the running task
+void sleep(uint64_t us);                        // the running task waits without using the CPU
+void boot();                                    // creates the Arduino loop task (setup() then loop() forever)
+void runFor(uint32_t ms);                       // runs the tasks for ms of simulated time
+bool runUntil(const std::function<bool()> &done, uint32_t timeout_ms);   // = false when the timeout expired
+bool inTask();                                  // = true when called from a task
+
+struct LoopStats {
+  uint64_t iterations = 0;
+  std::vector<uint32_t> hostCpu_ns;             // host CPU time of each loop() call
+};
+LoopStats &loopStats();
+
+/********************************************************************************
+  Serial output of the sketch (UART0)
+********************************************************************************/
+const std::string &serialLog();
+void clearSerialLog();
+void setSerialEcho(bool echo);                  // also HOST_SERIAL=1 in the environment
+std::vector<std::string> serialLines(const char *prefix);   // captured lines starting with prefix
+
+/********************************************************************************
+  Heap
+  Allocations made by the sketch (new/delete, String, ArduinoJson documents) are counted. Harness internals are not.
+********************************************************************************/
+struct HeapStats {
+  size_t current = 0;
+  size_t peak = 0;
+  uint64_t allocations = 0;
+};
+HeapStats heap();
+void resetHeapPeak();
+void beginHeapAccounting();                     // called by main(). Allocations of the static initialization are not counted
+class HeapAccountingOff {                       // allocations in this scope are harness internals
+  public:
+    HeapAccountingOff();
+    ~HeapAccountingOff();
+  private:
+    bool _previous;
+};
+const size_t HEAP_SIZE = 290000;                // free heap of the sketch at boot
+
+/********************************************************************************
+  Counting ILI9341 display. Every pixel sent to the display is written to the frame (240x320, rotation 0)
+********************************************************************************/
+struct DisplayStats {
+  uint64_t transactions = 0;                    // startWrite() (SPI transaction + CS)
+  uint64_t addressWindows = 0;                  // setAddrWindow()
+  uint64_t pixels = 0;                          // pixels sent
+  uint64_t fills = 0;                           // fillScreen()
+};
+DisplayStats &display();
+uint16_t displayPixel(int x, int y);
+const std::vector<uint16_t> &displayFrame();
+
+/********************************************************************************
+  GPS replay (Serial1)
+  NMEA sentences are delivered at the UART baud rate into a receive buffer of GPS_SERIAL_RX_BUFFER_SIZE bytes.
+  Bytes that arrive while the buffer is full are lost.
+********************************************************************************/
+std::string nmeaSentence(const std::string &body);          // adds $ and the checksum
+std::string nmeaCoordinate(int32_t microdegrees, bool latitude);   // "5332.15034,N"
+struct GpsPosition {
+  int32_t latitude;                             // microdegrees
+  int32_t longitude;
+  float speedKnots;
+  bool fix;
+  int satellites;
+};
+class GpsReplay {
+  public:
+    virtual ~GpsReplay() {}
+    virtual bool next(uint64_t now_us, uint64_t &at_us, std::string &sentences) = 0;   // next burst of sentences
+};
+//Sends RMC + GGA (+ GSA/GSV when extra) once per period from position(), like the PA1616 at 1 Hz
+class GpsRoute : public GpsReplay {
+  public:
+    std::function<GpsPosition(uint64_t now_us)> position;
+    uint32_t period_ms = 1000;
+    bool extraSentences = false;
+    bool next(uint64_t now_us, uint64_t &at_us, std::string &sentences) override;
+  private:
+    uint64_t _next_us = 500000;
+};
+//Replays recorded sentences with their timestamps
+class GpsRecording : public GpsReplay {
+  public:
+    std::vector<std::pair<uint64_t, std::string>> sentences;   // time(us), sentences
+    bool next(uint64_t now_us, uint64_t &at_us, std::string &sentences) override;
+  private:
+    size_t _index = 0;
+};
+struct GpsUartStats {
+  uint64_t delivered = 0;                       // bytes received by the UART
+  uint64_t lost = 0;                            // bytes lost because the receive buffer was full
+  uint64_t maxBuffered = 0;
+};
+void setGpsReplay(std::shared_ptr<GpsReplay> replay, uint32_t baud = 9600);
+GpsUartStats &gpsUart();
+const std::string &gpsCommands();               // bytes written to Serial1 (PMTK commands)
+
+/********************************************************************************
+  WiFi and MQTT broker
+********************************************************************************/
+struct MqttMessage {
+  uint64_t time_us;
+  std::string topic;
+  std::string payload;
+};
+struct MqttBroker {
+  bool wifiAvailable = true;
+  bool brokerAvailable = true;
+  uint32_t wifiConnect_ms = 1500;
+  uint32_t mqttConnect_ms = 300;
+  size_t maxPacketSize = 0;                     // 0 = MQTT_MAX_PACKET_SIZE
+  std::vector<MqttMessage> published;
+  std::vector<std::string> subscriptions;
+  uint64_t connects = 0;
+  uint64_t rejected = 0;                        // publishes larger than the packet size or while disconnected
+  void deliver(const std::string &topic, const std::string &payload);   // message from the broker to the scooter
+  std::vector<MqttMessage> on(const std::string &topic) const;
+};
+MqttBroker &mqtt();
+
+/********************************************************************************
+  TCP network. Servers are registered by host:port and reached through WiFiClient
+********************************************************************************/
+class Connection;
+class Server {
+  public:
+    virtual ~Server() {}
+    bool up = true;                             // = false -> connections time out
+    uint32_t connect_ms = 2;                    // TCP handshake
+    virtual void received(const std::shared_ptr<Connection> &connection) = 0;   // new bytes from the client
+};
+class Connection {
+  public:
+    Server *server = nullptr;
+    std::string request;                        // bytes from the client that the server has not consumed
+    void send(const std::string &data, uint64_t at_us, double bytesPerUs = 1.0);   // bytes to the client from at_us
+    void close(uint64_t at_us);                 // the server closes the connection at at_us
+    struct Segment {
+      uint64_t at_us;
+      std::string data;
+    };
+    std::vector<Segment> segments;              // bytes to the client. Readable from at_us
+    size_t readSegment = 0;
+    size_t readOffset = 0;
+    uint64_t closeAt_us = UINT64_MAX;
+    bool clientClosed = false;
+    uint64_t lastActivity_us = 0;
+    uint32_t requests = 0;
+};
+void listen(const std::string &host, int port, Server *server);
+void unlisten(const std::string &host, int port);
+
+/********************************************************************************
+  Fake Ark bridgechain and relays (REST API of Ark Core 2.6)
+  The chain holds the scooter wallet: its balance and confirmed nonce, the transactions it received and the
+  transactions it sent. A block is forged every blockTime_ms. Transactions received or accepted in the pool
+  are confirmed by the next block. Every relay serves the same chain.
+********************************************************************************/
+struct ArkReceived {
+  uint64_t at_us;                               // time the transaction reached the pool
+  std::string id;
+  uint16_t type;
+  uint32_t typeGroup;
+  uint64_t amount;
+  std::string sender;
+  std::string senderPublicKey;
+  std::string sessionId;                        // RentalStart only
+};
+struct ArkPoolEntry {
+  uint64_t at_us;
+  std::string id;
+  uint64_t nonce;
+  uint64_t amount;
+  uint64_t fee;
+};
+struct ArkChain {
+  std::string address;                          // scooter wallet (ArkAddress)
+  std::string publicKey;
+  uint64_t balance = 94968174556ULL;
+  uint64_t nonce = 0;                           // confirmed nonce of the scooter wallet
+  uint32_t blockTime_ms = 8000;
+  std::vector<ArkReceived> received;
+  std::vector<ArkPoolEntry> pool;               // transactions of the scooter waiting for a block
+  std::vector<std::string> forged;              // ids of the forged transactions of the scooter
+  uint64_t accepted = 0;                        // transactions accepted into the pool
+  void update(uint64_t now_us);                 // forges the blocks up to now_us
+  uint64_t blockAfter(uint64_t at_us) const;    // time of the block that confirms a transaction sent at at_us
+  std::vector<const ArkReceived *> confirmedReceived(uint64_t now_us) const;
+  uint64_t poolNonce() const;                   // nonce of the wallet including the pool
+  //Transactions to the scooter wallet. Return the id
+  std::string receiveTransfer(uint64_t amount, int rider = 1);
+  std::string receiveRentalStart(const std::string &sessionId, uint64_t amount, int rider = 1);
+};
+ArkChain &arkChain();                           // the address and key are set from secrets.h by the sketch unit
+std::string riderAddress(int rider);
+bool saveArkChain(const std::string &path);     // the chain survives rebootAfter()
+bool loadArkChain(const std::string &path);
+
+class ArkRelay : public Server {
+  public:
+    bool synced = true;
+    uint32_t latency_ms = 20;                   // time to the response head
+    double bytesPerUs = 2.0;                    // body bytes per microsecond
+    int status = 0;                             // != 0 -> every request is answered with this HTTP code
+    bool ignoreDuplicates = false;              // = true -> a known transaction is answered as accepted again
+    uint32_t idleClose_ms = 5000;               // keep-alive timeout of the relay
+    struct Request {
+      uint64_t at_us;
+      std::string method;
+      std::string path;
+      std::string body;
+      int status;
+    };
+    std::vector<Request> requests;
+    size_t count(const std::string &method, const std::string &pathPrefix) const;
+    void received(const std::shared_ptr<Connection> &connection) override;
+  private:
+    std::string respond(const std::string &method, const std::string &path, const std::string &body, int &status);
+    std::string postTransactions(const std::string &body, int &status);
+};
+
+/********************************************************************************
+  Flash (EEPROM sector and SPIFFS files). Survives reboot() in the same test
+********************************************************************************/
+struct Flash {
+  std::vector<uint8_t> eeprom = std::vector<uint8_t>(4096, 0xFF);
+  std::map<std::string, std::vector<uint8_t>> files;
+  bool spiffsMountable = true;
+  uint64_t bytesWritten = 0;
+  uint64_t eepromCommits = 0;
+};
+Flash &flash();
+bool saveFlash(const std::string &path);
+bool loadFlash(const std::string &path);
+
+/********************************************************************************
+  Runs firstBoot in a forked process with fresh globals and saves the flash and the Ark chain when it returns, then
+  loads them and returns to the caller with fresh globals too (a reboot). = false when the first boot failed
+********************************************************************************/
+bool rebootAfter(const std::function<void()> &firstBoot);
+
+}
+
+#endif
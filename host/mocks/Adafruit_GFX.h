@@ -0,0 +1,146 @@
+/********************************************************************************
+  Host stand-in for the Adafruit GFX library (1.7)
+  The drawing primitives follow the library so the same SPI traffic is generated: text in a custom font is drawn one
+  pixel at a time (writePixel), circles and rounded rectangles are drawn with vertical lines (writeFillRect).
+  Adafruit_SPITFT counts the SPI transactions, address windows and pixels (see host/src/gfx.cpp)
+********************************************************************************/
+#ifndef HOST_ADAFRUIT_GFX_H
+#define HOST_ADAFRUIT_GFX_H
+
+#include <Arduino.h>
+
+typedef struct {
+  uint16_t bitmapOffset;
+  uint8_t width;
+  uint8_t height;
+  uint8_t xAdvance;
+  int8_t xOffset;
+  int8_t yOffset;
+} GFXglyph;
+
+typedef struct {
+  uint8_t *bitmap;
+  GFXglyph *glyph;
+  uint16_t first;
+  uint16_t last;
+  uint8_t yAdvance;
+} GFXfont;
+
+class Adafruit_GFX : public Print {
+  public:
+    Adafruit_GFX(int16_t w, int16_t h) : _width(w), _height(h) {}
+
+    virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+    virtual void startWrite() {}
+    virtual void endWrite() {}
+    virtual void writePixel(int16_t x, int16_t y, uint16_t color) {
+      drawPixel(x, y, color);
+    }
+    virtual void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    virtual void fillScreen(uint16_t color) {
+      fillRect(0, 0, _width, _height, color);
+    }
+    void writeFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) {
+      writeFillRect(x, y, 1, h, color);
+    }
+    void fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color);
+    void fillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t corners, int16_t delta, uint16_t color);
+    void fillRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color);
+    void drawBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint16_t color);
+
+    void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size);
+    size_t write(uint8_t c) override;
+    using Print::write;
+    void setCursor(int16_t x, int16_t y) {
+      _cursorX = x;
+      _cursorY = y;
+    }
+    void setTextColor(uint16_t c) {
+      _textColor = _textBackground = c;
+    }
+    void setTextColor(uint16_t c, uint16_t bg) {
+      _textColor = c;
+      _textBackground = bg;
+    }
+    void setTextSize(uint8_t size) {
+      _textSize = size ? size : 1;
+    }
+    void setTextWrap(bool wrap) {
+      _wrap = wrap;
+    }
+    void setFont(const GFXfont *font);
+    void getTextBounds(const char *text, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h);
+    void getTextBounds(const String &text, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h) {
+      getTextBounds(text.c_str(), x, y, x1, y1, w, h);
+    }
+    int16_t width() const {
+      return _width;
+    }
+    int16_t height() const {
+      return _height;
+    }
+    int16_t getCursorX() const {
+      return _cursorX;
+    }
+    int16_t getCursorY() const {
+      return _cursorY;
+    }
+    void setRotation(uint8_t r) {
+      _rotation = r & 3;
+    }
+
+  protected:
+    void charBounds(unsigned char c, int16_t *x, int16_t *y, int16_t *minx, int16_t *miny, int16_t *maxx, int16_t *maxy);
+    int16_t _width;
+    int16_t _height;
+    int16_t _cursorX = 0;
+    int16_t _cursorY = 0;
+    uint16_t _textColor = 0xFFFF;
+    uint16_t _textBackground = 0xFFFF;
+    uint8_t _textSize = 1;
+    uint8_t _rotation = 0;
+    bool _wrap = true;
+    const GFXfont *_font = nullptr;
+};
+
+//16 bit off-screen canvas. The buffer is allocated on the heap like the library
+class GFXcanvas16 : public Adafruit_GFX {
+  public:
+    GFXcanvas16(uint16_t w, uint16_t h);
+    ~GFXcanvas16();
+    void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+    void fillScreen(uint16_t color) override;
+    uint16_t *getBuffer() const {
+      return _buffer;
+    }
+
+  private:
+    uint16_t *_buffer;
+};
+
+//SPI display. Every command and pixel is counted and the pixels are written to the frame of the harness
+class Adafruit_SPITFT : public Adafruit_GFX {
+  public:
+    Adafruit_SPITFT(uint16_t w, uint16_t h) : Adafruit_GFX(w, h) {}
+    void startWrite() override;
+    void endWrite() override;
+    void setAddrWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+    void writePixel(int16_t x, int16_t y, uint16_t color) override;
+    void writePixels(uint16_t *colors, uint32_t len, bool block = true, bool bigEndian = false);
+    void writeColor(uint16_t color, uint32_t len);
+    void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override;
+    void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override;
+    void fillScreen(uint16_t color) override;
+
+  private:
+    void pushPixel(uint16_t color);
+    int16_t _windowX = 0;
+    int16_t _windowY = 0;
+    int16_t _windowW = 0;
+    int16_t _windowH = 0;
+    uint32_t _windowOffset = 0;
+};
+
+#endif
@@ -0,0 +1,43 @@
+/********************************************************************************
+  Host stand-in for the Adafruit GPS library (1.5). Only the parts used by the sketch: the commands and parse() of the
+  RMC and GGA sentences. The NMEA bytes are delivered to Serial1 by the GPS replay of the harness (host::setGpsReplay())
+********************************************************************************/
+#ifndef HOST_ADAFRUIT_GPS_H
+#define HOST_ADAFRUIT_GPS_H
+
+#include <Arduino.h>
+
+#define PMTK_SET_NMEA_UPDATE_1HZ "$PMTK220,1000*1F"
+#define PMTK_SET_NMEA_UPDATE_5HZ "$PMTK220,200*2C"
+#define PMTK_SET_NMEA_OUTPUT_RMCONLY "$PMTK314,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0*29"
+#define PMTK_SET_NMEA_OUTPUT_RMCGGA "$PMTK314,0,1,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0*28"
+#define PMTK_SET_NMEA_OUTPUT_ALLDATA "$PMTK314,1,1,1,1,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0*28"
+#define PGCMD_ANTENNA "$PGCMD,33,1*6C"
+#define PGCMD_NOANTENNA "$PGCMD,33,0*6D"
+#define PMTK_Q_RELEASE "$PMTK605*31"
+
+class Adafruit_GPS {
+  public:
+    explicit Adafruit_GPS(HardwareSerial *serial) : _serial(serial) {}
+    bool begin(uint32_t baud);
+    void sendCommand(const char *command);
+    bool parse(char *nmea);
+    char *lastNMEA() {
+      return _lastNMEA;
+    }
+
+    bool fix = false;
+    uint8_t fixquality = 0;
+    uint8_t satellites = 0;
+    float speed = 0;          // knots
+    float angle = 0;
+    float latitudeDegrees = 0;
+    float longitudeDegrees = 0;
+    uint8_t hour = 0, minute = 0, seconds = 0;
+
+  private:
+    HardwareSerial *_serial;
+    char _lastNMEA[120] = "";
+};
+
+#endif
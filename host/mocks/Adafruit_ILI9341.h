@@ -0,0 +1,31 @@
+/********************************************************************************
+  Host stand-in for the Adafruit ILI9341 library. 240x320 display counted by Adafruit_SPITFT (see host/src/gfx.cpp)
+********************************************************************************/
+#ifndef HOST_ADAFRUIT_ILI9341_H
+#define HOST_ADAFRUIT_ILI9341_H
+
+#include "Adafruit_GFX.h"
+#include "SPI.h"
+
+#define ILI9341_TFTWIDTH 240
+#define ILI9341_TFTHEIGHT 320
+
+#define ILI9341_BLACK 0x0000
+#define ILI9341_NAVY 0x000F
+#define ILI9341_DARKGREEN 0x03E0
+#define ILI9341_BLUE 0x001F
+#define ILI9341_GREEN 0x07E0
+#define ILI9341_CYAN 0x07FF
+#define ILI9341_RED 0xF800
+#define ILI9341_MAGENTA 0xF81F
+#define ILI9341_YELLOW 0xFFE0
+#define ILI9341_WHITE 0xFFFF
+#define ILI9341_ORANGE 0xFD20
+
+class Adafruit_ILI9341 : public Adafruit_SPITFT {
+  public:
+    Adafruit_ILI9341(int8_t cs, int8_t dc, int8_t rst = -1) : Adafruit_SPITFT(ILI9341_TFTWIDTH, ILI9341_TFTHEIGHT) {}
+    void begin(uint32_t freq = 0);
+};
+
+#endif
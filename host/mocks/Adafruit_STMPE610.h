@@ -0,0 +1,32 @@
+/********************************************************************************
+  Host stand-in for the Adafruit STMPE610 touch controller. The touchscreen is never touched
+********************************************************************************/
+#ifndef HOST_ADAFRUIT_STMPE610_H
+#define HOST_ADAFRUIT_STMPE610_H
+
+#include <Arduino.h>
+
+class TS_Point {
+  public:
+    TS_Point(int16_t x = 0, int16_t y = 0, int16_t z = 0) : x(x), y(y), z(z) {}
+    int16_t x, y, z;
+};
+
+class Adafruit_STMPE610 {
+  public:
+    explicit Adafruit_STMPE610(uint8_t cs) {}
+    bool begin(uint8_t i2caddr = 0x41) {
+      return true;
+    }
+    bool touched() {
+      return false;
+    }
+    bool bufferEmpty() {
+      return true;
+    }
+    TS_Point getPoint() {
+      return TS_Point();
+    }
+};
+
+#endif
@@ -0,0 +1,339 @@
+/********************************************************************************
+  Host stand-in for the ESP32 Arduino core (1.0.4)
+  Only the parts used by the sketch are provided. Time is simulated (see host/src/runtime.cpp):
+  millis()/micros() only advance when a task sleeps or waits and by the modeled cost of the peripherals.
+********************************************************************************/
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ctime>
+#include <cstdio>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+using std::min;     // the ESP32 core imports std::min/max, so both arguments must have the same type
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x02
+#define INPUT_PULLUP 0x05
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_pointer(addr) ((void *)*(void *const *)(addr))
+
+#ifndef constrain
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#endif
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+long random(long howbig);
+long random(long howsmall, long howbig);
+
+//time() and printf() of the sketch are redirected to the simulated clock and to the captured serial output
+time_t hostTime(time_t *t);
+#define time(t) hostTime(t)
+int hostPrintf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+#define printf(...) hostPrintf(__VA_ARGS__)
+
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char *server1, const char *server2 = nullptr, const char *server3 = nullptr);
+
+uint32_t millis();          // unsigned long is 32 bits on the ESP32: the counters wrap like on the scooter
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+
+char *utoa(unsigned int value, char *str, int base);
+char *itoa(int value, char *str, int base);
+char *ltoa(long value, char *str, int base);
+char *ultoa(unsigned long value, char *str, int base);
+#if !defined(__GLIBC__) || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+#endif
+
+
+/********************************************************************************
+  String
+********************************************************************************/
+class String {
+  public:
+    String(const char *s = "") : _s(s ? s : "") {}
+    String(const std::string &s) : _s(s) {}
+    explicit String(char c) : _s(1, c) {}
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(double value, unsigned char decimals = 2);
+
+    const char *c_str() const {
+      return _s.c_str();
+    }
+    unsigned int length() const {
+      return _s.length();
+    }
+    bool reserve(unsigned int size) {
+      _s.reserve(size);
+      return true;
+    }
+    char operator[](unsigned int index) const {
+      return index < _s.length() ? _s[index] : 0;
+    }
+    char charAt(unsigned int index) const {
+      return (*this)[index];
+    }
+    bool equals(const String &other) const {
+      return _s == other._s;
+    }
+    bool operator==(const String &other) const {
+      return _s == other._s;
+    }
+    bool operator==(const char *other) const {
+      return _s == (other ? other : "");
+    }
+    bool operator!=(const String &other) const {
+      return _s != other._s;
+    }
+    bool operator!=(const char *other) const {
+      return !(*this == other);
+    }
+    String &operator+=(const String &other) {
+      _s += other._s;
+      return *this;
+    }
+    String &operator+=(const char *other) {
+      _s += other ? other : "";
+      return *this;
+    }
+    String &operator+=(char c) {
+      _s += c;
+      return *this;
+    }
+    bool concat(const String &other) {
+      _s += other._s;
+      return true;
+    }
+    bool concat(const char *other) {
+      _s += other ? other : "";
+      return true;
+    }
+    bool concat(char c) {
+      _s += c;
+      return true;
+    }
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const char *s, unsigned int from = 0) const;
+    bool startsWith(const char *prefix) const {
+      return _s.compare(0, strlen(prefix), prefix) == 0;
+    }
+    String substring(unsigned int from, unsigned int to = 0xFFFFFFFF) const;
+    long toInt() const {
+      return atol(_s.c_str());
+    }
+    float toFloat() const {
+      return atof(_s.c_str());
+    }
+    void trim();
+    const std::string &str() const {
+      return _s;
+    }
+
+  private:
+    std::string _s;
+};
+
+String operator+(const String &a, const String &b);
+String operator+(const String &a, const char *b);
+String operator+(const char *a, const String &b);
+
+
+/********************************************************************************
+  Print and Stream
+********************************************************************************/
+class Print;
+
+class Printable {
+  public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *s) {
+      return s ? write((const uint8_t *) s, strlen(s)) : 0;
+    }
+    size_t write(const char *buffer, size_t size) {
+      return write((const uint8_t *) buffer, size);
+    }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const char *s);
+    size_t print(const String &s);
+    size_t print(char c);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+    size_t print(const Printable &p);
+
+    size_t println();
+    template <typename T> size_t println(const T &value) {
+      size_t n = print(value);
+      return n + println();
+    }
+    template <typename T> size_t println(const T &value, int format) {
+      size_t n = print(value, format);
+      return n + println();
+    }
+
+  private:
+    size_t printNumber(unsigned long value, int base);
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+
+    void setTimeout(unsigned long timeout_ms) {
+      _timeout = timeout_ms;
+    }
+    unsigned long getTimeout() const {
+      return _timeout;
+    }
+    bool find(const char *target);
+    bool find(const char *target, size_t length);
+    bool find(char target) {
+      char text[2] = {target, '\0'};
+      return find(text);
+    }
+    bool findUntil(const char *target, const char *terminator);
+    virtual size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) {
+      return readBytes((char *) buffer, length);
+    }
+    size_t readBytesUntil(char terminator, char *buffer, size_t length);
+    size_t readBytesUntil(char terminator, uint8_t *buffer, size_t length) {
+      return readBytesUntil(terminator, (char *) buffer, length);
+    }
+    long parseInt();
+    String readString();
+    String readStringUntil(char terminator);
+
+  protected:
+    int timedRead();
+    int timedPeek();
+    unsigned long _timeout = 1000;
+    uint32_t _startMillis = 0;
+};
+
+
+/********************************************************************************
+  Serial ports
+  Serial (UART0) is captured by the harness (host::serialLog()). Serial1 receives the bytes of the GPS replay.
+********************************************************************************/
+#define SERIAL_8N1 0x800001c
+
+class HardwareSerial : public Stream {
+  public:
+    explicit HardwareSerial(int uart) : _uart(uart) {}
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1, bool invert = false, unsigned long timeout_ms = 20000UL);
+    void end() {}
+    size_t setRxBufferSize(size_t size);
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override {}
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    operator bool() const {
+      return true;
+    }
+    unsigned long baudRate() const {
+      return _baud;
+    }
+
+  private:
+    int _uart;
+    unsigned long _baud = 115200;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+
+/********************************************************************************
+  ESP32 system
+********************************************************************************/
+class EspClass {
+  public:
+    uint32_t getCycleCount();
+    uint8_t getCpuFreqMHz() {
+      return 240;
+    }
+    uint32_t getHeapSize();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    void restart();
+};
+extern EspClass ESP;
+
+#define MALLOC_CAP_8BIT (1 << 2)
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+
+typedef enum {
+  ESP_MAC_WIFI_STA,
+  ESP_MAC_WIFI_SOFTAP,
+  ESP_MAC_BT,
+  ESP_MAC_ETH,
+} esp_mac_type_t;
+int esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+uint32_t esp_random();
+
+#include "freertos/FreeRTOS.h"
+
+#endif
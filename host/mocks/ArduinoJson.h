@@ -0,0 +1,453 @@
+/********************************************************************************
+  Host stand-in for ArduinoJson 6.15 (deserialization with filters, and the accessors used by the sketch)
+  The memory pool of a document is modeled like the library on the ESP32: 16 bytes per value slot plus the copied
+  strings. A document whose values do not fit in its capacity fails with NoMemory, like on the scooter.
+  The input is read one character at a time with a one character look-ahead, so a stream is left just after the
+  value that was parsed.
+********************************************************************************/
+#ifndef HOST_ARDUINOJSON_H
+#define HOST_ARDUINOJSON_H
+
+#include <Arduino.h>
+#include "host.h"
+
+namespace host_json {
+
+enum NodeType : uint8_t {JSON_NULL, JSON_BOOL, JSON_INTEGER, JSON_FLOAT, JSON_STRING, JSON_OBJECT, JSON_ARRAY};
+
+struct Node {
+  NodeType type = JSON_NULL;
+  const char *key = nullptr;
+  Node *next = nullptr;                 // next member/element of the parent
+  Node *child = nullptr;                // first member/element (JSON_OBJECT, JSON_ARRAY)
+  union {
+    bool b;
+    int64_t i;
+    double f;
+    const char *s;
+  };
+  Node() : i(0) {}
+};
+
+const size_t SLOT_SIZE = 16;            // sizeof(VariantSlot) on the ESP32
+
+}
+
+//capacity of the values of an array/object (ArduinoJson 6 on the ESP32)
+#define JSON_ARRAY_SIZE(n) ((n) * host_json::SLOT_SIZE)
+#define JSON_OBJECT_SIZE(n) ((n) * host_json::SLOT_SIZE)
+
+class JsonDocument;
+class JsonObject;
+
+class DeserializationError {
+  public:
+    enum Code {Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, NotSupported, TooDeep};
+    DeserializationError(Code code = Ok) : _code(code) {}
+    const char *c_str() const {
+      static const char *const names[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "NotSupported", "TooDeep"};
+      return names[_code];
+    }
+    Code code() const {
+      return _code;
+    }
+    explicit operator bool() const {
+      return _code != Ok;
+    }
+    bool operator==(Code code) const {
+      return _code == code;
+    }
+    bool operator!=(Code code) const {
+      return _code != code;
+    }
+
+  private:
+    Code _code;
+};
+
+class JsonVariant {
+  public:
+    JsonVariant() {}
+    JsonVariant(JsonDocument *doc, host_json::Node *node, host_json::Node *parentNode = nullptr,
+                const JsonVariant *parentProxy = nullptr, const char *key = nullptr)
+      : _doc(doc), _node(node), _parentNode(parentNode), _parentProxy(parentProxy), _key(key) {}
+
+    JsonVariant operator[](const char *key) const;
+    JsonVariant operator[](int index) const;
+    bool isNull() const {
+      return !_node || (_node->type == host_json::JSON_NULL);
+    }
+    template <typename T> T as() const;
+    template <typename T> bool is() const;
+
+    operator bool() const {
+      return as<bool>();
+    }
+    operator const char *() const {
+      return as<const char *>();
+    }
+    operator JsonObject() const;
+
+    const JsonVariant &operator=(bool value) const;
+    const JsonVariant &operator=(int value) const {
+      return setInteger(value);
+    }
+    const JsonVariant &operator=(long value) const {
+      return setInteger(value);
+    }
+    const JsonVariant &operator=(long long value) const {
+      return setInteger(value);
+    }
+    const JsonVariant &operator=(unsigned long long value) const {
+      return setInteger((int64_t) value);
+    }
+    const JsonVariant &operator=(const char *value) const;
+    const JsonVariant &operator=(const JsonVariant &) = delete;
+
+    host_json::Node *node() const {
+      return _node;
+    }
+
+  private:
+    friend class JsonDocument;
+    const JsonVariant &setInteger(int64_t value) const;
+    host_json::Node *getOrCreate() const;     // creates the member (and its parents) when a value is assigned
+    JsonDocument *_doc = nullptr;
+    mutable host_json::Node *_node = nullptr;
+    host_json::Node *_parentNode = nullptr;
+    const JsonVariant *_parentProxy = nullptr;
+    const char *_key = nullptr;
+};
+
+class JsonObject {
+  public:
+    JsonObject() {}
+    JsonObject(JsonDocument *doc, host_json::Node *node) : _doc(doc), _node(node) {}
+    bool isNull() const {
+      return !_node;
+    }
+    JsonVariant operator[](const char *key) const;
+    size_t size() const {
+      size_t n = 0;
+      for (host_json::Node *member = _node ? _node->child : nullptr; member; member = member->next) {
+        n++;
+      }
+      return n;
+    }
+    bool containsKey(const char *key) const {
+      return !(*this)[key].isNull();
+    }
+
+  private:
+    JsonDocument *_doc = nullptr;
+    host_json::Node *_node = nullptr;
+};
+
+class JsonDocument {
+  public:
+    JsonDocument(const JsonDocument &) = delete;
+    JsonDocument &operator=(const JsonDocument &) = delete;
+
+    JsonVariant operator[](const char *key) {
+      return JsonVariant(this, find(&_root, key), &_root, nullptr, key);
+    }
+    JsonVariant operator[](int index) {
+      return JsonVariant(this, &_root)[index];
+    }
+    template <typename T> T as() {
+      return JsonVariant(this, &_root).as<T>();
+    }
+    bool isNull() const {
+      return _root.type == host_json::JSON_NULL;
+    }
+    void clear() {
+      _root = host_json::Node();
+      _used = 0;
+      _modelUsage = 0;
+    }
+    size_t capacity() const {
+      return _capacity;
+    }
+    size_t memoryUsage() const {
+      return _modelUsage;
+    }
+
+    //Internal interface of the parser and the variants
+    host_json::Node *root() {
+      return &_root;
+    }
+    host_json::Node *addChild(host_json::Node *parent, const char *key, size_t keyLength, bool copyKey);
+    const char *storeString(const char *s, size_t length);
+    static host_json::Node *find(host_json::Node *object, const char *key);
+
+  protected:
+    JsonDocument(char *pool, size_t poolSize, size_t capacity) : _pool(pool), _poolSize(poolSize), _capacity(capacity) {}
+    void *allocate(size_t size, size_t modelSize);
+    char *_pool;
+    size_t _poolSize;
+    size_t _capacity;
+    size_t _used = 0;
+    size_t _modelUsage = 0;
+    host_json::Node _root;
+};
+
+template <size_t CAPACITY> class StaticJsonDocument : public JsonDocument {
+  public:
+    StaticJsonDocument() : JsonDocument(_storage, sizeof(_storage), CAPACITY) {}
+
+  private:
+    alignas(8) char _storage[CAPACITY * 4 + 64];     // the host nodes are larger than the slots of the ESP32
+};
+
+//The pool is allocated on the heap. The heap accounting sees capacity bytes like on the ESP32
+class DynamicJsonDocument : public JsonDocument {
+  public:
+    explicit DynamicJsonDocument(size_t capacity) : JsonDocument(nullptr, 0, capacity) {
+      _modelPool = new char[capacity];
+      host::HeapAccountingOff internal;
+      _poolSize = capacity * 4 + 64;
+      _pool = new char[_poolSize];
+    }
+    ~DynamicJsonDocument() {
+      delete[] _pool;
+      delete[] _modelPool;
+    }
+
+  private:
+    char *_modelPool;
+};
+
+namespace DeserializationOption {
+class Filter {
+  public:
+    explicit Filter(JsonDocument &filter) : _node(filter.root()) {}
+    explicit Filter(host_json::Node *node) : _node(node) {}
+    bool allow() const {
+      return _node && ((_node->type == host_json::JSON_OBJECT) || (_node->type == host_json::JSON_ARRAY) || allowValue());
+    }
+    bool allowValue() const {
+      return _node && (_node->type == host_json::JSON_BOOL) && _node->b;
+    }
+    bool allowObject() const {
+      return allowValue() || (_node && (_node->type == host_json::JSON_OBJECT));
+    }
+    bool allowArray() const {
+      return allowValue() || (_node && (_node->type == host_json::JSON_ARRAY));
+    }
+    Filter member(const char *key) const {
+      if (allowValue()) {
+        return *this;
+      }
+      host_json::Node *member = JsonDocument::find(_node, key);
+      return Filter(member ? member : JsonDocument::find(_node, "*"));
+    }
+    Filter element() const {
+      if (allowValue()) {
+        return *this;
+      }
+      return Filter((_node && (_node->type == host_json::JSON_ARRAY)) ? _node->child : nullptr);
+    }
+
+  private:
+    host_json::Node *_node;
+};
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, Stream &input);
+DeserializationError deserializeJson(JsonDocument &doc, Stream &input, DeserializationOption::Filter filter);
+DeserializationError deserializeJson(JsonDocument &doc, const char *input);
+DeserializationError deserializeJson(JsonDocument &doc, const char *input, DeserializationOption::Filter filter);
+DeserializationError deserializeJson(JsonDocument &doc, const String &input);
+DeserializationError deserializeJson(JsonDocument &doc, const std::string &input);
+
+inline JsonVariant::operator JsonObject() const {
+  return as<JsonObject>();
+}
+
+template <typename T> bool JsonVariant::is() const {
+  using namespace host_json;
+  if (!_node) {
+    return false;
+  }
+  if (std::is_same<T, bool>::value) {
+    return _node->type == JSON_BOOL;
+  }
+  if (std::is_same<T, const char *>::value) {
+    return _node->type == JSON_STRING;
+  }
+  if (std::is_same<T, JsonObject>::value) {
+    return _node->type == JSON_OBJECT;
+  }
+  if (std::is_integral<T>::value) {
+    return _node->type == JSON_INTEGER;
+  }
+  if (std::is_floating_point<T>::value) {
+    return (_node->type == JSON_INTEGER) || (_node->type == JSON_FLOAT);
+  }
+  return false;
+}
+
+namespace host_json {
+template <typename T> struct As {
+  static T get(JsonDocument *, Node *node) {
+    if (!node) {
+      return T();
+    }
+    switch (node->type) {
+      case JSON_BOOL:
+        return (T) node->b;
+      case JSON_INTEGER:
+        return (T) node->i;
+      case JSON_FLOAT:
+        return (T) node->f;
+      case JSON_STRING:
+        return std::is_floating_point<T>::value ? (T) strtod(node->s, NULL) : (T) strtoll(node->s, NULL, 10);
+      default:
+        return T();
+    }
+  }
+};
+template <> struct As<bool> {
+  static bool get(JsonDocument *, Node *node) {
+    if (!node) {
+      return false;
+    }
+    switch (node->type) {
+      case JSON_BOOL:
+        return node->b;
+      case JSON_INTEGER:
+        return node->i != 0;
+      case JSON_FLOAT:
+        return node->f != 0;
+      default:
+        return false;
+    }
+  }
+};
+template <> struct As<const char *> {
+  static const char *get(JsonDocument *, Node *node) {
+    return (node && (node->type == JSON_STRING)) ? node->s : nullptr;
+  }
+};
+template <> struct As<char *> {
+  static char *get(JsonDocument *, Node *node) {
+    return (node && (node->type == JSON_STRING)) ? (char *) node->s : nullptr;
+  }
+};
+template <> struct As<String> {
+  static String get(JsonDocument *, Node *node) {
+    return String((node && (node->type == JSON_STRING)) ? node->s : "null");
+  }
+};
+template <> struct As<JsonObject> {
+  static JsonObject get(JsonDocument *doc, Node *node) {
+    return (node && (node->type == JSON_OBJECT)) ? JsonObject(doc, node) : JsonObject();
+  }
+};
+}
+
+template <typename T> T JsonVariant::as() const {
+  return host_json::As<T>::get(_doc, _node);
+}
+
+inline JsonVariant JsonVariant::operator[](const char *key) const {
+  host_json::Node *member = (_node && (_node->type == host_json::JSON_OBJECT)) ? JsonDocument::find(_node, key) : nullptr;
+  return JsonVariant(_doc, member, _node, _node ? nullptr : this, key);
+}
+
+inline JsonVariant JsonVariant::operator[](int index) const {
+  host_json::Node *element = (_node && (_node->type == host_json::JSON_ARRAY)) ? _node->child : nullptr;
+  for (int i = 0; element && (i < index); i++) {
+    element = element->next;
+  }
+  return JsonVariant(_doc, element);
+}
+
+inline host_json::Node *JsonVariant::getOrCreate() const {
+  if (_node) {
+    return _node;
+  }
+  host_json::Node *parent = _parentNode ? _parentNode : (_parentProxy ? _parentProxy->getOrCreate() : nullptr);
+  if (!parent || !_key) {
+    return nullptr;
+  }
+  if (parent->type == host_json::JSON_NULL) {
+    parent->type = host_json::JSON_OBJECT;
+  }
+  if (parent->type != host_json::JSON_OBJECT) {
+    return nullptr;
+  }
+  _node = _doc->addChild(parent, _key, strlen(_key), false);
+  return _node;
+}
+
+inline const JsonVariant &JsonVariant::operator=(bool value) const {
+  host_json::Node *node = getOrCreate();
+  if (node) {
+    node->child = nullptr;
+    node->type = host_json::JSON_BOOL;
+    node->b = value;
+  }
+  return *this;
+}
+
+inline const JsonVariant &JsonVariant::setInteger(int64_t value) const {
+  host_json::Node *node = getOrCreate();
+  if (node) {
+    node->child = nullptr;
+    node->type = host_json::JSON_INTEGER;
+    node->i = value;
+  }
+  return *this;
+}
+
+inline const JsonVariant &JsonVariant::operator=(const char *value) const {
+  host_json::Node *node = getOrCreate();
+  if (node) {
+    node->child = nullptr;
+    node->type = value ? host_json::JSON_STRING : host_json::JSON_NULL;
+    node->s = value;      //stored as a pointer like the library does for const char*
+  }
+  return *this;
+}
+
+inline JsonVariant JsonObject::operator[](const char *key) const {
+  return JsonVariant(_doc, _node ? JsonDocument::find(_node, key) : nullptr, _node, nullptr, key);
+}
+
+template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+inline bool operator==(const JsonVariant &variant, T value) {
+  host_json::Node *node = variant.node();
+  if (!node) {
+    return false;
+  }
+  if (node->type == host_json::JSON_INTEGER) {
+    return node->i == (int64_t) value;
+  }
+  if (node->type == host_json::JSON_FLOAT) {
+    return node->f == (double) value;
+  }
+  if (node->type == host_json::JSON_BOOL) {
+    return std::is_same<T, bool>::value && (node->b == (bool) value);
+  }
+  return false;
+}
+template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+inline bool operator!=(const JsonVariant &variant, T value) {
+  return !(variant == value);
+}
+inline bool operator==(const JsonVariant &variant, const char *value) {
+  const char *s = variant.as<const char *>();
+  return s && value && (strcmp(s, value) == 0);
+}
+
+template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+inline T operator|(const JsonVariant &variant, T defaultValue) {
+  return variant.is<T>() ? variant.as<T>() : defaultValue;
+}
+inline const char *operator|(const JsonVariant &variant, const char *defaultValue) {
+  const char *s = variant.as<const char *>();
+  return s ? s : defaultValue;
+}
+
+#endif
@@ -0,0 +1,39 @@
+/********************************************************************************
+  Host stand-in for the ESP32 EEPROM library (one 4 kB flash sector, host::flash().eeprom)
+  commit() only writes when the RAM copy changed, and costs a sector erase (host::EEPROM_COMMIT_US)
+********************************************************************************/
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <Arduino.h>
+
+class EEPROMClass {
+  public:
+    bool begin(size_t size);
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    bool commit();
+    void end();
+    template <typename T> T &get(int address, T &value) {
+      if ((address >= 0) && (address + sizeof(T) <= _data.size())) {
+        memcpy((void *) &value, &_data[address], sizeof(T));
+      }
+      return value;
+    }
+    template <typename T> const T &put(int address, const T &value) {
+      if ((address >= 0) && (address + sizeof(T) <= _data.size())) {
+        if (memcmp(&_data[address], (const void *) &value, sizeof(T)) != 0) {
+          _dirty = true;
+        }
+        memcpy(&_data[address], (const void *) &value, sizeof(T));
+      }
+      return value;
+    }
+
+  private:
+    std::vector<uint8_t> _data;
+    bool _dirty = false;
+};
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,40 @@
+/********************************************************************************
+  Host stand-in for EspMQTTClient 1.8.0
+  The WiFi and MQTT connections follow host::mqtt() (availability and connection times). Published messages are
+  recorded by the broker and messages given to host::MqttBroker::deliver() are passed to the subscriptions by loop().
+********************************************************************************/
+#ifndef HOST_ESPMQTTCLIENT_H
+#define HOST_ESPMQTTCLIENT_H
+
+#include <functional>
+#include <Arduino.h>
+#include "PubSubClient.h"
+#include "WiFi.h"
+
+void onConnectionEstablished();
+
+typedef std::function<void()> ConnectionEstablishedCallback;
+typedef std::function<void(const String &message)> MessageReceivedCallback;
+typedef std::function<void(const String &topicStr, const String &message)> MessageReceivedCallbackWithTopic;
+
+class EspMQTTClient {
+  public:
+    EspMQTTClient(const char *wifiSsid, const char *wifiPassword, const char *mqttServerIp, const char *mqttUsername,
+                  const char *mqttPassword, const char *mqttClientName = "ESP8266", const short mqttServerPort = 1883);
+    void enableDebuggingMessages(const bool enabled = true) {}
+    void enableHTTPWebUpdater(const char *username, const char *password, const char *address = "/") {}
+    void enableHTTPWebUpdater(const char *address = "/") {}
+    void enableLastWillMessage(const char *topic, const char *message, const bool retain = false) {}
+    void loop();
+    bool isConnected() {
+      return isWifiConnected() && isMqttConnected();
+    }
+    bool isWifiConnected();
+    bool isMqttConnected();
+    bool publish(const String &topic, const String &payload, bool retain = false);
+    bool subscribe(const String &topic, MessageReceivedCallback messageReceivedCallback);
+    bool subscribe(const String &topic, MessageReceivedCallbackWithTopic messageReceivedCallback);
+    bool unsubscribe(const String &topic);
+};
+
+#endif
@@ -0,0 +1,69 @@
+/********************************************************************************
+  Host stand-in for the ESP32 FS File class. Files live in host::flash().files
+********************************************************************************/
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <memory>
+#include <Arduino.h>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+struct FileHandle {
+  std::string path;
+  size_t position = 0;
+  bool writable = false;
+  bool readable = false;
+};
+
+class File : public Stream {
+  public:
+    File() {}
+    explicit File(std::shared_ptr<FileHandle> handle) : _handle(handle) {}
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    size_t read(uint8_t *buffer, size_t size);
+    int peek() override;
+    void flush() override {}
+    bool seek(uint32_t position, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void close();
+    const char *name() const;
+    operator bool() const {
+      return _handle != nullptr;
+    }
+
+  private:
+    std::shared_ptr<FileHandle> _handle;
+};
+
+class FS {
+  public:
+    File open(const char *path, const char *mode = FILE_READ);
+    bool exists(const char *path);
+    bool remove(const char *path);
+};
+
+}
+
+using fs::File;
+using fs::FS;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif
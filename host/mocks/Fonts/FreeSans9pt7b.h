@@ -0,0 +1,12 @@
+/********************************************************************************
+  Host stand-in for the FreeSans9pt7b font of Adafruit GFX. The glyphs are synthetic with the metrics of the real font
+  (see host/src/fonts.cpp)
+********************************************************************************/
+#ifndef HOST_FONTS_FREESANS9PT7B_H
+#define HOST_FONTS_FREESANS9PT7B_H
+
+#include <Adafruit_GFX.h>
+
+extern const GFXfont FreeSans9pt7b;
+
+#endif
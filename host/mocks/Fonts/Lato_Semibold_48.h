@@ -0,0 +1,2 @@
+//The custom fonts of the sketch are in fonts/ (the Arduino IDE finds them as Fonts/ on a case-insensitive file system)
+#include "../../../fonts/Lato_Semibold_48.h"
@@ -0,0 +1,13 @@
+/********************************************************************************
+  Host stand-in for PubSubClient 2.7 (only the packet size settings)
+  The stock library allows 128 bytes. The harness is built with MQTT_MAX_PACKET_SIZE=1536 as the README asks.
+********************************************************************************/
+#ifndef HOST_PUBSUBCLIENT_H
+#define HOST_PUBSUBCLIENT_H
+
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE 128
+#endif
+#define MQTT_MAX_HEADER_SIZE 5
+
+#endif
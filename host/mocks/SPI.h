@@ -0,0 +1,16 @@
+/********************************************************************************
+  Host stand-in for the ESP32 SPI library. The display traffic is modeled by Adafruit_SPITFT
+********************************************************************************/
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include <Arduino.h>
+
+class SPIClass {
+  public:
+    void begin() {}
+    void end() {}
+};
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,25 @@
+/********************************************************************************
+  Host stand-in for the ESP32 SPIFFS library
+  Mounting fails when host::flash().spiffsMountable is false. Writes cost FLASH_WRITE_BYTE_US per byte.
+********************************************************************************/
+#ifndef HOST_SPIFFS_H
+#define HOST_SPIFFS_H
+
+#include "FS.h"
+
+namespace fs {
+
+class SPIFFSFS : public FS {
+  public:
+    bool begin(bool formatOnFail = false, const char *basePath = "/spiffs", uint8_t maxOpenFiles = 10);
+    bool format();
+    size_t totalBytes();
+    size_t usedBytes();
+    void end();
+};
+
+}
+
+extern fs::SPIFFSFS SPIFFS;
+
+#endif
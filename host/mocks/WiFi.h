@@ -0,0 +1,24 @@
+/********************************************************************************
+  Host stand-in for the ESP32 WiFi library. The connection state is driven by host::mqtt() (see host/src/mqtt.cpp)
+********************************************************************************/
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <Arduino.h>
+#include "WiFiClient.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_CONNECTED = 3,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+class WiFiClass {
+  public:
+    wl_status_t status();
+    int8_t RSSI();
+    IPAddress localIP();
+};
+extern WiFiClass WiFi;
+
+#endif
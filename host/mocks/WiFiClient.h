@@ -0,0 +1,64 @@
+/********************************************************************************
+  Host stand-in for WiFiClient (ESP32 core 1.0.4)
+  Connections are made to the servers registered with host::listen() (see host/src/network.cpp)
+********************************************************************************/
+#ifndef HOST_WIFICLIENT_H
+#define HOST_WIFICLIENT_H
+
+#include <memory>
+#include <Arduino.h>
+
+namespace host {
+class Connection;
+}
+
+class IPAddress : public Printable {
+  public:
+    IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : _bytes{a, b, c, d} {}
+    size_t printTo(Print &p) const override;
+    String toString() const;
+    uint8_t operator[](int index) const {
+      return _bytes[index];
+    }
+
+  private:
+    uint8_t _bytes[4];
+};
+
+class Client : public Stream {
+  public:
+    virtual int connect(const char *host, uint16_t port) = 0;
+    virtual void stop() = 0;
+    virtual uint8_t connected() = 0;
+};
+
+class WiFiClient : public Client {
+  public:
+    WiFiClient() {}
+    int connect(const char *host, uint16_t port) override;
+    int connect(const char *host, uint16_t port, int32_t timeout_ms);
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buffer, size_t size);
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() {
+      return connected();
+    }
+    int setTimeout(uint32_t seconds);     // seconds in ESP32 core 1.0.4
+    int setNoDelay(bool nodelay) {
+      _noDelay = nodelay;
+      return 0;
+    }
+
+  private:
+    std::shared_ptr<host::Connection> _connection;
+    bool _noDelay = false;
+};
+
+#endif
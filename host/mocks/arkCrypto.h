@@ -0,0 +1,96 @@
+/********************************************************************************
+  Host stand-in for Ark Cpp-Crypto (1.0.0) with the Radians ScooterRentalFinish builder
+  Signing and serialization are done by host/src/ark_crypto.cpp (OpenSSL). Signing and verifying are charged to the
+  running task (host::ECDSA_SIGN_US, host::ECDSA_VERIFY_US).
+********************************************************************************/
+#ifndef HOST_ARKCRYPTO_H
+#define HOST_ARKCRYPTO_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "ark.h"
+
+namespace Ark {
+namespace Crypto {
+
+struct Network {
+  std::string nethash;
+  uint8_t slip44;
+  uint8_t wif;
+  uint8_t version;
+  std::string epoch;
+};
+
+class Configuration {
+  public:
+    Configuration() : _network{"", 1, 0xAA, 0x1E, ""} {}
+    explicit Configuration(const Network &network) : _network(network) {}
+    const Network &getNetwork() const {
+      return _network;
+    }
+
+  private:
+    Network _network;
+};
+
+//Signed message: signature = ECDSA(SHA256(message)) with the key of the passphrase
+class Message {
+  public:
+    bool sign(const std::string &text, const std::string &passphrase);
+    bool verify() const;
+    std::string message;
+    std::vector<uint8_t> publicKey;
+    std::vector<uint8_t> signature;
+};
+
+namespace identities {
+class Keys {
+  public:
+    static host::ark::Keys fromPassphrase(const char *passphrase) {
+      return host::ark::keysFromPassphrase(passphrase);
+    }
+};
+}
+
+namespace transactions {
+
+class Transaction {
+  public:
+    std::string toJson() const;
+    std::vector<uint8_t> toBytes() const;
+    std::string id;
+    host::ark::RentalFinish data;
+};
+
+namespace builder {
+namespace radians {
+
+class ScooterRentalFinish {
+  public:
+    explicit ScooterRentalFinish(const Configuration &configuration);
+    ScooterRentalFinish &recipientId(const char *recipient);
+    ScooterRentalFinish &timestamp(uint32_t timestamp, int index);
+    ScooterRentalFinish &latitude(uint64_t latitude, int index);
+    ScooterRentalFinish &longitude(uint64_t longitude, int index);
+    ScooterRentalFinish &sessionId(const uint8_t *sessionId);
+    ScooterRentalFinish &containsRefund(bool refund);
+    ScooterRentalFinish &fee(uint64_t fee);
+    ScooterRentalFinish &nonce(uint64_t nonce);
+    ScooterRentalFinish &amount(uint64_t amount);
+    ScooterRentalFinish &sign(const char *passphrase);
+    Transaction build();
+
+  private:
+    host::ark::GpsPoint &point(int index);
+    Transaction _transaction;
+};
+
+}
+}
+}
+}
+}
+
+#endif
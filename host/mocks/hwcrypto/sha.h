@@ -0,0 +1,19 @@
+/********************************************************************************
+  Host stand-in for the ESP32 hardware SHA engine (esp-idf 3.3)
+********************************************************************************/
+#ifndef HOST_HWCRYPTO_SHA_H
+#define HOST_HWCRYPTO_SHA_H
+
+#include <stddef.h>
+
+typedef enum {
+  SHA1 = 0,
+  SHA2_256,
+  SHA2_384,
+  SHA2_512,
+  SHA_TYPE_MAX
+} esp_sha_type;
+
+void esp_sha(esp_sha_type type, const unsigned char *input, size_t ilen, unsigned char *output);
+
+#endif
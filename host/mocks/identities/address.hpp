@@ -0,0 +1,2 @@
+//Part of the Ark Cpp-Crypto stand-in (see host/mocks/arkCrypto.h)
+#include <arkCrypto.h>
@@ -0,0 +1,35 @@
+/********************************************************************************
+  Host stand-in for QRCode by Richard Moore (0.0.1)
+  The module matrix has the size and the finder patterns of the real symbol and the data area is derived from a hash
+  of the text. It is not a readable QR code: the harness only needs the cost (host::QRCODE_ENCODE_US) and the pixels.
+********************************************************************************/
+#ifndef HOST_QRCODE_H
+#define HOST_QRCODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MODE_NUMERIC 0
+#define MODE_ALPHANUMERIC 1
+#define MODE_BYTE 2
+
+#define ECC_LOW 0
+#define ECC_MEDIUM 1
+#define ECC_QUARTILE 2
+#define ECC_HIGH 3
+
+typedef struct QRCode {
+  uint8_t version;
+  uint8_t size;
+  uint8_t ecc;
+  uint8_t mode;
+  uint8_t mask;
+  uint8_t *modules;
+} QRCode;
+
+uint16_t qrcode_getBufferSize(uint8_t version);
+int8_t qrcode_initText(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, const char *data);
+int8_t qrcode_initBytes(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length);
+bool qrcode_getModule(QRCode *qrcode, uint8_t x, uint8_t y);
+
+#endif
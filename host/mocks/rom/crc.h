@@ -0,0 +1,12 @@
+/********************************************************************************
+  Host stand-in for the ESP32 ROM CRC functions
+********************************************************************************/
+#ifndef HOST_ROM_CRC_H
+#define HOST_ROM_CRC_H
+
+#include <stdint.h>
+
+//CRC-32 (IEEE 802.3), same as zlib crc32(): crc32_le(0, data, length)
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif
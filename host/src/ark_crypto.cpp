@@ -0,0 +1,584 @@
+/********************************************************************************
+  Ark keys, signatures and the ScooterRentalFinish transaction (see host/ark.h), and the Ark Cpp-Crypto stand-in
+********************************************************************************/
+#define OPENSSL_SUPPRESS_DEPRECATED     // RIPEMD160() is only available through the deprecated API in OpenSSL 3
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/hmac.h>
+#include <openssl/obj_mac.h>
+#include <openssl/ripemd.h>
+#include <openssl/sha.h>
+
+#include <ArduinoJson.h>
+#include <arkCrypto.h>
+#include "host.h"
+
+namespace host {
+namespace ark {
+
+namespace {
+
+struct Curve {
+  EC_GROUP *group;
+  BIGNUM *order;
+  BIGNUM *halfOrder;
+  Curve() {
+    group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+    order = BN_new();
+    EC_GROUP_get_order(group, order, nullptr);
+    halfOrder = BN_dup(order);
+    BN_rshift1(halfOrder, halfOrder);
+  }
+};
+
+const Curve &curve() {
+  static Curve secp256k1;
+  return secp256k1;
+}
+
+//BIGNUMs and points are freed at the end of the scope
+struct BnScope {
+  BN_CTX *ctx = BN_CTX_new();
+  std::vector<BIGNUM *> numbers;
+  std::vector<EC_POINT *> points;
+  BIGNUM *bn() {
+    numbers.push_back(BN_new());
+    return numbers.back();
+  }
+  BIGNUM *bn(const uint8_t *bytes, size_t length) {
+    numbers.push_back(BN_bin2bn(bytes, length, nullptr));
+    return numbers.back();
+  }
+  EC_POINT *point() {
+    points.push_back(EC_POINT_new(curve().group));
+    return points.back();
+  }
+  ~BnScope() {
+    for (BIGNUM *n : numbers) {
+      BN_free(n);
+    }
+    for (EC_POINT *p : points) {
+      EC_POINT_free(p);
+    }
+    BN_CTX_free(ctx);
+  }
+};
+
+void hmac(const std::vector<uint8_t> &key, const std::vector<uint8_t> &data, std::vector<uint8_t> &out) {
+  unsigned int length = 32;
+  out.resize(32);
+  HMAC(EVP_sha256(), key.data(), key.size(), data.data(), data.size(), out.data(), &length);
+}
+
+void appendDerInteger(std::vector<uint8_t> &der, const BIGNUM *n) {
+  uint8_t bytes[33] = {0};
+  int length = BN_bn2bin(n, &bytes[1]);
+  uint8_t *start = &bytes[1];
+  if (start[0] & 0x80) {
+    start--;
+    length++;
+  }
+  der.push_back(0x02);
+  der.push_back(length);
+  der.insert(der.end(), start, start + length);
+}
+
+bool parseDer(const std::vector<uint8_t> &der, std::vector<uint8_t> &r, std::vector<uint8_t> &s) {
+  if ((der.size() < 8) || (der[0] != 0x30) || (der[1] != der.size() - 2)) {
+    return false;
+  }
+  size_t offset = 2;
+  for (std::vector<uint8_t> *part : {&r, &s}) {
+    if ((offset + 2 > der.size()) || (der[offset] != 0x02)) {
+      return false;
+    }
+    size_t length = der[offset + 1];
+    if ((length == 0) || (length > 33) || (offset + 2 + length > der.size())) {
+      return false;
+    }
+    part->assign(der.begin() + offset + 2, der.begin() + offset + 2 + length);
+    offset += 2 + length;
+  }
+  return offset == der.size();
+}
+
+const char BASE58[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+void put(std::vector<uint8_t> &out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    out.push_back((uint8_t) (value >> (8 * i)));
+  }
+}
+
+}
+
+void sha256(const void *data, size_t length, uint8_t hash[32]) {
+  SHA256((const uint8_t *) data, length, hash);
+}
+
+Keys keysFromPassphrase(const std::string &passphrase) {
+  HeapAccountingOff internal;
+  Keys keys;
+  sha256(passphrase.data(), passphrase.size(), keys.privateKey);
+  BnScope scope;
+  EC_POINT *publicPoint = scope.point();
+  EC_POINT_mul(curve().group, publicPoint, scope.bn(keys.privateKey, 32), nullptr, nullptr, scope.ctx);
+  EC_POINT_point2oct(curve().group, publicPoint, POINT_CONVERSION_COMPRESSED, keys.publicKey, 33, scope.ctx);
+  return keys;
+}
+
+//ECDSA with the deterministic nonce of RFC 6979 (HMAC-SHA256) and a low S value
+std::vector<uint8_t> sign(const uint8_t hash[32], const uint8_t privateKey[32]) {
+  HeapAccountingOff internal;
+  BnScope scope;
+  const BIGNUM *n = curve().order;
+  BIGNUM *d = scope.bn(privateKey, 32);
+  BIGNUM *z = scope.bn(hash, 32);
+  BIGNUM *zReduced = scope.bn();
+  BN_nnmod(zReduced, z, n, scope.ctx);
+  uint8_t h1[32];
+  BN_bn2binpad(zReduced, h1, 32);
+
+  std::vector<uint8_t> v(32, 0x01), k(32, 0x00), data;
+  for (uint8_t separator : {0x00, 0x01}) {
+    data = v;
+    data.push_back(separator);
+    data.insert(data.end(), privateKey, privateKey + 32);
+    data.insert(data.end(), h1, h1 + 32);
+    hmac(k, data, k);
+    hmac(k, v, v);
+  }
+
+  BIGNUM *nonce = scope.bn();
+  BIGNUM *r = scope.bn();
+  BIGNUM *s = scope.bn();
+  BIGNUM *x = scope.bn();
+  EC_POINT *R = scope.point();
+  for (;;) {
+    hmac(k, v, v);
+    BN_bin2bn(v.data(), 32, nonce);
+    if (!BN_is_zero(nonce) && (BN_cmp(nonce, n) < 0)) {
+      EC_POINT_mul(curve().group, R, nonce, nullptr, nullptr, scope.ctx);
+      EC_POINT_get_affine_coordinates(curve().group, R, x, nullptr, scope.ctx);
+      BN_nnmod(r, x, n, scope.ctx);
+      BIGNUM *rd = scope.bn();
+      BN_mod_mul(rd, r, d, n, scope.ctx);
+      BIGNUM *sum = scope.bn();
+      BN_mod_add(sum, z, rd, n, scope.ctx);
+      BIGNUM *kinv = scope.bn();
+      BN_mod_inverse(kinv, nonce, n, scope.ctx);
+      BN_mod_mul(s, kinv, sum, n, scope.ctx);
+      if (!BN_is_zero(r) && !BN_is_zero(s)) {
+        break;
+      }
+    }
+    data = v;
+    data.push_back(0x00);
+    hmac(k, data, k);
+    hmac(k, v, v);
+  }
+  if (BN_cmp(s, curve().halfOrder) > 0) {
+    BN_sub(s, n, s);
+  }
+
+  std::vector<uint8_t> integers;
+  appendDerInteger(integers, r);
+  appendDerInteger(integers, s);
+  std::vector<uint8_t> der;
+  der.reserve(2 + integers.size());
+  der.push_back(0x30);
+  der.push_back((uint8_t) integers.size());
+  der.insert(der.end(), integers.begin(), integers.end());
+  return der;
+}
+
+bool verify(const uint8_t hash[32], const std::vector<uint8_t> &signature, const uint8_t publicKey[33]) {
+  HeapAccountingOff internal;
+  std::vector<uint8_t> rBytes, sBytes;
+  if (!parseDer(signature, rBytes, sBytes)) {
+    return false;
+  }
+  BnScope scope;
+  const BIGNUM *n = curve().order;
+  BIGNUM *r = scope.bn(rBytes.data(), rBytes.size());
+  BIGNUM *s = scope.bn(sBytes.data(), sBytes.size());
+  if (BN_is_zero(r) || BN_is_zero(s) || (BN_cmp(r, n) >= 0) || (BN_cmp(s, n) >= 0)) {
+    return false;
+  }
+  EC_POINT *Q = scope.point();
+  if (!EC_POINT_oct2point(curve().group, Q, publicKey, 33, scope.ctx)) {
+    return false;
+  }
+  BIGNUM *z = scope.bn(hash, 32);
+  BIGNUM *w = scope.bn();
+  BN_mod_inverse(w, s, n, scope.ctx);
+  BIGNUM *u1 = scope.bn();
+  BIGNUM *u2 = scope.bn();
+  BN_mod_mul(u1, z, w, n, scope.ctx);
+  BN_mod_mul(u2, r, w, n, scope.ctx);
+  EC_POINT *P = scope.point();
+  EC_POINT_mul(curve().group, P, u1, Q, u2, scope.ctx);
+  if (EC_POINT_is_at_infinity(curve().group, P)) {
+    return false;
+  }
+  BIGNUM *x = scope.bn();
+  EC_POINT_get_affine_coordinates(curve().group, P, x, nullptr, scope.ctx);
+  BN_nnmod(x, x, n, scope.ctx);
+  return BN_cmp(x, r) == 0;
+}
+
+std::string address(const uint8_t publicKey[33], uint8_t version) {
+  HeapAccountingOff internal;
+  uint8_t payload[25];
+  payload[0] = version;
+  RIPEMD160(publicKey, 33, &payload[1]);
+  uint8_t check[32];
+  sha256(payload, 21, check);
+  sha256(check, 32, check);
+  memcpy(&payload[21], check, 4);
+
+  std::vector<uint8_t> digits;      // base 58, least significant first
+  for (uint8_t byte : payload) {
+    int carry = byte;
+    for (uint8_t &digit : digits) {
+      carry += digit * 256;
+      digit = carry % 58;
+      carry /= 58;
+    }
+    while (carry) {
+      digits.push_back(carry % 58);
+      carry /= 58;
+    }
+  }
+  std::string text;
+  for (size_t i = 0; (i < sizeof(payload)) && (payload[i] == 0); i++) {
+    text += '1';
+  }
+  for (auto digit = digits.rbegin(); digit != digits.rend(); ++digit) {
+    text += BASE58[*digit];
+  }
+  return text;
+}
+
+bool decodeAddress(const std::string &text, uint8_t decoded[21]) {
+  HeapAccountingOff internal;
+  std::vector<uint8_t> bytes;       // base 256, least significant first
+  for (char c : text) {
+    const char *p = strchr(BASE58, c);
+    if (!p || !c) {
+      return false;
+    }
+    int carry = p - BASE58;
+    for (uint8_t &byte : bytes) {
+      carry += byte * 58;
+      byte = carry & 0xFF;
+      carry >>= 8;
+    }
+    while (carry) {
+      bytes.push_back(carry & 0xFF);
+      carry >>= 8;
+    }
+  }
+  for (size_t i = 0; (i < text.size()) && (text[i] == '1'); i++) {
+    bytes.push_back(0);
+  }
+  if (bytes.size() != 25) {
+    return false;
+  }
+  uint8_t payload[25];
+  for (int i = 0; i < 25; i++) {
+    payload[i] = bytes[24 - i];
+  }
+  uint8_t check[32];
+  sha256(payload, 21, check);
+  sha256(check, 32, check);
+  if (memcmp(check, &payload[21], 4) != 0) {
+    return false;
+  }
+  memcpy(decoded, payload, 21);
+  return true;
+}
+
+std::string toHex(const uint8_t *data, size_t length) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(length * 2);
+  for (size_t i = 0; i < length; i++) {
+    hex += digits[data[i] >> 4];
+    hex += digits[data[i] & 0x0F];
+  }
+  return hex;
+}
+
+std::vector<uint8_t> fromHex(const std::string &hex) {
+  std::vector<uint8_t> bytes;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+    char pair[3] = {hex[i], hex[i + 1], '\0'};
+    bytes.push_back((uint8_t) strtoul(pair, NULL, 16));
+  }
+  return bytes;
+}
+
+std::vector<uint8_t> serialize(const RentalFinish &transaction, bool withSignature) {
+  std::vector<uint8_t> out;
+  out.push_back(0xFF);
+  out.push_back(0x02);                  // version
+  out.push_back(transaction.network);
+  put(out, RADIANS_TYPE_GROUP, 4);
+  put(out, RENTAL_FINISH_TYPE, 2);
+  put(out, transaction.nonce, 8);
+  out.insert(out.end(), transaction.senderPublicKey, transaction.senderPublicKey + 33);
+  put(out, transaction.fee, 8);
+  out.push_back(0x00);                  // no vendor field
+
+  out.insert(out.end(), transaction.sessionId, transaction.sessionId + 32);
+  out.push_back(transaction.containsRefund ? 1 : 0);
+  out.push_back((uint8_t) transaction.gps.size());
+  for (const GpsPoint &point : transaction.gps) {
+    put(out, point.timestamp, 4);
+    put(out, point.latitude, 8);
+    put(out, point.longitude, 8);
+  }
+  uint8_t recipient[21] = {0};
+  decodeAddress(transaction.recipient, recipient);
+  out.insert(out.end(), recipient, recipient + 21);
+  put(out, transaction.amount, 8);
+
+  if (withSignature) {
+    out.insert(out.end(), transaction.signature.begin(), transaction.signature.end());
+  }
+  return out;
+}
+
+std::string transactionId(const RentalFinish &transaction) {
+  std::vector<uint8_t> bytes = serialize(transaction, true);
+  uint8_t hash[32];
+  sha256(bytes.data(), bytes.size(), hash);
+  return toHex(hash, 32);
+}
+
+void signTransaction(RentalFinish &transaction, const std::string &passphrase) {
+  Keys keys = keysFromPassphrase(passphrase);
+  memcpy(transaction.senderPublicKey, keys.publicKey, 33);
+  std::vector<uint8_t> bytes = serialize(transaction, false);
+  uint8_t hash[32];
+  sha256(bytes.data(), bytes.size(), hash);
+  transaction.signature = sign(hash, keys.privateKey);
+}
+
+bool verifyTransaction(const RentalFinish &transaction) {
+  HeapAccountingOff internal;
+  std::vector<uint8_t> bytes = serialize(transaction, false);
+  uint8_t hash[32];
+  sha256(bytes.data(), bytes.size(), hash);
+  return verify(hash, transaction.signature, transaction.senderPublicKey);
+}
+
+std::string toJson(const RentalFinish &transaction) {
+  char number[24];
+  std::string json = "{\"version\":2,\"network\":" + std::to_string(transaction.network);
+  json += ",\"typeGroup\":" + std::to_string(RADIANS_TYPE_GROUP) + ",\"type\":" + std::to_string(RENTAL_FINISH_TYPE);
+  snprintf(number, sizeof(number), "%" PRIu64, transaction.nonce);
+  json += ",\"nonce\":\"" + std::string(number) + "\"";
+  json += ",\"senderPublicKey\":\"" + toHex(transaction.senderPublicKey, 33) + "\"";
+  snprintf(number, sizeof(number), "%" PRIu64, transaction.fee);
+  json += ",\"fee\":\"" + std::string(number) + "\"";
+  snprintf(number, sizeof(number), "%" PRIu64, transaction.amount);
+  json += ",\"amount\":\"" + std::string(number) + "\"";
+  json += ",\"recipientId\":\"" + transaction.recipient + "\"";
+  json += ",\"asset\":{\"rentalFinish\":{\"sessionId\":\"" + toHex(transaction.sessionId, 32) + "\"";
+  json += std::string(",\"containsRefund\":") + (transaction.containsRefund ? "true" : "false") + ",\"gps\":[";
+  for (size_t i = 0; i < transaction.gps.size(); i++) {
+    const GpsPoint &point = transaction.gps[i];
+    char text[96];
+    snprintf(text, sizeof(text), "%s{\"timestamp\":%u,\"latitude\":\"%" PRIu64 "\",\"longitude\":\"%" PRIu64 "\"}",
+             (i > 0) ? "," : "", point.timestamp, point.latitude, point.longitude);
+    json += text;
+  }
+  json += "]}}";
+  if (!transaction.signature.empty()) {
+    json += ",\"signature\":\"" + toHex(transaction.signature.data(), transaction.signature.size()) + "\"";
+    json += ",\"id\":\"" + transactionId(transaction) + "\"";
+  }
+  json += "}";
+  return json;
+}
+
+bool fromJson(const std::string &json, RentalFinish &transaction) {
+  HeapAccountingOff internal;
+  DynamicJsonDocument doc(4096);
+  if (deserializeJson(doc, json)) {
+    return false;
+  }
+  if (((doc["typeGroup"] | 0) != (int) RADIANS_TYPE_GROUP) || ((doc["type"] | 0) != RENTAL_FINISH_TYPE)) {
+    return false;
+  }
+  const char *nonce = doc["nonce"];
+  const char *publicKey = doc["senderPublicKey"];
+  const char *fee = doc["fee"];
+  const char *amount = doc["amount"];
+  const char *recipient = doc["recipientId"];
+  const char *signature = doc["signature"];
+  JsonObject asset = doc["asset"]["rentalFinish"];
+  if (!nonce || !publicKey || !fee || !amount || !recipient || !signature || asset.isNull()) {
+    return false;
+  }
+  const char *sessionId = asset["sessionId"];
+  std::vector<uint8_t> key = fromHex(publicKey);
+  std::vector<uint8_t> session = fromHex(sessionId ? sessionId : "");
+  if ((key.size() != 33) || (session.size() != 32)) {
+    return false;
+  }
+  transaction.network = doc["network"] | 0;
+  transaction.nonce = strtoull(nonce, NULL, 10);
+  memcpy(transaction.senderPublicKey, key.data(), 33);
+  transaction.fee = strtoull(fee, NULL, 10);
+  transaction.amount = strtoull(amount, NULL, 10);
+  transaction.recipient = recipient;
+  memcpy(transaction.sessionId, session.data(), 32);
+  transaction.containsRefund = asset["containsRefund"];
+  transaction.gps.clear();
+  JsonVariant gps = asset["gps"];
+  for (int i = 0; !gps[i].isNull(); i++) {
+    const char *latitude = gps[i]["latitude"];
+    const char *longitude = gps[i]["longitude"];
+    if (!latitude || !longitude) {
+      return false;
+    }
+    transaction.gps.push_back({(uint32_t) (gps[i]["timestamp"] | 0LL), strtoull(latitude, NULL, 10), strtoull(longitude, NULL, 10)});
+  }
+  transaction.signature = fromHex(signature);
+  return true;
+}
+
+}
+}
+
+
+/********************************************************************************
+  Ark Cpp-Crypto stand-in
+********************************************************************************/
+namespace Ark {
+namespace Crypto {
+
+bool Message::sign(const std::string &text, const std::string &passphrase) {
+  host::charge(host::ECDSA_SIGN_US + text.size() * host::SHA256_BYTE_US);
+  host::ark::Keys keys = host::ark::keysFromPassphrase(passphrase);
+  uint8_t hash[32];
+  host::ark::sha256(text.data(), text.size(), hash);
+  std::vector<uint8_t> der = host::ark::sign(hash, keys.privateKey);
+  message = text;
+  publicKey.assign(keys.publicKey, keys.publicKey + 33);
+  signature.assign(der.begin(), der.end());
+  return true;
+}
+
+bool Message::verify() const {
+  host::charge(host::ECDSA_VERIFY_US + message.size() * host::SHA256_BYTE_US);
+  if (publicKey.size() != 33) {
+    return false;
+  }
+  uint8_t hash[32];
+  host::ark::sha256(message.data(), message.size(), hash);
+  std::vector<uint8_t> der;
+  {
+    host::HeapAccountingOff internal;
+    der = signature;
+  }
+  return host::ark::verify(hash, der, publicKey.data());
+}
+
+namespace transactions {
+
+std::string Transaction::toJson() const {
+  std::string json;
+  {
+    host::HeapAccountingOff internal;
+    json = host::ark::toJson(data);
+  }
+  return std::string(json.data(), json.size());     // the copy returned to the sketch is counted
+}
+
+std::vector<uint8_t> Transaction::toBytes() const {
+  return host::ark::serialize(data, true);
+}
+
+namespace builder {
+namespace radians {
+
+ScooterRentalFinish::ScooterRentalFinish(const Configuration &configuration) {
+  _transaction.data.network = configuration.getNetwork().version;
+}
+
+ScooterRentalFinish &ScooterRentalFinish::recipientId(const char *recipient) {
+  _transaction.data.recipient = recipient;
+  return *this;
+}
+
+host::ark::GpsPoint &ScooterRentalFinish::point(int index) {
+  if ((size_t) index >= _transaction.data.gps.size()) {
+    _transaction.data.gps.resize(index + 1, {0, 0, 0});
+  }
+  return _transaction.data.gps[index];
+}
+
+ScooterRentalFinish &ScooterRentalFinish::timestamp(uint32_t timestamp, int index) {
+  point(index).timestamp = timestamp;
+  return *this;
+}
+
+ScooterRentalFinish &ScooterRentalFinish::latitude(uint64_t latitude, int index) {
+  point(index).latitude = latitude;
+  return *this;
+}
+
+ScooterRentalFinish &ScooterRentalFinish::longitude(uint64_t longitude, int index) {
+  point(index).longitude = longitude;
+  return *this;
+}
+
+ScooterRentalFinish &ScooterRentalFinish::sessionId(const uint8_t *sessionId) {
+  memcpy(_transaction.data.sessionId, sessionId, 32);
+  return *this;
+}
+
+ScooterRentalFinish &ScooterRentalFinish::containsRefund(bool refund) {
+  _transaction.data.containsRefund = refund;
+  return *this;
+}
+
+ScooterRentalFinish &ScooterRentalFinish::fee(uint64_t fee) {
+  _transaction.data.fee = fee;
+  return *this;
+}
+
+ScooterRentalFinish &ScooterRentalFinish::nonce(uint64_t nonce) {
+  _transaction.data.nonce = nonce;
+  return *this;
+}
+
+ScooterRentalFinish &ScooterRentalFinish::amount(uint64_t amount) {
+  _transaction.data.amount = amount;
+  return *this;
+}
+
+ScooterRentalFinish &ScooterRentalFinish::sign(const char *passphrase) {
+  std::vector<uint8_t> bytes = host::ark::serialize(_transaction.data, false);
+  host::charge(host::ECDSA_SIGN_US + bytes.size() * host::SHA256_BYTE_US);
+  host::ark::signTransaction(_transaction.data, passphrase);
+  return *this;
+}
+
+Transaction ScooterRentalFinish::build() {
+  {
+    host::HeapAccountingOff internal;
+    _transaction.id = host::ark::transactionId(_transaction.data);
+  }
+  return _transaction;
+}
+
+}
+}
+}
+}
+}
@@ -0,0 +1,467 @@
+/********************************************************************************
+  Fake Ark bridgechain and relays (see host.h)
+  The relays speak HTTP/1.1 with keep-alive and answer the requests of the sketch the way Ark Core 2.6 does:
+    GET  /api/node/status
+    GET  /api/wallets/<address>
+    GET  /api/wallets/<address>/transactions/received?page=&limit=&orderBy=timestamp:asc   ("meta" before "data")
+    POST /api/transactions   {"transactions":[...]}
+  Posted transactions are verified (signature, nonce, balance) and answered with data.accept/broadcast/excess/invalid
+  and the errors of each invalid transaction.
+  received() runs in the context of the client task (from WiFiClient::write) so nothing here charges the clock.
+********************************************************************************/
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "host.h"
+#include "ark.h"
+
+namespace host {
+
+/********************************************************************************
+  Chain
+********************************************************************************/
+ArkChain &arkChain() {
+  static ArkChain chain;
+  return chain;
+}
+
+std::string riderAddress(int rider) {
+  ark::Keys keys = ark::keysFromPassphrase("rider " + std::to_string(rider));
+  return ark::address(keys.publicKey, 0x41);
+}
+
+uint64_t ArkChain::blockAfter(uint64_t at_us) const {
+  uint64_t block_us = (uint64_t) blockTime_ms * 1000;
+  return (at_us / block_us + 1) * block_us;
+}
+
+void ArkChain::update(uint64_t now_us) {
+  HeapAccountingOff internal;
+  size_t kept = 0;
+  for (size_t i = 0; i < pool.size(); i++) {
+    if (blockAfter(pool[i].at_us) <= now_us) {
+      nonce = std::max(nonce, pool[i].nonce);
+      forged.push_back(pool[i].id);
+    }
+    else {
+      pool[kept++] = pool[i];
+    }
+  }
+  pool.resize(kept);
+}
+
+std::vector<const ArkReceived *> ArkChain::confirmedReceived(uint64_t now_us) const {
+  std::vector<const ArkReceived *> confirmed;
+  for (const ArkReceived &transaction : received) {
+    if (blockAfter(transaction.at_us) <= now_us) {
+      confirmed.push_back(&transaction);
+    }
+  }
+  return confirmed;
+}
+
+uint64_t ArkChain::poolNonce() const {
+  uint64_t n = nonce;
+  for (const ArkPoolEntry &entry : pool) {
+    n = std::max(n, entry.nonce);
+  }
+  return n;
+}
+
+static std::string receivedId(const ArkChain &chain, const std::string &salt) {
+  std::string seed = salt + "/" + std::to_string(chain.received.size());
+  uint8_t hash[32];
+  ark::sha256(seed.data(), seed.size(), hash);
+  return ark::toHex(hash, 32);
+}
+
+std::string ArkChain::receiveTransfer(uint64_t amount, int rider) {
+  HeapAccountingOff internal;
+  ark::Keys keys = ark::keysFromPassphrase("rider " + std::to_string(rider));
+  ArkReceived transaction;
+  transaction.at_us = now();
+  transaction.id = receivedId(*this, "transfer");
+  transaction.type = 0;
+  transaction.typeGroup = 1;
+  transaction.amount = amount;
+  transaction.sender = ark::address(keys.publicKey, 0x41);
+  transaction.senderPublicKey = ark::toHex(keys.publicKey, 33);
+  received.push_back(transaction);
+  balance += amount;
+  return transaction.id;
+}
+
+std::string ArkChain::receiveRentalStart(const std::string &sessionId, uint64_t amount, int rider) {
+  HeapAccountingOff internal;
+  ark::Keys keys = ark::keysFromPassphrase("rider " + std::to_string(rider));
+  ArkReceived transaction;
+  transaction.at_us = now();
+  transaction.id = receivedId(*this, sessionId);
+  transaction.type = ark::RENTAL_START_TYPE;
+  transaction.typeGroup = ark::RADIANS_TYPE_GROUP;
+  transaction.amount = amount;
+  transaction.sender = ark::address(keys.publicKey, 0x41);
+  transaction.senderPublicKey = ark::toHex(keys.publicKey, 33);
+  transaction.sessionId = sessionId;
+  received.push_back(transaction);
+  balance += amount;
+  return transaction.id;
+}
+
+//After a reboot the clocks start again at 0: everything that was sent before is confirmed
+bool saveArkChain(const std::string &path) {
+  ArkChain &chain = arkChain();
+  chain.update(UINT64_MAX - (uint64_t) chain.blockTime_ms * 1000);
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file) {
+    return false;
+  }
+  fprintf(file, "%s %s %" PRIu64 " %" PRIu64 " %" PRIu64 " %zu %zu\n", chain.address.c_str(), chain.publicKey.c_str(),
+          chain.balance, chain.nonce, chain.accepted, chain.received.size(), chain.forged.size());
+  for (const ArkReceived &r : chain.received) {
+    fprintf(file, "%s %u %u %" PRIu64 " %s %s %s\n", r.id.c_str(), r.type, r.typeGroup, r.amount, r.sender.c_str(),
+            r.senderPublicKey.c_str(), r.sessionId.empty() ? "-" : r.sessionId.c_str());
+  }
+  for (const std::string &id : chain.forged) {
+    fprintf(file, "%s\n", id.c_str());
+  }
+  return fclose(file) == 0;
+}
+
+bool loadArkChain(const std::string &path) {
+  HeapAccountingOff internal;
+  FILE *file = fopen(path.c_str(), "r");
+  if (!file) {
+    return false;
+  }
+  ArkChain &chain = arkChain();
+  char a[128], b[128], c[128];
+  size_t receivedCount = 0, forgedCount = 0;
+  bool ok = fscanf(file, "%127s %127s %" SCNu64 " %" SCNu64 " %" SCNu64 " %zu %zu", a, b, &chain.balance, &chain.nonce,
+                   &chain.accepted, &receivedCount, &forgedCount) == 7;
+  chain.address = a;
+  chain.publicKey = b;
+  chain.received.clear();
+  chain.pool.clear();
+  chain.forged.clear();
+  for (size_t i = 0; ok && (i < receivedCount); i++) {
+    char id[128], sender[128], key[128], session[128];
+    unsigned type, typeGroup;
+    ArkReceived r;
+    ok = fscanf(file, "%127s %u %u %" SCNu64 " %127s %127s %127s", id, &type, &typeGroup, &r.amount, sender, key, session) == 7;
+    r.at_us = 0;
+    r.id = id;
+    r.type = type;
+    r.typeGroup = typeGroup;
+    r.sender = sender;
+    r.senderPublicKey = key;
+    r.sessionId = (strcmp(session, "-") == 0) ? "" : session;
+    chain.received.push_back(r);
+  }
+  for (size_t i = 0; ok && (i < forgedCount); i++) {
+    ok = fscanf(file, "%127s", c) == 1;
+    chain.forged.push_back(c);
+  }
+  fclose(file);
+  return ok;
+}
+
+
+/********************************************************************************
+  Relay
+********************************************************************************/
+static const char *reason(int status) {
+  switch (status) {
+    case 200:
+      return "OK";
+    case 404:
+      return "Not Found";
+    case 422:
+      return "Unprocessable Entity";
+    case 500:
+      return "Internal Server Error";
+    case 503:
+      return "Service Unavailable";
+    default:
+      return "Error";
+  }
+}
+
+static std::string u64(uint64_t value) {
+  char text[24];
+  snprintf(text, sizeof(text), "%" PRIu64, value);
+  return text;
+}
+
+static std::string queryValue(const std::string &path, const std::string &name) {
+  size_t start = path.find("?");
+  while (start != std::string::npos) {
+    start++;
+    if (path.compare(start, name.size() + 1, name + "=") == 0) {
+      size_t end = path.find('&', start);
+      return path.substr(start + name.size() + 1, (end == std::string::npos) ? std::string::npos : end - start - name.size() - 1);
+    }
+    start = path.find('&', start);
+  }
+  return "";
+}
+
+size_t ArkRelay::count(const std::string &method, const std::string &pathPrefix) const {
+  size_t n = 0;
+  for (const Request &request : requests) {
+    if ((request.method == method) && (request.path.compare(0, pathPrefix.size(), pathPrefix) == 0)) {
+      n++;
+    }
+  }
+  return n;
+}
+
+void ArkRelay::received(const std::shared_ptr<Connection> &connection) {
+  HeapAccountingOff internal;
+  for (;;) {
+    std::string &buffer = connection->request;
+    size_t headEnd = buffer.find("\r\n\r\n");
+    if (headEnd == std::string::npos) {
+      return;
+    }
+    std::string head = buffer.substr(0, headEnd);
+    size_t contentLength = 0;
+    std::string lower = head;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    size_t field = lower.find("\r\ncontent-length:");
+    if (field != std::string::npos) {
+      contentLength = strtoul(&lower[field + 17], NULL, 10);
+    }
+    if (buffer.size() < headEnd + 4 + contentLength) {
+      return;       // the body is still being written
+    }
+    std::string body = buffer.substr(headEnd + 4, contentLength);
+    buffer.erase(0, headEnd + 4 + contentLength);
+
+    size_t methodEnd = head.find(' ');
+    size_t pathEnd = head.find(' ', methodEnd + 1);
+    std::string method = head.substr(0, methodEnd);
+    std::string path = head.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+
+    //requests are served one after the other on a connection
+    uint64_t start_us = now();
+    if (!connection->segments.empty()) {
+      start_us = std::max(start_us, connection->segments.back().at_us);
+    }
+    uint64_t head_us = start_us + (uint64_t) latency_ms * 1000;
+    arkChain().update(head_us);
+
+    int code = 200;
+    std::string json = (status != 0) ? ("{\"statusCode\":" + std::to_string(status) + ",\"error\":\"" + reason(status) + "\"}")
+                                     : respond(method, path, body, code);
+    if (status != 0) {
+      code = status;
+    }
+    requests.push_back({start_us, method, path, body, code});
+    connection->requests++;
+
+    std::string response = "HTTP/1.1 " + std::to_string(code) + " " + reason(code) + "\r\n";
+    response += "Content-Type: application/json; charset=utf-8\r\n";
+    response += "Content-Length: " + std::to_string(json.size()) + "\r\n";
+    response += "Connection: keep-alive\r\n\r\n";
+    connection->send(response, head_us, 1e6);
+    connection->send(json, head_us, bytesPerUs);
+    connection->closeAt_us = connection->segments.back().at_us + (uint64_t) idleClose_ms * 1000;
+  }
+}
+
+std::string ArkRelay::respond(const std::string &method, const std::string &path, const std::string &body, int &status) {
+  ArkChain &chain = arkChain();
+  const std::string wallet = "/api/wallets/" + chain.address;
+  uint64_t t = now() + (uint64_t) latency_ms * 1000;
+
+  if ((method == "GET") && (path == "/api/node/status")) {
+    uint64_t height = t / ((uint64_t) chain.blockTime_ms * 1000) + 4047140;
+    return std::string("{\"data\":{\"synced\":") + (synced ? "true" : "false") + ",\"now\":" + u64(height) +
+           ",\"blocksCount\":" + (synced ? "0" : "-120") + ",\"timestamp\":" + u64(82303508 + t / 1000000) + "}}";
+  }
+
+  if ((method == "GET") && (path == wallet)) {
+    return "{\"data\":{\"address\":\"" + chain.address + "\",\"publicKey\":\"" + chain.publicKey + "\",\"nonce\":\"" +
+           u64(chain.nonce) + "\",\"balance\":\"" + u64(chain.balance) + "\",\"isDelegate\":false,\"isResigned\":false}}";
+  }
+
+  if ((method == "GET") && (path.compare(0, wallet.size() + 22, wallet + "/transactions/received") == 0)) {
+    std::vector<const ArkReceived *> confirmed = chain.confirmedReceived(t);
+    int page = std::max(1, atoi(queryValue(path, "page").c_str()));
+    int limit = std::max(1, std::min(100, atoi(queryValue(path, "limit").c_str())));
+    int total = (int) confirmed.size();
+    int pageCount = (total + limit - 1) / limit;
+    size_t first = (size_t) (page - 1) * limit;
+    size_t last = std::min(confirmed.size(), first + limit);
+    int count = (first < last) ? (int) (last - first) : 0;
+
+    std::string link = wallet + "/transactions/received?page=";
+    std::string suffix = "&limit=" + std::to_string(limit) + "&orderBy=timestamp%3Aasc&transform=true";
+    std::string json = "{\"meta\":{\"totalCountIsEstimate\":true,\"count\":" + std::to_string(count) + ",\"pageCount\":" +
+                       std::to_string(pageCount) + ",\"totalCount\":" + std::to_string(total) + ",\"next\":";
+    json += (page < pageCount) ? ("\"" + link + std::to_string(page + 1) + suffix + "\"") : "null";
+    json += ",\"previous\":";
+    json += (page > 1) ? ("\"" + link + std::to_string(page - 1) + suffix + "\"") : "null";
+    json += ",\"self\":\"" + link + std::to_string(page) + suffix + "\",\"first\":\"" + link + "1" + suffix + "\",\"last\":";
+    json += (pageCount > 0) ? ("\"" + link + std::to_string(pageCount) + suffix + "\"") : "null";
+    json += "},\"data\":[";
+    for (size_t i = first; i < last; i++) {
+      const ArkReceived &r = *confirmed[i];
+      uint64_t unixTime = 1572368340 + r.at_us / 1000000;
+      uint8_t signature[64];
+      ark::sha256(r.id.data(), r.id.size(), signature);
+      ark::sha256(signature, 32, &signature[32]);
+      json += (i > first) ? "," : "";
+      json += "{\"id\":\"" + r.id + "\",\"blockId\":\"" + u64(4937253598533919154ULL + chain.blockAfter(r.at_us) / 1000) +
+              "\",\"version\":2,\"type\":" + std::to_string(r.type) + ",\"typeGroup\":" + std::to_string(r.typeGroup) +
+              ",\"amount\":\"" + u64(r.amount) + "\",\"fee\":\"10000000\",\"sender\":\"" + r.sender +
+              "\",\"senderPublicKey\":\"" + r.senderPublicKey + "\",\"recipient\":\"" + chain.address +
+              "\",\"signature\":\"" + ark::toHex(signature, 64) + "\"";
+      if (r.type == ark::RENTAL_START_TYPE) {
+        json += ",\"asset\":{\"gps\":{\"timestamp\":" + u64(unixTime) + ",\"latitude\":\"53.535352\",\"longitude\":\"-113.277912\","
+                "\"human\":\"2020-03-02T05:00:16.000Z\"},\"sessionId\":\"" + r.sessionId + "\",\"rate\":\"5\",\"gpsCount\":1}";
+      }
+      json += ",\"confirmations\":" + u64((t - chain.blockAfter(r.at_us)) / ((uint64_t) chain.blockTime_ms * 1000) + 1) +
+              ",\"timestamp\":{\"epoch\":" + u64(374000 + r.at_us / 1000000) + ",\"unix\":" + u64(unixTime) +
+              ",\"human\":\"2019-10-29T16:59:00.856Z\"},\"nonce\":\"" + std::to_string(i + 2) + "\"}";
+    }
+    json += "]}";
+    return json;
+  }
+
+  if ((method == "POST") && (path == "/api/transactions")) {
+    return postTransactions(body, status);
+  }
+
+  status = 404;
+  return "{\"statusCode\":404,\"error\":\"Not Found\",\"message\":\"Not Found\"}";
+}
+
+//Splits {"transactions":[{...},{...}]} into the transaction objects
+static bool splitTransactions(const std::string &body, std::vector<std::string> &transactions) {
+  size_t key = body.find("\"transactions\"");
+  size_t start = (key == std::string::npos) ? key : body.find('[', key);
+  if (start == std::string::npos) {
+    return false;
+  }
+  int depth = 0;
+  bool inString = false;
+  size_t objectStart = 0;
+  for (size_t i = start + 1; i < body.size(); i++) {
+    char c = body[i];
+    if (inString) {
+      if (c == '\\') {
+        i++;
+      }
+      else if (c == '"') {
+        inString = false;
+      }
+      continue;
+    }
+    if (c == '"') {
+      inString = true;
+    }
+    else if (c == '{') {
+      if (depth++ == 0) {
+        objectStart = i;
+      }
+    }
+    else if (c == '}') {
+      if (--depth == 0) {
+        transactions.push_back(body.substr(objectStart, i - objectStart + 1));
+      }
+    }
+    else if ((c == ']') && (depth == 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string ArkRelay::postTransactions(const std::string &body, int &status) {
+  ArkChain &chain = arkChain();
+  std::vector<std::string> transactions;
+  if (!splitTransactions(body, transactions)) {
+    status = 422;
+    return "{\"statusCode\":422,\"error\":\"Unprocessable Entity\",\"message\":\"Invalid request payload input\"}";
+  }
+
+  std::vector<std::string> accept, invalid, errors;
+  for (const std::string &json : transactions) {
+    ark::RentalFinish transaction;
+    std::string id;
+    std::string type, message;
+    if (!ark::fromJson(json, transaction)) {
+      uint8_t hash[32];
+      ark::sha256(json.data(), json.size(), hash);
+      id = ark::toHex(hash, 32);
+      type = "ERR_BAD_DATA";
+      message = "Transaction didn't pass the verification process.";
+    }
+    else {
+      id = ark::transactionId(transaction);
+      bool pooled = std::any_of(chain.pool.begin(), chain.pool.end(), [&](const ArkPoolEntry &e) { return e.id == id; });
+      bool forged = std::find(chain.forged.begin(), chain.forged.end(), id) != chain.forged.end();
+      uint64_t expected = chain.poolNonce() + 1;
+      if ((pooled || forged) && ignoreDuplicates) {
+        accept.push_back(id);
+        continue;
+      }
+      if (pooled) {
+        type = "ERR_DUPLICATE";
+        message = "Duplicate transaction " + id;
+      }
+      else if (forged) {
+        type = "ERR_FORGED";
+        message = "Already forged.";
+      }
+      else if (!ark::verifyTransaction(transaction) || (ark::toHex(transaction.senderPublicKey, 33) != chain.publicKey)) {
+        type = "ERR_BAD_DATA";
+        message = "Transaction didn't pass the verification process.";
+      }
+      else if (transaction.nonce != expected) {
+        type = "ERR_APPLY";
+        message = "Cannot apply a transaction with nonce " + u64(transaction.nonce) + ": the sender " + chain.publicKey +
+                  " has nonce " + u64(expected - 1) + ".";
+      }
+      else if (transaction.amount + transaction.fee > chain.balance) {
+        type = "ERR_APPLY";
+        message = "Insufficient balance in the wallet.";
+      }
+      else {
+        chain.pool.push_back({now(), id, transaction.nonce, transaction.amount, transaction.fee});
+        chain.balance -= transaction.amount + transaction.fee;
+        chain.accepted++;
+        accept.push_back(id);
+        continue;
+      }
+    }
+    invalid.push_back(id);
+    errors.push_back("\"" + id + "\":[{\"type\":\"" + type + "\",\"message\":\"" + message + "\"}]");
+  }
+
+  auto list = [](const std::vector<std::string> &ids) {
+    std::string text = "[";
+    for (size_t i = 0; i < ids.size(); i++) {
+      text += ((i > 0) ? ",\"" : "\"") + ids[i] + "\"";
+    }
+    return text + "]";
+  };
+  std::string json = "{\"data\":{\"accept\":" + list(accept) + ",\"broadcast\":" + list(accept) + ",\"excess\":[],\"invalid\":" +
+                     list(invalid) + "}";
+  if (!errors.empty()) {
+    json += ",\"errors\":{";
+    for (size_t i = 0; i < errors.size(); i++) {
+      json += ((i > 0) ? "," : "") + errors[i];
+    }
+    json += "}";
+  }
+  json += "}";
+  status = accept.empty() ? 422 : 200;
+  return json;
+}
+
+}
@@ -0,0 +1,79 @@
+/********************************************************************************
+  Synthetic FreeSans9pt7b and FreeSansBold18pt7b
+  The Adafruit fonts are not part of the repository. These fonts have the line height, cap height and advances of the
+  real ones, and each glyph is an outline box with the stroke width of the font, so text costs a similar number of
+  pixels. Good enough to count the SPI traffic, not to look at.
+********************************************************************************/
+#include <Adafruit_GFX.h>
+#include "host.h"
+
+namespace {
+
+struct FontMetrics {
+  uint8_t capHeight;
+  uint8_t xHeight;
+  uint8_t descender;
+  uint8_t width;          // glyph box of a digit or an upper case letter
+  uint8_t advance;
+  uint8_t stroke;
+  uint8_t yAdvance;
+};
+
+struct FontData {
+  std::vector<uint8_t> bitmap;
+  std::vector<GFXglyph> glyphs;
+};
+
+GFXfont makeFont(const FontMetrics &m) {
+  host::HeapAccountingOff internal;
+  FontData *data = new FontData();
+  for (int c = 0x20; c <= 0x7E; c++) {
+    uint8_t width = m.width;
+    uint8_t height = m.capHeight;
+    int8_t yOffset = -(int8_t) m.capHeight;
+    uint8_t advance = m.advance;
+    if (c == ' ') {
+      width = height = 0;
+      advance = m.advance / 2;
+    }
+    else if (strchr("il.,:;'!|", c)) {
+      width = m.stroke;
+      advance = m.stroke * 2 + 2;
+      if (strchr(".,:;", c)) {
+        height = m.stroke;
+        yOffset = -(int8_t) m.stroke;
+      }
+    }
+    else if (islower(c)) {
+      height = m.xHeight;
+      yOffset = -(int8_t) m.xHeight;
+      if (strchr("gjpqy", c)) {
+        height += m.descender;
+      }
+    }
+    GFXglyph glyph = {(uint16_t) data->bitmap.size(), width, height, advance, 1, yOffset};
+    data->glyphs.push_back(glyph);
+
+    uint32_t bit = 0;
+    uint8_t byte = 0;
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        bool on = (x < m.stroke) || (x >= width - m.stroke) || (y < m.stroke) || (y >= height - m.stroke);
+        byte = (byte << 1) | (on ? 1 : 0);
+        if ((++bit & 7) == 0) {
+          data->bitmap.push_back(byte);
+          byte = 0;
+        }
+      }
+    }
+    if (bit & 7) {
+      data->bitmap.push_back(byte << (8 - (bit & 7)));
+    }
+  }
+  return {data->bitmap.data(), data->glyphs.data(), 0x20, 0x7E, m.yAdvance};
+}
+
+}
+
+extern const GFXfont FreeSans9pt7b = makeFont({13, 10, 4, 9, 10, 1, 22});
+extern const GFXfont FreeSansBold18pt7b = makeFont({25, 19, 7, 18, 20, 4, 42});
@@ -0,0 +1,403 @@
+/********************************************************************************
+  Adafruit GFX stand-in and the counting ILI9341 display
+  The primitives are the ones of Adafruit GFX 1.7 so the number of SPI transactions, address windows and pixels is the
+  same as on the scooter. Each of them is charged to the running task (host::SPI_*_US).
+********************************************************************************/
+#include <Adafruit_ILI9341.h>
+#include "host.h"
+
+namespace host {
+
+static DisplayStats displayStatistics;
+static std::vector<uint16_t> frame(ILI9341_TFTWIDTH * ILI9341_TFTHEIGHT, 0);
+
+DisplayStats &display() {
+  return displayStatistics;
+}
+
+uint16_t displayPixel(int x, int y) {
+  if ((x < 0) || (y < 0) || (x >= ILI9341_TFTWIDTH) || (y >= ILI9341_TFTHEIGHT)) {
+    return 0;
+  }
+  return frame[y * ILI9341_TFTWIDTH + x];
+}
+
+const std::vector<uint16_t> &displayFrame() {
+  return frame;
+}
+
+}
+
+SPIClass SPI;
+
+
+/********************************************************************************
+  Adafruit_GFX
+********************************************************************************/
+void Adafruit_GFX::writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  fillRect(x, y, w, h, color);
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  startWrite();
+  for (int16_t j = y; j < y + h; j++) {
+    for (int16_t i = x; i < x + w; i++) {
+      writePixel(i, j, color);
+    }
+  }
+  endWrite();
+}
+
+void Adafruit_GFX::fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
+  startWrite();
+  writeFastVLine(x0, y0 - r, 2 * r + 1, color);
+  fillCircleHelper(x0, y0, r, 3, 0, color);
+  endWrite();
+}
+
+void Adafruit_GFX::fillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t corners, int16_t delta, uint16_t color) {
+  int16_t f = 1 - r;
+  int16_t ddF_x = 1;
+  int16_t ddF_y = -2 * r;
+  int16_t x = 0;
+  int16_t y = r;
+  int16_t px = x;
+  int16_t py = y;
+
+  delta++;
+  while (x < y) {
+    if (f >= 0) {
+      y--;
+      ddF_y += 2;
+      f += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f += ddF_x;
+    if (x < (y + 1)) {
+      if (corners & 1) {
+        writeFastVLine(x0 + x, y0 - y, 2 * y + delta, color);
+      }
+      if (corners & 2) {
+        writeFastVLine(x0 - x, y0 - y, 2 * y + delta, color);
+      }
+    }
+    if (y != py) {
+      if (corners & 1) {
+        writeFastVLine(x0 + py, y0 - px, 2 * px + delta, color);
+      }
+      if (corners & 2) {
+        writeFastVLine(x0 - py, y0 - px, 2 * px + delta, color);
+      }
+      py = y;
+    }
+    px = x;
+  }
+}
+
+void Adafruit_GFX::fillRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color) {
+  int16_t maxRadius = ((w < h) ? w : h) / 2;
+  if (r > maxRadius) {
+    r = maxRadius;
+  }
+  startWrite();
+  writeFillRect(x + r, y, w - 2 * r, h, color);
+  fillCircleHelper(x + w - r - 1, y + r, r, 1, h - 2 * r - 1, color);
+  fillCircleHelper(x + r, y + r, r, 2, h - 2 * r - 1, color);
+  endWrite();
+}
+
+void Adafruit_GFX::drawBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint16_t color) {
+  int16_t byteWidth = (w + 7) / 8;
+  uint8_t b = 0;
+  startWrite();
+  for (int16_t j = 0; j < h; j++, y++) {
+    for (int16_t i = 0; i < w; i++) {
+      if (i & 7) {
+        b <<= 1;
+      }
+      else {
+        b = pgm_read_byte(&bitmap[j * byteWidth + i / 8]);
+      }
+      if (b & 0x80) {
+        writePixel(x + i, y, color);
+      }
+    }
+  }
+  endWrite();
+}
+
+void Adafruit_GFX::setFont(const GFXfont *font) {
+  if (font) {
+    if (!_font) {
+      _cursorY += 6;      //the baseline of the custom fonts is at the cursor, the classic font is drawn below it
+    }
+  }
+  else if (_font) {
+    _cursorY -= 6;
+  }
+  _font = font;
+}
+
+//Only the custom fonts are drawn. Text in the classic font only moves the cursor (the sketch does not use it)
+void Adafruit_GFX::drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size) {
+  if (!_font) {
+    return;
+  }
+  c -= (uint8_t) _font->first;
+  const GFXglyph *glyph = &_font->glyph[c];
+  const uint8_t *bitmap = _font->bitmap;
+  uint16_t bo = glyph->bitmapOffset;
+  uint8_t w = glyph->width;
+  uint8_t h = glyph->height;
+  int8_t xo = glyph->xOffset;
+  int8_t yo = glyph->yOffset;
+  uint8_t bits = 0;
+  uint8_t bit = 0;
+
+  startWrite();
+  for (uint8_t yy = 0; yy < h; yy++) {
+    for (uint8_t xx = 0; xx < w; xx++) {
+      if (!(bit++ & 7)) {
+        bits = bitmap[bo++];
+      }
+      if (bits & 0x80) {
+        if (size == 1) {
+          writePixel(x + xo + xx, y + yo + yy, color);
+        }
+        else {
+          writeFillRect(x + (xo + xx) * size, y + (yo + yy) * size, size, size, color);
+        }
+      }
+      bits <<= 1;
+    }
+  }
+  endWrite();
+}
+
+size_t Adafruit_GFX::write(uint8_t c) {
+  if (!_font) {
+    if (c == '\n') {
+      _cursorX = 0;
+      _cursorY += _textSize * 8;
+    }
+    else if (c != '\r') {
+      _cursorX += _textSize * 6;
+    }
+    return 1;
+  }
+  if (c == '\n') {
+    _cursorX = 0;
+    _cursorY += (int16_t) _textSize * _font->yAdvance;
+  }
+  else if (c != '\r') {
+    if ((c >= _font->first) && (c <= _font->last)) {
+      const GFXglyph *glyph = &_font->glyph[c - _font->first];
+      if ((glyph->width > 0) && (glyph->height > 0)) {
+        if (_wrap && ((_cursorX + _textSize * (glyph->xOffset + glyph->width)) > _width)) {
+          _cursorX = 0;
+          _cursorY += (int16_t) _textSize * _font->yAdvance;
+        }
+        drawChar(_cursorX, _cursorY, c, _textColor, _textBackground, _textSize);
+      }
+      _cursorX += glyph->xAdvance * (int16_t) _textSize;
+    }
+  }
+  return 1;
+}
+
+void Adafruit_GFX::charBounds(unsigned char c, int16_t *x, int16_t *y, int16_t *minx, int16_t *miny, int16_t *maxx, int16_t *maxy) {
+  if (!_font) {
+    if (c == '\n') {
+      *x = 0;
+      *y += _textSize * 8;
+    }
+    else if (c != '\r') {
+      int16_t x2 = *x + _textSize * 6 - 1;
+      int16_t y2 = *y + _textSize * 8 - 1;
+      *minx = std::min(*minx, *x);
+      *miny = std::min(*miny, *y);
+      *maxx = std::max(*maxx, x2);
+      *maxy = std::max(*maxy, y2);
+      *x += _textSize * 6;
+    }
+    return;
+  }
+  if (c == '\n') {
+    *x = 0;
+    *y += _textSize * _font->yAdvance;
+  }
+  else if ((c != '\r') && (c >= _font->first) && (c <= _font->last)) {
+    const GFXglyph *glyph = &_font->glyph[c - _font->first];
+    if (_wrap && ((*x + ((int16_t) glyph->xOffset + glyph->width) * _textSize) > _width)) {
+      *x = 0;
+      *y += _textSize * _font->yAdvance;
+    }
+    int16_t x1 = *x + glyph->xOffset * _textSize;
+    int16_t y1 = *y + glyph->yOffset * _textSize;
+    int16_t x2 = x1 + glyph->width * _textSize - 1;
+    int16_t y2 = y1 + glyph->height * _textSize - 1;
+    *minx = std::min(*minx, x1);
+    *miny = std::min(*miny, y1);
+    *maxx = std::max(*maxx, x2);
+    *maxy = std::max(*maxy, y2);
+    *x += glyph->xAdvance * _textSize;
+  }
+}
+
+void Adafruit_GFX::getTextBounds(const char *text, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h) {
+  *x1 = x;
+  *y1 = y;
+  *w = *h = 0;
+  int16_t minx = _width, miny = _height, maxx = -1, maxy = -1;
+  uint8_t c;
+  while ((c = *text++)) {
+    charBounds(c, &x, &y, &minx, &miny, &maxx, &maxy);
+  }
+  if (maxx >= minx) {
+    *x1 = minx;
+    *w = maxx - minx + 1;
+  }
+  if (maxy >= miny) {
+    *y1 = miny;
+    *h = maxy - miny + 1;
+  }
+}
+
+
+/********************************************************************************
+  GFXcanvas16
+********************************************************************************/
+GFXcanvas16::GFXcanvas16(uint16_t w, uint16_t h) : Adafruit_GFX(w, h) {
+  _buffer = new (std::nothrow) uint16_t[(size_t) w * h];
+  if (_buffer) {
+    memset(_buffer, 0, (size_t) w * h * 2);
+  }
+}
+
+GFXcanvas16::~GFXcanvas16() {
+  delete[] _buffer;
+}
+
+void GFXcanvas16::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  if (_buffer && (x >= 0) && (y >= 0) && (x < _width) && (y < _height)) {
+    _buffer[x + y * _width] = color;
+  }
+}
+
+void GFXcanvas16::fillScreen(uint16_t color) {
+  if (_buffer) {
+    for (int32_t i = 0; i < (int32_t) _width * _height; i++) {
+      _buffer[i] = color;
+    }
+  }
+}
+
+
+/********************************************************************************
+  Adafruit_SPITFT: the counting display
+********************************************************************************/
+void Adafruit_ILI9341::begin(uint32_t) {
+  host::charge(120000);       //reset and sleep out delays of the initialization sequence
+}
+
+void Adafruit_SPITFT::startWrite() {
+  host::display().transactions++;
+  host::charge(host::SPI_TRANSACTION_US);
+}
+
+void Adafruit_SPITFT::endWrite() {
+}
+
+void Adafruit_SPITFT::setAddrWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+  host::display().addressWindows++;
+  host::charge(host::SPI_ADDRESS_WINDOW_US);
+  _windowX = x;
+  _windowY = y;
+  _windowW = w;
+  _windowH = h;
+  _windowOffset = 0;
+}
+
+void Adafruit_SPITFT::pushPixel(uint16_t color) {
+  if ((_windowW <= 0) || (_windowH <= 0)) {
+    return;
+  }
+  int x = _windowX + _windowOffset % _windowW;
+  int y = _windowY + _windowOffset / _windowW;
+  if ((x >= 0) && (y >= 0) && (x < _width) && (y < _height)) {
+    host::frame[y * ILI9341_TFTWIDTH + x] = color;
+  }
+  _windowOffset = (_windowOffset + 1) % ((uint32_t) _windowW * _windowH);
+}
+
+void Adafruit_SPITFT::writePixels(uint16_t *colors, uint32_t len, bool, bool) {
+  host::display().pixels += len;
+  host::charge(len * host::SPI_PIXEL_US);
+  for (uint32_t i = 0; i < len; i++) {
+    pushPixel(colors[i]);
+  }
+}
+
+void Adafruit_SPITFT::writeColor(uint16_t color, uint32_t len) {
+  host::display().pixels += len;
+  host::charge(len * host::SPI_PIXEL_US);
+  for (uint32_t i = 0; i < len; i++) {
+    pushPixel(color);
+  }
+}
+
+void Adafruit_SPITFT::writePixel(int16_t x, int16_t y, uint16_t color) {
+  if ((x >= 0) && (x < _width) && (y >= 0) && (y < _height)) {
+    setAddrWindow(x, y, 1, 1);
+    writeColor(color, 1);
+  }
+}
+
+void Adafruit_SPITFT::writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  if (w < 0) {
+    x += w + 1;
+    w = -w;
+  }
+  if (h < 0) {
+    y += h + 1;
+    h = -h;
+  }
+  if (x < 0) {
+    w += x;
+    x = 0;
+  }
+  if (y < 0) {
+    h += y;
+    y = 0;
+  }
+  w = std::min<int16_t>(w, _width - x);
+  h = std::min<int16_t>(h, _height - y);
+  if ((w <= 0) || (h <= 0)) {
+    return;
+  }
+  setAddrWindow(x, y, w, h);
+  writeColor(color, (uint32_t) w * h);
+}
+
+void Adafruit_SPITFT::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  if ((x >= 0) && (x < _width) && (y >= 0) && (y < _height)) {
+    startWrite();
+    writePixel(x, y, color);
+    endWrite();
+  }
+}
+
+void Adafruit_SPITFT::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  if ((w == 0) || (h == 0) || (x >= _width) || (y >= _height) || (x + w <= 0) || (y + h <= 0)) {
+    return;
+  }
+  startWrite();
+  writeFillRect(x, y, w, h, color);
+  endWrite();
+}
+
+void Adafruit_SPITFT::fillScreen(uint16_t color) {
+  host::display().fills++;
+  fillRect(0, 0, _width, _height, color);
+}
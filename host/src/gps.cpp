@@ -0,0 +1,139 @@
+/********************************************************************************
+  GPS replay (NMEA sentences of a simulated PA1616 module) and the Adafruit_GPS stand-in
+********************************************************************************/
+#include <Adafruit_GPS.h>
+#include "host.h"
+
+namespace host {
+
+std::string nmeaSentence(const std::string &body) {
+  HeapAccountingOff internal;
+  uint8_t checksum = 0;
+  for (char c : body) {
+    checksum ^= (uint8_t) c;
+  }
+  char tail[8];
+  snprintf(tail, sizeof(tail), "*%02X\r\n", checksum);
+  return "$" + body + tail;
+}
+
+//ddmm.mmmmm with 5 decimals of minutes: 0.00001 minute = 1/6 microdegree, so microdegrees are represented exactly
+std::string nmeaCoordinate(int32_t microdegrees, bool latitude) {
+  HeapAccountingOff internal;
+  uint32_t magnitude = (microdegrees < 0) ? -(int64_t) microdegrees : microdegrees;
+  uint32_t degrees = magnitude / 1000000;
+  uint32_t minutes_e5 = (magnitude % 1000000) * 6;
+  char text[24];
+  snprintf(text, sizeof(text), latitude ? "%02u%02u.%05u,%c" : "%03u%02u.%05u,%c", degrees, minutes_e5 / 100000, minutes_e5 % 100000,
+           latitude ? ((microdegrees < 0) ? 'S' : 'N') : ((microdegrees < 0) ? 'W' : 'E'));
+  return text;
+}
+
+bool GpsRoute::next(uint64_t, uint64_t &at_us, std::string &sentences) {
+  HeapAccountingOff internal;
+  at_us = _next_us;
+  GpsPosition p = position(_next_us);
+  uint32_t seconds = (uint32_t) (_next_us / 1000000);
+  char time[16];
+  snprintf(time, sizeof(time), "%02u%02u%02u.%03u", (seconds / 3600) % 24, (seconds / 60) % 60, seconds % 60,
+           (uint32_t) (_next_us / 1000) % 1000);
+  char body[128];
+  if (p.fix) {
+    std::string lat = nmeaCoordinate(p.latitude, true);
+    std::string lon = nmeaCoordinate(p.longitude, false);
+    snprintf(body, sizeof(body), "GPRMC,%s,A,%s,%s,%.2f,87.50,160926,,,A", time, lat.c_str(), lon.c_str(), p.speedKnots);
+    sentences = nmeaSentence(body);
+    snprintf(body, sizeof(body), "GPGGA,%s,%s,%s,1,%02d,0.92,650.3,M,-17.0,M,,", time, lat.c_str(), lon.c_str(), p.satellites);
+    sentences += nmeaSentence(body);
+  }
+  else {
+    snprintf(body, sizeof(body), "GPRMC,%s,V,,,,,0.00,0.00,160926,,,N", time);
+    sentences = nmeaSentence(body);
+    snprintf(body, sizeof(body), "GPGGA,%s,,,,,0,%02d,,,M,,M,,", time, p.satellites);
+    sentences += nmeaSentence(body);
+  }
+  if (extraSentences) {
+    sentences += nmeaSentence("GPGSA,A,3,10,12,14,24,25,32,,,,,,,1.25,0.92,0.84");
+    sentences += nmeaSentence("GPGSV,3,1,11,10,63,137,17,12,44,230,42,14,20,053,36,24,31,302,39");
+    sentences += nmeaSentence("GPGSV,3,2,11,25,40,089,44,32,71,283,38,01,09,166,,02,04,327,");
+    sentences += nmeaSentence("GPGSV,3,3,11,06,11,104,,19,02,047,,31,05,259,");
+    sentences += nmeaSentence("GPVTG,87.50,T,,M,0.00,N,0.00,K,A");
+  }
+  _next_us += (uint64_t) period_ms * 1000;
+  return true;
+}
+
+bool GpsRecording::next(uint64_t, uint64_t &at_us, std::string &text) {
+  if (_index >= sentences.size()) {
+    return false;
+  }
+  HeapAccountingOff internal;
+  at_us = sentences[_index].first;
+  text = sentences[_index].second;
+  _index++;
+  return true;
+}
+
+}
+
+
+/********************************************************************************
+  Adafruit_GPS
+********************************************************************************/
+bool Adafruit_GPS::begin(uint32_t baud) {
+  _serial->begin(baud);
+  return true;
+}
+
+void Adafruit_GPS::sendCommand(const char *command) {
+  _serial->println(command);
+}
+
+//Field n (0 = sentence type) of a sentence. Empty fields give ""
+static const char *nmeaField(const char *nmea, int n, char *field, size_t size) {
+  const char *p = nmea;
+  for (int i = 0; i < n; i++) {
+    p = strchr(p, ',');
+    if (!p) {
+      field[0] = '\0';
+      return field;
+    }
+    p++;
+  }
+  size_t length = strcspn(p, ",*\r\n");
+  length = std::min(length, size - 1);
+  memcpy(field, p, length);
+  field[length] = '\0';
+  return field;
+}
+
+bool Adafruit_GPS::parse(char *nmea) {
+  const char *asterisk = strchr(nmea, '*');
+  if ((nmea[0] != '$') || !asterisk || !isxdigit((uint8_t) asterisk[1]) || !isxdigit((uint8_t) asterisk[2])) {
+    return false;
+  }
+  uint8_t checksum = 0;
+  for (const char *p = nmea + 1; p < asterisk; p++) {
+    checksum ^= (uint8_t) *p;
+  }
+  char hex[3] = {asterisk[1], asterisk[2], '\0'};
+  if (checksum != strtoul(hex, NULL, 16)) {
+    return false;
+  }
+  strlcpy(_lastNMEA, nmea, sizeof(_lastNMEA));
+
+  char field[24];
+  if (strncmp(&nmea[3], "GGA", 3) == 0) {
+    fixquality = atoi(nmeaField(nmea, 6, field, sizeof(field)));
+    fix = fixquality > 0;
+    satellites = atoi(nmeaField(nmea, 7, field, sizeof(field)));
+    return true;
+  }
+  if (strncmp(&nmea[3], "RMC", 3) == 0) {
+    fix = nmeaField(nmea, 2, field, sizeof(field))[0] == 'A';
+    speed = atof(nmeaField(nmea, 7, field, sizeof(field)));
+    angle = atof(nmeaField(nmea, 8, field, sizeof(field)));
+    return true;
+  }
+  return false;
+}
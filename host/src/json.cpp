@@ -0,0 +1,467 @@
+/********************************************************************************
+  ArduinoJson stand-in: memory pool and the filtered deserializer (see host/mocks/ArduinoJson.h)
+********************************************************************************/
+#include <errno.h>
+
+#include <ArduinoJson.h>
+
+using namespace host_json;
+
+static const int NESTING_LIMIT = 10;
+
+void *JsonDocument::allocate(size_t size, size_t modelSize) {
+  size_t offset = (_used + 7) & ~(size_t) 7;
+  if ((offset + size > _poolSize) || (_modelUsage + modelSize > _capacity)) {
+    return nullptr;
+  }
+  _used = offset + size;
+  _modelUsage += modelSize;
+  return _pool + offset;
+}
+
+Node *JsonDocument::addChild(Node *parent, const char *key, size_t keyLength, bool copyKey) {
+  const char *storedKey = key;
+  if (key && copyKey) {
+    storedKey = storeString(key, keyLength);
+    if (!storedKey) {
+      return nullptr;
+    }
+  }
+  void *memory = allocate(sizeof(Node), SLOT_SIZE);
+  if (!memory) {
+    return nullptr;
+  }
+  Node *node = new (memory) Node();
+  node->key = storedKey;
+  if (!parent->child) {
+    parent->child = node;
+  }
+  else {
+    Node *last = parent->child;
+    while (last->next) {
+      last = last->next;
+    }
+    last->next = node;
+  }
+  return node;
+}
+
+const char *JsonDocument::storeString(const char *s, size_t length) {
+  char *copy = (char *) allocate(length + 1, length + 1);
+  if (!copy) {
+    return nullptr;
+  }
+  memcpy(copy, s, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+Node *JsonDocument::find(Node *object, const char *key) {
+  if (!object || (object->type != JSON_OBJECT) || !key) {
+    return nullptr;
+  }
+  for (Node *member = object->child; member; member = member->next) {
+    if (member->key && (strcmp(member->key, key) == 0)) {
+      return member;
+    }
+  }
+  return nullptr;
+}
+
+
+/********************************************************************************
+  Deserializer
+********************************************************************************/
+namespace {
+
+class Reader {
+  public:
+    virtual ~Reader() {}
+    virtual int read() = 0;
+};
+
+class StreamReader : public Reader {
+  public:
+    explicit StreamReader(Stream &stream) : _stream(stream) {}
+    int read() override {
+      char c;
+      return (_stream.readBytes(&c, 1) == 1) ? (uint8_t) c : -1;
+    }
+  private:
+    Stream &_stream;
+};
+
+class StringReader : public Reader {
+  public:
+    explicit StringReader(const char *s) : _s(s) {}
+    int read() override {
+      return *_s ? (uint8_t) *_s++ : -1;
+    }
+  private:
+    const char *_s;
+};
+
+class Parser {
+  public:
+    Parser(JsonDocument &doc, Reader &reader) : _doc(doc), _reader(reader) {}
+
+    DeserializationError parse(DeserializationOption::Filter filter) {
+      DeserializationError::Code error = skipSpaces();
+      if (error != DeserializationError::Ok) {
+        return (error == DeserializationError::IncompleteInput) ? DeserializationError::EmptyInput : error;
+      }
+      return parseVariant(filter.allow() ? _doc.root() : nullptr, filter, 0);
+    }
+
+  private:
+    int current() {
+      if (!_loaded) {
+        _current = _reader.read();
+        _loaded = true;
+      }
+      return _current;
+    }
+    void move() {
+      _loaded = false;
+    }
+
+    DeserializationError::Code skipSpaces() {
+      for (;;) {
+        int c = current();
+        if (c < 0) {
+          return DeserializationError::IncompleteInput;
+        }
+        if (!isspace(c)) {
+          return DeserializationError::Ok;
+        }
+        move();
+      }
+    }
+
+    //node == nullptr -> the value is skipped
+    DeserializationError::Code parseVariant(Node *node, DeserializationOption::Filter filter, int depth) {
+      DeserializationError::Code error = skipSpaces();
+      if (error) {
+        return error;
+      }
+      switch (current()) {
+        case '{':
+          return parseObject(filter.allowObject() ? node : nullptr, filter, depth + 1);
+        case '[':
+          return parseArray(filter.allowArray() ? node : nullptr, filter, depth + 1);
+        case '"':
+        case '\'':
+          return parseString(filter.allowValue() ? node : nullptr);
+        default:
+          return parseLiteral(filter.allowValue() ? node : nullptr);
+      }
+    }
+
+    DeserializationError::Code parseObject(Node *node, DeserializationOption::Filter filter, int depth) {
+      if (depth > NESTING_LIMIT) {
+        return DeserializationError::TooDeep;
+      }
+      move();     // '{'
+      if (node) {
+        node->type = JSON_OBJECT;
+      }
+      DeserializationError::Code error = skipSpaces();
+      if (error) {
+        return error;
+      }
+      if (current() == '}') {
+        move();
+        return DeserializationError::Ok;
+      }
+      for (;;) {
+        std::string key;
+        {
+          host::HeapAccountingOff internal;     // the library parses the key in the free part of the pool
+          error = readString(key);
+        }
+        if (error) {
+          return error;
+        }
+        error = skipSpaces();
+        if (error) {
+          return error;
+        }
+        if (current() != ':') {
+          return DeserializationError::InvalidInput;
+        }
+        move();
+
+        DeserializationOption::Filter memberFilter = filter.member(key.c_str());
+        Node *member = nullptr;
+        if (node && memberFilter.allow()) {
+          member = JsonDocument::find(node, key.c_str());
+          if (!member) {
+            member = _doc.addChild(node, key.data(), key.size(), true);
+            if (!member) {
+              return DeserializationError::NoMemory;
+            }
+          }
+        }
+        error = parseVariant(member, memberFilter, depth);
+        if (error) {
+          return error;
+        }
+
+        error = skipSpaces();
+        if (error) {
+          return error;
+        }
+        int c = current();
+        move();
+        if (c == '}') {
+          return DeserializationError::Ok;
+        }
+        if (c != ',') {
+          return DeserializationError::InvalidInput;
+        }
+        error = skipSpaces();
+        if (error) {
+          return error;
+        }
+      }
+    }
+
+    DeserializationError::Code parseArray(Node *node, DeserializationOption::Filter filter, int depth) {
+      if (depth > NESTING_LIMIT) {
+        return DeserializationError::TooDeep;
+      }
+      move();     // '['
+      if (node) {
+        node->type = JSON_ARRAY;
+      }
+      DeserializationError::Code error = skipSpaces();
+      if (error) {
+        return error;
+      }
+      if (current() == ']') {
+        move();
+        return DeserializationError::Ok;
+      }
+      DeserializationOption::Filter elementFilter = filter.element();
+      for (;;) {
+        Node *element = nullptr;
+        if (node && elementFilter.allow()) {
+          element = _doc.addChild(node, nullptr, 0, false);
+          if (!element) {
+            return DeserializationError::NoMemory;
+          }
+        }
+        error = parseVariant(element, elementFilter, depth);
+        if (error) {
+          return error;
+        }
+        error = skipSpaces();
+        if (error) {
+          return error;
+        }
+        int c = current();
+        move();
+        if (c == ']') {
+          return DeserializationError::Ok;
+        }
+        if (c != ',') {
+          return DeserializationError::InvalidInput;
+        }
+      }
+    }
+
+    DeserializationError::Code readString(std::string &text) {
+      int quote = current();
+      if ((quote != '"') && (quote != '\'')) {
+        return DeserializationError::InvalidInput;
+      }
+      move();
+      for (;;) {
+        int c = current();
+        move();
+        if (c < 0) {
+          return DeserializationError::IncompleteInput;
+        }
+        if (c == quote) {
+          return DeserializationError::Ok;
+        }
+        if (c == '\\') {
+          c = current();
+          move();
+          switch (c) {
+            case -1:
+              return DeserializationError::IncompleteInput;
+            case 'b':
+              c = '\b';
+              break;
+            case 'f':
+              c = '\f';
+              break;
+            case 'n':
+              c = '\n';
+              break;
+            case 'r':
+              c = '\r';
+              break;
+            case 't':
+              c = '\t';
+              break;
+            case 'u': {
+              char hex[5] = {0};
+              for (int i = 0; i < 4; i++) {
+                int h = current();
+                move();
+                if (h < 0) {
+                  return DeserializationError::IncompleteInput;
+                }
+                hex[i] = (char) h;
+              }
+              uint32_t codepoint = strtoul(hex, NULL, 16);
+              if (codepoint < 0x80) {
+                c = codepoint;
+              }
+              else if (codepoint < 0x800) {
+                text += (char) (0xC0 | (codepoint >> 6));
+                c = 0x80 | (codepoint & 0x3F);
+              }
+              else {
+                text += (char) (0xE0 | (codepoint >> 12));
+                text += (char) (0x80 | ((codepoint >> 6) & 0x3F));
+                c = 0x80 | (codepoint & 0x3F);
+              }
+              break;
+            }
+            default:
+              break;
+          }
+        }
+        text += (char) c;
+      }
+    }
+
+    DeserializationError::Code parseString(Node *node) {
+      std::string text;
+      DeserializationError::Code error;
+      {
+        host::HeapAccountingOff internal;
+        error = readString(text);
+      }
+      if (error || !node) {
+        return error;
+      }
+      const char *stored = _doc.storeString(text.data(), text.size());
+      if (!stored) {
+        return DeserializationError::NoMemory;
+      }
+      node->type = JSON_STRING;
+      node->s = stored;
+      return DeserializationError::Ok;
+    }
+
+    DeserializationError::Code parseLiteral(Node *node) {
+      char text[64];
+      size_t length = 0;
+      for (;;) {
+        int c = current();
+        if ((c < 0) || !(isalnum(c) || (c == '+') || (c == '-') || (c == '.'))) {
+          break;
+        }
+        if (length >= sizeof(text) - 1) {
+          return DeserializationError::InvalidInput;
+        }
+        text[length++] = (char) c;
+        move();
+      }
+      text[length] = '\0';
+      if (length == 0) {
+        return (current() < 0) ? DeserializationError::IncompleteInput : DeserializationError::InvalidInput;
+      }
+
+      Node value;
+      if (strcmp(text, "true") == 0) {
+        value.type = JSON_BOOL;
+        value.b = true;
+      }
+      else if (strcmp(text, "false") == 0) {
+        value.type = JSON_BOOL;
+        value.b = false;
+      }
+      else if (strcmp(text, "null") == 0) {
+        value.type = JSON_NULL;
+      }
+      else {
+        char *end;
+        bool integer = strpbrk(text, ".eE") == nullptr;
+        if (integer) {
+          errno = 0;
+          long long i = strtoll(text, &end, 10);
+          if ((*end == '\0') && (errno == 0)) {
+            value.type = JSON_INTEGER;
+            value.i = i;
+          }
+          else {
+            integer = false;
+          }
+        }
+        if (!integer) {
+          value.f = strtod(text, &end);
+          if (*end != '\0') {
+            return DeserializationError::InvalidInput;
+          }
+          value.type = JSON_FLOAT;
+        }
+      }
+      if (node) {
+        node->type = value.type;
+        node->i = value.i;
+      }
+      return DeserializationError::Ok;
+    }
+
+    JsonDocument &_doc;
+    Reader &_reader;
+    int _current = -1;
+    bool _loaded = false;
+};
+
+DeserializationError deserialize(JsonDocument &doc, Reader &reader, DeserializationOption::Filter filter) {
+  doc.clear();
+  Parser parser(doc, reader);
+  return parser.parse(filter);
+}
+
+}
+
+//Without a filter every value is kept
+static DeserializationOption::Filter noFilter() {
+  static Node all;
+  all.type = JSON_BOOL;
+  all.b = true;
+  return DeserializationOption::Filter(&all);
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, Stream &input) {
+  return deserializeJson(doc, input, noFilter());
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, Stream &input, DeserializationOption::Filter filter) {
+  StreamReader reader(input);
+  return deserialize(doc, reader, filter);
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, const char *input) {
+  return deserializeJson(doc, input, noFilter());
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, const char *input, DeserializationOption::Filter filter) {
+  StringReader reader(input ? input : "");
+  return deserialize(doc, reader, filter);
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, const String &input) {
+  return deserializeJson(doc, input.c_str());
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, const std::string &input) {
+  return deserializeJson(doc, input.c_str());
+}
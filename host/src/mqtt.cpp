@@ -0,0 +1,164 @@
+/********************************************************************************
+  WiFi and MQTT broker of the harness (EspMQTTClient stand-in)
+********************************************************************************/
+#include <deque>
+
+#include <EspMQTTClient.h>
+#include "host.h"
+
+namespace host {
+
+static MqttBroker broker;
+
+MqttBroker &mqtt() {
+  return broker;
+}
+
+static bool wifiUp = false;
+static bool mqttUp = false;
+static uint64_t wifiAttempt_us = 0;
+static bool wifiConnecting = false;
+static uint64_t mqttRetry_us = 0;
+static std::deque<std::pair<std::string, std::string>> inbox;
+static std::vector<std::pair<std::string, MessageReceivedCallbackWithTopic>> callbacks;
+static const uint32_t MQTT_RETRY_MS = 5000;
+
+bool wifiConnected() {
+  return wifiUp && broker.wifiAvailable;
+}
+
+void MqttBroker::deliver(const std::string &topic, const std::string &payload) {
+  HeapAccountingOff internal;
+  inbox.emplace_back(topic, payload);
+}
+
+std::vector<MqttMessage> MqttBroker::on(const std::string &topic) const {
+  std::vector<MqttMessage> messages;
+  for (const MqttMessage &message : published) {
+    if (message.topic == topic) {
+      messages.push_back(message);
+    }
+  }
+  return messages;
+}
+
+}
+
+using host::broker;
+
+EspMQTTClient::EspMQTTClient(const char *, const char *, const char *, const char *, const char *, const char *, const short) {
+}
+
+bool EspMQTTClient::isWifiConnected() {
+  return host::wifiConnected();
+}
+
+bool EspMQTTClient::isMqttConnected() {
+  return host::mqttUp && host::wifiConnected() && broker.brokerAvailable;
+}
+
+void EspMQTTClient::loop() {
+  uint64_t t = host::now();
+  if (!broker.wifiAvailable) {
+    host::wifiUp = false;
+    host::wifiConnecting = false;
+  }
+  if (!host::wifiConnected()) {
+    host::mqttUp = false;
+    if (broker.wifiAvailable && !host::wifiConnecting) {
+      host::wifiConnecting = true;
+      host::wifiAttempt_us = t;
+    }
+    if (host::wifiConnecting && (t - host::wifiAttempt_us >= (uint64_t) broker.wifiConnect_ms * 1000)) {
+      host::wifiUp = true;
+      host::wifiConnecting = false;
+      Serial.println("WiFi: Connected");
+    }
+    return;
+  }
+  if (!broker.brokerAvailable) {
+    host::mqttUp = false;
+  }
+  if (!host::mqttUp && (t >= host::mqttRetry_us)) {
+    host::sleep((uint64_t) broker.mqttConnect_ms * 1000);   //PubSubClient connect() blocks
+    if (!broker.brokerAvailable) {
+      host::mqttRetry_us = host::now() + (uint64_t) host::MQTT_RETRY_MS * 1000;
+      return;
+    }
+    host::mqttUp = true;
+    {
+      host::HeapAccountingOff internal;
+      host::callbacks.clear();
+      broker.subscriptions.clear();
+      broker.connects++;
+    }
+    Serial.println("MQTT: Connected");
+    onConnectionEstablished();
+  }
+  while (host::mqttUp && !host::inbox.empty()) {
+    std::pair<std::string, std::string> message;
+    {
+      host::HeapAccountingOff internal;
+      message = host::inbox.front();
+      host::inbox.pop_front();
+    }
+    for (size_t i = 0; i < host::callbacks.size(); i++) {
+      if (host::callbacks[i].first == message.first) {
+        host::callbacks[i].second(String(message.first), String(message.second));
+      }
+    }
+  }
+}
+
+bool EspMQTTClient::publish(const String &topic, const String &payload, bool) {
+  size_t maxPacketSize = broker.maxPacketSize ? broker.maxPacketSize : MQTT_MAX_PACKET_SIZE;
+  if (!isMqttConnected() || (maxPacketSize < MQTT_MAX_HEADER_SIZE + 2 + topic.length() + payload.length())) {
+    broker.rejected++;
+    return false;
+  }
+  host::charge(host::MQTT_PUBLISH_US + (topic.length() + payload.length()) * host::MQTT_BYTE_US);
+  host::HeapAccountingOff internal;
+  broker.published.push_back({host::now(), topic.str(), payload.str()});
+  return true;
+}
+
+bool EspMQTTClient::subscribe(const String &topic, MessageReceivedCallback messageReceivedCallback) {
+  return subscribe(topic, [messageReceivedCallback](const String &, const String &message) {
+    messageReceivedCallback(message);
+  });
+}
+
+bool EspMQTTClient::subscribe(const String &topic, MessageReceivedCallbackWithTopic messageReceivedCallback) {
+  if (!isMqttConnected()) {
+    return false;
+  }
+  host::HeapAccountingOff internal;
+  host::callbacks.emplace_back(topic.str(), messageReceivedCallback);
+  broker.subscriptions.push_back(topic.str());
+  return true;
+}
+
+bool EspMQTTClient::unsubscribe(const String &topic) {
+  host::HeapAccountingOff internal;
+  for (size_t i = 0; i < host::callbacks.size(); i++) {
+    if (host::callbacks[i].first == topic.str()) {
+      host::callbacks.erase(host::callbacks.begin() + i);
+      return true;
+    }
+  }
+  return false;
+}
+
+WiFiClass WiFi;
+
+wl_status_t WiFiClass::status() {
+  return host::wifiConnected() ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+int8_t WiFiClass::RSSI() {
+  return host::wifiConnected() ? -61 : 0;
+}
+
+IPAddress WiFiClass::localIP() {
+  return host::wifiConnected() ? IPAddress(192, 168, 1, 42) : IPAddress();
+}
@@ -0,0 +1,180 @@
+/********************************************************************************
+  TCP connections between WiFiClient and the servers of the harness (fake Ark relays)
+  A connection carries the bytes of the server as timed segments: the client can read a byte once its clock has
+  reached the time of the segment. connect() waits for the handshake, or for the timeout when the server is down.
+********************************************************************************/
+#include <map>
+
+#include <WiFiClient.h>
+#include "host.h"
+
+namespace host {
+
+bool wifiConnected();
+
+static std::map<std::string, Server *> &servers() {
+  static std::map<std::string, Server *> registry;
+  return registry;
+}
+
+static std::string endpoint(const std::string &host, int port) {
+  return host + ":" + std::to_string(port);
+}
+
+void listen(const std::string &host, int port, Server *server) {
+  HeapAccountingOff internal;
+  servers()[endpoint(host, port)] = server;
+}
+
+void unlisten(const std::string &host, int port) {
+  HeapAccountingOff internal;
+  servers().erase(endpoint(host, port));
+}
+
+void Connection::send(const std::string &data, uint64_t at_us, double bytesPerUs) {
+  HeapAccountingOff internal;
+  const size_t SEGMENT_SIZE = 1460;
+  if (!segments.empty()) {
+    at_us = std::max(at_us, segments.back().at_us);
+  }
+  for (size_t offset = 0; offset < data.size(); offset += SEGMENT_SIZE) {
+    size_t n = std::min(SEGMENT_SIZE, data.size() - offset);
+    at_us += (uint64_t) (n / bytesPerUs);
+    segments.push_back({at_us, data.substr(offset, n)});
+  }
+  lastActivity_us = at_us;
+}
+
+void Connection::close(uint64_t at_us) {
+  closeAt_us = std::min(closeAt_us, at_us);
+}
+
+}
+
+using host::Connection;
+
+static const double CLIENT_WRITE_BYTE_US = 0.1;     // lwIP copy and WiFi transmit
+
+
+size_t IPAddress::printTo(Print &p) const {
+  return p.print(toString());
+}
+
+String IPAddress::toString() const {
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u", _bytes[0], _bytes[1], _bytes[2], _bytes[3]);
+  return String(text);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+  return connect(host, port, 3000);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port, int32_t timeout_ms) {
+  stop();
+  if (!host::wifiConnected()) {
+    return 0;
+  }
+  host::Server *server = nullptr;
+  {
+    host::HeapAccountingOff internal;
+    auto found = host::servers().find(host::endpoint(host, port));
+    if (found != host::servers().end()) {
+      server = found->second;
+    }
+  }
+  if (!server || !server->up) {
+    host::sleep((uint64_t) timeout_ms * 1000);        // no SYN-ACK
+    return 0;
+  }
+  host::sleep((uint64_t) server->connect_ms * 1000);
+  host::HeapAccountingOff internal;
+  _connection = std::make_shared<Connection>();
+  _connection->server = server;
+  _connection->lastActivity_us = host::now();
+  return 1;
+}
+
+size_t WiFiClient::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size) {
+  if (!connected() || _connection->closeAt_us <= host::now()) {
+    return 0;
+  }
+  host::charge(size * CLIENT_WRITE_BYTE_US);
+  {
+    host::HeapAccountingOff internal;
+    _connection->request.append((const char *) buffer, size);
+  }
+  std::shared_ptr<Connection> connection = _connection;     // the server may close it
+  connection->server->received(connection);
+  return size;
+}
+
+int WiFiClient::available() {
+  if (!_connection) {
+    return 0;
+  }
+  uint64_t t = host::now();
+  size_t n = 0;
+  for (size_t i = _connection->readSegment; i < _connection->segments.size(); i++) {
+    const Connection::Segment &segment = _connection->segments[i];
+    if (segment.at_us > t) {
+      break;
+    }
+    n += segment.data.size() - ((i == _connection->readSegment) ? _connection->readOffset : 0);
+  }
+  return (int) n;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while ((n < size) && available()) {
+    Connection::Segment &segment = _connection->segments[_connection->readSegment];
+    size_t chunk = std::min(size - n, segment.data.size() - _connection->readOffset);
+    memcpy(buffer + n, segment.data.data() + _connection->readOffset, chunk);
+    n += chunk;
+    _connection->readOffset += chunk;
+    if (_connection->readOffset == segment.data.size()) {
+      _connection->readSegment++;
+      _connection->readOffset = 0;
+    }
+  }
+  return (int) n;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return (read(&c, 1) == 1) ? c : -1;
+}
+
+int WiFiClient::peek() {
+  if (!available()) {
+    return -1;
+  }
+  return (uint8_t) _connection->segments[_connection->readSegment].data[_connection->readOffset];
+}
+
+void WiFiClient::stop() {
+  if (_connection) {
+    _connection->clientClosed = true;
+    _connection.reset();
+  }
+}
+
+uint8_t WiFiClient::connected() {
+  if (!_connection) {
+    return 0;
+  }
+  if (available()) {
+    return 1;
+  }
+  return ((_connection->closeAt_us > host::now()) && host::wifiConnected()) ? 1 : 0;
+}
+
+int WiFiClient::setTimeout(uint32_t seconds) {
+  Stream::setTimeout(seconds * 1000);
+  return 0;
+}
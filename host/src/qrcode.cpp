@@ -0,0 +1,94 @@
+/********************************************************************************
+  QRCode stand-in (see host/mocks/qrcode.h)
+********************************************************************************/
+#include <string.h>
+#include <openssl/sha.h>
+
+#include "qrcode.h"
+#include "host.h"
+
+//Byte mode capacity of versions 1 to 10 (ECC_LOW, ECC_MEDIUM, ECC_QUARTILE, ECC_HIGH)
+static const uint16_t BYTE_CAPACITY[10][4] = {
+  {17, 14, 11, 7}, {32, 26, 20, 14}, {53, 42, 32, 24}, {78, 62, 46, 34}, {106, 84, 60, 44},
+  {134, 106, 74, 58}, {154, 122, 86, 64}, {192, 152, 108, 84}, {230, 180, 130, 98}, {271, 213, 151, 119},
+};
+
+uint16_t qrcode_getBufferSize(uint8_t version) {
+  uint16_t size = 4 * version + 17;
+  return ((uint32_t) size * size + 7) / 8;
+}
+
+static void setModule(QRCode *qrcode, int x, int y, bool on) {
+  uint32_t offset = (uint32_t) y * qrcode->size + x;
+  if (on) {
+    qrcode->modules[offset >> 3] |= 0x80 >> (offset & 7);
+  }
+  else {
+    qrcode->modules[offset >> 3] &= ~(0x80 >> (offset & 7));
+  }
+}
+
+static bool inFinder(int x, int y, int size) {
+  return ((x < 8) && (y < 8)) || ((x >= size - 8) && (y < 8)) || ((x < 8) && (y >= size - 8));
+}
+
+int8_t qrcode_initBytes(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length) {
+  host::charge(host::QRCODE_ENCODE_US);
+  if ((version < 1) || (version > 40) || (ecc > 3)) {
+    return -1;
+  }
+  uint16_t capacity = (version <= 10) ? BYTE_CAPACITY[version - 1][ecc] : 2953;
+  if (length > capacity) {
+    return -1;
+  }
+  qrcode->version = version;
+  qrcode->size = 4 * version + 17;
+  qrcode->ecc = ecc;
+  qrcode->mode = MODE_BYTE;
+  qrcode->mask = 0;
+  qrcode->modules = modules;
+  memset(modules, 0, qrcode_getBufferSize(version));
+
+  //data area: SHA256 chain of the text
+  uint8_t block[SHA256_DIGEST_LENGTH];
+  SHA256(data, length, block);
+  int bit = 0;
+  for (int y = 0; y < qrcode->size; y++) {
+    for (int x = 0; x < qrcode->size; x++) {
+      if (bit == 8 * SHA256_DIGEST_LENGTH) {
+        SHA256(block, sizeof(block), block);
+        bit = 0;
+      }
+      setModule(qrcode, x, y, block[bit / 8] & (0x80 >> (bit & 7)));
+      bit++;
+    }
+  }
+
+  //finder patterns with their separators, and the timing patterns
+  for (int y = 0; y < qrcode->size; y++) {
+    for (int x = 0; x < qrcode->size; x++) {
+      if (inFinder(x, y, qrcode->size)) {
+        int fx = (x < 8) ? x : qrcode->size - 1 - x;
+        int fy = (y < 8) ? y : qrcode->size - 1 - y;
+        int ring = std::max(abs(fx - 3), abs(fy - 3));
+        setModule(qrcode, x, y, (ring != 2) && (ring != 4));
+      }
+      else if ((x == 6) || (y == 6)) {
+        setModule(qrcode, x, y, ((x + y) & 1) == 0);
+      }
+    }
+  }
+  return 0;
+}
+
+int8_t qrcode_initText(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, const char *data) {
+  return qrcode_initBytes(qrcode, modules, version, ecc, (uint8_t *) data, strlen(data));
+}
+
+bool qrcode_getModule(QRCode *qrcode, uint8_t x, uint8_t y) {
+  if ((x >= qrcode->size) || (y >= qrcode->size)) {
+    return false;
+  }
+  uint32_t offset = (uint32_t) y * qrcode->size + x;
+  return (qrcode->modules[offset >> 3] & (0x80 >> (offset & 7))) != 0;
+}
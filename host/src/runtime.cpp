@@ -0,0 +1,1256 @@
+/********************************************************************************
+  Simulated clock, FreeRTOS tasks, queues and mutexes, serial ports, heap counters and the Arduino core functions
+********************************************************************************/
+#include <sys/wait.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <chrono>
+#include <deque>
+#include <new>
+
+#include <Arduino.h>
+#include "host.h"
+
+void setup();
+void loop();
+
+namespace host {
+
+struct Task {
+  std::string name;
+  TaskFunction_t function;
+  void *parameter;
+  int priority;
+  int core;
+  int id;
+  ucontext_t context;
+  char *stack;
+  uint64_t time_us = 0;         // clock of the task while it runs
+  uint64_t ready_us = 0;        // time at which the task can run again. UINT64_MAX = waiting without timeout
+  double pendingCost = 0;       // fraction of a microsecond charged but not yet added to the clock
+  const void *waitingFor = nullptr;
+  bool done = false;
+};
+
+static std::vector<Task *> tasks;
+static Task *current = nullptr;
+static ucontext_t schedulerContext;
+static uint64_t globalNow = 0;          // latest time reached by any task. The clock of a task that resumes starts here
+static double harnessPendingCost = 0;
+static int criticalDepth = 0;
+static const size_t TASK_STACK_SIZE = 1024 * 1024;
+
+uint64_t now() {
+  return current ? current->time_us : globalNow;
+}
+
+bool inTask() {
+  return current != nullptr;
+}
+
+static void switchToScheduler() {
+  Task *task = current;
+  swapcontext(&task->context, &schedulerContext);
+}
+
+//= true when another task is waiting for the CPU while the running task is ahead of it
+static bool othersBehind() {
+  for (Task *task : tasks) {
+    if ((task != current) && !task->done && (task->ready_us != UINT64_MAX) && (task->ready_us + HOST_SLICE_US < current->time_us)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void charge(double us) {
+  if (us <= 0) {
+    return;
+  }
+  if (!current) {
+    harnessPendingCost += us;
+    uint64_t whole = (uint64_t) harnessPendingCost;
+    harnessPendingCost -= whole;
+    globalNow += whole;
+    return;
+  }
+  current->pendingCost += us;
+  while (current->pendingCost >= 1) {
+    uint64_t step = std::min<uint64_t>((uint64_t) current->pendingCost, HOST_SLICE_US);
+    current->pendingCost -= step;
+    current->time_us += step;
+    globalNow = std::max(globalNow, current->time_us);
+    if ((criticalDepth == 0) && othersBehind()) {
+      current->ready_us = current->time_us;      //still busy, the other cores catch up first
+      switchToScheduler();
+    }
+  }
+}
+
+void sleep(uint64_t us) {
+  if (!current) {
+    globalNow += us;
+    return;
+  }
+  current->ready_us = current->time_us + us;
+  switchToScheduler();
+}
+
+//Waits until wake(object) or the timeout. = false on timeout
+static bool waitFor(const void *object, uint64_t timeout_us) {
+  if (!current) {
+    fprintf(stderr, "host: the harness cannot wait for a task\n");
+    abort();
+  }
+  uint64_t deadline = (timeout_us == UINT64_MAX) ? UINT64_MAX : current->time_us + timeout_us;
+  current->waitingFor = object;
+  current->ready_us = deadline;
+  switchToScheduler();
+  bool woken = current->waitingFor == nullptr;
+  current->waitingFor = nullptr;
+  return woken;
+}
+
+static void wake(const void *object) {
+  for (Task *task : tasks) {
+    if (task->waitingFor == object) {
+      task->waitingFor = nullptr;
+      task->ready_us = now();
+    }
+  }
+}
+
+static void taskEntry() {
+  Task *task = current;
+  task->function(task->parameter);
+  task->done = true;
+  switchToScheduler();
+}
+
+static Task *createTask(TaskFunction_t function, const char *name, void *parameter, int priority, int core) {
+  HeapAccountingOff internal;
+  Task *task = new Task();
+  task->name = name;
+  task->function = function;
+  task->parameter = parameter;
+  task->priority = priority;
+  task->core = core;
+  task->id = tasks.size();
+  task->stack = (char *) malloc(TASK_STACK_SIZE);
+  task->time_us = now();
+  task->ready_us = now();
+  getcontext(&task->context);
+  task->context.uc_stack.ss_sp = task->stack;
+  task->context.uc_stack.ss_size = TASK_STACK_SIZE;
+  task->context.uc_link = nullptr;
+  makecontext(&task->context, taskEntry, 0);
+  tasks.push_back(task);
+  return task;
+}
+
+//Runs the task that is the furthest behind until it gives up the CPU. = false when no task can run before limit_us
+static bool step(uint64_t limit_us) {
+  Task *next = nullptr;
+  for (Task *task : tasks) {
+    if (task->done || (task->ready_us == UINT64_MAX)) {
+      continue;
+    }
+    if (!next || (task->ready_us < next->ready_us)
+        || ((task->ready_us == next->ready_us) && (task->priority > next->priority))) {
+      next = task;
+    }
+  }
+  if (!next || (next->ready_us > limit_us)) {
+    return false;
+  }
+  next->time_us = std::max(next->ready_us, globalNow);
+  globalNow = next->time_us;
+  current = next;
+  swapcontext(&schedulerContext, &next->context);
+  current = nullptr;
+  return true;
+}
+
+void runFor(uint32_t ms) {
+  uint64_t limit = globalNow + (uint64_t) ms * 1000;
+  while (step(limit)) {
+  }
+  globalNow = std::max(globalNow, limit);
+}
+
+bool runUntil(const std::function<bool()> &done, uint32_t timeout_ms) {
+  uint64_t limit = globalNow + (uint64_t) timeout_ms * 1000;
+  while (!done()) {
+    if (!step(limit)) {
+      globalNow = std::max(globalNow, limit);
+      return done();
+    }
+  }
+  return true;
+}
+
+static LoopStats loopStatistics;
+
+LoopStats &loopStats() {
+  return loopStatistics;
+}
+
+//Arduino loopTask: setup() then loop() forever (core 1, priority 1)
+static void arduinoLoopTask(void *) {
+  setup();
+  for (;;) {
+    auto start = std::chrono::steady_clock::now();
+    loop();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    HeapAccountingOff internal;
+    loopStatistics.iterations++;
+    loopStatistics.hostCpu_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+}
+
+void boot() {
+  createTask(arduinoLoopTask, "loopTask", nullptr, 1, 1);
+}
+
+
+/********************************************************************************
+  Serial output
+********************************************************************************/
+static std::string serialText;
+static bool serialEcho = getenv("HOST_SERIAL") != nullptr;
+
+const std::string &serialLog() {
+  return serialText;
+}
+
+void clearSerialLog() {
+  serialText.clear();
+}
+
+void setSerialEcho(bool echo) {
+  serialEcho = echo;
+}
+
+std::vector<std::string> serialLines(const char *prefix) {
+  std::vector<std::string> lines;
+  size_t start = 0;
+  while (start < serialText.size()) {
+    size_t end = serialText.find('\n', start);
+    if (end == std::string::npos) {
+      end = serialText.size();
+    }
+    std::string line = serialText.substr(start, end - start);
+    if (!line.empty() && (line.back() == '\r')) {
+      line.pop_back();
+    }
+    if (line.compare(0, strlen(prefix), prefix) == 0) {
+      lines.push_back(line);
+    }
+    start = end + 1;
+  }
+  return lines;
+}
+
+static void serialWrite(const uint8_t *data, size_t size) {
+  HeapAccountingOff internal;
+  serialText.append((const char *) data, size);
+  if (serialEcho) {
+    fwrite(data, 1, size, stdout);
+  }
+}
+
+
+/********************************************************************************
+  GPS UART (Serial1)
+********************************************************************************/
+static std::shared_ptr<GpsReplay> gpsReplay;
+static uint32_t gpsBaud = 9600;
+static std::deque<uint8_t> gpsRx;
+static size_t gpsRxSize = 256;          // default UART receive buffer of the ESP32 core
+static std::string gpsBurst;
+static size_t gpsBurstPosition = 0;
+static uint64_t gpsBurstStart_us = 0;
+static GpsUartStats gpsStatistics;
+static std::string gpsCommandText;
+
+void setGpsReplay(std::shared_ptr<GpsReplay> replay, uint32_t baud) {
+  gpsReplay = replay;
+  gpsBaud = baud;
+  gpsBurst.clear();
+  gpsBurstPosition = 0;
+}
+
+GpsUartStats &gpsUart() {
+  return gpsStatistics;
+}
+
+const std::string &gpsCommands() {
+  return gpsCommandText;
+}
+
+//Moves the bytes that have arrived by now into the receive buffer
+static void gpsPump() {
+  if (!gpsReplay) {
+    return;
+  }
+  HeapAccountingOff internal;
+  uint64_t t = now();
+  double byte_us = 10.0 * 1000000.0 / gpsBaud;
+  for (;;) {
+    if (gpsBurstPosition == gpsBurst.size()) {
+      uint64_t at = 0;
+      uint64_t previousEnd = gpsBurstStart_us + (uint64_t) (gpsBurst.size() * byte_us);
+      if (!gpsReplay->next(t, at, gpsBurst)) {
+        gpsBurst.clear();
+        gpsBurstPosition = 0;
+        return;
+      }
+      gpsBurstPosition = 0;
+      gpsBurstStart_us = std::max(at, previousEnd);
+    }
+    uint64_t arrival = gpsBurstStart_us + (uint64_t) ((gpsBurstPosition + 1) * byte_us);
+    if (arrival > t) {
+      return;
+    }
+    uint8_t c = gpsBurst[gpsBurstPosition++];
+    if (gpsRx.size() < gpsRxSize) {
+      gpsRx.push_back(c);
+      gpsStatistics.delivered++;
+      gpsStatistics.maxBuffered = std::max<uint64_t>(gpsStatistics.maxBuffered, gpsRx.size());
+    }
+    else {
+      gpsStatistics.lost++;
+    }
+  }
+}
+
+
+/********************************************************************************
+  Heap counters
+********************************************************************************/
+static bool heapAccounting = false;     // the static objects of the harness are constructed before main() turns it on
+static HeapStats heapStatistics;
+static size_t heapPeakSinceBoot = 0;
+
+void beginHeapAccounting() {
+  heapAccounting = true;
+}
+
+HeapStats heap() {
+  return heapStatistics;
+}
+
+void resetHeapPeak() {
+  heapStatistics.peak = heapStatistics.current;
+}
+
+HeapAccountingOff::HeapAccountingOff() : _previous(heapAccounting) {
+  heapAccounting = false;
+}
+
+HeapAccountingOff::~HeapAccountingOff() {
+  heapAccounting = _previous;
+}
+
+struct AllocationHeader {
+  size_t size;
+  size_t counted;
+};
+
+static void *allocate(size_t size) {
+  AllocationHeader *header = (AllocationHeader *) malloc(sizeof(AllocationHeader) + size);
+  if (!header) {
+    throw std::bad_alloc();
+  }
+  header->size = size;
+  header->counted = heapAccounting;
+  if (heapAccounting) {
+    heapStatistics.current += size;
+    heapStatistics.allocations++;
+    heapStatistics.peak = std::max(heapStatistics.peak, heapStatistics.current);
+    heapPeakSinceBoot = std::max(heapPeakSinceBoot, heapStatistics.current);
+  }
+  return header + 1;
+}
+
+static void release(void *p) {
+  if (!p) {
+    return;
+  }
+  AllocationHeader *header = (AllocationHeader *) p - 1;
+  if (header->counted) {
+    heapStatistics.current -= header->size;
+  }
+  free(header);
+}
+
+static size_t freeHeap() {
+  return (heapStatistics.current < HEAP_SIZE) ? HEAP_SIZE - heapStatistics.current : 0;
+}
+
+
+/********************************************************************************
+  Reboot: the first boot runs in a child process with its own copy of the globals
+********************************************************************************/
+bool rebootAfter(const std::function<void()> &firstBoot) {
+  char flashPath[] = "/tmp/host_flash_XXXXXX";
+  int fd = mkstemp(flashPath);
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+  std::string logPath = std::string(flashPath) + ".log";
+  std::string chainPath = std::string(flashPath) + ".chain";
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    firstBoot();
+    saveFlash(flashPath);
+    saveArkChain(chainPath);
+    FILE *log = fopen(logPath.c_str(), "wb");
+    if (log) {
+      fwrite(serialText.data(), 1, serialText.size(), log);
+      fclose(log);
+    }
+    fflush(stdout);
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(child, &status, 0);
+  bool ok = WIFEXITED(status) && (WEXITSTATUS(status) == 0) && loadFlash(flashPath) && loadArkChain(chainPath);
+  FILE *log = fopen(logPath.c_str(), "rb");
+  if (log) {
+    HeapAccountingOff internal;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), log)) > 0) {
+      serialText.append(buffer, n);
+    }
+    fclose(log);
+  }
+  unlink(flashPath);
+  unlink(logPath.c_str());
+  unlink(chainPath.c_str());
+  return ok;
+}
+
+}
+
+
+/********************************************************************************
+  Global allocation functions (counted while heap accounting is on)
+********************************************************************************/
+void *operator new(size_t size) {
+  return host::allocate(size);
+}
+void *operator new[](size_t size) {
+  return host::allocate(size);
+}
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  try {
+    return host::allocate(size);
+  }
+  catch (...) {
+    return nullptr;
+  }
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  try {
+    return host::allocate(size);
+  }
+  catch (...) {
+    return nullptr;
+  }
+}
+void operator delete(void *p) noexcept {
+  host::release(p);
+}
+void operator delete[](void *p) noexcept {
+  host::release(p);
+}
+void operator delete(void *p, size_t) noexcept {
+  host::release(p);
+}
+void operator delete[](void *p, size_t) noexcept {
+  host::release(p);
+}
+
+
+/********************************************************************************
+  FreeRTOS
+********************************************************************************/
+struct HostTask : public host::Task {
+};
+
+struct HostQueue {
+  bool mutex = false;
+  bool recursive = false;
+  const void *owner = nullptr;
+  int depth = 0;
+  size_t length = 0;
+  size_t itemSize = 0;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+static const int HARNESS_OWNER = 0;
+
+static const void *currentOwner() {
+  return host::current ? (const void *) host::current : (const void *) &HARNESS_OWNER;
+}
+
+static uint64_t ticksToMicroseconds(TickType_t ticks) {
+  return (ticks == portMAX_DELAY) ? UINT64_MAX : (uint64_t) ticks * 1000;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *const name, const uint32_t, void *const parameter,
+                                   UBaseType_t priority, TaskHandle_t *const handle, const BaseType_t core) {
+  host::Task *task = host::createTask(function, name, parameter, priority, core);
+  if (handle) {
+    *handle = (TaskHandle_t) task;
+  }
+  return pdPASS;
+}
+
+void vTaskDelay(const TickType_t ticks) {
+  host::sleep(ticksToMicroseconds(ticks));
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  host::Task *t = task ? (host::Task *) task : host::current;
+  if (!t) {
+    return;
+  }
+  t->done = true;
+  if (t == host::current) {
+    host::switchToScheduler();
+  }
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t) (host::now() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return (TaskHandle_t) host::current;
+}
+
+BaseType_t xPortGetCoreID() {
+  return host::current ? host::current->core : 1;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  HostQueue *queue = new HostQueue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+static BaseType_t queueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait, bool overwrite) {
+  for (;;) {
+    if (overwrite && (queue->items.size() == queue->length)) {
+      queue->items.pop_back();
+    }
+    if (queue->items.size() < queue->length) {
+      queue->items.emplace_back((const uint8_t *) item, (const uint8_t *) item + queue->itemSize);
+      host::wake(queue);
+      return pdPASS;
+    }
+    if ((ticksToWait == 0) || !host::current || !host::waitFor(queue, ticksToMicroseconds(ticksToWait))) {
+      return errQUEUE_FULL;
+    }
+  }
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait) {
+  return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticksToWait) {
+  return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+  return queueSend(queue, item, 0, true);
+}
+
+static BaseType_t queueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait, bool remove) {
+  for (;;) {
+    if (!queue->items.empty()) {
+      memcpy(item, queue->items.front().data(), queue->itemSize);
+      if (remove) {
+        queue->items.pop_front();
+        host::wake(queue);
+      }
+      return pdPASS;
+    }
+    if ((ticksToWait == 0) || !host::current || !host::waitFor(queue, ticksToMicroseconds(ticksToWait))) {
+      return pdFAIL;
+    }
+  }
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait) {
+  return queueReceive(queue, item, ticksToWait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticksToWait) {
+  return queueReceive(queue, item, ticksToWait, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  return queue->items.size();
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+  delete queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  HostQueue *mutex = new HostQueue();
+  mutex->mutex = true;
+  return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+  HostQueue *mutex = xSemaphoreCreateMutex();
+  mutex->recursive = true;
+  return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticksToWait) {
+  const void *owner = currentOwner();
+  for (;;) {
+    if (!mutex->owner || (mutex->recursive && (mutex->owner == owner))) {
+      mutex->owner = owner;
+      mutex->depth++;
+      return pdTRUE;
+    }
+    if (!host::current) {
+      fprintf(stderr, "host: the harness cannot take a mutex held by a task\n");
+      abort();
+    }
+    if ((ticksToWait == 0) || !host::waitFor(mutex, ticksToMicroseconds(ticksToWait))) {
+      return pdFALSE;
+    }
+  }
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+  if (mutex->owner != currentOwner()) {
+    return pdFALSE;
+  }
+  if (--mutex->depth == 0) {
+    mutex->owner = nullptr;
+    host::wake(mutex);
+  }
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex, TickType_t ticksToWait) {
+  return xSemaphoreTake(mutex, ticksToWait);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex) {
+  return xSemaphoreGive(mutex);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t mutex) {
+  delete mutex;
+}
+
+void vPortCPUInitializeMutex(portMUX_TYPE *mux) {
+  mux->owner = 0;
+  mux->count = 0;
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux) {
+  mux->count++;
+  host::criticalDepth++;
+}
+
+void vPortExitCritical(portMUX_TYPE *mux) {
+  mux->count--;
+  host::criticalDepth--;
+}
+
+
+/********************************************************************************
+  Arduino core
+********************************************************************************/
+static bool ntpRequested = false;
+static uint64_t ntpSync_us = 0;
+static const time_t HOST_EPOCH = 1792224000;   // 2026-10-17 08:00 UTC, the time the NTP server answers at boot
+
+time_t hostTime(time_t *t) {
+  uint64_t us = host::now();
+  time_t seconds = (ntpRequested && (us >= ntpSync_us)) ? HOST_EPOCH + (time_t) (us / 1000000) : (time_t) (us / 1000000);
+  if (t) {
+    *t = seconds;
+  }
+  return seconds;
+}
+
+void configTime(long, int, const char *, const char *, const char *) {
+  setenv("TZ", "UTC", 1);
+  tzset();
+  if (!ntpRequested) {
+    ntpRequested = true;
+    ntpSync_us = host::now() + 250000;          // SNTP answer
+  }
+}
+
+int hostPrintf(const char *format, ...) {
+  char buffer[1024];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (n > 0) {
+    host::serialWrite((const uint8_t *) buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+  }
+  return n;
+}
+
+uint32_t millis() {
+  return (uint32_t) (host::now() / 1000);
+}
+
+uint32_t micros() {
+  return (uint32_t) host::now();
+}
+
+void delay(uint32_t ms) {
+  host::sleep((uint64_t) ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  host::charge(us);
+}
+
+void yield() {
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+long random(long howbig) {
+  return howbig ? (long) (esp_random() % (uint32_t) howbig) : 0;
+}
+
+long random(long howsmall, long howbig) {
+  return (howsmall >= howbig) ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+static uint8_t pinLevels[64];
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  pinLevels[pin & 63] = value;
+}
+
+int digitalRead(uint8_t pin) {
+  return pinLevels[pin & 63];
+}
+
+uint16_t analogRead(uint8_t) {
+  return 2350;      // ~3.8 V on the battery divider
+}
+
+static char *unsignedToText(unsigned long value, char *str, int base) {
+  char digits[66];
+  int n = 0;
+  do {
+    int d = value % base;
+    digits[n++] = d < 10 ? '0' + d : 'a' + d - 10;
+    value /= base;
+  } while (value);
+  for (int i = 0; i < n; i++) {
+    str[i] = digits[n - 1 - i];
+  }
+  str[n] = '\0';
+  return str;
+}
+
+char *utoa(unsigned int value, char *str, int base) {
+  return unsignedToText(value, str, base);
+}
+
+char *ultoa(unsigned long value, char *str, int base) {
+  return unsignedToText(value, str, base);
+}
+
+char *ltoa(long value, char *str, int base) {
+  if ((value < 0) && (base == 10)) {
+    str[0] = '-';
+    unsignedToText(-(unsigned long) value, str + 1, base);
+    return str;
+  }
+  return unsignedToText((unsigned long) value, str, base);
+}
+
+char *itoa(int value, char *str, int base) {
+  return ltoa(value, str, base);
+}
+
+#if !defined(__GLIBC__) || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+size_t strlcpy(char *dst, const char *src, size_t size) {
+  size_t length = strlen(src);
+  if (size) {
+    size_t n = std::min(length, size - 1);
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return length;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size) {
+  size_t used = strnlen(dst, size);
+  return used + strlcpy(dst + used, src, size - used);
+}
+#endif
+
+EspClass ESP;
+
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t) (host::now() * 240);
+}
+
+uint32_t EspClass::getHeapSize() {
+  return host::HEAP_SIZE;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  return host::freeHeap();
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  return (host::heapPeakSinceBoot < host::HEAP_SIZE) ? host::HEAP_SIZE - host::heapPeakSinceBoot : 0;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+  return host::freeHeap();
+}
+
+void EspClass::restart() {
+  fprintf(stderr, "host: ESP.restart()\n");
+  exit(2);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t) {
+  return host::freeHeap();      // fragmentation is not modeled
+}
+
+size_t heap_caps_get_free_size(uint32_t) {
+  return host::freeHeap();
+}
+
+int esp_read_mac(uint8_t *mac, esp_mac_type_t) {
+  static const uint8_t address[6] = {0x24, 0x0A, 0xC4, 0x12, 0x34, 0x56};
+  memcpy(mac, address, 6);
+  return 0;
+}
+
+uint32_t esp_random() {
+  static uint32_t state = 0x2545F491;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+
+/********************************************************************************
+  String
+********************************************************************************/
+static std::string numberText(unsigned long value, int base, bool negative) {
+  char text[68];
+  unsignedToText(value, text, base);
+  return negative ? std::string("-") + text : std::string(text);
+}
+
+String::String(int value, unsigned char base) : _s(numberText(value < 0 && base == 10 ? -(long) value : (unsigned int) value, base, value < 0 && base == 10)) {}
+String::String(unsigned int value, unsigned char base) : _s(numberText(value, base, false)) {}
+String::String(long value, unsigned char base) : _s(numberText(value < 0 && base == 10 ? -(unsigned long) value : (unsigned long) value, base, value < 0 && base == 10)) {}
+String::String(unsigned long value, unsigned char base) : _s(numberText(value, base, false)) {}
+
+String::String(double value, unsigned char decimals) {
+  char text[64];
+  snprintf(text, sizeof(text), "%.*f", decimals, value);
+  _s = text;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t i = _s.find(c, from);
+  return i == std::string::npos ? -1 : (int) i;
+}
+
+int String::indexOf(const char *s, unsigned int from) const {
+  size_t i = _s.find(s, from);
+  return i == std::string::npos ? -1 : (int) i;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > _s.size()) {
+    return String();
+  }
+  to = std::min<unsigned int>(to, _s.size());
+  return String(_s.substr(from, to > from ? to - from : 0));
+}
+
+void String::trim() {
+  size_t start = _s.find_first_not_of(" \t\r\n");
+  size_t end = _s.find_last_not_of(" \t\r\n");
+  _s = (start == std::string::npos) ? std::string() : _s.substr(start, end - start + 1);
+}
+
+String operator+(const String &a, const String &b) {
+  return String(a.str() + b.str());
+}
+
+String operator+(const String &a, const char *b) {
+  return String(a.str() + (b ? b : ""));
+}
+
+String operator+(const char *a, const String &b) {
+  return String(std::string(a ? a : "") + b.str());
+}
+
+
+/********************************************************************************
+  Print
+********************************************************************************/
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::printf(const char *format, ...) {
+  char buffer[1024];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (n <= 0) {
+    return 0;
+  }
+  return write((const uint8_t *) buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+}
+
+size_t Print::print(const char *s) {
+  return write(s);
+}
+
+size_t Print::print(const String &s) {
+  return write(s.c_str(), s.length());
+}
+
+size_t Print::print(char c) {
+  return write((uint8_t) c);
+}
+
+size_t Print::printNumber(unsigned long value, int base) {
+  char text[68];
+  unsignedToText(value, text, base < 2 ? 10 : base);
+  return write(text);
+}
+
+size_t Print::print(unsigned char value, int base) {
+  return printNumber(value, base);
+}
+
+size_t Print::print(int value, int base) {
+  return print((long) value, base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+  return printNumber(value, base);
+}
+
+size_t Print::print(long value, int base) {
+  if ((value < 0) && (base == 10)) {
+    return print('-') + printNumber(-(unsigned long) value, 10);
+  }
+  return printNumber((unsigned long) value, base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  return printNumber(value, base);
+}
+
+//Same rounding as the Arduino core
+size_t Print::print(double number, int digits) {
+  if (isnan(number)) {
+    return print("nan");
+  }
+  if (isinf(number)) {
+    return print("inf");
+  }
+  if (number > 4294967040.0 || number < -4294967040.0) {
+    return print("ovf");
+  }
+  size_t n = 0;
+  if (number < 0.0) {
+    n += print('-');
+    number = -number;
+  }
+  double rounding = 0.5;
+  for (int i = 0; i < digits; i++) {
+    rounding /= 10.0;
+  }
+  number += rounding;
+  unsigned long whole = (unsigned long) number;
+  double remainder = number - (double) whole;
+  n += print(whole);
+  if (digits > 0) {
+    n += print('.');
+  }
+  while (digits-- > 0) {
+    remainder *= 10.0;
+    int digit = (int) remainder;
+    n += print(digit);
+    remainder -= digit;
+  }
+  return n;
+}
+
+size_t Print::print(const Printable &p) {
+  return p.printTo(*this);
+}
+
+size_t Print::println() {
+  return write("\r\n");
+}
+
+
+/********************************************************************************
+  Stream
+********************************************************************************/
+static const double STREAM_POLL_US = 20;    // a read that waits for data spins on the CPU like the Arduino core
+
+int Stream::timedRead() {
+  _startMillis = millis();
+  do {
+    int c = read();
+    if (c >= 0) {
+      return c;
+    }
+    host::charge(STREAM_POLL_US);
+  } while (millis() - _startMillis < _timeout);
+  return -1;
+}
+
+int Stream::timedPeek() {
+  _startMillis = millis();
+  do {
+    int c = peek();
+    if (c >= 0) {
+      return c;
+    }
+    host::charge(STREAM_POLL_US);
+  } while (millis() - _startMillis < _timeout);
+  return -1;
+}
+
+bool Stream::find(const char *target) {
+  return find(target, strlen(target));
+}
+
+//Knuth-Morris-Pratt over the stream
+bool Stream::find(const char *target, size_t length) {
+  if (length == 0) {
+    return true;
+  }
+  std::vector<size_t> fallback;
+  {
+    host::HeapAccountingOff internal;     // the Arduino core matches without allocating
+    fallback.assign(length, 0);
+  }
+  for (size_t i = 1, k = 0; i < length; i++) {
+    while (k && (target[i] != target[k])) {
+      k = fallback[k - 1];
+    }
+    if (target[i] == target[k]) {
+      k++;
+    }
+    fallback[i] = k;
+  }
+  size_t matched = 0;
+  for (;;) {
+    int c = timedRead();
+    if (c < 0) {
+      return false;
+    }
+    while (matched && ((char) c != target[matched])) {
+      matched = fallback[matched - 1];
+    }
+    if ((char) c == target[matched]) {
+      matched++;
+    }
+    if (matched == length) {
+      return true;
+    }
+  }
+}
+
+bool Stream::findUntil(const char *target, const char *terminator) {
+  size_t targetLength = strlen(target);
+  size_t terminatorLength = terminator ? strlen(terminator) : 0;
+  size_t matched = 0;
+  size_t terminatorMatched = 0;
+  for (;;) {
+    int c = timedRead();
+    if (c < 0) {
+      return false;
+    }
+    matched = ((char) c == target[matched]) ? matched + 1 : ((char) c == target[0] ? 1 : 0);
+    if (matched == targetLength) {
+      return true;
+    }
+    if (terminatorLength) {
+      terminatorMatched = ((char) c == terminator[terminatorMatched]) ? terminatorMatched + 1 : ((char) c == terminator[0] ? 1 : 0);
+      if (terminatorMatched == terminatorLength) {
+        return false;
+      }
+    }
+  }
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = timedRead();
+    if (c < 0) {
+      break;
+    }
+    buffer[count++] = (char) c;
+  }
+  return count;
+}
+
+size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = timedRead();
+    if ((c < 0) || ((char) c == terminator)) {
+      break;
+    }
+    buffer[count++] = (char) c;
+  }
+  return count;
+}
+
+long Stream::parseInt() {
+  int c;
+  do {
+    c = timedPeek();
+    if (c < 0) {
+      return 0;
+    }
+    if ((c == '-') || isdigit(c)) {
+      break;
+    }
+    read();
+  } while (true);
+  bool negative = false;
+  long value = 0;
+  while ((c = timedPeek()) >= 0) {
+    if (c == '-') {
+      negative = true;
+    }
+    else if (isdigit(c)) {
+      value = value * 10 + (c - '0');
+    }
+    else {
+      break;
+    }
+    read();
+  }
+  return negative ? -value : value;
+}
+
+String Stream::readString() {
+  std::string text;
+  int c;
+  while ((c = timedRead()) >= 0) {
+    text += (char) c;
+  }
+  return String(text);
+}
+
+String Stream::readStringUntil(char terminator) {
+  std::string text;
+  int c;
+  while (((c = timedRead()) >= 0) && ((char) c != terminator)) {
+    text += (char) c;
+  }
+  return String(text);
+}
+
+
+/********************************************************************************
+  HardwareSerial
+********************************************************************************/
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+
+void HardwareSerial::begin(unsigned long baud, uint32_t, int8_t, int8_t, bool, unsigned long) {
+  _baud = baud;
+}
+
+size_t HardwareSerial::setRxBufferSize(size_t size) {
+  if (_uart == 1) {
+    host::gpsRxSize = size;
+  }
+  return size;
+}
+
+int HardwareSerial::available() {
+  if (_uart != 1) {
+    return 0;
+  }
+  host::gpsPump();
+  return host::gpsRx.size();
+}
+
+int HardwareSerial::read() {
+  if (_uart != 1) {
+    return -1;
+  }
+  host::gpsPump();
+  if (host::gpsRx.empty()) {
+    return -1;
+  }
+  uint8_t c = host::gpsRx.front();
+  host::gpsRx.pop_front();
+  return c;
+}
+
+int HardwareSerial::peek() {
+  if (_uart != 1) {
+    return -1;
+  }
+  host::gpsPump();
+  return host::gpsRx.empty() ? -1 : host::gpsRx.front();
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  if (_uart == 0) {
+    host::serialWrite(buffer, size);
+  }
+  else if (_uart == 1) {
+    host::HeapAccountingOff internal;
+    host::gpsCommandText.append((const char *) buffer, size);
+  }
+  return size;
+}
@@ -0,0 +1,322 @@
+/********************************************************************************
+  Flash of the harness: the EEPROM sector and the SPIFFS files, the ROM CRC and the SHA engine
+********************************************************************************/
+#include <openssl/evp.h>
+
+#include <EEPROM.h>
+#include <SPIFFS.h>
+#include "hwcrypto/sha.h"
+#include "rom/crc.h"
+#include "host.h"
+
+namespace host {
+
+static Flash flashImage;
+static bool spiffsMounted = false;
+
+Flash &flash() {
+  return flashImage;
+}
+
+//Image format: "HFL1", eeprom size, eeprom, file count, then path length, path, data length, data for each file
+bool saveFlash(const std::string &path) {
+  HeapAccountingOff internal;
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+  auto put32 = [f](uint32_t v) {
+    fwrite(&v, sizeof(v), 1, f);
+  };
+  fwrite("HFL1", 1, 4, f);
+  put32(flashImage.eeprom.size());
+  fwrite(flashImage.eeprom.data(), 1, flashImage.eeprom.size(), f);
+  put32(flashImage.files.size());
+  for (const auto &file : flashImage.files) {
+    put32(file.first.size());
+    fwrite(file.first.data(), 1, file.first.size(), f);
+    put32(file.second.size());
+    fwrite(file.second.data(), 1, file.second.size(), f);
+  }
+  fclose(f);
+  return true;
+}
+
+bool loadFlash(const std::string &path) {
+  HeapAccountingOff internal;
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) {
+    return false;
+  }
+  bool ok = true;
+  auto get32 = [f, &ok]() {
+    uint32_t v = 0;
+    ok = ok && (fread(&v, sizeof(v), 1, f) == 1);
+    return v;
+  };
+  char magic[4];
+  ok = (fread(magic, 1, 4, f) == 4) && (memcmp(magic, "HFL1", 4) == 0);
+  Flash image;
+  image.eeprom.resize(get32());
+  ok = ok && (fread(image.eeprom.data(), 1, image.eeprom.size(), f) == image.eeprom.size());
+  uint32_t files = get32();
+  for (uint32_t i = 0; ok && (i < files); i++) {
+    std::string name(get32(), '\0');
+    ok = ok && (fread(&name[0], 1, name.size(), f) == name.size());
+    std::vector<uint8_t> data(get32());
+    ok = ok && (fread(data.data(), 1, data.size(), f) == data.size());
+    image.files[name] = data;
+  }
+  fclose(f);
+  if (ok) {
+    flashImage.eeprom = image.eeprom;
+    flashImage.files = image.files;
+  }
+  return ok;
+}
+
+}
+
+using host::flashImage;
+
+
+/********************************************************************************
+  EEPROM
+********************************************************************************/
+EEPROMClass EEPROM;
+
+bool EEPROMClass::begin(size_t size) {
+  if (size > flashImage.eeprom.size()) {
+    return false;
+  }
+  _data.assign(flashImage.eeprom.begin(), flashImage.eeprom.begin() + size);
+  _dirty = false;
+  return true;
+}
+
+uint8_t EEPROMClass::read(int address) {
+  return ((address >= 0) && ((size_t) address < _data.size())) ? _data[address] : 0;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  if ((address >= 0) && ((size_t) address < _data.size()) && (_data[address] != value)) {
+    _data[address] = value;
+    _dirty = true;
+  }
+}
+
+bool EEPROMClass::commit() {
+  if (!_dirty) {
+    return true;
+  }
+  host::charge(host::EEPROM_COMMIT_US);
+  std::copy(_data.begin(), _data.end(), flashImage.eeprom.begin());
+  flashImage.eepromCommits++;
+  flashImage.bytesWritten += 4096;
+  _dirty = false;
+  return true;
+}
+
+void EEPROMClass::end() {
+  commit();
+  _data.clear();
+}
+
+
+/********************************************************************************
+  SPIFFS
+********************************************************************************/
+fs::SPIFFSFS SPIFFS;
+
+namespace fs {
+
+static std::vector<uint8_t> *contents(const std::shared_ptr<FileHandle> &handle) {
+  auto found = flashImage.files.find(handle->path);
+  return (found == flashImage.files.end()) ? nullptr : &found->second;
+}
+
+size_t File::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+  if (!_handle || !_handle->writable) {
+    return 0;
+  }
+  std::vector<uint8_t> *data = contents(_handle);
+  if (!data) {
+    return 0;
+  }
+  host::charge(size * host::FLASH_WRITE_BYTE_US);
+  host::HeapAccountingOff internal;
+  if (_handle->position + size > data->size()) {
+    data->resize(_handle->position + size, 0xFF);
+  }
+  memcpy(data->data() + _handle->position, buffer, size);
+  _handle->position += size;
+  flashImage.bytesWritten += size;
+  return size;
+}
+
+int File::available() {
+  std::vector<uint8_t> *data = _handle ? contents(_handle) : nullptr;
+  return (data && (_handle->position < data->size())) ? (int) (data->size() - _handle->position) : 0;
+}
+
+size_t File::read(uint8_t *buffer, size_t size) {
+  if (!_handle || !_handle->readable) {
+    return 0;
+  }
+  std::vector<uint8_t> *data = contents(_handle);
+  if (!data || (_handle->position >= data->size())) {
+    return 0;
+  }
+  size_t n = std::min(size, data->size() - _handle->position);
+  host::charge(n * host::FLASH_READ_BYTE_US);
+  memcpy(buffer, data->data() + _handle->position, n);
+  _handle->position += n;
+  return n;
+}
+
+int File::read() {
+  uint8_t c;
+  return (read(&c, 1) == 1) ? c : -1;
+}
+
+int File::peek() {
+  std::vector<uint8_t> *data = _handle ? contents(_handle) : nullptr;
+  return (data && (_handle->position < data->size())) ? (*data)[_handle->position] : -1;
+}
+
+bool File::seek(uint32_t position, SeekMode mode) {
+  std::vector<uint8_t> *data = _handle ? contents(_handle) : nullptr;
+  if (!data) {
+    return false;
+  }
+  size_t base = (mode == SeekSet) ? 0 : (mode == SeekCur) ? _handle->position : data->size();
+  if (base + position > data->size()) {
+    return false;
+  }
+  _handle->position = base + position;
+  return true;
+}
+
+size_t File::position() const {
+  return _handle ? _handle->position : 0;
+}
+
+size_t File::size() const {
+  std::vector<uint8_t> *data = _handle ? contents(_handle) : nullptr;
+  return data ? data->size() : 0;
+}
+
+void File::close() {
+  _handle.reset();
+}
+
+const char *File::name() const {
+  return _handle ? _handle->path.c_str() : "";
+}
+
+File FS::open(const char *path, const char *mode) {
+  if (!host::spiffsMounted) {
+    return File();
+  }
+  host::charge(host::FLASH_OPEN_US);
+  host::HeapAccountingOff internal;
+  std::string name = path;
+  bool exists = flashImage.files.count(name) > 0;
+  auto handle = std::make_shared<FileHandle>();
+  handle->path = name;
+  if (strcmp(mode, "r") == 0) {
+    if (!exists) {
+      return File();
+    }
+    handle->readable = true;
+  }
+  else if (strcmp(mode, "r+") == 0) {
+    if (!exists) {
+      return File();
+    }
+    handle->readable = true;
+    handle->writable = true;
+  }
+  else if ((strcmp(mode, "w") == 0) || (strcmp(mode, "w+") == 0)) {
+    flashImage.files[name].clear();
+    handle->writable = true;
+    handle->readable = mode[1] == '+';
+  }
+  else if (mode[0] == 'a') {
+    handle->position = flashImage.files[name].size();
+    handle->writable = true;
+    handle->readable = mode[1] == '+';
+  }
+  else {
+    return File();
+  }
+  return File(handle);
+}
+
+bool FS::exists(const char *path) {
+  return host::spiffsMounted && (flashImage.files.count(path) > 0);
+}
+
+bool FS::remove(const char *path) {
+  if (!host::spiffsMounted) {
+    return false;
+  }
+  host::HeapAccountingOff internal;
+  return flashImage.files.erase(path) > 0;
+}
+
+bool SPIFFSFS::begin(bool, const char *, uint8_t) {
+  host::spiffsMounted = flashImage.spiffsMountable;
+  return host::spiffsMounted;
+}
+
+bool SPIFFSFS::format() {
+  host::HeapAccountingOff internal;
+  flashImage.files.clear();
+  return true;
+}
+
+size_t SPIFFSFS::totalBytes() {
+  return 1408 * 1024;
+}
+
+size_t SPIFFSFS::usedBytes() {
+  size_t used = 0;
+  for (const auto &file : flashImage.files) {
+    used += file.second.size();
+  }
+  return used;
+}
+
+void SPIFFSFS::end() {
+  host::spiffsMounted = false;
+}
+
+}
+
+
+/********************************************************************************
+  ROM CRC and SHA engine
+********************************************************************************/
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int k = 0; k < 8; k++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+void esp_sha(esp_sha_type type, const unsigned char *input, size_t ilen, unsigned char *output) {
+  host::charge(1 + ilen * host::SHA256_BYTE_US);
+  host::HeapAccountingOff internal;
+  const EVP_MD *md = (type == SHA1) ? EVP_sha1() : (type == SHA2_384) ? EVP_sha384() : (type == SHA2_512) ? EVP_sha512() : EVP_sha256();
+  unsigned int length = 0;
+  EVP_Digest(input, ilen, output, &length, md, nullptr);
+}
@@ -0,0 +1,179 @@
+/********************************************************************************
+  Host tests and benchmarks
+  A test file includes the merged sketch ("sketch.cpp", generated from the .ino files by host/tools/merge_sketch.py)
+  and then this header, so the tests can read and set the globals of the sketch.
+  Every TEST runs in its own process (fork) so it starts from the globals of a scooter that was just powered on.
+  usage: <test> [name]     runs every test, or only the one with this name
+********************************************************************************/
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "host.h"
+#include "ark.h"
+
+namespace host {
+namespace test {
+
+struct Case {
+  const char *name;
+  void (*run)();
+};
+
+inline std::vector<Case> &cases() {
+  static std::vector<Case> all;
+  return all;
+}
+
+struct Register {
+  Register(const char *name, void (*run)()) {
+    cases().push_back({name, run});
+  }
+};
+
+inline int &failures() {
+  static int count = 0;
+  return count;
+}
+
+inline void fail(const char *file, int line, const std::string &message) {
+  fprintf(stderr, "%s:%d: %s\n", file, line, message.c_str());
+  failures()++;
+}
+
+}
+
+
+/********************************************************************************
+  Scooter under test
+********************************************************************************/
+
+//Fake relays at the addresses of ARK_RELAY_HOSTS/ARK_RELAY_PORTS, serving the chain of the scooter wallet
+inline std::vector<std::unique_ptr<ArkRelay>> &relays() {
+  static std::vector<std::unique_ptr<ArkRelay>> all;
+  return all;
+}
+
+inline ArkRelay &relay(int index = 0) {
+  return *relays()[index];
+}
+
+inline void startNetwork() {
+  HeapAccountingOff internal;
+  arkChain().address = ArkAddress;
+  arkChain().publicKey = ArkPublicKey;
+  for (int i = 0; i < ARK_RELAY_COUNT; i++) {
+    relays().emplace_back(new ArkRelay());
+    listen(ARK_RELAY_HOSTS[i], ARK_RELAY_PORTS[i], relays().back().get());
+  }
+}
+
+//GPS receiver with a fix at a fixed position (Edmonton)
+inline std::shared_ptr<GpsRoute> parkedGps(int32_t latitude = 53535352, int32_t longitude = -113277912) {
+  HeapAccountingOff internal;
+  std::shared_ptr<GpsRoute> route = std::make_shared<GpsRoute>();
+  route->position = [latitude, longitude](uint64_t) {
+    return GpsPosition{latitude, longitude, 0.0f, true, 8};
+  };
+  setGpsReplay(route);
+  return route;
+}
+
+//Powers on the scooter and waits until the QRcode is displayed (STATE_4)
+inline bool bootToAvailable(uint32_t timeout_ms = 60000) {
+  boot();
+  return runUntil([] { return state == STATE_4; }, timeout_ms);
+}
+
+//A rider pays for a ride of 'seconds' to the session of the displayed QRcode
+inline std::string rentScooter(uint32_t seconds, int rider = 1) {
+  return arkChain().receiveRentalStart(scooterRental.sessionID_QRcode, (uint64_t) seconds * RENTAL_RATE_UINT64, rider);
+}
+
+//From the displayed QRcode to the next one: pays for the ride, waits for the ride to end and the RentalFinish to be accepted
+inline bool runRentalCycle(uint32_t seconds, uint32_t timeout_ms = 120000) {
+  uint64_t accepted = arkChain().accepted;
+  rentScooter(seconds);
+  if (!runUntil([] { return state == STATE_5; }, timeout_ms)) {
+    return false;
+  }
+  return runUntil([accepted] { return (state == STATE_4) && (arkChain().accepted > accepted); }, (uint64_t) seconds * 1000 + timeout_ms);
+}
+
+inline uint32_t percentile(std::vector<uint32_t> values, double percent) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = (size_t) (percent / 100.0 * (values.size() - 1) + 0.5);
+  return values[std::min(index, values.size() - 1)];
+}
+
+}
+
+#define TEST(name)                                                        \
+  static void test_##name();                                              \
+  static host::test::Register register_##name(#name, test_##name);       \
+  static void test_##name()
+
+#define CHECK(condition)                                                  \
+  do {                                                                    \
+    if (!(condition)) {                                                   \
+      host::test::fail(__FILE__, __LINE__, "CHECK(" #condition ") failed"); \
+    }                                                                     \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                    \
+  do {                                                                    \
+    auto _a = (a);                                                        \
+    auto _b = (b);                                                        \
+    if (!(_a == _b)) {                                                    \
+      host::test::fail(__FILE__, __LINE__, "CHECK_EQ(" #a ", " #b ") failed: " + std::to_string(_a) + " != " + std::to_string(_b)); \
+    }                                                                     \
+  } while (0)
+
+#define REQUIRE(condition)                                                \
+  do {                                                                    \
+    if (!(condition)) {                                                   \
+      host::test::fail(__FILE__, __LINE__, "REQUIRE(" #condition ") failed"); \
+      return;                                                             \
+    }                                                                     \
+  } while (0)
+
+int main(int argc, char **argv) {
+  host::beginHeapAccounting();
+  int failed = 0;
+  int run = 0;
+  for (const host::test::Case &c : host::test::cases()) {
+    if ((argc > 1) && (std::string(argv[1]) != c.name)) {
+      continue;
+    }
+    run++;
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+      host::startNetwork();
+      c.run();
+      fflush(stdout);
+      _exit(host::test::failures() ? 1 : 0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    bool ok = WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+    fprintf(stdout, "[%s] %s\n", ok ? "  OK  " : "FAILED", c.name);
+    if (!ok) {
+      failed++;
+    }
+  }
+  fprintf(stdout, "%d tests, %d failed\n", run, failed);
+  return (failed || !run) ? 1 : 0;
+}
+
+#endif
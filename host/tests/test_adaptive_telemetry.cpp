@@ -0,0 +1,154 @@
+/********************************************************************************
+  Adaptive telemetry replay
+  A scooter parked for 2 minutes, rented for a 10 minute ride (5 m/s north with a 1 minute stop) and parked again.
+  Reports the messages and bytes published by the adaptive scheduler (keyframes and deltas) and what a keyframe every
+  UpdateInterval_MQTT_Publish, or every TELEMETRY_MOVING_INTERVAL (the adaptive rate of a moving scooter), would have
+  sent, and how far the last reported position was behind the scooter during the ride. The deltas must be hash
+  chained to the keyframes and the chain heads signed.
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+static const uint64_t RIDE_START_US = 120000000;
+static const uint64_t STOP_START_US = 300000000;
+static const uint64_t STOP_END_US = 360000000;
+static const uint64_t RIDE_END_US = 720000000;
+static const uint64_t REPLAY_END_US = 900000000;
+static const int32_t START_LATITUDE = 53535352;
+static const int32_t MICRODEGREES_PER_SECOND = 45;      // 5 m/s north
+
+static int32_t rideLatitude(uint64_t now_us) {
+  uint64_t moving_us = 0;
+  if (now_us > RIDE_START_US) {
+    moving_us = min(now_us, RIDE_END_US) - RIDE_START_US;
+    if (now_us > STOP_START_US) {
+      moving_us -= min(now_us, STOP_END_US) - STOP_START_US;
+    }
+  }
+  return START_LATITUDE + (int32_t) (moving_us * MICRODEGREES_PER_SECOND / 1000000);
+}
+
+static bool moving(uint64_t now_us) {
+  return (now_us > RIDE_START_US) && (now_us < RIDE_END_US) && !((now_us > STOP_START_US) && (now_us < STOP_END_US));
+}
+
+static std::string field(const std::string &json, const std::string &name) {
+  size_t start = json.find("\"" + name + "\":");
+  if (start == std::string::npos) {
+    return "";
+  }
+  start += name.size() + 3;
+  if (json[start] == '"') {
+    return json.substr(start + 1, json.find('"', start + 1) - start - 1);
+  }
+  return json.substr(start, json.find_first_of(",}", start) - start);
+}
+
+static std::vector<uint8_t> sha256(const std::string &data) {
+  std::vector<uint8_t> hash(32);
+  host::ark::sha256(data.data(), data.size(), hash.data());
+  return hash;
+}
+
+TEST(adaptive_telemetry_against_the_fixed_interval) {
+  std::shared_ptr<host::GpsRoute> route = host::parkedGps();
+  route->position = [](uint64_t now_us) {
+    return host::GpsPosition{rideLatitude(now_us), -113277912, moving(now_us) ? 9.72f : 0.0f, true, 8};
+  };
+  REQUIRE(host::bootToAvailable());
+  host::runUntil([] { return host::now() >= RIDE_START_US - 15000000; }, 200000);
+  host::rentScooter((RIDE_END_US - host::now()) / 1000000);
+  REQUIRE(host::runUntil([] { return state == STATE_5; }, 30000));
+  host::runUntil([] { return host::now() >= REPLAY_END_US; }, 1000000);
+
+  host::HeapAccountingOff internal;
+  std::vector<host::MqttMessage> messages = host::mqtt().on(MQTT_Base_Topic);
+  std::vector<host::MqttMessage> deltas = host::mqtt().on(MQTT_Delta_Topic);
+  messages.insert(messages.end(), deltas.begin(), deltas.end());
+  std::stable_sort(messages.begin(), messages.end(), [](const host::MqttMessage &a, const host::MqttMessage &b) {
+    return a.time_us < b.time_us;
+  });
+
+  //walk the messages: the chain of the deltas, the keyframe signatures and the reported positions
+  host::ark::Keys keys = host::ark::keysFromPassphrase(PASSPHRASE);
+  std::vector<uint8_t> chain;
+  int chainLength = 0;
+  int keyframes = 0;
+  int chainedDeltas = 0;
+  int brokenLinks = 0;
+  size_t keyframeBytes = 0;
+  size_t deltaBytes = 0;
+  size_t plainKeyframeBytes = 0;                    // without "chain" and "deltas": the packet of the fixed interval
+  int32_t keyLatitude = 0;
+  std::vector<std::pair<uint64_t, int32_t>> reported;
+  for (const host::MqttMessage &message : messages) {
+    const std::string &json = message.payload;
+    if (message.topic == MQTT_Base_Topic) {
+      size_t signature = json.find(",\"sig\":");
+      std::string signedText = json.substr(1, signature - 1);
+      CHECK(host::ark::verify(sha256(signedText).data(), host::ark::fromHex(field(json, "sig")), keys.publicKey));
+      if (!field(json, "chain").empty()) {
+        CHECK(field(json, "chain") == host::ark::toHex(chain.data(), chain.size()));
+        CHECK_EQ(atoi(field(json, "deltas").c_str()), chainLength);
+        chainedDeltas += chainLength;
+      }
+      else {
+        CHECK_EQ(chainLength, 0);
+      }
+      chain = sha256(field(json, "sig"));
+      chainLength = 0;
+      keyframes++;
+      keyframeBytes += json.size();
+      size_t chainField = json.find(",\"chain\":");
+      plainKeyframeBytes += json.size() - ((chainField == std::string::npos) ? 0 : signature - chainField);
+      keyLatitude = (int32_t) llround(atof(field(json, "lat").c_str()) * 1e6);
+      reported.push_back({message.time_us, keyLatitude});
+    }
+    else {
+      std::string text = json.substr(1, json.find(",\"h\":") - 1);
+      std::vector<uint8_t> link = chain;
+      link.insert(link.end(), text.begin(), text.end());
+      chain = sha256(std::string(link.begin(), link.end()));
+      chainLength++;
+      brokenLinks += (field(json, "h") == host::ark::toHex(chain.data(), chain.size())) ? 0 : 1;
+      deltaBytes += json.size();
+      reported.push_back({message.time_us, keyLatitude + atoi(field(json, "dlat").c_str())});
+    }
+  }
+
+  //distance between the scooter and the last reported position, every second of the ride
+  double adaptiveError = 0;
+  double fixedError = 0;
+  double fastError = 0;
+  size_t next = 0;
+  int32_t lastReported = START_LATITUDE;
+  for (uint64_t t = RIDE_START_US; t < RIDE_END_US; t += 1000000) {
+    while ((next < reported.size()) && (reported[next].first <= t)) {
+      lastReported = reported[next++].second;
+    }
+    int32_t actual = rideLatitude(t);
+    int32_t fixed = rideLatitude(t / (UpdateInterval_MQTT_Publish * 1000ULL) * (UpdateInterval_MQTT_Publish * 1000ULL));
+    int32_t fast = rideLatitude(t / (TELEMETRY_MOVING_INTERVAL * 1000ULL) * (TELEMETRY_MOVING_INTERVAL * 1000ULL));
+    adaptiveError = std::max(adaptiveError, (double) telemetryDistance(lastReported, 0, actual, 0));
+    fixedError = std::max(fixedError, (double) telemetryDistance(fixed, 0, actual, 0));
+    fastError = std::max(fastError, (double) telemetryDistance(fast, 0, actual, 0));
+  }
+
+  uint64_t fixedMessages = REPLAY_END_US / 1000 / UpdateInterval_MQTT_Publish;
+  uint64_t fixedBytes = fixedMessages * plainKeyframeBytes / keyframes;
+  uint64_t fastMessages = REPLAY_END_US / 1000 / TELEMETRY_MOVING_INTERVAL;
+  uint64_t fastBytes = fastMessages * plainKeyframeBytes / keyframes;
+  fprintf(stdout, "%u s: 2 min parked, 10 min ride at 5 m/s with a 1 min stop, parked\n", (unsigned) (REPLAY_END_US / 1000000));
+  fprintf(stdout, "  adaptive  %3d keyframes %3zu deltas %3zu messages %6zu bytes   position behind by at most %5.1f m\n",
+          keyframes, deltas.size(), messages.size(), keyframeBytes + deltaBytes, adaptiveError);
+  fprintf(stdout, "  fixed     %3" PRIu64 " keyframes (every %u s)         %6" PRIu64 " bytes   position behind by at most %5.1f m\n",
+          fixedMessages, UpdateInterval_MQTT_Publish / 1000, fixedBytes, fixedError);
+  fprintf(stdout, "  fixed     %3" PRIu64 " keyframes (every %u s)         %6" PRIu64 " bytes   position behind by at most %5.1f m\n",
+          fastMessages, TELEMETRY_MOVING_INTERVAL / 1000, fastBytes, fastError);
+
+  CHECK(!deltas.empty());
+  CHECK_EQ(brokenLinks, 0);
+  CHECK(chainedDeltas + chainLength == (int) deltas.size());
+  CHECK(adaptiveError < fixedError);
+  CHECK(keyframeBytes + deltaBytes < fastBytes);
+}
@@ -0,0 +1,64 @@
+/********************************************************************************
+  Profiler summary: the sections of loop() (core 1) are reset by loop() itself after each summary of networkTask()
+  (core 0), and a section that was not called in a window reports no calls
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+//calls of a section in a diagnostics packet: "gps":[calls,avg,p99,max]
+static long sectionCalls(const std::string &json, const char *section) {
+  size_t start = json.find("\"" + std::string(section) + "\":[");
+  return (start == std::string::npos) ? -1 : atol(json.c_str() + start + strlen(section) + 4);
+}
+
+TEST(sections_are_reset_by_their_own_task) {
+  host::parkedGps();
+  REQUIRE(host::bootToAvailable());
+  uint64_t boot_us = host::now();
+  host::runFor(3 * UpdateInterval_Diagnostics);
+
+  host::HeapAccountingOff internal;
+  std::vector<host::MqttMessage> packets = host::mqtt().on(MQTT_Diagnostics_Topic);
+  REQUIRE(packets.size() >= 2);
+  for (const host::MqttMessage &packet : packets) {
+    if (packet.time_us < boot_us) {
+      continue;
+    }
+    //a whole window of the display loop: about one GPS section per 20 ms pass, never the sum of two windows
+    long gps = sectionCalls(packet.payload, "gps");
+    CHECK(gps > 0);
+    CHECK(gps <= (long) (UpdateInterval_Diagnostics / 20 + 100));
+    //no ride: the ride display was never timed
+    CHECK_EQ(sectionCalls(packet.payload, "ride"), 0L);
+  }
+}
+
+static volatile bool stallsDone = false;
+static struct profileStall stallCopy;
+
+static void stallTask(void *) {
+  for (int i = 0; i < 1000; i++) {
+    uint32_t start = profileStart(PROFILE_OUTBOX);
+    host::charge(PROFILE_STALL_THRESHOLD_MS * 1000.0);
+    profileEnd(PROFILE_OUTBOX, start);
+  }
+  stallsDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(stalls_of_both_tasks_are_counted) {
+  initProfiler();
+  xTaskCreatePinnedToCore(stallTask, "stallTask", 4096, NULL, 1, NULL, 0);
+  for (int i = 0; i < 1000; i++) {
+    uint32_t start = profileStart(PROFILE_GPS);
+    host::charge(PROFILE_STALL_THRESHOLD_MS * 1000.0);
+    profileEnd(PROFILE_GPS, start);
+  }
+  REQUIRE(host::runUntil([] { return stallsDone; }, 2000000));
+  portENTER_CRITICAL(&profileStallMux);
+  stallCopy = profileStalls;
+  portEXIT_CRITICAL(&profileStallMux);
+  CHECK_EQ(stallCopy.count, (uint32_t) 2000);
+  CHECK_EQ(profileSections[PROFILE_GPS].calls, (uint32_t) 1000);
+  CHECK_EQ(profileSections[PROFILE_OUTBOX].calls, (uint32_t) 1000);
+}
@@ -0,0 +1,129 @@
+/********************************************************************************
+  Fixed point coordinates: the NMEA digits are converted to int32_t microdegrees and printed back exactly in every
+  hemisphere, in the QRcode and in the MQTT telemetry
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+//degrees and millionths of a minute to microdegrees, rounded to the nearest microdegree
+static int32_t exactMicrodegrees(uint32_t degrees, uint32_t minutes_e6, char hemisphere) {
+  int64_t magnitude = ((int64_t) degrees * 60000000 + minutes_e6 + 30) / 60;
+  return (int32_t) (((hemisphere == 'S') || (hemisphere == 'W')) ? -magnitude : magnitude);
+}
+
+//"-113.277912" without formatMicrodegrees(): the decimal point is inserted into the digits of the magnitude
+static std::string decimalDegrees(int32_t microdegrees) {
+  std::string digits = std::to_string((microdegrees < 0) ? -(int64_t) microdegrees : (int64_t) microdegrees);
+  digits.insert(0, (digits.size() < 7) ? 7 - digits.size() : 0, '0');
+  digits.insert(digits.size() - 6, ".");
+  return ((microdegrees < 0) ? "-" : "") + digits;
+}
+
+static std::string field(const std::string &json, const std::string &name) {
+  size_t start = json.find("\"" + name + "\":");
+  if (start == std::string::npos) {
+    return "";
+  }
+  start += name.size() + 3;
+  return json.substr(start, json.find_first_of(",}", start) - start);
+}
+
+TEST(nmea_coordinates_are_exact_in_every_hemisphere) {
+  static const struct {
+    char hemisphere;
+    uint32_t maxDegrees;
+    const char *format;
+  } axes[] = {
+    {'N', 90, "%02u%02u.%06u,%c"},
+    {'S', 90, "%02u%02u.%06u,%c"},
+    {'E', 180, "%03u%02u.%06u,%c"},
+    {'W', 180, "%03u%02u.%06u,%c"},
+  };
+  long cases = 0;
+  long mismatches = 0;
+  for (const auto &axis : axes) {
+    for (uint32_t degrees = 0; degrees < axis.maxDegrees; degrees++) {
+      //every 4 decimal minute of a few minutes and a stride through the rest, with the 6 decimals of the u-blox
+      for (uint32_t minutes_e6 = 0; minutes_e6 < 60000000; minutes_e6 += (minutes_e6 < 200000) ? 100 : 29989) {
+        char text[24];
+        snprintf(text, sizeof(text), axis.format, degrees, minutes_e6 / 1000000, minutes_e6 % 1000000, axis.hemisphere);
+        int32_t microdegrees = 0;
+        cases++;
+        if (!parseNMEAcoordinate(text, microdegrees) || (microdegrees != exactMicrodegrees(degrees, minutes_e6, axis.hemisphere))) {
+          mismatches++;
+        }
+      }
+    }
+  }
+  CHECK(cases > 500000);
+  CHECK_EQ(mismatches, 0L);
+
+  int32_t microdegrees = 0;
+  CHECK(parseNMEAcoordinate("11316.6045,W", microdegrees));
+  CHECK_EQ(microdegrees, -113276742);
+  CHECK(parseNMEAcoordinate("3326.93340,S", microdegrees));
+  CHECK_EQ(microdegrees, -33448890);
+  CHECK(parseNMEAcoordinate("00000.0001,W", microdegrees));
+  CHECK_EQ(microdegrees, -2);
+  CHECK(parseNMEAcoordinate("17959.999999,E", microdegrees));
+  CHECK_EQ(microdegrees, 180000000);
+
+  CHECK(!parseNMEAcoordinate(",N", microdegrees));
+  CHECK(!parseNMEAcoordinate("5360.0000,N", microdegrees));
+  CHECK(!parseNMEAcoordinate("18000.0001,E", microdegrees));
+  CHECK(!parseNMEAcoordinate("5332.1234,X", microdegrees));
+  CHECK(!parseNMEAcoordinate("5332.1234", microdegrees));
+}
+
+TEST(microdegrees_are_printed_exactly) {
+  static const int32_t edges[] = {0, 1, -1, -500, 999999, -999999, 1000000, -1000000, 180000000, -180000000};
+  long mismatches = 0;
+  char text[COORDINATE_TEXT_SIZE];
+  for (int32_t microdegrees : edges) {
+    formatMicrodegrees(microdegrees, text, sizeof(text));
+    mismatches += (decimalDegrees(microdegrees) == text) ? 0 : 1;
+  }
+  for (int32_t microdegrees = -180000000; microdegrees <= 180000000; microdegrees += 1237) {
+    int length = formatMicrodegrees(microdegrees, text, sizeof(text));
+    mismatches += ((length < COORDINATE_TEXT_SIZE) && (decimalDegrees(microdegrees) == text)) ? 0 : 1;
+  }
+  CHECK_EQ(mismatches, 0L);
+  formatMicrodegrees(-500, text, sizeof(text));
+  CHECK(std::string(text) == "-0.000500");
+}
+
+//boots at the position and checks the coordinates of the QRcode and of a telemetry keyframe
+static void checkPosition(int32_t latitude, int32_t longitude) {
+  host::parkedGps(latitude, longitude);
+  REQUIRE(host::bootToAvailable());
+  host::runFor(UpdateInterval_MQTT_Publish + 1000);
+
+  struct gpsFix fix;
+  getGPSfix(fix);
+  CHECK_EQ(fix.latitude, latitude);
+  CHECK_EQ(fix.longitude, longitude);
+
+  host::HeapAccountingOff internal;
+  std::string coordinates = "&lat=" + decimalDegrees(latitude) + "&lon=" + decimalDegrees(longitude);
+  CHECK(std::string(nextSession.QRcodeText).find(coordinates) != std::string::npos);
+  std::vector<host::MqttMessage> keyframes = host::mqtt().on(MQTT_Base_Topic);
+  REQUIRE(!keyframes.empty());
+  CHECK(field(keyframes.back().payload, "lat") == decimalDegrees(latitude));
+  CHECK(field(keyframes.back().payload, "lon") == decimalDegrees(longitude));
+}
+
+TEST(north_west_position_is_exact) {
+  checkPosition(53535352, -113277912);            // Edmonton
+}
+
+TEST(south_west_position_is_exact) {
+  checkPosition(-33448890, -70669265);            // Santiago
+}
+
+TEST(south_east_position_is_exact) {
+  checkPosition(-33868820, 151209296);            // Sydney
+}
+
+TEST(north_east_position_is_exact) {
+  checkPosition(35689487, 139691706);             // Tokyo
+}
@@ -0,0 +1,75 @@
+/********************************************************************************
+  The stand-ins of the harness: counting display, GPS replay, MQTT broker and the fake Ark relay
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+TEST(display_counts_pixels_and_transactions) {
+  host::DisplayStats before = host::display();
+  tft.fillScreen(ILI9341_BLUE);
+  CHECK_EQ(host::display().pixels - before.pixels, (uint64_t) 240 * 320);
+  CHECK_EQ(host::display().transactions - before.transactions, (uint64_t) 1);
+  CHECK_EQ(host::displayPixel(120, 160), (uint16_t) ILI9341_BLUE);
+
+  before = host::display();
+  tft.drawPixel(3, 4, ILI9341_RED);
+  CHECK_EQ(host::display().pixels - before.pixels, (uint64_t) 1);
+  CHECK_EQ(host::display().addressWindows - before.addressWindows, (uint64_t) 1);
+  CHECK_EQ(host::displayPixel(3, 4), (uint16_t) ILI9341_RED);
+}
+
+TEST(nmea_replay_is_parsed_by_the_sketch) {
+  CHECK(host::nmeaCoordinate(53535352, true) == "5332.12112,N");
+  CHECK(host::nmeaCoordinate(-113277912, false) == "11316.67472,W");
+  std::string sentence = host::nmeaSentence("GPGSA,A,3,10,12,14,24,25,32,,,,,,,1.25,0.92,0.84");
+  CHECK(checkNMEAchecksum(sentence.c_str()));
+
+  host::parkedGps(-33868820, 151209296);
+  REQUIRE(host::bootToAvailable());
+  struct gpsFix fix;
+  getGPSfix(fix);
+  CHECK_EQ(fix.latitude, -33868820);
+  CHECK_EQ(fix.longitude, 151209296);
+  CHECK_EQ(host::gpsUart().lost, (uint64_t) 0);
+}
+
+TEST(mqtt_packets_reach_the_broker) {
+  host::parkedGps();
+  REQUIRE(host::bootToAvailable());
+  host::runFor(30000);
+  std::vector<host::MqttMessage> packets = host::mqtt().on(MQTT_Base_Topic);
+  REQUIRE(!packets.empty());
+  CHECK(packets.back().payload.find("\"status\":\"Available\"") != std::string::npos);
+  CHECK(host::mqtt().connects == 1);
+}
+
+TEST(relay_rejects_a_stale_nonce) {
+  host::ark::RentalFinish transaction;
+  transaction.recipient = host::riderAddress(1);
+  transaction.fee = 10000000;
+  transaction.amount = 1;
+  transaction.nonce = 5;
+  host::ark::signTransaction(transaction, PASSPHRASE);
+  std::string body = "{\"transactions\":[" + host::ark::toJson(transaction) + "]}";
+  std::string request = "POST /api/transactions HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+  auto connection = std::make_shared<host::Connection>();
+  connection->request = request;
+  host::relay().received(connection);
+  REQUIRE(connection->segments.size() >= 2);
+  std::string response;
+  for (const host::Connection::Segment &segment : connection->segments) {
+    response += segment.data;
+  }
+  CHECK(response.compare(0, 12, "HTTP/1.1 422") == 0);
+  CHECK(response.find("\"ERR_APPLY\"") != std::string::npos);
+  CHECK(response.find("Cannot apply a transaction with nonce 5: the sender " + std::string(ArkPublicKey) + " has nonce 0.") != std::string::npos);
+
+  transaction.nonce = 1;
+  host::ark::signTransaction(transaction, PASSPHRASE);
+  body = "{\"transactions\":[" + host::ark::toJson(transaction) + "]}";
+  connection->request = "POST /api/transactions HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+  host::relay().received(connection);
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 1);
+  CHECK_EQ(host::relay().requests.back().status, 200);
+}
@@ -0,0 +1,401 @@
+/********************************************************************************
+  Store-and-forward outbox: the ring of slots in flash and the transactions sent again after a reboot
+  The outbox runs in a task on core 0 with WiFi only (the broker is down) and without the rest of the sketch.
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+static volatile bool taskDone = false;
+
+static void runInTask(void (*task)(void *)) {
+  host::mqtt().brokerAvailable = false;
+  taskDone = false;
+  xTaskCreatePinnedToCore(task, "outboxTask", 8192, NULL, 1, NULL, 0);
+  host::runUntil([] { return taskDone; }, 600000);
+}
+
+static void connectWifi() {
+  initProfiler();
+  initRelayPool();
+  while (!WiFiMQTTclient.isWifiConnected()) {
+    WiFiMQTTclient.loop();
+    delay(100);
+  }
+}
+
+//A RentalFinish signed by the scooter wallet with the next nonce of the chain
+static std::string signedTransaction(uint64_t nonce) {
+  host::HeapAccountingOff internal;
+  host::ark::RentalFinish transaction;
+  transaction.recipient = host::riderAddress(1);
+  transaction.fee = 10000000;
+  transaction.amount = 1;
+  transaction.nonce = nonce;
+  host::ark::signTransaction(transaction, PASSPHRASE);
+  return host::ark::toJson(transaction);
+}
+
+static void appendTransactions(int count) {
+  uint64_t nonce = host::arkChain().poolNonce();
+  for (int i = 1; i <= count; i++) {
+    std::string json = signedTransaction(nonce + i);
+    outboxAppend(OUTBOX_TRANSACTION, json.c_str(), json.length());
+  }
+}
+
+//Sends the pending transactions without saving the tail: the scooter loses power before saveOutboxTail()
+static uint32_t sendWithoutSavingTail() {
+  File file = SPIFFS.open(OUTBOX_FILE, FILE_READ);
+  uint32_t sentEntries = 0;
+  outboxSendTransactions(file, sentEntries);
+  file.close();
+  return sentEntries;
+}
+
+
+/********************************************************************************
+  Ring: the newest OUTBOX_SLOTS entries are kept in order and found again after a reboot
+********************************************************************************/
+static uint32_t firstKept;
+static uint32_t keptInOrder;
+
+static void ringTask(void *) {
+  initProfiler();
+  initOutbox();
+  for (uint32_t i = 0; i < OUTBOX_SLOTS + 3; i++) {
+    outboxAppend(OUTBOX_TELEMETRY, &i, sizeof(i));
+  }
+  outbox = outboxState();                   //power cycle: the state is found again from the flash
+  initOutbox();
+
+  File file = SPIFFS.open(OUTBOX_FILE, FILE_READ);
+  struct outboxEntryHeader header;
+  uint32_t payload = 0;
+  if (outboxReadEntry(file, outbox.tail, header, &payload)) {
+    firstKept = payload;
+  }
+  keptInOrder = 0;
+  for (uint32_t id = outbox.tail; id != outbox.head; id++) {
+    if (outboxReadEntry(file, id, header, &payload) && (payload == firstKept + keptInOrder)) {
+      keptInOrder++;
+    }
+  }
+  file.close();
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(ring_keeps_the_newest_entries) {
+  runInTask(ringTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(outbox.head - outbox.tail, (uint32_t) OUTBOX_SLOTS);
+  CHECK_EQ(firstKept, (uint32_t) 3);
+  CHECK_EQ(keptInOrder, (uint32_t) OUTBOX_SLOTS);
+}
+
+//an outage: the telemetry batches keep coming behind a RentalFinish that cannot be sent
+static std::string pendingTransaction;
+static bool transactionKept;
+static uint32_t firstTelemetryKept;
+static uint32_t telemetryInOrder;
+
+static void telemetryBehindTransactionTask(void *) {
+  initProfiler();
+  initOutbox();
+  pendingTransaction = signedTransaction(1);
+  outboxAppend(OUTBOX_TRANSACTION, pendingTransaction.c_str(), pendingTransaction.length());
+  for (uint32_t i = 0; i < 4 * OUTBOX_SLOTS; i++) {
+    outboxAppend(OUTBOX_TELEMETRY, &i, sizeof(i));
+  }
+  outbox = outboxState();                   //power cycle
+  initOutbox();
+
+  File file = SPIFFS.open(OUTBOX_FILE, FILE_READ);
+  struct outboxEntryHeader header;
+  static char payload[OUTBOX_SLOT_SIZE];
+  transactionKept = outboxReadEntry(file, outbox.tail, header, payload) && (header.type == OUTBOX_TRANSACTION) &&
+                    (std::string(payload, header.length) == pendingTransaction);
+  uint32_t telemetry = 0;
+  telemetryInOrder = 0;
+  for (uint32_t id = outbox.tail + 1; id != outbox.head; id++) {
+    if (outboxReadEntry(file, id, header, &telemetry) && (header.type == OUTBOX_TELEMETRY)) {
+      firstTelemetryKept = (id == outbox.tail + 1) ? telemetry : firstTelemetryKept;
+      telemetryInOrder += (telemetry == firstTelemetryKept + telemetryInOrder) ? 1 : 0;
+    }
+  }
+  file.close();
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(full_ring_drops_telemetry_and_keeps_the_transaction) {
+  runInTask(telemetryBehindTransactionTask);
+  REQUIRE(taskDone);
+  CHECK(transactionKept);
+  CHECK_EQ(outbox.pendingTransactions, 1);
+  CHECK_EQ(outbox.head - outbox.tail, (uint32_t) OUTBOX_SLOTS);
+  CHECK_EQ(telemetryInOrder, (uint32_t) (OUTBOX_SLOTS - 1));
+  CHECK_EQ(firstTelemetryKept, (uint32_t) (4 * OUTBOX_SLOTS - (OUTBOX_SLOTS - 1)));
+}
+
+static uint32_t telemetryId;
+static uint32_t transactionId;
+
+static void fullOfTransactionsTask(void *) {
+  initProfiler();
+  initOutbox();
+  for (int i = 1; i <= OUTBOX_SLOTS; i++) {
+    std::string json = signedTransaction(i);
+    outboxAppend(OUTBOX_TRANSACTION, json.c_str(), json.length());
+  }
+  uint32_t sample = 0;
+  telemetryId = outboxAppend(OUTBOX_TELEMETRY, &sample, sizeof(sample));
+  std::string json = signedTransaction(OUTBOX_SLOTS + 1);
+  transactionId = outboxAppend(OUTBOX_TRANSACTION, json.c_str(), json.length());
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(full_ring_of_transactions_refuses_new_entries) {
+  runInTask(fullOfTransactionsTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(telemetryId, (uint32_t) 0);
+  CHECK_EQ(transactionId, (uint32_t) 0);
+  CHECK_EQ(outbox.pendingTransactions, OUTBOX_SLOTS);
+  CHECK_EQ(outbox.tail, (uint32_t) 1);
+  CHECK_EQ(outboxStats.refused, (uint32_t) 2);
+}
+
+static void resizedTask(void *) {
+  initProfiler();
+  initOutbox();
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(file_of_another_slot_size_is_cleared) {
+  {
+    host::HeapAccountingOff internal;
+    host::flash().files[OUTBOX_FILE] = std::vector<uint8_t>(OUTBOX_SLOTS * 2048, 0xA5);
+  }
+  runInTask(resizedTask);
+  REQUIRE(taskDone);
+  CHECK(outbox.ready);
+  CHECK_EQ(outbox.head, outbox.tail);
+  CHECK_EQ(host::flash().files[OUTBOX_FILE].size(), OUTBOX_SLOTS * OUTBOX_SLOT_SIZE);
+}
+
+
+/********************************************************************************
+  Delivery: entries are removed only when the relay has the transactions
+********************************************************************************/
+static uint32_t sentBefore;
+
+static void appendAndSendTask(void *) {
+  connectWifi();
+  initOutbox();
+  appendTransactions(3);
+  sentBefore = sendWithoutSavingTail();
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+static void sendAgainTask(void *) {
+  sentBefore = sendWithoutSavingTail();
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+static void drainTask(void *) {
+  connectWifi();
+  initOutbox();
+  drainOutbox();
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(failed_send_keeps_the_entries) {
+  for (const std::unique_ptr<host::ArkRelay> &relay : host::relays()) {
+    relay->status = 503;
+  }
+  runInTask(appendAndSendTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(sentBefore, (uint32_t) 0);
+  CHECK_EQ(outbox.pendingTransactions, 3);
+
+  for (const std::unique_ptr<host::ArkRelay> &relay : host::relays()) {
+    relay->status = 0;
+  }
+  runInTask(sendAgainTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(sentBefore, (uint32_t) 3);
+  CHECK_EQ(outbox.pendingTransactions, 0);
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 3);
+}
+
+TEST(duplicates_count_as_delivered) {
+  runInTask(appendAndSendTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(sentBefore, (uint32_t) 3);
+  outbox.pendingTransactions = 3;           //the tail was not saved: the same entries are sent again
+
+  runInTask(sendAgainTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(sentBefore, (uint32_t) 3);
+  CHECK_EQ(host::relay().requests.back().status, 422);
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 3);
+  CHECK(!nonceReconcilePending);
+}
+
+//the pool was forged while the scooter was off: the relay answers ERR_FORGED
+TEST(resend_after_a_reboot_is_delivered) {
+  REQUIRE(host::rebootAfter([] {
+    runInTask(appendAndSendTask);
+  }));
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 3);
+  CHECK_EQ(host::arkChain().forged.size(), (size_t) 3);
+
+  runInTask(drainTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(outbox.tail, outbox.head);
+  CHECK_EQ(outbox.pendingTransactions, 0);
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 3);
+  CHECK(!nonceReconcilePending);
+  CHECK_EQ(host::relay().requests.back().status, 422);
+}
+
+TEST(resend_to_a_relay_ignoring_duplicates) {
+  REQUIRE(host::rebootAfter([] {
+    runInTask(appendAndSendTask);
+  }));
+  for (const std::unique_ptr<host::ArkRelay> &relay : host::relays()) {
+    relay->ignoreDuplicates = true;
+  }
+  runInTask(drainTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(outbox.tail, outbox.head);
+  CHECK_EQ(outbox.pendingTransactions, 0);
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 3);
+  CHECK_EQ(host::relay().requests.back().status, 200);
+}
+
+
+/********************************************************************************
+  Nonce: it only goes back when the relay rejects a transaction with a nonce past the next one. A RentalFinish
+  rejected because of its nonce is signed again with the corrected nonce
+********************************************************************************/
+static uint64_t nonces[2];
+static uint32_t sentAgain;
+
+//A RentalFinish of a two point ride queued with its parameters like SendTransaction_RentalFinish()
+static void queueRide(uint64_t nonce) {
+  struct rentalFinishParameters ride;
+  memset(&ride, 0, sizeof(ride));
+  {
+    host::HeapAccountingOff internal;
+    strlcpy(ride.recipient, host::riderAddress(1).c_str(), sizeof(ride.recipient));
+  }
+  memset(ride.sessionId, (int) nonce, sizeof(ride.sessionId));
+  ride.nonce = nonce;
+  ride.trackCount = 2;
+  ride.track[0] = {1583475939, 53535352, -113277912};
+  ride.track[1] = {1583475999, 53535400, -113277944};
+  queueTransaction(ride, signRentalFinish(ride));
+}
+
+static void sendWithNonceTask(void *) {
+  connectWifi();
+  initOutbox();
+  queueRide(bridgechainWallet.walletNonce_Uint64);
+  sentBefore = sendWithoutSavingTail();
+  nonces[0] = bridgechainWallet.walletNonce_Uint64;
+  sentAgain = (sentBefore == 0) ? sendWithoutSavingTail() : 0;      //the entry is still at the tail
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+//a RentalFinish was lost (e.g. never signed after a crash): nonce 6 leaves a gap after 0
+TEST(nonce_past_the_next_one_is_signed_again) {
+  bridgechainWallet.walletNonce_Uint64 = 6;
+  runInTask(sendWithNonceTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(sentBefore, (uint32_t) 0);               //kept and signed again with nonce 1
+  CHECK_EQ(nonces[0], (uint64_t) 1);
+  CHECK_EQ(outboxStats.resigned, (uint32_t) 1);
+  CHECK_EQ(sentAgain, (uint32_t) 1);
+  CHECK_EQ(outbox.pendingTransactions, 0);
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 1);
+  CHECK(!nonceReconcilePending);
+}
+
+//the journal was lost and the EEPROM held an older nonce
+TEST(used_nonce_moves_forward) {
+  host::arkChain().nonce = 9;
+  bridgechainWallet.walletNonce_Uint64 = 4;
+  runInTask(sendWithNonceTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(sentBefore, (uint32_t) 0);
+  CHECK_EQ(nonces[0], (uint64_t) 10);
+  CHECK_EQ(sentAgain, (uint32_t) 1);
+  CHECK_EQ(bridgechainWallet.walletNonce_Uint64, (uint64_t) 10);
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 1);
+}
+
+//two rides behind a gap: both are signed again in order and settled by the next send
+static void gapTask(void *) {
+  connectWifi();
+  initOutbox();
+  queueRide(2);
+  queueRide(3);
+  bridgechainWallet.walletNonce_Uint64 = 3;
+  sentBefore = sendWithoutSavingTail();
+  nonces[0] = bridgechainWallet.walletNonce_Uint64;
+  sentAgain = sendWithoutSavingTail();
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(rides_behind_a_nonce_gap_are_settled) {
+  runInTask(gapTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(sentBefore, (uint32_t) 0);
+  CHECK_EQ(nonces[0], (uint64_t) 2);
+  CHECK_EQ(outboxStats.resigned, (uint32_t) 2);
+  CHECK_EQ(sentAgain, (uint32_t) 2);
+  CHECK_EQ(outbox.pendingTransactions, 0);
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 2);
+  CHECK_EQ(host::arkChain().poolNonce(), (uint64_t) 2);
+}
+
+static void reconcileTask(void *) {
+  connectWifi();
+  bridgechainWallet.walletNonce_Uint64 = 12;
+  reconcileNonce();
+  nonces[0] = bridgechainWallet.walletNonce_Uint64;
+  bridgechainWallet.walletNonce_Uint64 = 2;
+  reconcileNonce();
+  nonces[1] = bridgechainWallet.walletNonce_Uint64;
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(reconcile_only_moves_forward) {
+  host::arkChain().nonce = 7;
+  runInTask(reconcileTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(nonces[0], (uint64_t) 12);
+  CHECK_EQ(nonces[1], (uint64_t) 7);
+}
+
+//rejected for its balance: the relay does not say which nonce it expects. The RentalFinish is dropped
+TEST(other_rejection_reconciles_the_nonce) {
+  host::arkChain().balance = 0;
+  bridgechainWallet.walletNonce_Uint64 = 1;
+  runInTask(sendWithNonceTask);
+  REQUIRE(taskDone);
+  CHECK_EQ(sentBefore, (uint32_t) 1);
+  CHECK_EQ(outbox.pendingTransactions, 0);
+  CHECK_EQ(outboxStats.resigned, (uint32_t) 0);
+  CHECK_EQ(nonces[0], (uint64_t) 1);
+  CHECK(nonceReconcilePending);
+}
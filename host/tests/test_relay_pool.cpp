@@ -0,0 +1,106 @@
+/********************************************************************************
+  Relay pool: the health checks take the relays in turn and a relay that fails a POST is not used as the answer.
+  The unread rest of a response keeps the connection only when skipping it is faster than a new connection
+  The relays are those of secrets.h
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+static volatile bool taskDone = false;
+static int postLength;
+static int postCode;
+
+static void postTask(void *) {
+  initProfiler();
+  initRelayPool();
+  while (!WiFiMQTTclient.isWifiConnected()) {
+    WiFiMQTTclient.loop();
+    delay(100);
+  }
+  static char response[ARK_RESPONSE_SIZE];
+  const char body[] = "{\"transactions\":[]}";
+  postLength = arkPost("/api/transactions", body, strlen(body), HTTP_SEND, response, sizeof(response), postCode);
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(post_skips_a_relay_that_fails) {
+  host::mqtt().brokerAvailable = false;
+  for (const std::unique_ptr<host::ArkRelay> &relay : host::relays()) {
+    relay->status = 503;
+  }
+  xTaskCreatePinnedToCore(postTask, "postTask", 8192, NULL, 1, NULL, 0);
+  REQUIRE(host::runUntil([] { return taskDone; }, 60000));
+  CHECK_EQ(postLength, -1);
+  CHECK_EQ(postCode, 503);
+  for (int relay = 0; relay < ARK_RELAY_COUNT; relay++) {
+    CHECK_EQ(host::relay(relay).count("POST", "/api/transactions"), (size_t) 1);
+    CHECK_EQ(arkRelays[relay].failures, (uint8_t) 1);
+  }
+}
+
+TEST(health_checks_take_the_relays_in_turn) {
+  host::parkedGps();
+  REQUIRE(host::bootToAvailable());
+  std::vector<size_t> before;
+  for (int relay = 0; relay < ARK_RELAY_COUNT; relay++) {
+    before.push_back(host::relay(relay).count("GET", "/api/node/status"));
+    CHECK(before.back() >= 1);                  //every relay is checked at boot
+  }
+
+  host::runFor(3 * UpdateInterval_RelayHealth);
+  for (int relay = 0; relay < ARK_RELAY_COUNT; relay++) {
+    size_t checks = host::relay(relay).count("GET", "/api/node/status") - before[relay];
+    CHECK(checks >= 2);
+    CHECK(checks <= 4);
+  }
+  CHECK(ARK_status);
+}
+
+static int pageCount;
+
+static void countThenWalletTask(void *) {
+  initProfiler();
+  initRelayPool();
+  while (!WiFiMQTTclient.isWifiConnected()) {
+    WiFiMQTTclient.loop();
+    delay(100);
+  }
+  int totalCount = 0;
+  pageCount = GetReceivedTransactionCount(ArkAddress, 1, RX_CATCHUP_PAGE_LIMIT, totalCount);
+  getWallet();
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+//only the counts of the page are read. The transactions are skipped if that is faster than a new connection
+static void countThenWallet(uint32_t connect_ms) {
+  {
+    host::HeapAccountingOff internal;
+    for (int i = 0; i < RX_CATCHUP_PAGE_LIMIT; i++) {
+      host::arkChain().receiveTransfer(100000000, 1 + i % 8);
+    }
+  }
+  host::runFor(host::arkChain().blockTime_ms + 1000);
+  host::mqtt().brokerAvailable = false;
+  for (const std::unique_ptr<host::ArkRelay> &relay : host::relays()) {
+    relay->connect_ms = connect_ms;
+  }
+  xTaskCreatePinnedToCore(countThenWalletTask, "countThenWalletTask", 8192, NULL, 1, NULL, 0);
+  REQUIRE(host::runUntil([] { return taskDone; }, 60000));
+  CHECK_EQ(pageCount, RX_CATCHUP_PAGE_LIMIT);
+  CHECK_EQ(arkConnectionStats.requests, (uint32_t) 2);
+}
+
+TEST(rest_of_a_page_is_skipped_when_a_new_connection_is_slower) {
+  countThenWallet(80);
+  CHECK_EQ(arkConnectionStats.connects, (uint32_t) 1);
+  CHECK_EQ(arkConnectionStats.drainCloses, (uint32_t) 0);
+  CHECK(arkConnectionStats.drainedBytes > 10000);
+}
+
+TEST(connection_is_closed_when_the_rest_of_a_page_takes_longer_than_a_new_one) {
+  countThenWallet(2);
+  CHECK_EQ(arkConnectionStats.connects, (uint32_t) 2);
+  CHECK_EQ(arkConnectionStats.drainCloses, (uint32_t) 1);
+}
@@ -0,0 +1,181 @@
+/********************************************************************************
+  Full rental cycles against the fake relays, MQTT broker and GPS
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+TEST(boots_to_available) {
+  host::parkedGps();
+  REQUIRE(host::bootToAvailable());
+  CHECK(scooterRental.sessionID_QRcode[0] != '\0');
+  CHECK(host::display().pixels > 0);
+}
+
+TEST(wallet_keys_match_secrets) {
+  host::ark::Keys keys = host::ark::keysFromPassphrase(PASSPHRASE);
+  CHECK(host::ark::address(keys.publicKey, BRIDGECHAIN_VERSION) == ArkAddress);
+  CHECK(host::ark::toHex(keys.publicKey, 33) == ArkPublicKey);
+}
+
+TEST(rental_cycle_settles_on_chain) {
+  host::parkedGps();
+  REQUIRE(host::bootToAvailable());
+  std::string firstSession = scooterRental.sessionID_QRcode;
+  uint64_t nonce = host::arkChain().nonce;
+  REQUIRE(host::runRentalCycle(30));
+  CHECK(host::arkChain().accepted == 1);
+  CHECK(std::string(scooterRental.sessionID_QRcode) != firstSession);
+  host::runFor(10000);
+  CHECK_EQ(host::arkChain().nonce, nonce + 1);
+  CHECK(host::arkChain().pool.empty());
+}
+
+static size_t receivedPolls() {
+  size_t polls = 0;
+  for (const std::unique_ptr<host::ArkRelay> &relay : host::relays()) {
+    polls += relay->count("GET", "/api/wallets/" + std::string(ArkAddress) + "/transactions/received");
+  }
+  return polls;
+}
+
+TEST(polls_every_8s_until_a_notification_arrives) {
+  host::parkedGps();
+  REQUIRE(host::bootToAvailable());
+  //subscribed, but the bridge never publishes
+  size_t polls = receivedPolls();
+  host::runFor(80000);
+  CHECK(receivedPolls() - polls >= 9);
+
+  host::mqtt().deliver(MQTT_Notify_Topic, "{\"id\":\"00\",\"type\":0,\"typeGroup\":1}");
+  host::runFor(1000);
+  polls = receivedPolls();
+  host::runFor(80000);
+  CHECK(receivedPolls() - polls <= 2);
+}
+
+TEST(unlocks_within_a_poll_without_notifications) {
+  host::parkedGps();
+  REQUIRE(host::bootToAvailable());
+  host::rentScooter(30);
+  uint64_t confirmed_us = host::arkChain().blockAfter(host::arkChain().received.back().at_us);
+  REQUIRE(host::runUntil([] { return state == STATE_5; }, 30000));
+  CHECK(host::now() - confirmed_us <= (uint64_t) UpdateInterval_RentalStartSearch * 1000 + 1000000);
+}
+
+TEST(next_qrcode_holds_the_end_of_the_ride) {
+  //rides north 10 microdegrees per second from Edmonton
+  std::shared_ptr<host::GpsRoute> route = host::parkedGps();
+  route->position = [](uint64_t now_us) {
+    return host::GpsPosition{53535352 + (int32_t) (now_us / 100000), -113277912, 5.0f, true, 8};
+  };
+  REQUIRE(host::bootToAvailable());
+  std::string firstSession = scooterRental.sessionID_QRcode;
+  REQUIRE(host::runRentalCycle(30));
+
+  //the session was prepared once during the ride and the QRcode encodes where the ride ended
+  CHECK_EQ(networkJobs[JOB_NEXT_SESSION].runs, (uint32_t) 1);
+  CHECK(std::string(scooterRental.sessionID_QRcode) != firstSession);
+  CHECK(strstr(nextSession.QRcodeText, scooterRental.sessionID_QRcode) != nullptr);
+  char latitude[COORDINATE_TEXT_SIZE];
+  formatMicrodegrees(scooterRental.QRLatitude, latitude, sizeof(latitude));
+  CHECK(strstr(nextSession.QRcodeText, (std::string("&lat=") + latitude).c_str()) != nullptr);
+  CHECK(scooterRental.QRLatitude >= scooterRental.endLatitude);
+}
+
+TEST(ride_snapshot_follows_the_rental) {
+  host::parkedGps();
+  REQUIRE(host::bootToAvailable());
+  struct rideSnapshot ride;
+  getRideSnapshot(ride);
+  CHECK_EQ(ride.rentalStatus, 'A');
+
+  host::rentScooter(30);
+  REQUIRE(host::runUntil([] { return state == STATE_5; }, 30000));
+  host::runFor(1000);
+  getRideSnapshot(ride);
+  CHECK_EQ(ride.state, (uint8_t) STATE_5);
+  CHECK_EQ(ride.rentalStatus, 'R');
+  CHECK_EQ(ride.rideTime_start_ms, rideTime_start_ms);
+  CHECK_EQ(ride.rideTime_length_ms, rideTime_length_ms);
+
+  REQUIRE(host::runUntil([] { return state == STATE_3; }, 60000));
+  host::runFor(1000);
+  getRideSnapshot(ride);
+  CHECK_EQ(ride.rentalStatus, 'A');
+}
+
+//power loss after the RentalFinish was written to the outbox and before the journal marked the rental as finished
+TEST(reboot_after_the_finish_is_queued_sends_it_once) {
+  host::parkedGps();
+  REQUIRE(host::rebootAfter([] {
+    REQUIRE(host::bootToAvailable());
+    host::rentScooter(600);
+    REQUIRE(host::runUntil([] { return state == STATE_5; }, 30000));
+    SendTransaction_RentalFinish();
+  }));
+  REQUIRE(host::serialLines("Resuming rental").empty());
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 0);
+
+  host::boot();
+  REQUIRE(host::runUntil([] { return (state == STATE_4) && (host::arkChain().accepted > 0); }, 60000));
+  host::runFor(30000);
+  CHECK(host::serialLines("Resuming rental").empty());
+  CHECK(!journal.rentalActive);
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 1);
+  CHECK_EQ(bridgechainWallet.walletNonce_Uint64, (uint64_t) 1);
+}
+
+TEST(reboot_during_a_ride_resumes_it) {
+  host::parkedGps();
+  REQUIRE(host::rebootAfter([] {
+    REQUIRE(host::bootToAvailable());
+    host::rentScooter(60);
+    REQUIRE(host::runUntil([] { return state == STATE_5; }, 30000));
+    host::runFor(20000);
+  }));
+  host::boot();
+  REQUIRE(host::runUntil([] { return state == STATE_5; }, 10000));
+  CHECK(!host::serialLines("Resuming rental").empty());
+  REQUIRE(host::runUntil([] { return (state == STATE_4) && (host::arkChain().accepted > 0); }, 120000));
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) 1);
+}
+
+//the EEPROM copy of the nonce is the fallback when SPIFFS cannot be mounted
+TEST(eeprom_nonce_follows_the_journal) {
+  host::parkedGps();
+  REQUIRE(host::bootToAvailable());
+  REQUIRE(host::runRentalCycle(30));
+  CHECK_EQ(bridgechainWallet.walletNonce_Uint64, (uint64_t) 1);
+  CHECK_EQ(loadNonceEEPROM(), (uint64_t) 1);
+}
+
+//a record of the firmware with float coordinates: the nonce and lastRXpage are kept, its rental is not resumed
+TEST(journal_of_the_float_firmware_keeps_the_nonce) {
+  {
+    host::HeapAccountingOff internal;
+    struct journalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = JOURNAL_MAGIC_V1;
+    record.sequence = 41;
+    record.lastRXpage = 3;
+    record.nonce = 5;
+    record.rentalActive = true;
+    record.rideLength_ms = 600000;
+    const size_t crcStart = offsetof(struct journalRecord, crc) + sizeof(record.crc);
+    record.crc = outboxCRC((const uint8_t *) &record + crcStart, sizeof(record) - crcStart);
+    std::vector<uint8_t> file(JOURNAL_SLOTS * JOURNAL_SLOT_SIZE, 0);
+    memcpy(file.data() + (record.sequence % JOURNAL_SLOTS) * JOURNAL_SLOT_SIZE, &record, sizeof(record));
+    host::flash().files[JOURNAL_FILE] = file;
+  }
+  host::parkedGps();
+  REQUIRE(host::bootToAvailable());
+  CHECK(!journal.rentalActive);
+  CHECK_EQ(journal.sequence, (uint32_t) 42);
+  CHECK_EQ(bridgechainWallet.walletNonce_Uint64, (uint64_t) 5);
+
+  File file = SPIFFS.open(JOURNAL_FILE, FILE_READ);
+  struct journalRecord record;
+  REQUIRE(journalReadRecord(file, journal.sequence % JOURNAL_SLOTS, record));
+  file.close();
+  CHECK_EQ(record.magic, JOURNAL_MAGIC);
+}
@@ -0,0 +1,104 @@
+/********************************************************************************
+  RentalFinish serialization: a full ride track (RIDE_TRACK_MAX_POINTS points) west of Greenwich and south of the
+  equator is signed by SendTransaction_RentalFinish(), accepted by the relay and decoded to the same microdegrees.
+  A negative coordinate is sent as the 64-bit two's complement of its microdegrees.
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+struct ride {
+  int32_t latitude;
+  int32_t longitude;
+};
+static const struct ride RIDES[] = {
+  {53535352, -113277912},           // Edmonton: north, west
+  {-33448890, -70669265},           // Santiago: south, west
+};
+static const int RIDE_COUNT = sizeof(RIDES) / sizeof(RIDES[0]);
+
+static volatile bool taskDone = false;
+static struct rideTrackBuffer tracks[RIDE_COUNT];
+
+static void finishTask(void *) {
+  initProfiler();
+  initRelayPool();
+  while (!WiFiMQTTclient.isWifiConnected()) {
+    WiFiMQTTclient.loop();
+    delay(100);
+  }
+  initOutbox();
+
+  strcpy(scooterRental.senderAddress, host::riderAddress(1).c_str());
+  for (int r = 0; r < RIDE_COUNT; r++) {
+    for (int i = 0; i < 32; i++) {
+      scooterRental.sessionID_QRcode_byte[i] = r * 32 + i;
+    }
+    //a ride to the south-west: every point has a different latitude and longitude
+    rideTrack.count = RIDE_TRACK_MAX_POINTS;
+    for (int i = 0; i < RIDE_TRACK_MAX_POINTS; i++) {
+      rideTrack.points[i] = {1589222400u + 60u * i, RIDES[r].latitude - 1234 * i, RIDES[r].longitude - 2345 * i};
+    }
+    tracks[r] = rideTrack;
+    SendTransaction_RentalFinish();
+    drainOutbox();
+  }
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(rental_finish_keeps_the_track_in_every_hemisphere) {
+  host::mqtt().brokerAvailable = false;
+  xTaskCreatePinnedToCore(finishTask, "finishTask", 8192, NULL, 1, NULL, 0);
+  REQUIRE(host::runUntil([] { return taskDone; }, 600000));
+  CHECK_EQ(host::arkChain().accepted, (uint64_t) RIDE_COUNT);
+  CHECK_EQ(outbox.pendingTransactions, 0);
+  CHECK_EQ(outboxStats.appended, (uint32_t) RIDE_COUNT);       //the parameters and the JSON fit in an outbox slot
+
+  //the transactions as the relays received them (each one is broadcast to ARK_BROADCAST_RELAYS relays)
+  host::HeapAccountingOff internal;
+  std::vector<host::ark::RentalFinish> received;
+  std::vector<std::string> ids;
+  std::string bodies;
+  for (const std::unique_ptr<host::ArkRelay> &relay : host::relays()) {
+    for (const host::ArkRelay::Request &request : relay->requests) {
+      size_t start = request.body.find("{\"version\"");
+      host::ark::RentalFinish transaction;
+      if ((request.method != "POST") || (start == std::string::npos)) {
+        continue;
+      }
+      REQUIRE(host::ark::fromJson(request.body.substr(start, request.body.size() - start - 2), transaction));
+      if (std::find(ids.begin(), ids.end(), host::ark::transactionId(transaction)) == ids.end()) {
+        ids.push_back(host::ark::transactionId(transaction));
+        received.push_back(transaction);
+        bodies += request.body;
+      }
+    }
+  }
+  std::stable_sort(received.begin(), received.end(), [](const host::ark::RentalFinish &a, const host::ark::RentalFinish &b) {
+    return a.nonce < b.nonce;
+  });
+  REQUIRE(received.size() == (size_t) RIDE_COUNT);
+
+  for (int r = 0; r < RIDE_COUNT; r++) {
+    const host::ark::RentalFinish &transaction = received[r];
+    CHECK(host::ark::verifyTransaction(transaction));
+    CHECK_EQ(transaction.sessionId[31], (uint8_t) (r * 32 + 31));
+    REQUIRE(transaction.gps.size() == (size_t) RIDE_TRACK_MAX_POINTS);
+    for (int i = 0; i < RIDE_TRACK_MAX_POINTS; i++) {
+      CHECK_EQ(transaction.gps[i].timestamp, tracks[r].points[i].timestamp);
+      CHECK_EQ((int64_t) transaction.gps[i].latitude, (int64_t) tracks[r].points[i].latitude);
+      CHECK_EQ((int64_t) transaction.gps[i].longitude, (int64_t) tracks[r].points[i].longitude);
+    }
+    //AIP-11 asset: each point is a uint32 timestamp and two uint64 coordinates, little endian
+    std::vector<uint8_t> bytes = host::ark::serialize(transaction, false);
+    uint8_t encoded[8];
+    uint64_t longitude = (uint64_t) (int64_t) tracks[r].points[0].longitude;
+    for (int b = 0; b < 8; b++) {
+      encoded[b] = (uint8_t) (longitude >> (8 * b));
+    }
+    CHECK(std::search(bytes.begin(), bytes.end(), encoded, encoded + 8) != bytes.end());
+  }
+
+  //18446744073596273704 is -113277912
+  CHECK(bodies.find("\"longitude\":\"18446744073596273704\"") != std::string::npos);
+}
@@ -0,0 +1,203 @@
+/********************************************************************************
+  Job scheduler: the timer wheel runs each job on its tick across the three levels, clamps deadlines beyond the last
+  level, coalesces the periods missed in a stall, adds jitter, lets a one-shot job start itself again and returns
+  the time until the next job. The test drives its own scheduler with the simulated millis(), outside the tasks
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+enum TestJob_enum {JOB_A, JOB_B, JOB_C, JOB_D, TEST_JOBS};
+static struct schedulerJob testJobs[TEST_JOBS];
+static struct scheduler testScheduler;
+static uint32_t start_ms;
+static std::vector<uint32_t> runs_ms[TEST_JOBS];   // time of each run since start_ms
+static int restarts = 0;                            // runs of JOB_D that start it again
+
+static void runA() {
+  runs_ms[JOB_A].push_back(millis() - start_ms);
+}
+
+static void runB() {
+  runs_ms[JOB_B].push_back(millis() - start_ms);
+}
+
+static void runC() {
+  runs_ms[JOB_C].push_back(millis() - start_ms);
+}
+
+static void runD() {
+  runs_ms[JOB_D].push_back(millis() - start_ms);
+  if (restarts > 0) {
+    restarts--;
+    schedulerStart(testScheduler, JOB_D, 300);
+  }
+}
+
+static void addJobs(uint32_t periodA, uint32_t periodB, uint32_t periodC, uint32_t jitter_ms = 0, uint32_t deadline_ms = 0) {
+  start_ms = millis();
+  initScheduler(testScheduler, testJobs, TEST_JOBS);
+  schedulerAdd(testScheduler, JOB_A, "a", runA, periodA, jitter_ms, deadline_ms, -1);
+  schedulerAdd(testScheduler, JOB_B, "b", runB, periodB, jitter_ms, deadline_ms, -1);
+  schedulerAdd(testScheduler, JOB_C, "c", runC, periodC, jitter_ms, deadline_ms, -1);
+  schedulerAdd(testScheduler, JOB_D, "d", runD, 0, 0, 0, -1);
+}
+
+//a task pass every tick
+static void runFor(uint32_t ms) {
+  for (uint32_t elapsed = 0; elapsed < ms; elapsed += SCHEDULER_TICK_MS) {
+    delay(SCHEDULER_TICK_MS);
+    schedulerRun(testScheduler);
+  }
+}
+
+TEST(jobs_cascade_from_levels_1_and_2_and_run_on_their_tick) {
+  addJobs(100, 5000, 60000);
+  for (int job = JOB_A; job <= JOB_C; job++) {
+    schedulerStart(testScheduler, job, testJobs[job].period_ms);
+  }
+  CHECK_EQ(testJobs[JOB_A].level, (uint8_t) 0);     //10 ticks
+  CHECK_EQ(testJobs[JOB_B].level, (uint8_t) 1);     //500 ticks
+  CHECK_EQ(testJobs[JOB_C].level, (uint8_t) 2);     //6000 ticks
+
+  runFor(130000);
+  const uint32_t periods[3] = {100, 5000, 60000};
+  for (int job = JOB_A; job <= JOB_C; job++) {
+    CHECK_EQ(runs_ms[job].size(), (size_t) (130000 / periods[job]));
+    for (size_t i = 0; i < runs_ms[job].size(); i++) {
+      CHECK_EQ(runs_ms[job][i], (uint32_t) ((i + 1) * periods[job]));
+    }
+    CHECK_EQ(testJobs[job].coalesced, (uint32_t) 0);
+    CHECK(testJobs[job].armed);
+  }
+}
+
+TEST(deadline_beyond_the_last_level_is_clamped_and_placed_again) {
+  const uint32_t wheelSpan_ms = (1 << (SCHEDULER_WHEEL_BITS * SCHEDULER_LEVELS)) * SCHEDULER_TICK_MS;   //43 minutes
+  const uint32_t delay_ms = 3 * wheelSpan_ms / 2;
+  addJobs(0, 0, 0);
+  schedulerStart(testScheduler, JOB_A, delay_ms);
+  CHECK_EQ(testJobs[JOB_A].level, (uint8_t) (SCHEDULER_LEVELS - 1));
+
+  //the task sleeps as long as schedulerRun() says, at most 1 second
+  while (runs_ms[JOB_A].empty() && (millis() - start_ms < 2 * wheelSpan_ms)) {
+    delay(min(schedulerRun(testScheduler), (uint32_t) 1000));
+  }
+  REQUIRE(runs_ms[JOB_A].size() == (size_t) 1);
+  CHECK_EQ(runs_ms[JOB_A][0], delay_ms);
+  CHECK(!testJobs[JOB_A].armed);
+}
+
+TEST(overdue_periods_are_coalesced_into_one_run) {
+  addJobs(100, 0, 0, 0, 50);
+  schedulerStart(testScheduler, JOB_A, 100);
+  runFor(100);
+  REQUIRE(runs_ms[JOB_A].size() == (size_t) 1);
+
+  //loop() is stalled for 1050 ms: the runs due at 200, 300 ... 1100 ms are merged into the run at 1150 ms
+  delay(1050);
+  schedulerRun(testScheduler);
+  REQUIRE(runs_ms[JOB_A].size() == (size_t) 2);
+  CHECK_EQ(runs_ms[JOB_A][1], (uint32_t) 1150);
+  CHECK_EQ(testJobs[JOB_A].coalesced, (uint32_t) 9);
+  CHECK_EQ(testJobs[JOB_A].overruns, (uint32_t) 1);
+  CHECK_EQ(testJobs[JOB_A].maxLate_ms, (uint32_t) 950);
+
+  //the next run is one period after the coalesced run
+  runFor(300);
+  REQUIRE(runs_ms[JOB_A].size() == (size_t) 5);
+  CHECK_EQ(runs_ms[JOB_A][2], (uint32_t) 1250);
+  CHECK_EQ(runs_ms[JOB_A][4], (uint32_t) 1450);
+  CHECK_EQ(testJobs[JOB_A].runs, (uint32_t) 5);
+}
+
+TEST(jitter_delays_each_run_without_moving_the_period) {
+  addJobs(1000, 0, 0, 250);
+  schedulerStart(testScheduler, JOB_A, 1000);
+  runFor(100500);
+  REQUIRE(runs_ms[JOB_A].size() == (size_t) 100);
+  uint32_t smallest = UINT32_MAX;
+  uint32_t largest = 0;
+  for (size_t i = 0; i < runs_ms[JOB_A].size(); i++) {
+    uint32_t nominal = (i + 1) * 1000;
+    CHECK(runs_ms[JOB_A][i] >= nominal);
+    uint32_t jitter = runs_ms[JOB_A][i] - nominal;
+    CHECK(jitter <= 250);
+    smallest = min(smallest, jitter);
+    largest = max(largest, jitter);
+  }
+  CHECK(largest - smallest >= 100);             //the delay is drawn again for each run
+  CHECK_EQ(testJobs[JOB_A].coalesced, (uint32_t) 0);
+}
+
+TEST(one_shot_job_started_again_from_its_own_run) {
+  addJobs(0, 0, 0);
+  restarts = 3;
+  schedulerStart(testScheduler, JOB_D, 100);
+  runFor(2000);
+  REQUIRE(runs_ms[JOB_D].size() == (size_t) 4);
+  CHECK_EQ(runs_ms[JOB_D][0], (uint32_t) 100);
+  CHECK_EQ(runs_ms[JOB_D][1], (uint32_t) 400);
+  CHECK_EQ(runs_ms[JOB_D][2], (uint32_t) 700);
+  CHECK_EQ(runs_ms[JOB_D][3], (uint32_t) 1000);
+  CHECK(!testJobs[JOB_D].armed);
+  CHECK_EQ(testJobs[JOB_D].runs, (uint32_t) 4);
+}
+
+TEST(run_returns_the_time_until_the_next_job) {
+  addJobs(0, 0, 0);
+  CHECK_EQ(schedulerRun(testScheduler), (uint32_t) 0xFFFFFFFF);    //no job is armed
+
+  schedulerStart(testScheduler, JOB_A, 250);
+  schedulerStart(testScheduler, JOB_B, 100);
+  CHECK_EQ(schedulerRun(testScheduler), (uint32_t) 100);
+  delay(35);                                    //between two ticks
+  CHECK_EQ(schedulerRun(testScheduler), (uint32_t) 65);
+  delay(65);
+  CHECK_EQ(schedulerRun(testScheduler), (uint32_t) 150);
+  CHECK_EQ(runs_ms[JOB_B].size(), (size_t) 1);
+
+  //a job that is already due is run by this pass, the next one by the following pass without sleeping
+  delay(200);
+  CHECK_EQ(schedulerRun(testScheduler), (uint32_t) 0xFFFFFFFF);
+  CHECK_EQ(runs_ms[JOB_A].size(), (size_t) 1);
+  schedulerStart(testScheduler, JOB_C, 0);
+  CHECK_EQ(schedulerRun(testScheduler), (uint32_t) 0);
+}
+
+TEST(stall_longer_than_a_level_1_span_runs_every_job_once) {
+  const uint32_t level1Span_ms = (1 << (SCHEDULER_WHEEL_BITS * 2)) * SCHEDULER_TICK_MS;   //41 seconds
+  addJobs(100, 5000, 60000);
+  for (int job = JOB_A; job <= JOB_C; job++) {
+    schedulerStart(testScheduler, job, testJobs[job].period_ms);
+  }
+  schedulerStart(testScheduler, JOB_D, 20000);
+  runFor(1000);
+  CHECK_EQ(runs_ms[JOB_A].size(), (size_t) 10);
+
+  //the wheel is advanced by 2.5 level 1 spans in one pass
+  delay(5 * level1Span_ms / 2);
+  schedulerRun(testScheduler);
+  uint32_t stallEnd_ms = millis() - start_ms;
+  CHECK_EQ(runs_ms[JOB_A].size(), (size_t) 11);
+  CHECK_EQ(runs_ms[JOB_B].size(), (size_t) 1);
+  CHECK_EQ(runs_ms[JOB_C].size(), (size_t) 1);
+  CHECK_EQ(runs_ms[JOB_D].size(), (size_t) 1);
+  CHECK_EQ(runs_ms[JOB_A].back(), stallEnd_ms);
+  CHECK_EQ(runs_ms[JOB_C].back(), stallEnd_ms);
+  CHECK_EQ(testJobs[JOB_A].coalesced, (stallEnd_ms - 1100) / 100);
+  CHECK_EQ(testJobs[JOB_B].coalesced, (stallEnd_ms - 5000) / 5000);
+  CHECK_EQ(testJobs[JOB_C].coalesced, (uint32_t) 0);
+
+  //no job was lost and they run one period after the stall, or on their nominal tick if that comes first
+  for (int job = JOB_A; job <= JOB_C; job++) {
+    CHECK(testJobs[job].armed);
+  }
+  runFor(60000);
+  CHECK_EQ(runs_ms[JOB_A].size(), (size_t) (11 + 600));
+  CHECK_EQ(runs_ms[JOB_A][11], stallEnd_ms + 100);
+  CHECK_EQ(runs_ms[JOB_B].size(), (size_t) (1 + 12));
+  CHECK_EQ(runs_ms[JOB_B][1], stallEnd_ms + 5000);
+  CHECK_EQ(runs_ms[JOB_C].size(), (size_t) 2);
+  CHECK_EQ(runs_ms[JOB_C][1], (uint32_t) 120000);   //it had not missed a whole period so it keeps its nominal tick
+  CHECK_EQ(runs_ms[JOB_D].size(), (size_t) 1);
+}
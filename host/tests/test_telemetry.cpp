@@ -0,0 +1,97 @@
+/********************************************************************************
+  Batched telemetry: the Merkle root of a batch and the batches kept while MQTT is disconnected
+********************************************************************************/
+#include "sketch.cpp"
+#include "test.h"
+
+static struct telemetryBatchBuffer makeBatch(int count) {
+  struct telemetryBatchBuffer batch;
+  batch.count = count;
+  for (int i = 0; i < count; i++) {
+    batch.samples[i] = {1589222400u + i, 53538493 + i, -113275896 - i, (uint16_t) (74 + i), 1, 5, 96, 'R'};
+  }
+  return batch;
+}
+
+//the tree of tools/verify_telemetry_batch.py
+static std::string referenceRoot(const struct telemetryBatchBuffer &batch) {
+  host::HeapAccountingOff internal;
+  std::vector<std::vector<uint8_t>> level;
+  for (int i = 0; i < batch.count; i++) {
+    char text[TELEMETRY_SAMPLE_TEXT_SIZE];
+    std::string leaf = std::string(1, '\x00') + std::string(text, formatTelemetrySample(batch.samples[i], text, sizeof(text)));
+    std::vector<uint8_t> hash(32);
+    host::ark::sha256(leaf.data(), leaf.size(), hash.data());
+    level.push_back(hash);
+  }
+  while (level.size() > 1) {
+    std::vector<std::vector<uint8_t>> parents;
+    for (size_t i = 0; i + 1 < level.size(); i += 2) {
+      std::vector<uint8_t> pair(1, 0x01);
+      pair.insert(pair.end(), level[i].begin(), level[i].end());
+      pair.insert(pair.end(), level[i + 1].begin(), level[i + 1].end());
+      std::vector<uint8_t> hash(32);
+      host::ark::sha256(pair.data(), pair.size(), hash.data());
+      parents.push_back(hash);
+    }
+    if (level.size() % 2) {
+      parents.push_back(level.back());
+    }
+    level = parents;
+  }
+  return host::ark::toHex(level[0].data(), 32);
+}
+
+static std::string sketchRoot(const struct telemetryBatchBuffer &batch) {
+  uint8_t root[32];
+  telemetryMerkleRoot(batch, root);
+  return host::ark::toHex(root, sizeof(root));
+}
+
+TEST(merkle_root_matches_the_verifier) {
+  for (int count = 1; count <= TELEMETRY_BATCH_SIZE; count++) {
+    struct telemetryBatchBuffer batch = makeBatch(count);
+    CHECK(sketchRoot(batch) == referenceRoot(batch));
+  }
+}
+
+TEST(merkle_root_of_a_repeated_last_sample_differs) {
+  //CVE-2012-2459: with the odd node paired with itself [a, b, c] and [a, b, c, c] had the same root
+  struct telemetryBatchBuffer odd = makeBatch(3);
+  struct telemetryBatchBuffer repeated = odd;
+  repeated.samples[3] = repeated.samples[2];
+  repeated.count = 4;
+  CHECK(sketchRoot(odd) != sketchRoot(repeated));
+}
+
+static volatile bool taskDone = false;
+static uint32_t appended;
+static struct outboxEntryHeader stored;
+
+static void disconnectedTask(void *) {
+  initProfiler();
+  initOutbox();
+  uint32_t head = outbox.head;
+  struct telemetryBatchBuffer batch = makeBatch(TELEMETRY_BATCH_SIZE);
+  xQueueSend(telemetryBatchQueue, &batch, 0);
+  send_MQTTbatch();                     //MQTT was never connected
+  appended = outbox.head - head;
+
+  File file = SPIFFS.open(OUTBOX_FILE, FILE_READ);
+  struct telemetryBatchBuffer read;
+  if (!outboxReadEntry(file, head, stored, &read) || (read.count != TELEMETRY_BATCH_SIZE)) {
+    stored.type = 0;
+  }
+  file.close();
+  taskDone = true;
+  vTaskDelete(NULL);
+}
+
+TEST(batch_is_kept_in_the_outbox_while_disconnected) {
+  telemetryBatchQueue = xQueueCreate(2, sizeof(struct telemetryBatchBuffer));
+  xTaskCreatePinnedToCore(disconnectedTask, "disconnectedTask", 8192, NULL, 1, NULL, 0);
+  REQUIRE(host::runUntil([] { return taskDone; }, 60000));
+  CHECK_EQ(appended, (uint32_t) 1);
+  CHECK_EQ(stored.type, (uint16_t) OUTBOX_TELEMETRY);
+  CHECK(host::mqtt().on(MQTT_Batch_Topic).empty());
+}
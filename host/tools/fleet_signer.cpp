@@ -0,0 +1,99 @@
+/********************************************************************************
+  Signer of the fleet load simulator (tools/fleet_load_simulator.py)
+  Signs the MQTT packets and the RentalFinish transactions of the virtual scooters the way the firmware does: the
+  packet with Message::sign() (publish_MQTTpacket()) and the transaction with the ScooterRentalFinish builder and the
+  network of the sketch (SendTransaction_RentalFinish()). Each virtual scooter has its own passphrase.
+  One request per line on stdin, fields separated by tabs. One answer per line on stdout, or "error\t<reason>".
+    key       <passphrase>                                       -> <address>\t<public key hex>
+    message   <passphrase>  <text>                               -> <DER signature hex> of SHA256(text)
+    finish    <passphrase>  <nonce>  <recipient>  <session id hex (64)>  <timestamp,latitude,longitude;...>
+                                                                 -> <transaction JSON> (microdegrees, south/west < 0)
+    verify    <transaction JSON>                                 -> ok | invalid
+  usage: fleet_signer
+********************************************************************************/
+#include <iostream>
+#include <sstream>
+#include "sketch.cpp"
+
+static std::vector<std::string> splitFields(const std::string &line, char separator) {
+  std::vector<std::string> fields;
+  std::stringstream stream(line);
+  std::string field;
+  while (std::getline(stream, field, separator)) {
+    fields.push_back(field);
+  }
+  return fields;
+}
+
+static std::string keyAnswer(const std::string &passphrase) {
+  host::ark::Keys keys = host::ark::keysFromPassphrase(passphrase);
+  return host::ark::address(keys.publicKey, BRIDGECHAIN_VERSION) + "\t" + host::ark::toHex(keys.publicKey, sizeof(keys.publicKey));
+}
+
+static std::string messageAnswer(const std::string &passphrase, const std::string &text) {
+  Message message;
+  message.sign(text, passphrase);
+  return host::ark::toHex(message.signature.data(), message.signature.size());
+}
+
+static std::string finishAnswer(const std::vector<std::string> &fields) {
+  std::vector<uint8_t> sessionId = host::ark::fromHex(fields[4]);
+  if (sessionId.size() != 32) {
+    return "error\tsession id is not 32 bytes";
+  }
+  std::vector<std::string> points = splitFields(fields[5], ';');
+  if (points.empty() || (points.size() > RIDE_TRACK_MAX_POINTS)) {
+    return "error\tthe track must have 1 to RIDE_TRACK_MAX_POINTS points";
+  }
+
+  //SendTransaction_RentalFinish()
+  builder::radians::ScooterRentalFinish rentalFinishBuilder(cfg);
+  rentalFinishBuilder.recipientId(fields[3].c_str());
+  for (size_t i = 0; i < points.size(); i++) {
+    std::vector<std::string> point = splitFields(points[i], ',');
+    if (point.size() != 3) {
+      return "error\ta point is timestamp,latitude,longitude";
+    }
+    rentalFinishBuilder.timestamp((uint32_t) strtoul(point[0].c_str(), NULL, 10), i)
+                       .latitude((uint64_t) (int64_t) strtol(point[1].c_str(), NULL, 10), i)
+                       .longitude((uint64_t) (int64_t) strtol(point[2].c_str(), NULL, 10), i);
+  }
+  auto transaction = rentalFinishBuilder.sessionId(sessionId.data())
+                     .containsRefund(false)
+                     .fee(10000000)
+                     .nonce(strtoull(fields[2].c_str(), NULL, 10))
+                     .amount(1)
+                     .sign(fields[1].c_str())
+                     .build();
+  return transaction.toJson();
+}
+
+static std::string verifyAnswer(const std::string &json) {
+  host::ark::RentalFinish transaction;
+  return (host::ark::fromJson(json, transaction) && host::ark::verifyTransaction(transaction)) ? "ok" : "invalid";
+}
+
+int main() {
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    std::vector<std::string> fields = splitFields(line, '\t');
+    std::string answer;
+    if ((fields.size() == 2) && (fields[0] == "key")) {
+      answer = keyAnswer(fields[1]);
+    }
+    else if ((fields.size() == 3) && (fields[0] == "message")) {
+      answer = messageAnswer(fields[1], fields[2]);
+    }
+    else if ((fields.size() == 6) && (fields[0] == "finish")) {
+      answer = finishAnswer(fields);
+    }
+    else if ((fields.size() == 2) && (fields[0] == "verify")) {
+      answer = verifyAnswer(fields[1]);
+    }
+    else {
+      answer = "error\tunknown request";
+    }
+    std::cout << answer << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Merge the .ino files of the sketch into one C++ file, like the Arduino builder does.
+
+<Arduino.h> is included first, Ark_Scooter.ino follows and then the other tabs in alphabetical order. A prototype is generated for every
+function defined at file scope and inserted at the start of the hand-written prototype block of Ark_Scooter.ino
+("void setup();"), so a function can be called before it is defined. #line directives keep the compiler
+messages pointing at the .ino files.
+
+usage: merge_sketch.py <sketch directory> <output file>
+"""
+import os
+import re
+import sys
+
+MAIN = "Ark_Scooter.ino"
+DEFINITION = re.compile(r"^([A-Za-z_][\w\s\*&:<>,]*?[\s\*&])([A-Za-z_]\w*)\s*\(([^;{}]*)\)\s*\{\s*(//.*)?$")
+KEYWORDS = {"if", "for", "while", "switch", "return", "else"}
+
+
+def prototypes(lines):
+    found = []
+    for line in lines:
+        match = DEFINITION.match(line.rstrip("\n"))
+        if not match or "::" in match.group(1) or match.group(2) in KEYWORDS:
+            continue
+        found.append("%s%s(%s);" % (match.group(1), match.group(2), match.group(3)))
+    return found
+
+
+def main():
+    sketch, output = sys.argv[1], sys.argv[2]
+    tabs = [MAIN] + sorted(f for f in os.listdir(sketch) if f.endswith(".ino") and f != MAIN)
+    sources = {}
+    for tab in tabs:
+        with open(os.path.join(sketch, tab), encoding="utf-8", errors="replace") as f:
+            sources[tab] = f.readlines()
+
+    generated = []
+    for tab in tabs:
+        generated += prototypes(sources[tab])
+
+    main_lines = sources[MAIN]
+    insert = next(i for i, line in enumerate(main_lines) if line.strip() == "void setup();")
+
+    out = ["#include <Arduino.h>\n"]
+    path = os.path.abspath(os.path.join(sketch, MAIN))
+    out.append('#line 1 "%s"\n' % path)
+    out += main_lines[:insert]
+    out += [p + "\n" for p in generated]
+    out.append('#line %d "%s"\n' % (insert + 1, path))
+    out += main_lines[insert:]
+    for tab in tabs[1:]:
+        out.append('\n#line 1 "%s"\n' % os.path.abspath(os.path.join(sketch, tab)))
+        out += sources[tab]
+
+    text = "".join(out)
+    if os.path.exists(output):
+        with open(output, encoding="utf-8") as f:
+            if f.read() == text:
+                return
+    with open(output, "w", encoding="utf-8") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
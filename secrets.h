@@ -23,13 +23,64 @@
 //NOTE. Thingsboard Dashboard is hardcoded with this topic so if you adjust the wallet do not modify the topic.
 const char* MQTT_Base_Topic = "scooter/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/data";
 
+//--------------------------------------------
+// Transaction Notifications
+// The relay webhook->MQTT bridge (tools/webhook_mqtt_bridge.py) publishes on this topic when the wallet receives a transaction.
+// The scooter polls the relay immediately when a notification arrives. After the first notification on a connection,
+// polling every UpdateInterval_RentalStartSearch_Fallback is kept as a safety net.
+// Comment out to poll the relay every UpdateInterval_RentalStartSearch instead.
+#define ENABLE_MQTT_TX_NOTIFY
+const char* MQTT_Notify_Topic = "scooter/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/transactions";
+
+//--------------------------------------------
+// Batched Telemetry
+// A sample is collected every second and TELEMETRY_BATCH_SIZE samples are published together on MQTT_Batch_Topic with one signature.
+// The batches replace the packets on MQTT_Base_Topic (and MQTT_Delta_Topic), so the Node-RED flow must read MQTT_Batch_Topic.
+// MQTT_MAX_PACKET_SIZE in PubSubClient.h must be increased to 1536 (see README)
+// Uncomment to publish batches instead of the packets on MQTT_Base_Topic.
+//#define ENABLE_MQTT_BATCH_TELEMETRY
+const char* MQTT_Batch_Topic = "scooter/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/batch";
+
+//--------------------------------------------
+// Telemetry collected while MQTT is disconnected is stored in flash and published on this topic when the connection is back (see Outbox.ino)
+const char* MQTT_Backlog_Topic = "scooter/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/backlog";
+
+//--------------------------------------------
+// Adaptive Telemetry
+// The publish rate depends on the rental status and motion instead of a fixed UpdateInterval_MQTT_Publish.
+// Full signed packets (keyframes) are still published on MQTT_Base_Topic. Small updates relative to the last keyframe are published on MQTT_Delta_Topic.
+// Comment out to publish on MQTT_Base_Topic every UpdateInterval_MQTT_Publish.
+#define ENABLE_ADAPTIVE_TELEMETRY
+const char* MQTT_Delta_Topic = "scooter/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/delta";
+
+//--------------------------------------------
+// Diagnostics
+// A summary of the loop profiler (subsystem timings, Ark API requests, heap and stalls) is published every UpdateInterval_Diagnostics on this topic.
+// MQTT_MAX_PACKET_SIZE in PubSubClient.h must be increased to 1536 (see README)
+#define ENABLE_DIAGNOSTICS
+const char* MQTT_Diagnostics_Topic = "scooter/TRXA2NUACckkYwWnS9JRkATQA453ukAcD1/diagnostics";
+
+//--------------------------------------------
+// Geofences
+// Each GPS fix is looked up in the zones of geofences.h (no-ride, slow and parking zones). The result limits the speed (applySpeedLimit()),
+// shows a warning on the ride screen and is added to the MQTT packet as "zone". Generate geofences.h with tools/geofence_tool.py
+// The geofences.h of the repository has no zones (tools/geofences.geojson is an example map)
+#define ENABLE_GEOFENCE
+
+//--------------------------------------------
+// Verify the signature of each MQTT packet after signing it. This doubles the cost of signing so only use it for debugging.
+//#define DEBUG_VERIFY_MQTT_SIGNATURE
+
 //int8_t TIME_ZONE = -6;      //set timezone:  MST (use this in summer)
 int8_t TIME_ZONE = -7;        //set timezone:  MST (use this in winter)
 int16_t DST = 0;              //To enable Daylight saving time set it to 3600. Otherwise, set it to 0. This does not seem to work!!
 
-//Configure Bridgechain Relay
-const char* ARK_PEER = "37.34.60.90";  //RADIANS Testnet Peer
-int ARK_PORT = 4040;
+//Configure the Bridgechain relays: the relay pool (see RelayPool.ino). Reads go to the fastest synced relay and transactions are sent to several relays.
+//The first relay is the RADIANS Testnet Peer. Add more relays of the same bridgechain with their port at the same position, e.g.
+//  const char* ARK_RELAY_HOSTS[] = {"37.34.60.90", "192.168.1.20"};
+//  const int ARK_RELAY_PORTS[] = {4040, 4003};
+const char* ARK_RELAY_HOSTS[] = {"37.34.60.90"};
+const int ARK_RELAY_PORTS[] = {4040};
 
 // Configure Radians Wallet for Scooter
 const char* ArkAddress = "TRXA2NUACckkYwWnS9JRkATQA453ukAcD1";
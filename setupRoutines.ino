@@ -10,6 +10,16 @@ void setup()
   Serial.begin(115200);             // Initialize Serial Connection for debug
   while ( !Serial && millis() < 20 );
 
+  //--------------------------------------------
+  // create the objects shared by the network task and the display task
+  displayMutex = xSemaphoreCreateRecursiveMutex();
+  gpsMailbox = xQueueCreate(1, sizeof(struct gpsFix));
+  rideMailbox = xQueueCreate(1, sizeof(struct rideSnapshot));
+  telemetryBatchQueue = xQueueCreate(2, sizeof(struct telemetryBatchBuffer));
+  initProfiler();
+  initRelayPool();
+  initSchedulers();
+
   pinMode(LED_PIN, OUTPUT);         // initialize on board LED control pin as an output.
   digitalWrite(LED_PIN, HIGH);      // Turn LED on
 
@@ -20,6 +30,7 @@ void setup()
   // 3. undefine ERASE_FLASH and reprogram
 #ifdef ERASE_FLASH
   clearEEPROM();
+  clearJournal();
   while (true) {
   }
 #endif
@@ -55,11 +66,17 @@ void setup()
 
   //--------------------------------------------
   // 9600 NMEA is the default baud rate for Adafruit MTK GPS
+  GPSSerial.setRxBufferSize(GPS_SERIAL_RX_BUFFER_SIZE);   // must be set before the serial port is started
   GPS.begin(9600);
   GPS.sendCommand(PMTK_SET_NMEA_OUTPUT_RMCGGA);   // turn on RMC (recommended minimum) and GGA (fix data) including altitude
   GPS.sendCommand(PMTK_SET_NMEA_UPDATE_1HZ);      // 1 Hz update rate
   GPS.sendCommand(PGCMD_ANTENNA);                 // Request updates on antenna status, comment out to keep quiet
 
+  //--------------------------------------------
+  // Start the GPS ingestion task on core 1 at a higher priority than loop(), as soon as the port is open, so the
+  // sentences received during the rest of setup() wait in gpsRing instead of overflowing the UART receive buffer
+  xTaskCreatePinnedToCore(gpsIngestTask, "gpsIngest", 2048, NULL, 2, &gpsIngestTaskHandle, 1);
+
   delay(500);                             //show bootup screen for 500ms
 
   tft.setTextColor(WHITE);
@@ -77,6 +94,22 @@ void setup()
   UpdateBatteryStatus();                  // update battery voltage on the status bar
 
   GPSSerial.println(PMTK_Q_RELEASE);      // request firmware version from GPS module. This can be used as a way to detect if GPS module is connected and operational.
+
+  //--------------------------------------------
+  // Find the transactions and telemetry that were not sent before the last reboot
+  initOutbox();
+
+  //--------------------------------------------
+  // Load lastRXpage, the nonce and the rental in progress. Resume the rental if the scooter rebooted during a ride
+  initJournal();
+  if (journal.rentalActive) {
+    resumeRental();
+  }
+  publishRideSnapshot();
+
+  //--------------------------------------------
+  // Start the network task on core 0. loop() keeps running on core 1
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK_SIZE, NULL, 1, &networkTaskHandle, 0);
 }
 
 
@@ -86,6 +119,14 @@ void setup()
 ********************************************************************************/
 void onConnectionEstablished() {
 
+#ifdef ENABLE_MQTT_TX_NOTIFY
+  //--------------------------------------------
+  //  subscriptions are lost when the MQTT connection drops so subscribe every time we connect
+  WiFiMQTTclient.subscribe(MQTT_Notify_Topic, onTransactionNotification);
+  txNotificationPending = true;       //we may have missed notifications while disconnected. Check right away
+  txNotificationSeen = false;         //poll every UpdateInterval_RentalStartSearch until the bridge proves it is publishing
+#endif
+
   if (!initialConnectionEstablished_Flag) {     //execute this the first time we have established a WiFi and MQTT connection after powerup
     initialConnectionEstablished_Flag = true;
 
@@ -98,23 +139,17 @@ void onConnectionEstablished() {
     Serial.println("IP address: ");
     Serial.println(WiFi.localIP());
 
-    //--------------------------------------------
-    //  update WiFi and MQTT connection status bar
-    UpdateWiFiConnectionStatus();     //update WiFi status bar
-    UpdateMQTTConnectionStatus();     //update MQTT status bar
-
     //--------------------------------------------
     //  query Ark Node to see if it is synced
     //  we need some error handling here!!!!!!  What do we do if there is no ark node connected?
     //  if (checkArkNodeStatus()) {
 
     //--------------------------------------------
-    //  Retrieve Wallet Nonce and Balance
-    getWallet();
+    //  Retrieve Wallet Nonce and Balance and reconcile the local nonce with the relay
+    //  The local nonce and lastRXpage were loaded from the journal in setup()
+    reconcileNonce();
 
     //--------------------------------------------
-    //  Copy data stored in Flash into RAM
-    bridgechainWallet.lastRXpage = loadEEPROM();                 //load page number from eeprom
     if (bridgechainWallet.lastRXpage < 1) {
       bridgechainWallet.lastRXpage = 0;
     }
@@ -125,12 +160,12 @@ void onConnectionEstablished() {
 
     //TODO.  Sometimes I find that the API reads will return with no data even if there are additional transactions to be read
     // I think this occurs when the WiFi connection or my network is a bit flakey.
-    saveEEPROM(bridgechainWallet.lastRXpage);
+    markJournalDirty();
 
 
     //--------------------------------------------
-    //  query Ark Node to see if it is synced and update status bar
-    UpdateArkNodeConnectionStatus();
+    //  query every relay of the pool to see if it is synced. The display task updates the status bar
+    ARK_status = checkArkRelays(ARK_RELAY_COUNT);
 
     //--------------------------------------------
     scooterRental.rentalRate_Uint64 = RENTAL_RATE_UINT64;
@@ -138,23 +173,15 @@ void onConnectionEstablished() {
 
 
     //wait for time to sync from NTP servers
+    //the clock on the TFT display is updated by the display task once the time is synced
     while (time(nullptr) <= 100000) {
       delay(50);
     }
 
-    //--------------------------------------------
-    //  Update clock on TFT display
-    UpdateDisplayTime();
-
   }
 
-  else {
-    //--------------------------------------------
-    //  update WiFi and MQTT connection status bar
-    UpdateWiFiConnectionStatus();     //update WiFi status bar
-    UpdateMQTTConnectionStatus();     //update MQTT status bar
-
-  }
+  //--------------------------------------------
+  //  the WiFi and MQTT connection status bar is updated by the display task
 
 }
 
@@ -179,6 +206,7 @@ void setupDisplayTouchscreen() {
   tft.fillScreen(BLACK);  //clear screen
   tft.setFont(&FreeSans9pt7b);    //9pt = 12pixel height(I think)  https://reeddesign.co.uk/test/points-pixels.html
   tft.setTextColor(WHITE);
+  initDisplayWidgets();           //size the display widgets and allocate the off-screen canvas
   // we currently are not using the touchscreen so don't bother initializing it.
   /*
     //--------------------------------------------
@@ -229,4 +257,10 @@ void InitStatusBar() {
   tft.fillCircle(130, 301 - 6, 6, RED); //x,y,radius,color    //MQTT Status
   tft.fillCircle(50, 319 - 6, 6, RED); //x,y,radius,color     //GPS Status
   tft.fillCircle(130, 319 - 6, 6, RED); //x,y,radius,color    //ARK Status
+
+  showWidget(WIDGET_GPS_SPEED);
+  showWidget(WIDGET_CLOCK);
+  showWidget(WIDGET_RSSI);
+  showWidget(WIDGET_BATTERY);
+  showWidget(WIDGET_SATELLITES);
 }
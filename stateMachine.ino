@@ -101,7 +101,8 @@ void StateMachine() {
 
           GenerateDisplay_QRcode();
 
-          previousUpdateTime_RentalStartSearch = millis();    //reset transaction search counter
+          rentalSearchDue = false;                            //reset transaction search counter
+          schedulerStart(networkScheduler, JOB_RENTAL_SEARCH, UpdateInterval_RentalStartSearch);
 
           scooterRental.rentalStatus = "Available";
           state = STATE_4;
@@ -156,8 +157,11 @@ void StateMachine() {
             rideTime_start_ms = millis();                 //We are using the ms timer for the ride timer. This id probably redundant. We could use the previous unix timer
 
             //record current GPS coordinates at the start of the Rental
-            scooterRental.startLatitude = convertDegMinToDecDeg_lat(GPS.latitude);
-            scooterRental.startLongitude = convertDegMinToDecDeg_lon(GPS.longitude);
+            struct gpsFix fix;
+            getGPSfix(fix);
+            scooterRental.startLatitude = fix.latitude;
+            scooterRental.startLongitude = fix.longitude;
+            startRideTrack(scooterRental.startTime, scooterRental.startLatitude, scooterRental.startLongitude);
 
             //calculate the ride length = received payment / Rental rate(RAD/seconds)
             uint64_t rideTime_length_sec = scooterRental.payment_Uint64 / RENTAL_RATE_UINT64;
@@ -170,22 +174,15 @@ void StateMachine() {
             Serial.print("Ride time length(ms): ");
             Serial.println(rideTime_length_ms);
 
-            remainingRentalTime_previous_s = rideTime_length_sec;    //this is used by the countdown timer to refresh the display only once each second.
-            // remainingRentalTime_previous_s = 0;   //Might need to use this to ensure that timer display shows the initial timer value.  Otherwise it might not show anything until the first second has elapsed.
-
             //erase QRcode from display and show speedometer and ride timer
-            clearMainScreen();
-            tft.setFont(&Lato_Medium_36);
-            tft.setTextColor(SpeedGreen);     // http://www.barth-dev.de/online/rgb565-color-picker/
-            tft.setCursor(75, 150);
-            tft.print("km/h");
-
-            previousSpeed = 0;
-            updateSpeedometer();
+            showRideScreen();
 
             unlockScooter();                  //put control logic to unlock scoote here
 
             scooterRental.rentalStatus = "Rented";
+            journal.rentalActive = true;      //save the rental so it can be resumed after a reboot
+            commitJournal();
+            schedulerStart(networkScheduler, JOB_NEXT_SESSION, Delay_NextSession);   //get the next session ready during the ride
             state = STATE_5;
             Serial.println("Rental Started. ");
             Serial.print("Entering State: ");
@@ -207,10 +204,11 @@ void StateMachine() {
     // Transition Actions:
     //  -lock scooter
     //  -rentalStatus = "Available"
-    //  -Send RentalFinish blockchan transaction (code currently does not check to make sure a WiFi connection is available prior to sending).
+    //  -Send RentalFinish blockchan transaction. It is kept in the outbox until the relay can be reached (see Outbox.ino)
     //  -Initialize display with speedometer and ride timer
     //
     // In this state the WiFi, MQTT, Ark, and GPS connections are ignored.
+    // The speedometer and ride timer are updated by the display task while in this state.
     case STATE_5: {   // rider is using scooter
         //wait for timer to expire and then lock scooter and send rental finish and go back to beginning
         if (millis() - rideTime_start_ms > rideTime_length_ms)  {
@@ -221,10 +219,17 @@ void StateMachine() {
           scooterRental.endTime = time(nullptr);  //record Unix timestamp of the Rental Finish
 
           //record GPS coordinates of the Rental Finish
-          scooterRental.endLatitude = convertDegMinToDecDeg_lat(GPS.latitude);
-          scooterRental.endLongitude = convertDegMinToDecDeg_lon(GPS.longitude);
+          struct gpsFix fix;
+          getGPSfix(fix);
+          scooterRental.endLatitude = fix.latitude;
+          scooterRental.endLongitude = fix.longitude;
+          finishRideTrack(scooterRental.endTime, scooterRental.endLatitude, scooterRental.endLongitude);
+
+          SendTransaction_RentalFinish(); // sign the Rental Finish transaction and write it to the outbox
 
-          SendTransaction_RentalFinish(); // send Rental Finish transaction
+          journal.rentalActive = false;   //the rental is not resumed after this point. Before it, a reboot finds the RentalFinish in the outbox (see initJournal())
+          commitJournal();
+          drainOutbox();                  //send it now. If the relay cannot be reached it is sent once the WiFi connection is back
 
           Serial.println("");
           Serial.println("=================================");
@@ -233,10 +238,15 @@ void StateMachine() {
           //Serial.println(scooterRental.payment);
           Serial.printf("%" PRIu64 "\n", scooterRental.payment_Uint64);   //PRIx64 to print in hexadecimal
           Serial.println(scooterRental.rentalRate);
-          Serial.println(scooterRental.startLatitude, 6);     //this prints out only 6 decimal places.  It has 8 decimals
-          Serial.println(scooterRental.startLongitude, 6);
-          Serial.println(scooterRental.endLatitude, 6);
-          Serial.println(scooterRental.endLongitude, 6);
+          char coordinate[COORDINATE_TEXT_SIZE];
+          formatMicrodegrees(scooterRental.startLatitude, coordinate, sizeof(coordinate));
+          Serial.println(coordinate);
+          formatMicrodegrees(scooterRental.startLongitude, coordinate, sizeof(coordinate));
+          Serial.println(coordinate);
+          formatMicrodegrees(scooterRental.endLatitude, coordinate, sizeof(coordinate));
+          Serial.println(coordinate);
+          formatMicrodegrees(scooterRental.endLongitude, coordinate, sizeof(coordinate));
+          Serial.println(coordinate);
           //Serial.println(scooterRental.vendorField);
           Serial.println("=================================");
 
@@ -248,6 +258,17 @@ void StateMachine() {
           //  Serial.println("");
 
 
+          reportRentalCycleLatency();
+          printDisplayStats();
+          printJournalStats();
+          printArkConnectionStats();
+          printRelayPoolStats();
+#ifdef ENABLE_GEOFENCE
+          printGeofenceStats();
+#endif
+          printSchedulerStats(loopScheduler);
+          printSchedulerStats(networkScheduler);
+
           scooterRental.rentalStatus = "Available";
           state = STATE_6;
           Serial.print("State: ");
@@ -256,8 +277,9 @@ void StateMachine() {
         }
         else {
           //timer has not expired
-          updateSpeedometer();      // no speed is shown initially if there is no change.
-          updateCountdownTimer();
+          //the speedometer and ride timer are updated by the display task (see loop())
+          //the route of the ride is recorded by the JOB_RIDE_TRACK job for the RentalFinish transaction
+          //the next rental session is generated by the JOB_NEXT_SESSION job
           state = STATE_5;
         }
         break;
@@ -281,11 +303,53 @@ void StateMachine() {
 
 
 
+/********************************************************************************
+  Place the state machine state, the rental status and the ride timer in rideMailbox for loop() (core 1).
+  Called by the network task after each pass of the state machine, and by setup() before the network task is started.
+  The mailbox is only written when something changed.
+********************************************************************************/
+void publishRideSnapshot() {
+  static struct rideSnapshot published;
+  static bool valid = false;
+
+  struct rideSnapshot ride;
+  memset(&ride, 0, sizeof(ride));      //padding is compared too
+  ride.state = state;
+  ride.rentalStatus = (scooterRental.rentalStatus != NULL) ? scooterRental.rentalStatus[0] : 'B';    //"Broken" until the first pass
+  ride.rideTime_start_ms = rideTime_start_ms;
+  ride.rideTime_length_ms = rideTime_length_ms;
+
+  if (valid && (memcmp(&ride, &published, sizeof(ride)) == 0)) {
+    return;
+  }
+  published = ride;
+  valid = true;
+  xQueueOverwrite(rideMailbox, &ride);
+}
+
+
+/********************************************************************************
+  Get the latest ride snapshot. Safe to call from any task.
+********************************************************************************/
+void getRideSnapshot(struct rideSnapshot &ride) {
+  if (xQueuePeek(rideMailbox, &ride, 0) != pdTRUE) {
+    memset(&ride, 0, sizeof(ride));
+    ride.state = STATE_0;
+    ride.rentalStatus = 'B';
+  }
+}
+
+
 /********************************************************************************
   updates the ride countdown timer Displayed on the screen.
   It only refreshes the screen once per second
+  The ride timer is read from rideMailbox so this can run in loop() while the network task changes the rental.
 ********************************************************************************/
 void updateCountdownTimer() {
+  struct rideSnapshot ride;
+  getRideSnapshot(ride);
+  uint32_t rideTime_length_ms = ride.rideTime_length_ms;
+  uint32_t rideTime_start_ms = ride.rideTime_start_ms;
 
   uint32_t remainingRentalTime_s = rideTime_length_ms - (millis() - rideTime_start_ms);   //calculate remaining ride time in ms
   //need to check for time < 0
@@ -299,30 +363,45 @@ void updateCountdownTimer() {
   }
 
 
-  if (remainingRentalTime_s != remainingRentalTime_previous_s) {
-    //update display every second
+  setWidgetNumber(WIDGET_COUNTDOWN, remainingRentalTime_s, 0);     //only redrawn when the number of seconds changes
+}
 
-    //create the string this is currently displayed on the screen.  We are going to use this to calculate how much of the screen to erase
-    char previousTimer_char[10];
-    snprintf(&previousTimer_char[0], 10, "%u", remainingRentalTime_previous_s);        //create string from unsigned int
 
-    //create the string that we want to write to the display.
-    char currentTimer_char[10];
-    snprintf(&currentTimer_char[0], 10, "%u", remainingRentalTime_s);             //create string from unsigned int
+/********************************************************************************
+  Erase the QRcode and show the speedometer and ride timer (network task, or setup() when a rental is resumed)
+********************************************************************************/
+void showRideScreen() {
+  publishRideSnapshot();            //the countdown is drawn from the new ride timer
+  displayLock();
+  clearMainScreen();
+  tft.setFont(&Lato_Medium_36);
+  tft.setTextColor(SpeedGreen);     // http://www.barth-dev.de/online/rgb565-color-picker/
+  tft.setCursor(75, 150);
+  tft.print("km/h");
+
+  updateSpeedometer();
+  updateCountdownTimer();
+  showWidget(WIDGET_SPEEDOMETER);
+  showWidget(WIDGET_COUNTDOWN);
+  showWidget(WIDGET_GEOFENCE);
+  displayUnlock();
+}
 
-    remainingRentalTime_previous_s = remainingRentalTime_s;               //update previous timer
-    //update countdown timer display
-    int16_t  x1, y1;
-    uint16_t w, h;
-    tft.setFont(&Lato_Semibold_48);
-    tft.setTextColor(OffWhite);
-    tft.getTextBounds(previousTimer_char, 70, 230, &x1, &y1, &w, &h);   //get bounds of the previous speed text
-    tft.fillRect(x1, y1, w, h, BLACK);                                  //erase the last speed reading
 
-    //display the updated countdowntimer on the display
-    tft.setCursor(70, 230);
-    tft.print(remainingRentalTime_s);
-  }
+/********************************************************************************
+  Continue the rental that was in progress when the scooter rebooted. (setup(), see initJournal())
+  The ride timer, rental details and ride track have been restored from the journal.
+********************************************************************************/
+void resumeRental() {
+  Serial.print("Resuming rental. Remaining ride time(ms): ");
+  Serial.println(rideTime_length_ms - min((uint32_t) (millis() - rideTime_start_ms), rideTime_length_ms));
+
+  showRideScreen();
+  unlockScooter();
+  schedulerStart(networkScheduler, JOB_RIDE_TRACK, UpdateInterval_RideTrack);
+  schedulerStart(networkScheduler, JOB_NEXT_SESSION, Delay_NextSession);
+  scooterRental.rentalStatus = "Rented";
+  state = STATE_5;
 }
 
 
@@ -335,121 +414,118 @@ void unlockScooter() {
 
 
 /********************************************************************************
-  updates the speedometer displayed on the screen.
-  It only refreshes the screen if the speed changes
+  Limit the speed of the scooter. Called by updateGeofence() when the scooter enters or leaves a zone.
+  speedLimitKPH -> 0 = the scooter must not be ridden (no-ride zone), GEOFENCE_NO_SPEED_LIMIT = no limit
+  put control logic for the motor controller here
 ********************************************************************************/
-void updateSpeedometer() {
+void applySpeedLimit(uint8_t speedLimitKPH) {
 
-  char previousSpeed_char[6];
-  snprintf(&previousSpeed_char[0], 6, "%.1f", previousSpeed);   //create string of prevoius speed with 1 decimal point.
+}
 
-  float speedkmh = GPS.speed * 1.852;                           //get current speed with full precision
-  char currentSpeed_char[6];
-  snprintf(&currentSpeed_char[0], 6, "%.1f", speedkmh);         //create string with 1 decimal point.
 
-  if  (strcmp(currentSpeed_char, previousSpeed_char) == 0) {
-    return;
-  }
+/********************************************************************************
+  updates the speedometer displayed on the screen.
+  It only refreshes the screen if the speed changes
+********************************************************************************/
+void updateSpeedometer() {
 
-  int16_t  x1, y1;
-  uint16_t w, h;
-  tft.setFont(&Lato_Black_96);
-  tft.getTextBounds(previousSpeed_char, 30, 105, &x1, &y1, &w, &h);   //get bounds of the previous speed text
-  tft.fillRect(x1, y1, w, h, BLACK);                                  //clear the last speed reading
-
-  //display updated speed
-  previousSpeed = speedkmh;               //update previous speed
-  //tft.setFont(&Lato_Black_96);
-  tft.setTextColor(SpeedGreenDarker);
-  tft.setCursor(30, 105);
-  tft.print(speedkmh, 1);
+  int32_t speedTenths = lroundf(GPS.speed * 18.52);            //km/h with 1 decimal point. Only redrawn when this changes
+  setWidgetNumber(WIDGET_SPEEDOMETER, speedTenths, 1);
 }
 
 
 /********************************************************************************
-  Generates the QRcode and displays on TFT display
+  Generates the session ID and the QRcode text (without GPS coordinates) of the next rental session.
+  This is run ahead of time while the scooter is being ridden (see prepareNextSession()).
 ********************************************************************************/
-void GenerateDisplay_QRcode () {
+void generateNextSession() {
 
   uint32_t esprandom = (esp_random());            //generate 32 bit random number with a lower and upper bound using ESP32 RNG.
   // this is pseudorandom when the wifi or bluetooth does not have a connection. It can be considered "random" when the radios have a connection
   // arduino random function is overloaded on to esp_random();
   // https://docs.espressif.com/projects/esp-idf/en/latest/api-reference/system/system.html
 
-
-  char QRcodeText[256 + 1];       // QRcode Version = 10 with ECC=2 gives 211 Alphanumeric characters or 151 bytes(any characters)
-  //NOTE!  I wonder if sprintf() is better to use here
-  //sprintf, strcpy, strcat (and also strlen function) are all considered dangerous - the all use pointer to buffers -
-  //there are no checks to see if the destination buffer is large enough to hold the resulting string -
-  //so can easily lead to buffer overflow.
-
-  strcpy(QRcodeText, "rad:");
-  strcat(QRcodeText, ArkAddress);
-
   //   start sha256
   // use this to check result of SHA256 https://passwordsgenerator.net/sha256-hash-generator/
   // http://www.fileformat.info/tool/hash.htm
-
   char SHApayload[10 + 1]; //max number is 4294967295
   //itoa(esprandom, SHApayload, 10);      //this will interpret numbers as signed
   utoa(esprandom, SHApayload, 10);        //use this instead for unsigned conversion
-  const size_t payloadLength = strlen(SHApayload);       //holds length of payload
-  mbedtls_md_init(&ctx);
-  mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(md_type), 0);
-  mbedtls_md_starts(&ctx);
-  mbedtls_md_update(&ctx, (const unsigned char *) SHApayload, payloadLength);
-  mbedtls_md_finish(&ctx, scooterRental.sessionID_QRcode_byte);   //shaResult is global variable of type bytes
-  mbedtls_md_free(&ctx);
+  esp_sha(SHA2_256, (const unsigned char *) SHApayload, strlen(SHApayload), nextSession.sessionID_byte);
 
-  Serial.println("\n=================================");
-  Serial.println("Generating QRcode");
+  //convert the SHAresult which is an array of bytes into an array of characters
+  bytesToHex(nextSession.sessionID_byte, sizeof(nextSession.sessionID_byte), nextSession.sessionID);
 
-  //display the value to be hashed
+  Serial.println("\n=================================");
+  Serial.println("Generating next rental session");
   Serial.print("random value to be Hashed: ");
   Serial.println(SHApayload);
-
-  //convert the SHAresult which is an array of bytes into an array of characters so we can send to terminal display
-  char shaResult_char[64 + 1];
-  shaResult_char[0] = '\0';
-  for (int i = 0; i < sizeof(scooterRental.sessionID_QRcode_byte); i++) {
-    char str[3];
-    sprintf(str, "%02x", (int)scooterRental.sessionID_QRcode_byte[i]);
-    strcat(shaResult_char, str);
-  }
-  //display the resulting SHA256
   Serial.print("SHA256 hash: ");
-  Serial.println(shaResult_char);
+  Serial.println(nextSession.sessionID);
   //end sha256
 
-  strcat(QRcodeText, "?hash=");
-  strcat(QRcodeText, shaResult_char);     //append hash to QRcode string
-  strcpy(scooterRental.sessionID_QRcode, shaResult_char);    //stash hash away for use later in rental start transaction handler
+  //Example QRcodeText = "rad:TRXA2NUACckkYwWnS9JRkATQA453ukAcD1?hash=1234300000000000000000000000000000000000000000000000000000000000&rate=370000000&lat=-180.222222&lon=1.111111"
+  nextSession.QRcodeTextPrefixLength = snprintf(nextSession.QRcodeText, sizeof(nextSession.QRcodeText), "rad:%s?hash=%s&rate=%s", ArkAddress, nextSession.sessionID, RENTAL_RATE_STR);
+  nextSession.ready = true;
+}
 
-  strcat(QRcodeText, "&rate=");
-  strcat(QRcodeText, RENTAL_RATE_STR);
 
+/********************************************************************************
+  Patches the GPS coordinates into the QRcode text of the next session and encodes the QRcode into qrcodeData.
+********************************************************************************/
+void encodeNextSessionQRcode(const char *const latitude, const char *const longitude) {
+  char *coordinates = &nextSession.QRcodeText[nextSession.QRcodeTextPrefixLength];
+  snprintf(coordinates, sizeof(nextSession.QRcodeText) - nextSession.QRcodeTextPrefixLength, "&lat=%s&lon=%s", latitude, longitude);
 
-  scooterRental.QRLatitude = convertDegMinToDecDeg_lat(GPS.latitude);
-  scooterRental.QRLongitude = convertDegMinToDecDeg_lon(GPS.longitude);
+  qrcode_initText(&qrcode, qrcodeData, QRcode_Version, QRcode_ECC, nextSession.QRcodeText);
+}
 
 
-  //buf += String(scooterRental.QRLatitude, 4);    // use 6 decimal point precision. alternate method
-  // http://joequery.me/code/snprintf-c/
-  char QRLatitude[13];
-  snprintf(&QRLatitude[0], 13, "%.6f", scooterRental.QRLatitude);             //create string with 6 decimal point.
+/********************************************************************************
+  Job of networkScheduler (JOB_NEXT_SESSION): prepares the next rental session while the current ride is in progress.
+  Started once when a ride starts so the state machine does not have to check on every pass.
+  Only the session ID and the QRcode text prefix are generated. The QRcode is encoded when it is displayed because
+  it holds the coordinates of the end of the ride.
+********************************************************************************/
+void prepareNextSession() {
+  if (!nextSession.ready) {
+    generateNextSession();
+  }
+}
+
+
+/********************************************************************************
+  Generates the QRcode and displays on TFT display
+  Uses the pregenerated session if one is available.
+********************************************************************************/
+void GenerateDisplay_QRcode () {
+
+  if (!nextSession.ready) {
+    generateNextSession();
+  }
 
-  char QRLongitude[13];
-  snprintf(&QRLongitude[0], 13, "%.6f", scooterRental.QRLongitude);           //create string with 6 decimal point.
+  struct gpsFix fix;
+  getGPSfix(fix);
+  scooterRental.QRLatitude = fix.latitude;
+  scooterRental.QRLongitude = fix.longitude;
 
-  strcat(QRcodeText, "&lat=");
-  strcat(QRcodeText, QRLatitude);
+  char QRLatitude[COORDINATE_TEXT_SIZE];
+  formatMicrodegrees(scooterRental.QRLatitude, QRLatitude, sizeof(QRLatitude));       //6 decimals
 
-  strcat(QRcodeText, "&lon=");
-  strcat(QRcodeText, QRLongitude);
+  char QRLongitude[COORDINATE_TEXT_SIZE];
+  formatMicrodegrees(scooterRental.QRLongitude, QRLongitude, sizeof(QRLongitude));
 
+  encodeNextSessionQRcode(QRLatitude, QRLongitude);
+
+  //stash hash away for use later in rental start transaction handler
+  strcpy(scooterRental.sessionID_QRcode, nextSession.sessionID);
+  memcpy(scooterRental.sessionID_QRcode_byte, nextSession.sessionID_byte, sizeof(scooterRental.sessionID_QRcode_byte));
+  nextSession.ready = false;      //this session is now in use
+
+  Serial.println("\n=================================");
+  Serial.println("Displaying QRcode");
   Serial.print("QR code text: ");
-  Serial.println(QRcodeText);
+  Serial.println(nextSession.QRcodeText);
 
-  //Example QRcodeText = "rad:TRXA2NUACckkYwWnS9JRkATQA453ukAcD1?hash=1234300000000000000000000000000000000000000000000000000000000000&rate=370000000&lat=-180.222222&lon=1.111111"
-  displayQRcode(QRcodeText);    //display on the screen
+  displayQRcode();    //display on the screen
 }
@@ -0,0 +1,657 @@
+#!/usr/bin/env python3
+"""
+Fleet load simulator for the relay node and the MQTT broker.
+
+Runs N virtual scooters as asyncio tasks in one process. Each scooter follows the protocol of the firmware:
+  - boot:       GET /api/node/status, GET /api/wallets/<address>, GET the page of received transactions holding the checkpoint
+  - available:  poll /api/wallets/<address>/transactions/received?page=..&limit=RX_POLL_PAGE_LIMIT every
+                UpdateInterval_RentalStartSearch. With --notify a notification on scooter/<address>/transactions triggers
+                a poll right away and, once one has arrived, polling slows down to UpdateInterval_RentalStartSearch_Fallback
+                (like ENABLE_MQTT_TX_NOTIFY)
+  - telemetry:  a signed {"status":..,"sig":..} packet on scooter/<address>/data every UpdateInterval_MQTT_Publish
+  - rental:     a virtual rider adds a RentalStart to the wallet of an available scooter. The scooter finds it with its
+                next poll, rides for --ride seconds, then POSTs a RentalFinish with its ride track to /api/transactions
+                on 2 relays (ARK_BROADCAST_RELAYS) and reads its wallet again. The RentalFinish carries the next nonce of
+                the scooter, which is read from the wallet at boot and read again when a transaction is rejected
+Every scooter keeps one HTTP/1.1 keep-alive connection per relay (see ArkStream.ino) and reads from the relay with the
+lowest EWMA latency. The intervals, page limits and relay settings are read from ../Ark_Scooter.ino (FIRMWARE_SETTINGS)
+so the simulator follows the firmware.
+
+The protocol of the scooters (paths, paging, polling, relay ranking and parsing) is written again here rather than
+running the compiled sketch. The host harness runs the sketch in simulated time against simulated sockets, so it
+cannot put a thousand scooters on real sockets in real time. Changes to the request sequence of the firmware have to
+be made here as well. The signatures are the exception: they come from the firmware code through fleet_signer.
+
+By default a stand-in relay and a stand-in MQTT broker run in the same process. --relay and --broker point the fleet at
+real endpoints instead. Rentals need the stand-in relay because the riders add their RentalStart through it.
+The fleet grows through --steps. One line of statistics is printed for each step:
+
+  python3 fleet_load_simulator.py --steps 100,500,1000 --step-time 60 --time-scale 10
+  python3 fleet_load_simulator.py --steps 50 --relay 192.168.1.20:4003 --broker 192.168.1.30:1883
+
+--time-scale 10 runs every interval 10 times faster, so 100 scooters load the endpoints like 1000.
+Every scooter has its own wallet (passphrase "fleet scooter <n>"). The MQTT packets and the RentalFinish transactions
+are signed by host/tools/fleet_signer.cpp, which uses the same Message::sign() and ScooterRentalFinish builder calls as
+the firmware. The stand-in relay verifies the signature and the nonce of every transaction like a relay node. Build
+the signer with the host harness first, from the root of the repository:
+
+  cmake -S host -B build && cmake --build build --target fleet_signer
+"""
+import argparse
+import asyncio
+import collections
+import hashlib
+import json
+import os
+import random
+import re
+import resource
+import struct
+import time
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+FIRMWARE = os.path.join(ROOT, "Ark_Scooter.ino")
+SIGNER = os.path.join(ROOT, "build", "fleet_signer")
+RIDER_ADDRESS = "TLdYHTKRSD3rG66zsytqpAgJDX75qbcvgT"         # sender of the RentalStart transactions
+# read from Ark_Scooter.ino by load_firmware_settings(). The simulator has no defaults of its own
+FIRMWARE_SETTINGS = dict.fromkeys([
+    "UpdateInterval_MQTT_Publish",
+    "UpdateInterval_RentalStartSearch",
+    "UpdateInterval_RentalStartSearch_Fallback",
+    "RX_CATCHUP_PAGE_LIMIT",
+    "RX_POLL_PAGE_LIMIT",
+    "RIDE_TRACK_MAX_POINTS",
+    "ARK_BROADCAST_RELAYS",
+    "ARK_REQUEST_RELAYS",
+    "ARK_RELAY_EWMA_ALPHA",
+    "ARK_HTTP_TIMEOUT_MS",
+])
+
+
+def load_firmware_settings():
+    """read the values of FIRMWARE_SETTINGS from Ark_Scooter.ino. Exits if one of them is not found"""
+    try:
+        source = open(FIRMWARE).read()
+    except OSError as error:
+        raise SystemExit("cannot read the firmware settings: %s" % error)
+    for name in FIRMWARE_SETTINGS:
+        match = re.search(r"\b%s\s*=\s*(\d+(\.\d+)?)\s*;" % name, source)
+        if not match:
+            raise SystemExit("%s is not defined in %s" % (name, FIRMWARE))
+        FIRMWARE_SETTINGS[name] = float(match.group(1)) if match.group(2) else int(match.group(1))
+
+
+# --------------------------------------------------------------------------------------------------------------------
+# statistics
+
+
+class Stats:
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.start = time.perf_counter()
+        self.latency = {}           # endpoint -> [ms]
+        self.errors = {}            # endpoint -> count
+        self.publishes = 0
+        self.publish_bytes = 0
+        self.mqtt_errors = 0
+        self.connack = []
+        self.rentals = 0
+        self.rejected = 0           # RentalFinish transactions the relay did not accept
+
+    def request(self, endpoint, latency_ms, ok):
+        if ok:
+            self.latency.setdefault(endpoint, []).append(latency_ms)
+        else:
+            self.errors[endpoint] = self.errors.get(endpoint, 0) + 1
+
+    def report(self, scooters):
+        elapsed = time.perf_counter() - self.start
+        print("\n%d scooters  %.0f s  rentals %d  rejected %d  MQTT %.1f pub/s  %.1f kB/s  errors %d  connack p99 %.1f ms" % (
+            scooters, elapsed, self.rentals, self.rejected, self.publishes / elapsed, self.publish_bytes / elapsed / 1024,
+            self.mqtt_errors, percentile(self.connack, 99)))
+        for endpoint in sorted(set(self.latency) | set(self.errors)):
+            samples = self.latency.get(endpoint, [])
+            errors = self.errors.get(endpoint, 0)
+            total = len(samples) + errors
+            print("  %-9s %7.1f req/s  p50 %7.1f ms  p95 %7.1f ms  p99 %7.1f ms  errors %5.2f%%" % (
+                endpoint, total / elapsed, percentile(samples, 50), percentile(samples, 95),
+                percentile(samples, 99), 100.0 * errors / max(total, 1)))
+
+
+def percentile(samples, p):
+    if not samples:
+        return 0.0
+    ordered = sorted(samples)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))]
+
+
+# --------------------------------------------------------------------------------------------------------------------
+# signer (host/tools/fleet_signer.cpp)
+
+
+class Signer:
+    """A fleet_signer process. A request is one line of tab separated fields, and so is the answer. The requests are
+    pipelined: the answers come back in the order of the requests"""
+
+    def __init__(self, path):
+        self.path = path
+        self.process = None
+        self.pending = collections.deque()      # futures of the requests waiting for their answer
+        self.reader = None
+
+    async def start(self):
+        self.process = await asyncio.create_subprocess_exec(
+            self.path, stdin=asyncio.subprocess.PIPE, stdout=asyncio.subprocess.PIPE)
+        self.reader = asyncio.ensure_future(self.read())
+
+    async def read(self):
+        while True:
+            line = await self.process.stdout.readline()
+            if not line:
+                break
+            self.answer(line.decode().rstrip("\n"))
+        while self.pending:
+            self.answer("")
+
+    def answer(self, text):
+        future = self.pending.popleft()
+        if not future.done():               # the scooter that asked may have been cancelled
+            future.set_result(text)
+
+    async def request(self, *fields):
+        if self.process.stdin.is_closing():
+            raise RuntimeError("fleet_signer %s: stopped" % fields[0])
+        answer = asyncio.get_event_loop().create_future()
+        self.pending.append(answer)
+        self.process.stdin.write(("\t".join(str(field) for field in fields) + "\n").encode())
+        await self.process.stdin.drain()
+        answer = await answer
+        if not answer or answer.startswith("error\t"):
+            raise RuntimeError("fleet_signer %s: %s" % (fields[0], answer[6:] or "no answer"))
+        return answer
+
+    async def stop(self):
+        self.process.stdin.close()
+        await self.process.wait()
+        await self.reader
+
+
+# --------------------------------------------------------------------------------------------------------------------
+# stand-in relay node
+
+
+class StandInRelay:
+    """Answers the requests of the firmware. The received transactions and the nonce of each wallet are kept in memory.
+    A posted transaction is accepted if its signature is valid and its nonce is the next one of the sender."""
+
+    def __init__(self, latency_ms, signer):
+        self.latency = latency_ms / 1000
+        self.signer = signer
+        self.received = {}          # address -> [transaction]
+        self.nonces = {}            # address -> nonce of the last accepted transaction
+        self.senders = {}           # public key -> address
+
+    def register(self, address, public_key):
+        self.senders[public_key] = address
+        self.nonces.setdefault(address, 0)
+
+    def add_rental_start(self, address, session_id, seconds):
+        transactions = self.received.setdefault(address, [])
+        transactions.append({
+            "id": hashlib.sha256(os.urandom(8)).hexdigest(), "type": 500, "typeGroup": 4000,
+            "amount": str(int(seconds * 61667)), "sender": RIDER_ADDRESS, "recipient": address,
+            "asset": {"sessionId": session_id, "rate": "61667", "gpsCount": 1},
+            "nonce": str(len(transactions) + 1),
+        })
+
+    async def post_transactions(self, body):
+        """POST /api/transactions of Ark Core 2.6: 422 when no transaction was accepted"""
+        accept, invalid, errors = [], [], {}
+        for transaction in json.loads(body)["transactions"]:
+            tid = transaction.get("id", "")
+            address = self.senders.get(transaction.get("senderPublicKey"))
+            if await self.signer.request("verify", json.dumps(transaction, separators=(",", ":"))) != "ok":
+                errors[tid] = [{"type": "ERR_BAD_DATA", "message": "Transaction didn't pass the verification process."}]
+            elif address is None or int(transaction["nonce"]) != self.nonces[address] + 1:
+                errors[tid] = [{"type": "ERR_APPLY", "message": "Cannot apply a transaction with nonce %s: the sender %s has nonce %d." % (
+                    transaction["nonce"], transaction.get("senderPublicKey"), self.nonces.get(address, 0))}]
+            else:
+                self.nonces[address] += 1
+                accept.append(tid)
+                continue
+            invalid.append(tid)
+        data = {"data": {"accept": accept, "broadcast": accept, "excess": [], "invalid": invalid}}
+        if errors:
+            data["errors"] = errors
+        return (200 if accept else 422), data
+
+    async def respond(self, method, path, body):
+        if method == "POST":
+            return await self.post_transactions(body)
+        if path == "/api/node/status":
+            return 200, {"data": {"synced": True, "now": 4047140, "blocksCount": 0}}
+        match = re.match(r"/api/wallets/(\w+)/transactions/received\?page=(\d+)&limit=(\d+)", path)
+        if match:
+            transactions = self.received.get(match.group(1), [])
+            page, limit = int(match.group(2)), int(match.group(3))
+            data = transactions[(page - 1) * limit:page * limit]
+            return 200, {"meta": {"count": len(data), "totalCount": len(transactions)}, "data": data}
+        match = re.match(r"/api/wallets/(\w+)$", path)
+        if match:
+            return 200, {"data": {"address": match.group(1), "nonce": str(self.nonces.get(match.group(1), 0)), "balance": "94968174556"}}
+        return 404, {"error": "not found"}
+
+    async def handle(self, reader, writer):
+        try:
+            while True:
+                line = await reader.readline()
+                if not line:
+                    break
+                method, path, _ = line.decode().split(" ", 2)
+                length = 0
+                while True:
+                    header = (await reader.readline()).strip().lower()
+                    if not header:
+                        break
+                    if header.startswith(b"content-length:"):
+                        length = int(header[15:])
+                body = await reader.readexactly(length) if length else b""
+                await asyncio.sleep(self.latency)
+                status, payload = await self.respond(method, path, body)
+                body = json.dumps(payload).encode()
+                writer.write(b"HTTP/1.1 %d OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n" % (status, len(body)) + body)
+                await writer.drain()
+        except (ConnectionError, asyncio.IncompleteReadError, ValueError, KeyError, asyncio.CancelledError):
+            pass
+        writer.close()
+
+
+# --------------------------------------------------------------------------------------------------------------------
+# stand-in MQTT broker (MQTT 3.1.1, exact topic match, QoS 0 forwarding)
+
+
+async def mqtt_read_packet(reader):
+    header = (await reader.readexactly(1))[0]
+    length, shift = 0, 0
+    while True:
+        byte = (await reader.readexactly(1))[0]
+        length |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            break
+    return header, await reader.readexactly(length)
+
+
+def mqtt_packet(header, payload):
+    length = len(payload)
+    encoded = bytearray()
+    while True:
+        byte = length & 0x7F
+        length >>= 7
+        encoded.append(byte | (0x80 if length else 0))
+        if not length:
+            break
+    return bytes([header]) + bytes(encoded) + payload
+
+
+def mqtt_string(text):
+    data = text.encode()
+    return struct.pack("!H", len(data)) + data
+
+
+class StandInBroker:
+    def __init__(self):
+        self.subscribers = {}       # topic -> set of writers
+        self.received = 0
+
+    async def handle(self, reader, writer):
+        topics = []
+        try:
+            while True:
+                header, payload = await mqtt_read_packet(reader)
+                kind = header >> 4
+                if kind == 1:                                       # CONNECT
+                    writer.write(mqtt_packet(0x20, b"\x00\x00"))
+                elif kind == 3:                                     # PUBLISH
+                    self.received += 1
+                    topic_length = struct.unpack("!H", payload[:2])[0]
+                    topic = payload[2:2 + topic_length].decode()
+                    message = payload[2 + topic_length + (2 if header & 0x06 else 0):]
+                    for subscriber in self.subscribers.get(topic, ()):
+                        subscriber.write(mqtt_packet(0x30, mqtt_string(topic) + message))
+                elif kind == 8:                                     # SUBSCRIBE
+                    topic_length = struct.unpack("!H", payload[2:4])[0]
+                    topic = payload[4:4 + topic_length].decode()
+                    self.subscribers.setdefault(topic, set()).add(writer)
+                    topics.append(topic)
+                    writer.write(mqtt_packet(0x90, payload[:2] + b"\x00"))
+                elif kind == 12:                                    # PINGREQ
+                    writer.write(mqtt_packet(0xD0, b""))
+                elif kind == 14:                                    # DISCONNECT
+                    break
+                await writer.drain()
+        except (ConnectionError, asyncio.IncompleteReadError, asyncio.CancelledError):
+            pass
+        for topic in topics:
+            self.subscribers[topic].discard(writer)
+        writer.close()
+
+
+# --------------------------------------------------------------------------------------------------------------------
+# virtual scooter
+
+
+class RelayConnection:
+    """One keep-alive connection to a relay (arkRelayState in the firmware)"""
+
+    def __init__(self, host, port):
+        self.host, self.port = host, port
+        self.reader = self.writer = None
+        self.latency = 0.0
+
+    async def request(self, method, path, body=b""):
+        if self.writer is None:
+            self.reader, self.writer = await asyncio.open_connection(self.host, self.port)
+        head = "%s %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: keep-alive\r\n" % (method, path, self.host, self.port)
+        if body:
+            head += "Content-Type: application/json\r\nContent-Length: %d\r\n" % len(body)
+        self.writer.write(head.encode() + b"\r\n" + body)
+        status = int((await self.reader.readline()).split()[1])
+        length = 0
+        while True:
+            line = (await self.reader.readline()).strip().lower()
+            if not line:
+                break
+            if line.startswith(b"content-length:"):
+                length = int(line[15:])
+        return status, await self.reader.readexactly(length)
+
+    def close(self):
+        if self.writer is not None:
+            self.writer.close()
+            self.reader = self.writer = None
+
+
+class Scooter:
+    def __init__(self, number, fleet):
+        self.fleet = fleet
+        self.passphrase = "fleet scooter %d" % number
+        self.address = self.public_key = None
+        self.relays = [RelayConnection(host, port) for host, port in fleet.relays]
+        self.seen = 0               # lastRXpage
+        self.nonce = 0              # bridgechainWallet.walletNonce_Uint64: nonce of the last transaction that was sent
+        self.session_id = None
+        self.rented = False
+        self.poll_now = asyncio.Event()
+        self.notified = False       # txNotificationSeen
+        self.mqtt_writer = None
+
+    def interval(self, name):
+        return FIRMWARE_SETTINGS[name] / 1000 / self.fleet.time_scale
+
+    async def http(self, endpoint, method, path, body=b""):
+        """A read goes to the fastest relay, then to the next one if it fails, up to ARK_REQUEST_RELAYS relays (arkRequest()).
+        A POST goes to ARK_BROADCAST_RELAYS relays that answer 2xx or 422 (arkPost()) and the first of those answers is
+        returned. Returns None if no relay answered"""
+        ranked = sorted(self.relays, key=lambda r: r.latency)
+        targets = ranked if method == "POST" else ranked[:FIRMWARE_SETTINGS["ARK_REQUEST_RELAYS"]]
+        answers = FIRMWARE_SETTINGS["ARK_BROADCAST_RELAYS"] if method == "POST" else 1
+        result = None
+        sent = 0
+        for relay in targets:
+            if sent >= answers:
+                break
+            start = time.perf_counter()
+            try:
+                status, data = await asyncio.wait_for(relay.request(method, path, body), FIRMWARE_SETTINGS["ARK_HTTP_TIMEOUT_MS"] / 1000)
+            except (OSError, asyncio.TimeoutError, asyncio.IncompleteReadError, ValueError, IndexError):
+                relay.close()
+                status, data = 0, b""
+            latency_ms = (time.perf_counter() - start) * 1000
+            relay.latency = latency_ms if relay.latency == 0 else relay.latency + FIRMWARE_SETTINGS["ARK_RELAY_EWMA_ALPHA"] * (latency_ms - relay.latency)
+            self.fleet.stats.request(endpoint, latency_ms, status == 200)
+            answered = 200 <= status < 300 or (method == "POST" and status == 422)
+            sent += 1 if answered else 0
+            if result is None and answered:
+                result = json.loads(data)
+        return result
+
+    async def poll(self, limit):
+        """GetTransactions_RentalStart(): read pages until caught up. Returns true if our RentalStart was found"""
+        while True:
+            page = self.seen // limit + 1
+            response = await self.http("received", "GET", "/api/wallets/%s/transactions/received?page=%d&limit=%d&orderBy=timestamp:asc" % (
+                self.address, page, limit))
+            if response is None:
+                return False
+            data = response["data"][self.seen % limit:]
+            for transaction in data:
+                self.seen += 1
+                if transaction.get("type") == 500 and transaction["asset"]["sessionId"] == self.session_id:
+                    return True
+            if response["meta"]["count"] < limit:
+                return False
+
+    async def packet(self):
+        """publish_MQTTpacket(): the signed message is the packet without the leading '{'"""
+        message = '"status":"%s","fix":1,"lat":%.6f,"lon":%.6f,"speed":%.2f,"sat":7,"bal":94968174556,"bat":%d' % (
+            "Rented" if self.rented else "Available", 53.535839 + random.uniform(-0.01, 0.01),
+            -113.276741 + random.uniform(-0.01, 0.01), random.uniform(0, 25) if self.rented else 0, random.randint(20, 100))
+        signature = await self.fleet.signer.request("message", self.passphrase, message)
+        return "{" + message + ',"sig":"%s"}' % signature
+
+    def track(self):
+        """RIDE_TRACK_MAX_POINTS points of the ride in microdegrees: timestamp,latitude,longitude;..."""
+        start = int(time.time()) - int(self.fleet.ride)
+        count = FIRMWARE_SETTINGS["RIDE_TRACK_MAX_POINTS"]
+        return ";".join("%d,%d,%d" % (start + int(self.fleet.ride) * i // (count - 1), 53535839 + 45 * i, -113276741 - 60 * i)
+                        for i in range(count))
+
+    async def send_rental_finish(self):
+        """SendTransaction_RentalFinish() with the next nonce. A rejected transaction reconciles the nonce with the
+        wallet (reconcileNonce())"""
+        transaction = await self.fleet.signer.request("finish", self.passphrase, self.nonce + 1, RIDER_ADDRESS,
+                                                      self.session_id, self.track())
+        tid = json.loads(transaction)["id"]
+        response = await self.http("send", "POST", "/api/transactions", ('{"transactions":[%s]}' % transaction).encode())
+        if response is not None and tid in response["data"]["accept"] + response["data"]["broadcast"]:
+            self.nonce += 1
+        else:
+            self.fleet.stats.rejected += 1
+        wallet = await self.http("wallet", "GET", "/api/wallets/%s" % self.address)
+        if wallet is not None and int(wallet["data"]["nonce"]) > self.nonce:
+            self.nonce = int(wallet["data"]["nonce"])
+
+    async def mqtt(self):
+        host, port = self.fleet.broker
+        start = time.perf_counter()
+        reader, writer = await asyncio.open_connection(host, port)
+        connect = mqtt_string("MQTT") + b"\x04\x02" + struct.pack("!H", 60) + mqtt_string(self.address[:23])
+        writer.write(mqtt_packet(0x10, connect))
+        await mqtt_read_packet(reader)
+        self.fleet.stats.connack.append((time.perf_counter() - start) * 1000)
+        if self.fleet.notify:
+            writer.write(mqtt_packet(0x82, b"\x00\x01" + mqtt_string("scooter/%s/transactions" % self.address) + b"\x00"))
+        self.mqtt_writer = writer
+        self.notified = False               # txNotificationSeen is reset on every connection
+        while True:
+            header, _ = await mqtt_read_packet(reader)
+            if header >> 4 == 3:
+                self.notified = True
+                self.poll_now.set()         # onTransactionNotification()
+
+    async def publish(self):
+        while True:
+            await asyncio.sleep(self.interval("UpdateInterval_MQTT_Publish"))
+            if self.mqtt_writer is None:
+                continue
+            packet = (await self.packet()).encode()
+            try:
+                self.mqtt_writer.write(mqtt_packet(0x30, mqtt_string("scooter/%s/data" % self.address) + packet))
+                await self.mqtt_writer.drain()
+                self.fleet.stats.publishes += 1
+                self.fleet.stats.publish_bytes += len(packet)
+            except ConnectionError:
+                self.fleet.stats.mqtt_errors += 1
+                self.mqtt_writer = None
+
+    async def run(self):
+        self.address, self.public_key = (await self.fleet.signer.request("key", self.passphrase)).split("\t")
+        if self.fleet.standin is not None:
+            self.fleet.standin.register(self.address, self.public_key)
+
+        # onConnectionEstablished()
+        await self.http("status", "GET", "/api/node/status")
+        wallet = await self.http("wallet", "GET", "/api/wallets/%s" % self.address)
+        if wallet is not None:
+            self.nonce = int(wallet["data"]["nonce"])
+        await self.poll(FIRMWARE_SETTINGS["RX_CATCHUP_PAGE_LIMIT"])
+
+        mqtt = asyncio.ensure_future(self.mqtt())
+        mqtt.add_done_callback(self.mqtt_failed)
+        publish = asyncio.ensure_future(self.publish())
+        try:
+            while True:
+                # STATE_4: show a new QR code and wait for the RentalStart
+                self.session_id = hashlib.sha256(os.urandom(8)).hexdigest()
+                self.fleet.available.append(self)
+                found = False
+                while not found:
+                    # dueRentalSearch(): slow down only once a notification has arrived on this connection
+                    search = "UpdateInterval_RentalStartSearch_Fallback" if self.notified and self.mqtt_writer else "UpdateInterval_RentalStartSearch"
+                    try:
+                        await asyncio.wait_for(self.poll_now.wait(), self.interval(search))
+                    except asyncio.TimeoutError:
+                        pass
+                    self.poll_now.clear()
+                    found = await self.poll(FIRMWARE_SETTINGS["RX_POLL_PAGE_LIMIT"])
+
+                # STATE_5: ride, then send the RentalFinish
+                self.rented = True
+                self.fleet.stats.rentals += 1
+                await asyncio.sleep(self.fleet.ride / self.fleet.time_scale)
+                self.rented = False
+                await self.send_rental_finish()
+        finally:
+            mqtt.cancel()
+            publish.cancel()
+
+    def mqtt_failed(self, task):
+        if not task.cancelled() and task.exception() is not None:
+            self.fleet.stats.mqtt_errors += 1
+            self.mqtt_writer = None
+
+
+# --------------------------------------------------------------------------------------------------------------------
+# fleet
+
+
+class Fleet:
+    def __init__(self, args, relays, broker, standin, signer):
+        self.relays = relays
+        self.broker = broker
+        self.standin = standin
+        self.signer = signer
+        self.notify = args.notify
+        self.time_scale = args.time_scale
+        self.ride = args.ride
+        self.idle = args.idle
+        self.stats = Stats()
+        self.available = []
+        self.scooters = []
+
+    async def rider(self):
+        """Rent an available scooter once it has been idle for about --idle seconds"""
+        while True:
+            await asyncio.sleep(1 / self.time_scale)
+            waiting = []
+            for scooter in self.available:
+                if random.random() < 1 / max(self.idle, 1):
+                    self.standin.add_rental_start(scooter.address, scooter.session_id, self.ride)
+                    if self.notify and self.broker_writer:
+                        topic = "scooter/%s/transactions" % scooter.address
+                        self.broker_writer.write(mqtt_packet(0x30, mqtt_string(topic) + b'{"type":500,"typeGroup":4000}'))
+                else:
+                    waiting.append(scooter)
+            self.available = waiting
+
+    async def grow(self, count, ramp):
+        for number in range(len(self.scooters), count):
+            scooter = Scooter(number, self)
+            self.scooters.append(asyncio.ensure_future(scooter.run()))
+            await asyncio.sleep(ramp / max(count, 1))
+
+
+async def main_async(args):
+    load_firmware_settings()
+    signer = Signer(args.signer)
+    await signer.start()
+    verifier = Signer(args.signer)                  # the stand-in relay does not wait behind the signatures of the fleet
+    await verifier.start()
+    servers = []
+    standin = StandInRelay(args.relay_latency, verifier)
+    if args.relay:
+        relays = [(target.rsplit(":", 1)[0], int(target.rsplit(":", 1)[1])) for target in args.relay]
+    else:
+        server = await asyncio.start_server(standin.handle, "127.0.0.1", 0, backlog=4096)
+        servers.append(server)
+        relays = [server.sockets[0].getsockname()[:2]]
+    if args.broker:
+        broker = (args.broker.rsplit(":", 1)[0], int(args.broker.rsplit(":", 1)[1]))
+    else:
+        server = await asyncio.start_server(StandInBroker().handle, "127.0.0.1", 0, backlog=4096)
+        servers.append(server)
+        broker = server.sockets[0].getsockname()[:2]
+    print("relays %s  broker %s:%d  time scale %g  firmware settings %s" % (
+        ", ".join("%s:%d" % r for r in relays), broker[0], broker[1], args.time_scale, FIRMWARE_SETTINGS))
+
+    fleet = Fleet(args, relays, broker, standin, signer)
+    fleet.broker_writer = None
+    if args.notify:
+        _, fleet.broker_writer = await asyncio.open_connection(*broker)
+        fleet.broker_writer.write(mqtt_packet(0x10, mqtt_string("MQTT") + b"\x04\x02\x00\x3c" + mqtt_string("webhook-bridge")))
+    rider = asyncio.ensure_future(fleet.rider())
+
+    for count in args.steps:
+        await fleet.grow(count, args.ramp)
+        fleet.stats.reset()
+        await asyncio.sleep(args.step_time)
+        fleet.stats.report(count)
+
+    rider.cancel()
+    for scooter in fleet.scooters:
+        scooter.cancel()
+    await asyncio.gather(rider, *fleet.scooters, return_exceptions=True)
+    for server in servers:
+        server.close()
+    await signer.stop()
+    await verifier.stop()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--steps", default="10,100", help="fleet sizes, e.g. 100,500,1000")
+    parser.add_argument("--step-time", type=float, default=30, help="seconds measured at each fleet size")
+    parser.add_argument("--ramp", type=float, default=5, help="seconds over which the scooters of a step are started")
+    parser.add_argument("--time-scale", type=float, default=1, help="run the firmware intervals this many times faster")
+    parser.add_argument("--ride", type=float, default=300, help="ride length in seconds")
+    parser.add_argument("--idle", type=float, default=120, help="mean seconds a scooter waits for a rider")
+    parser.add_argument("--notify", action="store_true", help="transaction notifications over MQTT (ENABLE_MQTT_TX_NOTIFY)")
+    parser.add_argument("--relay", action="append", help="host:port of a relay node (repeat for a pool). Default: stand-in")
+    parser.add_argument("--relay-latency", type=float, default=20, help="latency of the stand-in relay (ms)")
+    parser.add_argument("--broker", help="host:port of an MQTT broker. Default: stand-in")
+    parser.add_argument("--signer", default=SIGNER, help="fleet_signer of the host harness. Default: %(default)s")
+    args = parser.parse_args()
+    args.steps = [int(step) for step in args.steps.split(",")]
+    if not os.access(args.signer, os.X_OK):
+        parser.error("%s not found. Build it: cmake -S host -B build && cmake --build build --target fleet_signer" % args.signer)
+
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))    # several sockets per scooter
+    asyncio.run(main_async(args))
+
+
+if __name__ == "__main__":
+    main()
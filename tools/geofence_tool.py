@@ -0,0 +1,401 @@
+#!/usr/bin/env python3
+"""
+Geofence compiler and benchmark for the geofence engine (see Geofence.ino).
+
+  python3 geofence_tool.py compile geofences.geojson -o ../geofences.h
+      Compile the Polygon / MultiPolygon features of a GeoJSON file into geofences.h. Properties of each feature:
+        "zone": "no_ride", "slow" or "parking"
+        "speed": speed limit in km/h (slow zones)
+      Only the outer ring of a polygon is used. The zones are indexed by a uniform grid of --cell meters
+      (larger when the grid would have more than --max-cells cells)
+  python3 geofence_tool.py synth --zones 2000 -o city.geojson
+      Write a synthetic city-scale zone set around DEFAULT_LATITUDE / DEFAULT_LONGITUDE: many small parking zones,
+      slow zones along the busy streets and a few no-ride zones, clustered around the centre like an operator's map
+  python3 geofence_tool.py bench --zones 10,100,1000,10000
+  python3 geofence_tool.py bench --geojson city.geojson
+      Compile the zone sets, build lookupGeofence() from Geofence.ino on this computer (g++ -O2) and time it against
+      testing every zone. Both must give the same result for every point.
+
+The types are taken from ../Ark_Scooter.ino and the functions from ../Geofence.ino so the benchmark runs the firmware code.
+"""
+import argparse
+import json
+import math
+import os
+import random
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+ZONE_TYPES = {"no_ride": 0, "slow": 1, "parking": 2}
+NO_SPEED_LIMIT = 255
+MAX_ZONES = 32767                   # geofenceState.zone is an int16_t
+METERS_PER_MICRODEGREE = 0.111195
+DEFAULT_CENTRE = (53535839, -113276741)
+
+
+def firmware_default_centre():
+    with open(os.path.join(ROOT, "Ark_Scooter.ino")) as f:
+        source = f.read()
+    lat = re.search(r"DEFAULT_LATITUDE\s*=\s*(-?\d+)", source)
+    lon = re.search(r"DEFAULT_LONGITUDE\s*=\s*(-?\d+)", source)
+    if lat and lon:
+        return int(lat.group(1)), int(lon.group(1))
+    return DEFAULT_CENTRE
+
+
+def load_zones(path):
+    """returns a list of (type, speed, [(lat, lon), ...]) in microdegrees"""
+    with open(path) as f:
+        collection = json.load(f)
+    zones = []
+    for feature in collection["features"]:
+        properties = feature.get("properties") or {}
+        zone_type = ZONE_TYPES[properties.get("zone", "parking")]
+        speed = int(properties.get("speed", NO_SPEED_LIMIT)) if zone_type == ZONE_TYPES["slow"] else NO_SPEED_LIMIT
+        geometry = feature["geometry"]
+        polygons = [geometry["coordinates"]] if geometry["type"] == "Polygon" else geometry["coordinates"]
+        for polygon in polygons:
+            ring = [(round(lat * 1e6), round(lon * 1e6)) for lon, lat in polygon[0]]
+            if len(ring) > 1 and ring[0] == ring[-1]:
+                ring.pop()          # GeoJSON repeats the first vertex
+            if len(ring) >= 3:
+                zones.append((zone_type, min(speed, NO_SPEED_LIMIT), ring))
+    return zones
+
+
+def build_index(zones, cell_meters, max_cells):
+    """uniform grid over the bounding boxes of the zones. Returns a dict with everything geofences.h needs"""
+    if len(zones) > MAX_ZONES:
+        sys.exit("too many zones: %d (at most %d)" % (len(zones), MAX_ZONES))
+    boxes = []
+    for _, _, ring in zones:
+        lats = [p[0] for p in ring]
+        lons = [p[1] for p in ring]
+        boxes.append((min(lats), min(lons), max(lats), max(lons)))
+    index = {"zones": zones, "boxes": boxes, "rows": 0, "columns": 0, "origin": (0, 0), "cell": (1, 1),
+             "cell_start": [0], "cell_zones": []}
+    if not zones:
+        return index
+
+    min_lat = min(b[0] for b in boxes)
+    min_lon = min(b[1] for b in boxes)
+    max_lat = max(b[2] for b in boxes)
+    max_lon = max(b[3] for b in boxes)
+    scale = math.cos(math.radians((min_lat + max_lat) / 2e6))
+    cell_lat = max(1, round(cell_meters / METERS_PER_MICRODEGREE))
+    cell_lon = max(1, round(cell_lat / scale))
+    while True:
+        rows = (max_lat - min_lat) // cell_lat + 1
+        columns = (max_lon - min_lon) // cell_lon + 1
+        if rows * columns <= max_cells:
+            break
+        cell_lat = cell_lat * 5 // 4 + 1
+        cell_lon = cell_lon * 5 // 4 + 1
+
+    cells = [[] for _ in range(rows * columns)]
+    for i, (lat0, lon0, lat1, lon1) in enumerate(boxes):
+        for row in range((lat0 - min_lat) // cell_lat, (lat1 - min_lat) // cell_lat + 1):
+            for column in range((lon0 - min_lon) // cell_lon, (lon1 - min_lon) // cell_lon + 1):
+                cells[row * columns + column].append(i)
+    cell_start = [0]
+    cell_zones = []
+    for cell in cells:
+        cell_zones.extend(cell)
+        cell_start.append(len(cell_zones))
+    index.update(rows=rows, columns=columns, origin=(min_lat, min_lon), cell=(cell_lat, cell_lon),
+                 cell_start=cell_start, cell_zones=cell_zones)
+    return index
+
+
+def flash_bytes(index):
+    vertices = sum(len(ring) for _, _, ring in index["zones"])
+    return 24 * len(index["zones"]) + 8 * vertices + 4 * len(index["cell_start"]) + 2 * len(index["cell_zones"])
+
+
+def write_header(index, path, source):
+    zones = index["zones"]
+    names = {v: k for k, v in ZONE_TYPES.items()}
+    lines = [
+        "// Geofences generated by tools/geofence_tool.py from %s. Do not edit" % source,
+        "// %d zones, %d grid cells, %d bytes of flash" % (len(zones), len(index["cell_start"]) - 1, flash_bytes(index)),
+        "#define GEOFENCE_ZONES %d" % len(zones),
+        "const int32_t GEOFENCE_GRID_LATITUDE = %d;        // south west corner of the grid, microdegrees" % index["origin"][0],
+        "const int32_t GEOFENCE_GRID_LONGITUDE = %d;" % index["origin"][1],
+        "const uint32_t GEOFENCE_CELL_LATITUDE = %d;       // size of a cell, microdegrees" % index["cell"][0],
+        "const uint32_t GEOFENCE_CELL_LONGITUDE = %d;" % index["cell"][1],
+        "const uint32_t GEOFENCE_GRID_ROWS = %d;" % index["rows"],
+        "const uint32_t GEOFENCE_GRID_COLUMNS = %d;" % index["columns"],
+        "",
+        "const struct geofenceZone geofenceZones[] PROGMEM = {",
+    ]
+    first = 0
+    for (zone_type, speed, ring), box in zip(zones, index["boxes"]):
+        lines.append("  {%d, %d, %d, %d, %d, %d, %d, %d},     // %s" % (
+            box[0], box[1], box[2], box[3], first, len(ring), zone_type, speed, names[zone_type]))
+        first += len(ring)
+    if not zones:
+        lines.append("  {0, 0, 0, 0, 0, 0, 0, 0},     // placeholder. There are no zones")
+    lines += ["};", "", "const struct geofenceVertex geofenceVertices[] PROGMEM = {"]
+    for _, _, ring in zones:
+        lines.append("  " + " ".join("{%d, %d}," % p for p in ring))
+    if not zones:
+        lines.append("  {0, 0},")
+    lines += ["};", "", "const uint32_t geofenceCellStart[] PROGMEM = {"]
+    for i in range(0, len(index["cell_start"]), 16):
+        lines.append("  " + " ".join("%d," % n for n in index["cell_start"][i:i + 16]))
+    lines += ["};", "", "const uint16_t geofenceCellZones[] PROGMEM = {"]
+    for i in range(0, len(index["cell_zones"]), 16):
+        lines.append("  " + " ".join("%d," % n for n in index["cell_zones"][i:i + 16]))
+    if not index["cell_zones"]:
+        lines.append("  0,")
+    lines += ["};", ""]
+    with open(path, "w") as f:
+        f.write("\n".join(lines))
+
+
+def polygon(rng, lat, lon, radius_m, vertices):
+    """irregular star shaped polygon around a point. GeoJSON ring [lon, lat] in degrees"""
+    scale = math.cos(math.radians(lat / 1e6))
+    ring = []
+    for i in range(vertices):
+        angle = 2 * math.pi * (i + rng.uniform(-0.3, 0.3)) / vertices
+        r = radius_m * rng.uniform(0.5, 1.0) / METERS_PER_MICRODEGREE
+        ring.append([round((lon + r * math.cos(angle) / scale)) / 1e6, round(lat + r * math.sin(angle)) / 1e6])
+    ring.append(ring[0])
+    return [ring]
+
+
+def synthesize(count, seed, centre):
+    """synthetic city: 70% parking (20-60 m), 20% slow (100-600 m), 10% no-ride (50-400 m). 60% of the zones are
+    within a few km of the centre, the others are spread over 20 x 20 km"""
+    rng = random.Random(seed)
+    scale = math.cos(math.radians(centre[0] / 1e6))
+    features = []
+    for _ in range(count):
+        if rng.random() < 0.6:
+            dy, dx = rng.gauss(0, 2000), rng.gauss(0, 2000)
+        else:
+            dy, dx = rng.uniform(-10000, 10000), rng.uniform(-10000, 10000)
+        lat = centre[0] + round(dy / METERS_PER_MICRODEGREE)
+        lon = centre[1] + round(dx / METERS_PER_MICRODEGREE / scale)
+        kind = rng.random()
+        if kind < 0.7:
+            properties, radius = {"zone": "parking"}, rng.uniform(20, 60)
+        elif kind < 0.9:
+            properties, radius = {"zone": "slow", "speed": rng.choice([10, 15, 20])}, rng.uniform(100, 600)
+        else:
+            properties, radius = {"zone": "no_ride"}, rng.uniform(50, 400)
+        features.append({"type": "Feature", "properties": properties,
+                         "geometry": {"type": "Polygon", "coordinates": polygon(rng, lat, lon, radius, rng.randint(5, 16))}})
+    return {"type": "FeatureCollection", "features": features}
+
+
+def extract(source, start, end):
+    begin = source.index(start)
+    return source[begin:source.index(end, begin) + len(end)]
+
+
+def extract_function(source, name):
+    match = re.search(r"^\w+ %s\(" % name, source, re.M)
+    depth = 0
+    for i in range(source.index("{", match.start()), len(source)):
+        depth += {"{": 1, "}": -1}.get(source[i], 0)
+        if depth == 0:
+            return source[match.start():i + 1]
+
+
+HARNESS = r"""
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#define PROGMEM
+using std::min;
+using std::max;
+
+%(types)s
+
+%(functions)s
+
+static void bruteForce(int32_t latitude, int32_t longitude, struct geofenceState &result) {
+  result.flags = 0;
+  result.speedLimitKPH = GEOFENCE_NO_SPEED_LIMIT;
+  result.zone = -1;
+  for (int index = 0; index < GEOFENCE_ZONES; index++) {
+    const struct geofenceZone &zone = geofenceZones[index];
+    if (!geofenceContains(zone, latitude, longitude)) {
+      continue;
+    }
+    result.flags |= 1 << zone.type;
+    uint8_t speedLimitKPH = (zone.type == GEOFENCE_NO_RIDE) ? 0 : (zone.type == GEOFENCE_SLOW) ? zone.speedLimitKPH : GEOFENCE_NO_SPEED_LIMIT;
+    if ((speedLimitKPH < result.speedLimitKPH) || (result.zone < 0)) {
+      result.speedLimitKPH = speedLimitKPH;
+      result.zone = index;
+    }
+  }
+}
+
+template <typename F> static double time_ns(const std::vector<int32_t> &points, F lookup) {
+  struct geofenceState result;
+  uint32_t sink = 0;
+  size_t count = 0;
+  auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  while (elapsed < 0.2) {
+    for (size_t i = 0; i < points.size(); i += 2) {
+      lookup(points[i], points[i + 1], result);
+      sink += result.flags;
+    }
+    count += points.size() / 2;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  if (sink == 0xFFFFFFFF) {
+    printf(" ");
+  }
+  return elapsed * 1e9 / count;
+}
+
+int main(int argc, char **argv) {
+  std::vector<int32_t> points;
+  FILE *f = fopen(argv[1], "rb");
+  int32_t value;
+  while (fread(&value, sizeof(value), 1, f) == 1) {
+    points.push_back(value);
+  }
+  fclose(f);
+
+  size_t inside = 0;
+  for (size_t i = 0; i < points.size(); i += 2) {
+    struct geofenceState a, b;
+    lookupGeofence(points[i], points[i + 1], a);
+    bruteForce(points[i], points[i + 1], b);
+    if ((a.flags != b.flags) || (a.speedLimitKPH != b.speedLimitKPH)) {
+      printf("MISMATCH at %%d,%%d: grid flags %%u limit %%u, every zone flags %%u limit %%u\n",
+             points[i], points[i + 1], a.flags, a.speedLimitKPH, b.flags, b.speedLimitKPH);
+      return 1;
+    }
+    inside += (a.flags != 0);
+  }
+  geofenceStats = geofenceStatistics();
+  for (size_t i = 0; i < points.size(); i += 2) {
+    struct geofenceState a;
+    lookupGeofence(points[i], points[i + 1], a);
+  }
+  double lookups = points.size() / 2;
+  double candidates = geofenceStats.candidates / lookups;
+  double polygonTests = geofenceStats.polygonTests / lookups;
+  double grid_ns = time_ns(points, lookupGeofence);
+  double brute_ns = time_ns(points, bruteForce);
+  printf("%%zu %%.2f %%.2f %%.1f %%.1f\n", inside, candidates, polygonTests, grid_ns, brute_ns);
+  return 0;
+}
+"""
+
+
+def build_harness(directory):
+    with open(os.path.join(ROOT, "Ark_Scooter.ino")) as f:
+        types = extract(f.read(), "enum GeofenceType_enum", "struct geofenceStatistics geofenceStats;")
+    with open(os.path.join(ROOT, "Geofence.ino")) as f:
+        source = f.read()
+    functions = "\n\n".join(extract_function(source, name) for name in ("geofenceContains", "lookupGeofence"))
+    path = os.path.join(directory, "bench.cpp")
+    with open(path, "w") as f:
+        f.write(HARNESS % {"types": types, "functions": functions})
+    return path
+
+
+def query_points(zones, count, seed):
+    """half uniform over the zones, half near a zone (most of those inside)"""
+    rng = random.Random(seed)
+    lats = [p[0] for _, _, ring in zones for p in ring]
+    lons = [p[1] for _, _, ring in zones for p in ring]
+    margin = 2000
+    points = []
+    for i in range(count):
+        if i % 2 or not zones:
+            points += [rng.randint(min(lats, default=0) - margin, max(lats, default=0) + margin),
+                       rng.randint(min(lons, default=0) - margin, max(lons, default=0) + margin)]
+        else:
+            ring = rng.choice(zones)[2]
+            a, b = rng.choice(ring), rng.choice(ring)
+            points += [(a[0] + b[0]) // 2, (a[1] + b[1]) // 2]
+    return points
+
+
+def bench(args):
+    centre = firmware_default_centre()
+    if args.geojson:
+        sets = [(os.path.basename(args.geojson), load_zones(args.geojson))]
+    else:
+        sets = []
+        for count in args.zones:
+            with tempfile.NamedTemporaryFile("w", suffix=".geojson", delete=False) as f:
+                json.dump(synthesize(count, args.seed, centre), f)
+            sets.append(("synthetic", load_zones(f.name)))
+            os.unlink(f.name)
+
+    print("%-18s %6s %8s %6s %8s %7s %6s %6s %11s %12s %8s" % (
+        "zone set", "zones", "vertices", "cells", "flash", "inside", "cand.", "tests", "grid ns", "all zones ns", "speedup"))
+    with tempfile.TemporaryDirectory() as directory:
+        for name, zones in sets:
+            index = build_index(zones, args.cell, args.max_cells)
+            write_header(index, os.path.join(directory, "geofences.h"), name)
+            binary = os.path.join(directory, "bench")
+            subprocess.run(["g++", "-O2", "-std=c++11", "-I", directory, "-o", binary, build_harness(directory)], check=True)
+            points = query_points(zones, args.points, args.seed + 1)
+            with open(os.path.join(directory, "points.bin"), "wb") as f:
+                f.write(struct.pack("<%di" % len(points), *points))
+            output = subprocess.run([binary, os.path.join(directory, "points.bin")], check=False,
+                                    capture_output=True, text=True).stdout.split()
+            if len(output) != 5:
+                sys.exit(" ".join(output))
+            inside, candidates, tests, grid_ns, brute_ns = output
+            print("%-18s %6d %8d %6d %8d %6.1f%% %6s %6s %11s %12s %7.0fx" % (
+                name, len(zones), sum(len(ring) for _, _, ring in zones), len(index["cell_start"]) - 1,
+                flash_bytes(index), 100.0 * int(inside) / (len(points) // 2), candidates, tests, grid_ns, brute_ns,
+                float(brute_ns) / float(grid_ns)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    compile_command = commands.add_parser("compile", help="compile a GeoJSON file into geofences.h")
+    compile_command.add_argument("geojson")
+    compile_command.add_argument("-o", "--output", default=os.path.join(ROOT, "geofences.h"))
+
+    synth_command = commands.add_parser("synth", help="write a synthetic city-scale zone set")
+    synth_command.add_argument("--zones", type=int, default=1000)
+    synth_command.add_argument("-o", "--output", required=True)
+
+    bench_command = commands.add_parser("bench", help="time lookupGeofence() against testing every zone")
+    bench_command.add_argument("--zones", type=lambda s: [int(n) for n in s.split(",")], default=[10, 100, 1000, 10000])
+    bench_command.add_argument("--geojson", help="benchmark this zone set instead of synthetic ones")
+    bench_command.add_argument("--points", type=int, default=20000)
+
+    for command in (compile_command, synth_command, bench_command):
+        command.add_argument("--cell", type=float, default=250, help="grid cell size in meters")
+        command.add_argument("--max-cells", type=int, default=16384)
+        command.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    if args.command == "compile":
+        index = build_index(load_zones(args.geojson), args.cell, args.max_cells)
+        write_header(index, args.output, os.path.basename(args.geojson))
+        print("%d zones, %d x %d grid, %d candidates, %d bytes of flash -> %s" % (
+            len(index["zones"]), index["rows"], index["columns"], len(index["cell_zones"]), flash_bytes(index), args.output))
+    elif args.command == "synth":
+        with open(args.output, "w") as f:
+            json.dump(synthesize(args.zones, args.seed, firmware_default_centre()), f)
+        print("%d zones -> %s" % (args.zones, args.output))
+    else:
+        bench(args)
+
+
+if __name__ == "__main__":
+    main()
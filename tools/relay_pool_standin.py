@@ -0,0 +1,285 @@
+#!/usr/bin/env python3
+"""
+Local stand-ins for the Ark relay pool (see RelayPool.ino).
+
+Starts one stand-in relay per --relay option. Each relay adds a latency to every request and, with a given probability,
+a long tail delay, and can report itself as not synced. The stand-ins answer the requests of a poll
+(node status, wallet, pages of received transactions) and POST /api/transactions.
+
+  python3 relay_pool_standin.py --relay 4041:20 --relay 4042:40:900:8 --relay 4043:30:unsynced --serve
+      Serve until Ctrl-C. Put the IP address of this computer and the ports in ARK_RELAY_HOSTS / ARK_RELAY_PORTS (secrets.h)
+  python3 relay_pool_standin.py --relay 4041:20:900:8 --relay 4042:40:900:8 --requests 400
+      Run the pool policy of the firmware against the stand-ins and compare the received transactions reads
+      with and without hedging
+
+--relay port:latency_ms[:tail_ms:tail_percent][:unsynced]   port 0 = any free port
+
+The client follows the firmware:
+  - health check: GET /api/node/status on every relay at the start, then on one relay at a time in turn. A relay is
+    usable when it is synced
+  - reads go to the usable relay with the lowest EWMA latency (weight 0.25)
+  - received transactions reads are sent to the next relay as well when the first has not answered within the
+    p95 of the previous reads (1500 ms until 20 reads have been timed, at least 200 ms). The first response is used
+    and the connection of the slower relay is closed
+  - transactions are POSTed to 2 relays. A relay that answers with a code other than 2xx or 422 is skipped
+"""
+import argparse
+import json
+import random
+import select
+import socket
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+EWMA_ALPHA = 0.25
+HEDGE_DEFAULT_MS = 1500
+HEDGE_MIN_MS = 200
+HEDGE_MIN_SAMPLES = 20
+BROADCAST_RELAYS = 2
+
+ADDRESS = "TRXA2NUACckkYwWnS9JRkATQA453ukAcD1"
+PATHS = [
+    "/api/node/status",
+    "/api/wallets/" + ADDRESS,
+    "/api/wallets/" + ADDRESS + "/transactions/received?page=1&limit=50&orderBy=timestamp:asc",
+    "/api/wallets/" + ADDRESS + "/transactions/received?page=2&limit=50&orderBy=timestamp:asc",
+]
+
+
+def transaction(i):
+    return {
+        "id": "%064x" % i,
+        "type": 0,
+        "typeGroup": 1,
+        "amount": "100000000000",
+        "sender": "TEf7p5jf1LReywuits5orBsmpkMe8fLTkk",
+        "recipient": ADDRESS,
+        "vendorField": "%d,-27.45,153.03" % i,
+        "timestamp": {"epoch": 374000 + i, "unix": 1572368340 + i},
+        "nonce": str(i),
+    }
+
+
+RESPONSES = {
+    PATHS[0]: {"data": {"synced": True, "now": 4047140, "blocksCount": -4047140, "timestamp": 82303508}},
+    PATHS[1]: {"data": {"address": ADDRESS, "nonce": "140", "balance": "94968174556", "isDelegate": False}},
+    PATHS[2]: {"meta": {"count": 50, "totalCount": 133}, "data": [transaction(i) for i in range(50)]},
+    PATHS[3]: {"meta": {"count": 50, "totalCount": 133}, "data": [transaction(i) for i in range(50, 100)]},
+}
+
+
+def percentile(samples, p):
+    ordered = sorted(samples)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))]
+
+
+def make_handler(latency, tail, tail_percent, synced, rng):
+    class RelayHandler(BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def setup(self):
+            self.request.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            super().setup()
+
+        def handle(self):
+            try:
+                super().handle()
+            except (BrokenPipeError, ConnectionResetError):
+                pass            # the client closed the connection of the relay that lost a hedged read
+
+        def delay(self):
+            time.sleep(latency + (tail if rng.random() * 100 < tail_percent else 0))
+
+        def reply(self, status, payload):
+            body = json.dumps(payload).encode()
+            self.send_response(status)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def do_GET(self):
+            self.delay()
+            if self.path == PATHS[0]:
+                self.reply(200, {"data": {"synced": synced, "now": 4047140}})
+            elif self.path in RESPONSES:
+                self.reply(200, RESPONSES[self.path])
+            else:
+                self.reply(404, {"error": "not found"})
+
+        def do_POST(self):
+            self.rfile.read(int(self.headers.get("Content-Length", 0)))
+            self.delay()
+            self.reply(200, {"data": {"accept": ["%064x" % 0], "broadcast": [], "excess": [], "invalid": []}})
+
+        def log_message(self, *args):
+            pass
+
+    return RelayHandler
+
+
+def start_relay(spec, seed):
+    fields = spec.split(":")
+    synced = "unsynced" not in fields
+    fields = [f for f in fields if f != "unsynced"]
+    port, latency = int(fields[0]), float(fields[1]) / 1000
+    tail = float(fields[2]) / 1000 if len(fields) > 2 else 0
+    tail_percent = float(fields[3]) if len(fields) > 3 else 0
+    handler = make_handler(latency, tail, tail_percent, synced, random.Random(seed))
+    server = ThreadingHTTPServer(("0.0.0.0", port), handler)
+    server.daemon_threads = True
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    print("stand-in relay on port %d  latency %.0f ms  tail %.0f ms (%g%%)%s" % (
+        server.server_address[1], latency * 1000, tail * 1000, tail_percent, "" if synced else "  not synced"))
+    return server.server_address[1]
+
+
+class Relay:
+    """One relay of the pool with its keep-alive connection."""
+
+    def __init__(self, port):
+        self.port = port
+        self.sock = None
+        self.synced = False
+        self.latency = 0.0
+        self.requests = 0
+        self.hedge_wins = 0
+
+    def send(self, method, path, body=b""):
+        if self.sock is None:
+            self.sock = socket.create_connection(("127.0.0.1", self.port), timeout=5)
+            self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            self.reader = self.sock.makefile("rb")
+        head = "%s %s HTTP/1.1\r\nHost: 127.0.0.1:%d\r\nConnection: keep-alive\r\n" % (method, path, self.port)
+        if body:
+            head += "Content-Type: application/json\r\nContent-Length: %d\r\n" % len(body)
+        self.sock.sendall(head.encode() + b"\r\n" + body)
+        self.requests += 1
+        self.sent = time.perf_counter()
+
+    def read(self):
+        status = int(self.reader.readline().split()[1])
+        self.record((time.perf_counter() - self.sent) * 1000)
+        length = 0
+        while True:
+            line = self.reader.readline().strip().lower()
+            if not line:
+                break
+            name, _, value = line.partition(b":")
+            if name == b"content-length":
+                length = int(value)
+        return status, self.reader.read(length)
+
+    def record(self, latency_ms):
+        self.latency = latency_ms if self.latency == 0 else self.latency + EWMA_ALPHA * (latency_ms - self.latency)
+
+    def drop(self):
+        if self.sock is not None:
+            self.reader.close()
+            self.sock.close()
+            self.sock = None
+
+
+class Pool:
+    def __init__(self, ports, hedge):
+        self.relays = [Relay(port) for port in ports]
+        self.hedge = hedge
+        self.received_latency = []
+        self.hedges = 0
+        self.next_check = 0
+
+    def rank(self):
+        return sorted(self.relays, key=lambda r: (not r.synced, r.latency))
+
+    def check(self, count=1):
+        for _ in range(min(count, len(self.relays))):
+            relay = self.relays[self.next_check]
+            self.next_check = (self.next_check + 1) % len(self.relays)
+            relay.send("GET", PATHS[0])
+            status, body = relay.read()
+            relay.synced = status == 200 and json.loads(body)["data"]["synced"]
+
+    def budget(self):
+        if len(self.received_latency) < HEDGE_MIN_SAMPLES:
+            return HEDGE_DEFAULT_MS
+        return max(HEDGE_MIN_MS, percentile(self.received_latency, 95))
+
+    def get(self, path, hedge):
+        ranked = self.rank()
+        first = ranked[0]
+        start = time.perf_counter()
+        first.send("GET", path)
+        racing = [first]
+        if hedge and len(ranked) > 1:
+            ready, _, _ = select.select([first.sock], [], [], self.budget() / 1000)
+            if not ready:
+                ranked[1].send("GET", path)
+                racing.append(ranked[1])
+                self.hedges += 1
+        ready, _, _ = select.select([r.sock for r in racing], [], [], 5)
+        winner = next(r for r in racing if r.sock in ready)
+        for relay in racing:
+            if relay is not winner:
+                relay.record((time.perf_counter() - relay.sent) * 1000)     # at least this long
+                relay.drop()
+        if winner is not first:
+            winner.hedge_wins += 1
+        status, body = winner.read()
+        latency = (time.perf_counter() - start) * 1000
+        if hedge:
+            self.received_latency.append(latency)
+        return latency
+
+    def post(self, body):
+        sent = 0
+        for relay in self.rank():
+            if sent >= BROADCAST_RELAYS or (sent > 0 and not relay.synced):
+                break
+            relay.send("POST", "/api/transactions", body)
+            status, _ = relay.read()
+            if 200 <= status < 300 or status == 422:
+                sent += 1
+        return sent
+
+
+def run(ports, requests, hedge):
+    pool = Pool(ports, hedge)
+    pool.check(len(ports))
+    latencies = []
+    broadcasts = 0
+    for i in range(requests):
+        latencies.append(pool.get(PATHS[2 + i % 2], hedge))
+        if i % 20 == 19:
+            broadcasts += pool.post(b'{"transactions":[{}]}') > 1
+            pool.check()
+    print("%-9s %4d reads  p50 %6.1f ms  p95 %6.1f ms  p99 %6.1f ms  max %6.1f ms  hedged %3d  broadcasts %d" % (
+        "hedged" if hedge else "unhedged", requests, percentile(latencies, 50), percentile(latencies, 95),
+        percentile(latencies, 99), max(latencies), pool.hedges, broadcasts))
+    for relay in pool.relays:
+        print("    relay %d  synced %-5s  ewma %6.1f ms  requests %4d  hedges won %d" % (
+            relay.port, relay.synced, relay.latency, relay.requests, relay.hedge_wins))
+        relay.drop()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--relay", action="append", required=True, help="port:latency_ms[:tail_ms:tail_percent][:unsynced]")
+    parser.add_argument("--requests", type=int, default=400)
+    parser.add_argument("--serve", action="store_true", help="only serve the stand-ins until Ctrl-C")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    ports = [start_relay(spec, args.seed + i) for i, spec in enumerate(args.relay)]
+    if args.serve:
+        try:
+            while True:
+                time.sleep(1)
+        except KeyboardInterrupt:
+            return
+    run(ports, args.requests, False)
+    run(ports, args.requests, True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""
+Verify a batched telemetry packet published by the Ark Scooter on scooter/<address>/batch (ENABLE_MQTT_BATCH_TELEMETRY).
+
+The scooter signs the Merkle root (hex) of the batch with its wallet key:
+  leaf = sha256(0x00 || sample text), node = sha256(0x01 || left || right)
+  the last node of a level with an odd number of nodes is carried up unchanged (it is not paired with itself).
+Any single sample can be verified with the signed root and its proof (the sibling hashes from the leaf up to the root).
+
+  python3 verify_telemetry_batch.py --public-key 03e063f4... batch.json
+
+Requires ecdsa (pip install ecdsa)
+"""
+import argparse
+import hashlib
+import json
+
+from ecdsa import SECP256k1, VerifyingKey
+from ecdsa.util import sigdecode_der
+
+
+def sha256(data):
+    return hashlib.sha256(data).digest()
+
+
+def leaf_hash(sample):
+    return sha256(b"\x00" + sample.encode())
+
+
+def node_hash(left, right):
+    return sha256(b"\x01" + left + right)
+
+
+def merkle_levels(samples):
+    level = [leaf_hash(sample) for sample in samples]
+    levels = [level]
+    while len(level) > 1:
+        parents = [node_hash(level[i], level[i + 1]) for i in range(0, len(level) - 1, 2)]
+        if len(level) % 2:
+            parents.append(level[-1])
+        level = parents
+        levels.append(level)
+    return levels
+
+
+def merkle_proof(levels, index):
+    """sibling hashes from the leaf to the root. True when the sibling is on the right.
+    A node without a sibling is carried up and adds nothing to the proof"""
+    proof = []
+    for level in levels[:-1]:
+        sibling = index ^ 1
+        if sibling < len(level):
+            proof.append((level[sibling], sibling > index))
+        index //= 2
+    return proof
+
+
+def root_from_proof(sample, proof):
+    node = leaf_hash(sample)
+    for sibling, right in proof:
+        node = node_hash(node, sibling) if right else node_hash(sibling, node)
+    return node
+
+
+def verify_signature(public_key, root_hex, signature_hex):
+    key = VerifyingKey.from_string(bytes.fromhex(public_key), curve=SECP256k1)
+    return key.verify_digest(bytes.fromhex(signature_hex), sha256(root_hex.encode()), sigdecode=sigdecode_der)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--public-key", required=True, help="public key of the scooter wallet (hex)")
+    parser.add_argument("packet", help="file containing the JSON batch packet")
+    args = parser.parse_args()
+
+    with open(args.packet) as f:
+        packet = json.load(f)
+
+    levels = merkle_levels(packet["s"])
+    root_hex = levels[-1][0].hex()
+    if root_hex != packet["root"]:
+        raise SystemExit("Merkle root does not match the samples")
+    verify_signature(args.public_key, root_hex, packet["sig"])
+    print("signature is valid for", len(packet["s"]), "samples")
+
+    for index, sample in enumerate(packet["s"]):
+        proof = merkle_proof(levels, index)
+        assert root_from_proof(sample, proof).hex() == root_hex
+        print(sample, [sibling.hex()[:8] + ("R" if right else "L") for sibling, right in proof])
+
+
+if __name__ == "__main__":
+    main()
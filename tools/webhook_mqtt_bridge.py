@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""
+Relay webhook -> MQTT bridge for the Ark Scooter transaction notifications.
+
+Register this bridge as a webhook on the Radians relay node for the "transaction.applied" event:
+  POST http://<relay>:4004/api/webhooks
+  {"event":"transaction.applied","target":"http://<bridge>:8085/webhook","enabled":true,"conditions":[]}
+
+Every transaction that is applied on chain is published to scooter/<recipient>/transactions.
+The scooter subscribes to its own topic (MQTT_Notify_Topic in secrets.h) and polls the relay right away.
+Only id/type/typeGroup are forwarded. The firmware always reads the transaction back from the relay.
+
+Stand-in publisher for testing with a local broker (no relay needed):
+  python3 webhook_mqtt_bridge.py --broker localhost --publish TRXA2NUACckkYwWnS9JRkATQA453ukAcD1
+
+Requires paho-mqtt (pip install paho-mqtt)
+"""
+import argparse
+import json
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+import paho.mqtt.client as mqtt
+
+TOPIC_FORMAT = "scooter/{}/transactions"
+
+
+def notification(transaction):
+    return json.dumps({
+        "id": transaction.get("id"),
+        "type": transaction.get("type"),
+        "typeGroup": transaction.get("typeGroup"),
+    })
+
+
+def publish(client, recipient, transaction):
+    topic = TOPIC_FORMAT.format(recipient)
+    payload = notification(transaction)
+    info = client.publish(topic, payload, qos=1)
+    print("published", topic, payload)
+    return info
+
+
+def make_handler(client, token):
+    class WebhookHandler(BaseHTTPRequestHandler):
+        def do_POST(self):
+            if token and self.headers.get("Authorization") != token:
+                self.send_response(401)
+                self.end_headers()
+                return
+
+            length = int(self.headers.get("Content-Length", 0))
+            try:
+                body = json.loads(self.rfile.read(length))
+            except ValueError:
+                self.send_response(400)
+                self.end_headers()
+                return
+
+            transaction = body.get("data", {})
+            recipient = transaction.get("recipientId") or transaction.get("recipient")
+            if body.get("event") == "transaction.applied" and recipient:
+                publish(client, recipient, transaction)
+
+            self.send_response(200)
+            self.end_headers()
+
+    return WebhookHandler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--broker", default="localhost", help="MQTT broker host")
+    parser.add_argument("--broker-port", type=int, default=1883)
+    parser.add_argument("--username")
+    parser.add_argument("--password")
+    parser.add_argument("--listen-port", type=int, default=8085, help="port for the relay webhook")
+    parser.add_argument("--token", help="webhook token returned by the relay when the webhook was registered")
+    parser.add_argument("--publish", metavar="ADDRESS", help="publish one stand-in RentalStart notification for ADDRESS and exit")
+    args = parser.parse_args()
+
+    client = mqtt.Client()
+    if args.username:
+        client.username_pw_set(args.username, args.password)
+    client.connect(args.broker, args.broker_port)
+    client.loop_start()
+
+    if args.publish:
+        publish(client, args.publish, {"id": "0" * 64, "type": 500, "typeGroup": 4000}).wait_for_publish()
+        client.loop_stop()
+        client.disconnect()
+        return
+
+    server = HTTPServer(("", args.listen_port), make_handler(client, args.token))
+    print("listening for relay webhooks on port", args.listen_port)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()